@@ -0,0 +1,109 @@
+#ifndef SMILE_BENCH_H
+#define SMILE_BENCH_H
+
+// --------------------------------------------------
+// Includes
+// --------------------------------------------------
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+#define BENCH_NS_PER_SEC 1000000000.0
+
+// --------------------------------------------------
+// Variables
+// --------------------------------------------------
+
+// Where Bench_Report also writes its results, if anywhere
+static FILE *benchJson;
+static bool benchJsonEmpty;
+
+// --------------------------------------------------
+// Prototypes
+// --------------------------------------------------
+
+/**
+ * @brief Reads a monotonic clock.
+ *
+ * @return double Current time in nanoseconds.
+ * @author Vitor Betmann
+ */
+static inline double Bench_Now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * BENCH_NS_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * @brief Starts writing results as JSON, if asked to with `--json <path>`.
+ *
+ * Every result reported until Bench_CloseJson goes to the file as well, so
+ * two runs can be compared by a script to catch regressions.
+ *
+ * @param argc  Argument count, as passed to main.
+ * @param argv  Arguments, as passed to main.
+ * @param suite Name of the benchmarked module.
+ * @return false if the file couldn't be opened, true otherwise.
+ * @author Vitor Betmann
+ */
+static inline bool Bench_OpenJson(int argc, char **argv, const char *suite) {
+
+  for (int i = 1; i + 1 < argc; i++) {
+    if (strcmp(argv[i], "--json") == 0) {
+      benchJson = fopen(argv[i + 1], "w");
+      if (!benchJson) {
+        fprintf(stderr, "Can't write results to '%s'.\n", argv[i + 1]);
+        return false;
+      }
+      fprintf(benchJson, "{\"suite\":\"%s\",\"results\":[", suite);
+      benchJsonEmpty = true;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Finishes the JSON file opened by Bench_OpenJson, if any.
+ *
+ * @author Vitor Betmann
+ */
+static inline void Bench_CloseJson(void) {
+
+  if (benchJson) {
+    fputs("\n]}\n", benchJson);
+    fclose(benchJson);
+    benchJson = NULL;
+  }
+}
+
+/**
+ * @brief Prints one benchmark result line, and writes it to the JSON file if
+ * one is open.
+ *
+ * @param name  Name of the measured case. Unique per problem size, so results
+ * can be matched up between runs.
+ * @param n     Problem size (particles, states...).
+ * @param ops   Number of operations measured.
+ * @param ns    Total time spent, in nanoseconds.
+ * @author Vitor Betmann
+ */
+static inline void Bench_Report(const char *name, long n, long ops, double ns) {
+
+  printf("\t%-40s n=%-8ld %10.2f ns/op %12.2f Mop/s\n", name, n, ns / ops,
+         ops / ns * 1000.0);
+  if (benchJson) {
+    fprintf(benchJson,
+            "%s\n{\"name\":\"%s\",\"n\":%ld,\"ops\":%ld,\"nsPerOp\":%.3f,"
+            "\"mopsPerSec\":%.3f}",
+            benchJsonEmpty ? "" : ",", name, n, ops, ns / ops,
+            ops / ns * 1000.0);
+    benchJsonEmpty = false;
+  }
+}
+
+#endif
@@ -0,0 +1,322 @@
+/*
+ * Benchmarks for the ParticleSystem module.
+ *
+ * Each case builds a system, emits once and times PS_Update. Cases named
+ * "(full)" force the kernel with every feature enabled, which is what every
+ * system ran before kernels were specialized, so the pairs show the gain.
+ * @author Vitor Betmann
+ */
+
+#include "../../include/ParticleSystem.h"
+#include "../../src/ParticleSystem/ParticleSystemInternal.h"
+#include "../Bench.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// --------------------------------------------------
+// Data types
+// --------------------------------------------------
+
+typedef struct {
+  const char *name;
+  bool motion, colorFade;
+} UpdateCase;
+
+// --------------------------------------------------
+// Variables
+// --------------------------------------------------
+static const int PARTICLE_COUNTS[] = {1000, 100000};
+static const int FRAMES = 200;
+static const float BENCH_DT = 0.0001f;
+static Texture2D benchTexture;
+
+static const UpdateCase UPDATE_CASES[] = {
+    {"static", false, false},
+    {"motion", true, false},
+    {"colorFade", false, true},
+    {"motion+colorFade", true, true},
+};
+
+// --------------------------------------------------
+// Benchmarks
+// --------------------------------------------------
+
+static ParticleSystem *NewConfiguredSystem(const UpdateCase *c, int count) {
+
+  ParticleSystem *ps =
+      newParticleSystem(&benchTexture, count, (Vector2){0.0f, 0.0f});
+  PS_SetParticleLifetime(ps, 1000000, 1000000);
+  PS_SetEmissionArea(ps, NORMAL, 100, 100);
+
+  if (c->motion) {
+    PS_SetLinearAcceleration(ps, -50, -50, 50, 50);
+  }
+
+  Color color = {255, 255, 255, 255};
+  PS_SetColors(ps, color, c->colorFade ? (Color){0, 0, 0, 0} : color);
+
+  PS_Emit(ps);
+  return ps;
+}
+
+static double TimeUpdates(ParticleSystem *ps) {
+
+  double start = Bench_Now();
+  for (int i = 0; i < FRAMES; i++) {
+    PS_Update(ps, BENCH_DT);
+  }
+  return Bench_Now() - start;
+}
+
+static void Bench_PS_Update(int count) {
+
+  for (size_t i = 0; i < sizeof(UPDATE_CASES) / sizeof(*UPDATE_CASES); i++) {
+    const UpdateCase *c = &UPDATE_CASES[i];
+    char name[64];
+
+    ParticleSystem *ps = NewConfiguredSystem(c, count);
+    snprintf(name, sizeof(name), "PS_Update %s", c->name);
+    Bench_Report(name, count, (long)count * FRAMES, TimeUpdates(ps));
+
+    ps->update = PS_Internal_GetKernel(PS_FEATURE_ALL);
+    snprintf(name, sizeof(name), "PS_Update %s (full)", c->name);
+    Bench_Report(name, count, (long)count * FRAMES, TimeUpdates(ps));
+
+    PS_Unload(ps);
+  }
+}
+
+static void Bench_PS_EmitChurn(int count) {
+
+  // Steady stream: `count` particles alive on average, a burst every frame
+  const int churnFrames = 600;
+  const float frameDT = 1.0f / 60.0f;
+  ParticleSystem *ps =
+      newParticleSystem(&benchTexture, count / 60, (Vector2){0.0f, 0.0f});
+  PS_SetParticleLifetime(ps, 500, 1500);
+  PS_SetLinearAcceleration(ps, -50, -50, 50, 50);
+  PS_SetColors(ps, (Color){255, 255, 255, 255}, (Color){0, 0, 0, 0});
+
+  long updated = 0;
+  int peakBlocks = 0;
+  double start = Bench_Now();
+  for (int i = 0; i < churnFrames; i++) {
+    PS_Emit(ps);
+    updated += PS_GetLiveCount(ps);
+    PS_Update(ps, frameDT);
+    peakBlocks = ps->blockCount > peakBlocks ? ps->blockCount : peakBlocks;
+  }
+  Bench_Report("PS_Emit+PS_Update churn", count, updated, Bench_Now() - start);
+  printf("\t%-40s peak blocks=%d (%d KB)\n", "", peakBlocks,
+         (int)(peakBlocks * PS_BLOCK_SIZE * sizeof(Particle) / 1024));
+
+  PS_Unload(ps);
+}
+
+static void Bench_PS_Emit(int count) {
+
+  static const struct {
+    const char *name;
+    Distribution distribution;
+  } emitCases[] = {
+      {"PS_Emit UNIFORM", UNIFORM},
+      {"PS_Emit NORMAL", NORMAL},
+      {"PS_Emit DISK", DISK},
+      {"PS_Emit CIRCLE", CIRCLE},
+      {"PS_Emit IMAGE_MASK 512x512", IMAGE_MASK},
+      {"PS_Emit POLYLINE", POLYLINE},
+  };
+
+  // A soft round sprite, to dissolve into particles
+  const int side = 512;
+  Color *pixels = malloc(side * side * sizeof(Color));
+  for (int y = 0; y < side; y++) {
+    for (int x = 0; x < side; x++) {
+      float dx = x - side / 2.0f, dy = y - side / 2.0f;
+      float alpha = 255.0f * (1.0f - (dx * dx + dy * dy) / (side * side / 4));
+      pixels[y * side + x] =
+          (Color){255, 255, 255, alpha > 0 ? (unsigned char)alpha : 0};
+    }
+  }
+  Image mask = {pixels, side, side, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+  Vector2 star[10];
+  for (int i = 0; i < 10; i++) {
+    float radius = i % 2 ? 40.0f : 100.0f;
+    star[i] = (Vector2){radius * cosf(i * PI / 5), radius * sinf(i * PI / 5)};
+  }
+
+  for (size_t i = 0; i < sizeof(emitCases) / sizeof(*emitCases); i++) {
+    ParticleSystem *ps =
+        newParticleSystem(&benchTexture, count, (Vector2){0.0f, 0.0f});
+    PS_SetUniformDist(ps, (Vector2){1.0f, 1.0f}, 100);
+    PS_SetEmissionArea(ps, emitCases[i].distribution, 100, 100);
+    if (emitCases[i].distribution == IMAGE_MASK) {
+      PS_SetEmissionMask(ps, mask);
+    } else if (emitCases[i].distribution == POLYLINE) {
+      PS_SetEmissionPolyline(ps, star, 10, true);
+    }
+    PS_SetLinearAcceleration(ps, -50, -50, 50, 50);
+
+    // Reuse the same blocks every frame so only initialization is timed
+    double ns = 0;
+    for (int frame = 0; frame < FRAMES; frame++) {
+      ps->liveCount = 0;
+      double start = Bench_Now();
+      PS_Emit(ps);
+      ns += Bench_Now() - start;
+    }
+    Bench_Report(emitCases[i].name, count, (long)count * FRAMES, ns);
+    PS_Unload(ps);
+  }
+  free(pixels);
+
+  ParticleRng rng;
+  PS_Internal_SeedRng(&rng, 1);
+  float *samples = malloc(count * sizeof(float));
+  double start = Bench_Now();
+  for (int frame = 0; frame < FRAMES; frame++) {
+    PS_Internal_FillNormal(&rng, samples, count);
+  }
+  Bench_Report("PS_Internal_FillNormal", count, (long)count * FRAMES,
+               Bench_Now() - start);
+  free(samples);
+}
+
+static void Bench_PS_Sort(int count) {
+
+  static const struct {
+    const char *name;
+    SortMode mode;
+  } sortCases[] = {
+      {"PS_Update motion, no sort", SORT_NONE},
+      {"PS_Update motion, SORT_BY_AGE", SORT_BY_AGE},
+      {"PS_Update motion, SORT_BY_Y", SORT_BY_Y},
+      {"PS_Update motion, SORT_BY_DEPTH", SORT_BY_DEPTH},
+  };
+
+  for (size_t i = 0; i < sizeof(sortCases) / sizeof(*sortCases); i++) {
+    ParticleSystem *ps =
+        newParticleSystem(&benchTexture, count, (Vector2){0.0f, 0.0f});
+    PS_SetParticleLifetime(ps, 1000000, 1000000);
+    PS_SetEmissionArea(ps, NORMAL, 500, 500);
+    PS_SetLinearAcceleration(ps, -50, -50, 50, 50);
+    PS_SetDepth(ps, 0.0f, 100.0f);
+    PS_SetSortMode(ps, sortCases[i].mode);
+    PS_Emit(ps);
+    PS_Update(ps, BENCH_DT);
+
+    Bench_Report(sortCases[i].name, count, (long)count * FRAMES,
+                 TimeUpdates(ps));
+    PS_Unload(ps);
+  }
+
+  // Worst case: a full radix sort of unrelated keys every frame
+  unsigned *keys = malloc(count * sizeof(unsigned));
+  unsigned *keysTmp = malloc(count * sizeof(unsigned));
+  int *values = malloc(count * sizeof(int));
+  int *valuesTmp = malloc(count * sizeof(int));
+  double ns = 0;
+  for (int frame = 0; frame < FRAMES; frame++) {
+    for (int i = 0; i < count; i++) {
+      keys[i] = (unsigned)rand() * 2654435761u;
+      values[i] = i;
+    }
+    double start = Bench_Now();
+    PS_Internal_RadixSort(keys, values, keysTmp, valuesTmp, count);
+    ns += Bench_Now() - start;
+  }
+  Bench_Report("PS_Internal_RadixSort random keys", count,
+               (long)count * FRAMES, ns);
+
+  free(keys);
+  free(keysTmp);
+  free(values);
+  free(valuesTmp);
+}
+
+static void Bench_PS_Snapshot(int count) {
+
+  // Replay recording: a snapshot and a delta against the last one per frame
+  const int frames = 60;
+  ParticleSystem *ps =
+      newParticleSystem(&benchTexture, count, (Vector2){0.0f, 0.0f});
+  PS_SetParticleLifetime(ps, 1000000, 1000000);
+  PS_SetEmissionArea(ps, NORMAL, 100, 100);
+  PS_SetLinearAcceleration(ps, -50, -50, 50, 50);
+  PS_SetColors(ps, (Color){255, 255, 255, 255}, (Color){0, 0, 0, 0});
+  PS_Emit(ps);
+
+  size_t size = PS_GetSnapshotSize(ps);
+  size_t bound = PS_GetSnapshotDeltaBound(size);
+  unsigned char *prev = malloc(size), *curr = malloc(size);
+  unsigned char *delta = malloc(bound);
+  double snapshotNs = 0, deltaNs = 0, decodeNs = 0, restoreNs = 0;
+  size_t deltaBytes = 0;
+
+  PS_Snapshot(ps, prev, size);
+  for (int frame = 0; frame < frames; frame++) {
+    PS_Update(ps, 1.0f / 60.0f);
+
+    double start = Bench_Now();
+    PS_Snapshot(ps, curr, size);
+    snapshotNs += Bench_Now() - start;
+
+    start = Bench_Now();
+    size_t written = PS_EncodeSnapshotDelta(prev, size, curr, size, delta, bound);
+    deltaNs += Bench_Now() - start;
+    deltaBytes += written;
+
+    start = Bench_Now();
+    PS_DecodeSnapshotDelta(curr, size, delta, written, prev, size);
+    decodeNs += Bench_Now() - start;
+
+    start = Bench_Now();
+    PS_Restore(ps, curr, size);
+    restoreNs += Bench_Now() - start;
+
+    unsigned char *tmp = prev;
+    prev = curr;
+    curr = tmp;
+  }
+
+  Bench_Report("PS_Snapshot", count, (long)count * frames, snapshotNs);
+  Bench_Report("PS_EncodeSnapshotDelta", count, (long)count * frames, deltaNs);
+  Bench_Report("PS_DecodeSnapshotDelta", count, (long)count * frames,
+               decodeNs);
+  Bench_Report("PS_Restore", count, (long)count * frames, restoreNs);
+  printf("\t%-40s snapshot=%zu KB (%.3f ms), delta=%zu KB (%.3f ms)\n", "",
+         size / 1024, snapshotNs / frames / 1e6, deltaBytes / frames / 1024,
+         deltaNs / frames / 1e6);
+
+  free(prev);
+  free(curr);
+  free(delta);
+  PS_Unload(ps);
+}
+
+// --------------------------------------------------
+// Main
+// --------------------------------------------------
+
+int main(int argc, char **argv) {
+  if (!Bench_OpenJson(argc, argv, "ParticleSystem")) {
+    return 1;
+  }
+
+  puts("");
+  puts("Benchmarking ParticleSystem");
+
+  for (size_t i = 0; i < sizeof(PARTICLE_COUNTS) / sizeof(*PARTICLE_COUNTS);
+       i++) {
+    Bench_PS_Update(PARTICLE_COUNTS[i]);
+    Bench_PS_EmitChurn(PARTICLE_COUNTS[i]);
+    Bench_PS_Emit(PARTICLE_COUNTS[i]);
+    Bench_PS_Sort(PARTICLE_COUNTS[i]);
+    Bench_PS_Snapshot(PARTICLE_COUNTS[i]);
+    puts("");
+  }
+
+  Bench_CloseJson();
+  return 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * Benchmarks for the Profiler module.
+ *
+ * Times the cost of one zone, begun and ended back to back, with nothing
+ * being captured (what every zone costs in a build with SMILE_PROFILER) and
+ * while capturing. Captured zones are written out to a trace every time the
+ * ring fills up, the way a game flushing every few seconds would, but only
+ * the zones themselves are timed.
+ * @author Vitor Betmann
+ */
+
+#include "../../include/Profiler.h"
+#include "../Bench.h"
+#include <stdio.h>
+
+// --------------------------------------------------
+// Variables
+// --------------------------------------------------
+static const long ZONE_OPS = 10000000;
+static const char *TRACE_PATH = "BenchProfilerTrace.json";
+
+// --------------------------------------------------
+// Benchmarks
+// --------------------------------------------------
+
+static void Bench_PF_Zone(const char *name) {
+
+  double ns = 0;
+  for (long done = 0; done < ZONE_OPS; done += PF_RING_SIZE) {
+    double start = Bench_Now();
+    for (int i = 0; i < PF_RING_SIZE; i++) {
+      ProfileZone zone = PF_BeginZone("BenchZone");
+      PF_EndZone(&zone);
+    }
+    ns += Bench_Now() - start;
+
+    // Drained outside the timing, as a game would between frames
+    if (PF_IsCapturing()) {
+      PF_WriteTrace(TRACE_PATH);
+    }
+  }
+
+  long ops = (ZONE_OPS + PF_RING_SIZE - 1) / PF_RING_SIZE * PF_RING_SIZE;
+  Bench_Report(name, 1, ops, ns);
+}
+
+// --------------------------------------------------
+// Main
+// --------------------------------------------------
+
+int main(int argc, char **argv) {
+  if (!Bench_OpenJson(argc, argv, "Profiler")) {
+    return 1;
+  }
+
+  puts("");
+  puts("Benchmarking Profiler");
+
+  Bench_PF_Zone("zone (not capturing)");
+
+  PF_StartCapture();
+  Bench_PF_Zone("zone (capturing)");
+  PF_StopCapture();
+  printf("\t%ld zones dropped\n", PF_GetDroppedCount());
+
+  remove(TRACE_PATH);
+  puts("");
+  Bench_CloseJson();
+  return 0;
+}
@@ -0,0 +1,406 @@
+/*
+ * Benchmarks for the StateMachine module.
+ *
+ * A crowd of AI agents, each with its own machine instance, spread over a few
+ * states. Every agent does a little steering math per update, about what a
+ * simple AI would. The parallel cases rerun the same crowd on 1 to N threads.
+ * The event cases walk the global machine through the same states, once by
+ * name and once through the transition table, the way a UI flow would.
+ *
+ * The registry cases register 10 to 1M states, then look them up, change to
+ * them in shuffled order, and time what SM_Update and SM_Draw cost on top of
+ * the state's own functions. Small registries are rebuilt until about a
+ * million operations were timed. The frame memory cases hand out a few
+ * scratch buffers per frame, from SM_FrameAlloc and from malloc. Run with
+ * `--json <path>` to also write the results to a file.
+ * @author Vitor Betmann
+ */
+
+#include "../../include/StateMachine.h"
+#include "../Bench.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+#define NAME_SIZE 32
+
+// --------------------------------------------------
+// Data types
+// --------------------------------------------------
+
+typedef struct {
+  float x, y;
+  float vx, vy;
+  float targetX, targetY;
+  StateMachine *machine;
+} Agent;
+
+typedef struct {
+  int count;
+  char *names;
+  char *missingNames;
+  int *order;
+} NameSet;
+
+// --------------------------------------------------
+// Variables
+// --------------------------------------------------
+static const int AGENT_COUNTS[] = {10000, 100000};
+static const int FRAMES = 100;
+static const float BENCH_DT = 1.0f / 60.0f;
+static const char *STATE_NAMES[] = {"idle", "wander", "chase", "flee"};
+static const int STATE_COUNT = sizeof(STATE_NAMES) / sizeof(*STATE_NAMES);
+static const int EVENT_OPS = 10000000;
+static const int EVENT_NEXT = 0;
+static const int NAME_COUNTS[] = {10, 100, 1000, 10000, 100000, 1000000};
+static const long MIN_OPS = 1000000;
+static const long FRAME_OPS = 10000000;
+static volatile long found; // Keeps lookups from being optimized out
+static const int SCRATCH_FRAMES = 100000;
+static const int SCRATCH_PER_FRAME = 64;
+static const size_t SCRATCH_SIZE = 256;
+
+// --------------------------------------------------
+// States
+// --------------------------------------------------
+
+static inline void Steer(Agent *agent, float dt) {
+
+  float dx = agent->targetX - agent->x, dy = agent->targetY - agent->y;
+  float distance = sqrtf(dx * dx + dy * dy) + 1e-6f;
+  agent->vx += (dx / distance * 50.0f - agent->vx) * dt;
+  agent->vy += (dy / distance * 50.0f - agent->vy) * dt;
+  agent->x += agent->vx * dt;
+  agent->y += agent->vy * dt;
+}
+
+static void AgentUpdate(float dt) {
+  Steer(SM_GetUserData(SM_GetActiveMachine()), dt);
+}
+
+static void AgentUpdateBatch(float dt, void **entities, int count) {
+  for (int i = 0; i < count; i++) {
+    Steer(entities[i], dt);
+  }
+}
+
+// Empty, so only what SM_Update and SM_Draw add around them is timed
+static void EmptyUpdate(float dt) {}
+
+static void EmptyDraw(void) {}
+
+// --------------------------------------------------
+// Helpers
+// --------------------------------------------------
+
+static NameSet NewNameSet(int count) {
+
+  NameSet set = {
+      .count = count,
+      .names = malloc((size_t)count * NAME_SIZE),
+      .missingNames = malloc((size_t)count * NAME_SIZE),
+      .order = malloc(count * sizeof(int)),
+  };
+  for (int i = 0; i < count; i++) {
+    snprintf(set.names + (size_t)i * NAME_SIZE, NAME_SIZE, "level_%d", i);
+    snprintf(set.missingNames + (size_t)i * NAME_SIZE, NAME_SIZE,
+             "missing_%d", i);
+    set.order[i] = i;
+  }
+  // Registration order would be kinder to the cache than a game is
+  for (int i = count - 1; i > 0; i--) {
+    int j = rand() % (i + 1);
+    int temp = set.order[i];
+    set.order[i] = set.order[j];
+    set.order[j] = temp;
+  }
+  return set;
+}
+
+static void FreeNameSet(NameSet *set) {
+  free(set->names);
+  free(set->missingNames);
+  free(set->order);
+}
+
+static char *NameAt(char *names, int index) {
+  return names + (size_t)index * NAME_SIZE;
+}
+
+static void RegisterNames(const NameSet *set) {
+  for (int i = 0; i < set->count; i++) {
+    SM_RegisterState(NameAt(set->names, i), NULL, EmptyUpdate, EmptyDraw,
+                     NULL);
+  }
+}
+
+// --------------------------------------------------
+// Benchmarks
+// --------------------------------------------------
+
+static void Bench_SM_RegisterState(const NameSet *set) {
+
+  int count = set->count;
+  int rounds = count < MIN_OPS ? (int)(MIN_OPS / count) : 1;
+  double ns = 0;
+  for (int round = 0; round < rounds; round++) {
+    SM_Init();
+    double start = Bench_Now();
+    RegisterNames(set);
+    ns += Bench_Now() - start;
+    SM_Shutdown();
+  }
+  Bench_Report("SM_RegisterState", count, (long)count * rounds, ns);
+}
+
+static void Bench_SM_IsStateRegistered(NameSet *set) {
+
+  int count = set->count;
+  long ops = count < MIN_OPS ? MIN_OPS : count;
+
+  double start = Bench_Now();
+  for (long i = 0; i < ops; i++) {
+    found += SM_IsStateRegistered(NameAt(set->names, set->order[i % count]));
+  }
+  Bench_Report("SM_IsStateRegistered", count, ops, Bench_Now() - start);
+
+  start = Bench_Now();
+  for (long i = 0; i < ops; i++) {
+    found += SM_IsStateRegistered(NameAt(set->missingNames, i % count));
+  }
+  Bench_Report("SM_IsStateRegistered (missing)", count, ops,
+               Bench_Now() - start);
+}
+
+static void Bench_SM_ChangeStateToShuffled(const NameSet *set) {
+
+  int count = set->count;
+  long ops = count < MIN_OPS ? MIN_OPS : count;
+
+  double start = Bench_Now();
+  for (long i = 0; i < ops; i++) {
+    SM_ChangeStateTo(NameAt(set->names, set->order[i % count]), NULL);
+  }
+  Bench_Report("SM_ChangeStateTo (shuffled)", count, ops,
+               Bench_Now() - start);
+}
+
+static void Bench_SM_UpdateAndDraw(int count) {
+
+  double start = Bench_Now();
+  for (long i = 0; i < FRAME_OPS; i++) {
+    SM_Update(BENCH_DT);
+  }
+  Bench_Report("SM_Update", count, FRAME_OPS, Bench_Now() - start);
+
+  start = Bench_Now();
+  for (long i = 0; i < FRAME_OPS; i++) {
+    SM_Draw();
+  }
+  Bench_Report("SM_Draw", count, FRAME_OPS, Bench_Now() - start);
+}
+
+static void Bench_SM_FrameAlloc(void) {
+
+  SM_Init();
+  SM_RegisterState("frame", NULL, EmptyUpdate, NULL, NULL);
+  SM_ChangeStateTo("frame", NULL);
+
+  // Each frame's buffers are touched, as a state filling them would
+  double start = Bench_Now();
+  for (int frame = 0; frame < SCRATCH_FRAMES; frame++) {
+    SM_Update(BENCH_DT);
+    for (int i = 0; i < SCRATCH_PER_FRAME; i++) {
+      char *scratch = SM_FrameAlloc(SCRATCH_SIZE);
+      scratch[0] = (char)i;
+      found += scratch[0];
+    }
+  }
+  long ops = (long)SCRATCH_FRAMES * SCRATCH_PER_FRAME;
+  Bench_Report("SM_FrameAlloc (with SM_Update)", SCRATCH_PER_FRAME, ops,
+               Bench_Now() - start);
+
+  char *scratches[SCRATCH_PER_FRAME];
+  start = Bench_Now();
+  for (int frame = 0; frame < SCRATCH_FRAMES; frame++) {
+    SM_Update(BENCH_DT);
+    for (int i = 0; i < SCRATCH_PER_FRAME; i++) {
+      scratches[i] = malloc(SCRATCH_SIZE);
+      scratches[i][0] = (char)i;
+      found += scratches[i][0];
+    }
+    for (int i = 0; i < SCRATCH_PER_FRAME; i++) {
+      free(scratches[i]);
+    }
+  }
+  Bench_Report("malloc/free (with SM_Update)", SCRATCH_PER_FRAME, ops,
+               Bench_Now() - start);
+
+  SM_Shutdown();
+}
+
+static Agent *NewCrowd(int count) {
+
+  Agent *agents = malloc(count * sizeof(Agent));
+  for (int i = 0; i < count; i++) {
+    agents[i] = (Agent){.x = (float)(i % 1000),
+                        .y = (float)(i / 1000),
+                        .targetX = 500.0f,
+                        .targetY = 50.0f,
+                        .machine = SM_Create(&agents[i])};
+    SM_MachineChangeStateTo(agents[i].machine,
+                            STATE_NAMES[rand() % STATE_COUNT], NULL);
+  }
+  return agents;
+}
+
+static void FreeCrowd(Agent *agents, int count) {
+
+  for (int i = 0; i < count; i++) {
+    SM_Destroy(agents[i].machine);
+  }
+  free(agents);
+}
+
+static void SetBatchUpdates(bool enabled) {
+
+  for (int i = 0; i < STATE_COUNT; i++) {
+    SM_SetStateBatchUpdate(STATE_NAMES[i], enabled ? AgentUpdateBatch : NULL);
+  }
+}
+
+static void Bench_SM_MachineUpdate(Agent *agents, int count) {
+
+  double start = Bench_Now();
+  for (int frame = 0; frame < FRAMES; frame++) {
+    for (int i = 0; i < count; i++) {
+      SM_MachineUpdate(agents[i].machine, BENCH_DT);
+    }
+  }
+  Bench_Report("SM_MachineUpdate per agent", count, (long)count * FRAMES,
+               Bench_Now() - start);
+}
+
+static void Bench_SM_UpdateAll(const char *name, int count) {
+
+  double start = Bench_Now();
+  for (int frame = 0; frame < FRAMES; frame++) {
+    SM_UpdateAll(BENCH_DT);
+  }
+  Bench_Report(name, count, (long)count * FRAMES, Bench_Now() - start);
+}
+
+static void Bench_SM_UpdateAllParallel(int count, int maxThreads) {
+
+  // Powers of two, then every core, e.g. 1, 2, 4, 6 on a 6-core machine
+  for (int threads = 1;; threads = threads * 2 < maxThreads ? threads * 2
+                                                              : maxThreads) {
+    char name[64];
+    SM_SetThreadCount(threads);
+    SM_UpdateAllParallel(BENCH_DT); // Starts the workers
+
+    double start = Bench_Now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+      SM_UpdateAllParallel(BENCH_DT);
+    }
+    snprintf(name, sizeof(name), "SM_UpdateAllParallel %d threads", threads);
+    Bench_Report(name, count, (long)count * FRAMES, Bench_Now() - start);
+
+    if (threads >= maxThreads) {
+      break;
+    }
+  }
+}
+
+static void Bench_SM_ChangeStateTo(void) {
+
+  double start = Bench_Now();
+  for (int i = 0; i < EVENT_OPS; i++) {
+    SM_ChangeStateTo(STATE_NAMES[i % STATE_COUNT], NULL);
+  }
+  Bench_Report("SM_ChangeStateTo", STATE_COUNT, EVENT_OPS,
+               Bench_Now() - start);
+}
+
+static void Bench_SM_Dispatch(void) {
+
+  // Every state moves on to the next one, the last back to the first
+  for (int i = 0; i < STATE_COUNT; i++) {
+    SM_RegisterTransition(STATE_NAMES[i], EVENT_NEXT,
+                          STATE_NAMES[(i + 1) % STATE_COUNT]);
+  }
+
+  double start = Bench_Now();
+  for (int i = 0; i < EVENT_OPS; i++) {
+    SM_Dispatch(EVENT_NEXT, NULL);
+  }
+  Bench_Report("SM_Dispatch", STATE_COUNT, EVENT_OPS, Bench_Now() - start);
+}
+
+// --------------------------------------------------
+// Main
+// --------------------------------------------------
+
+int main(int argc, char **argv) {
+  if (!Bench_OpenJson(argc, argv, "StateMachine")) {
+    return 1;
+  }
+
+  puts("");
+  puts("Benchmarking StateMachine");
+
+  for (size_t i = 0; i < sizeof(NAME_COUNTS) / sizeof(*NAME_COUNTS); i++) {
+    NameSet set = NewNameSet(NAME_COUNTS[i]);
+
+    Bench_SM_RegisterState(&set);
+
+    SM_Init();
+    RegisterNames(&set);
+    Bench_SM_IsStateRegistered(&set);
+    Bench_SM_ChangeStateToShuffled(&set);
+    Bench_SM_UpdateAndDraw(set.count);
+    SM_Shutdown();
+
+    FreeNameSet(&set);
+    puts("");
+  }
+
+  Bench_SM_FrameAlloc();
+  puts("");
+
+  int maxThreads = SM_SetThreadCount(0);
+
+  SM_Init();
+  for (int i = 0; i < STATE_COUNT; i++) {
+    SM_RegisterState(STATE_NAMES[i], NULL, AgentUpdate, NULL, NULL);
+  }
+
+  for (size_t i = 0; i < sizeof(AGENT_COUNTS) / sizeof(*AGENT_COUNTS); i++) {
+    int count = AGENT_COUNTS[i];
+    Agent *agents = NewCrowd(count);
+
+    SetBatchUpdates(false);
+    Bench_SM_MachineUpdate(agents, count);
+    Bench_SM_UpdateAll("SM_UpdateAll", count);
+
+    puts("\t(batch update)");
+    SetBatchUpdates(true);
+    Bench_SM_UpdateAll("SM_UpdateAll (batch)", count);
+    Bench_SM_UpdateAllParallel(count, maxThreads);
+
+    FreeCrowd(agents, count);
+    puts("");
+  }
+
+  Bench_SM_ChangeStateTo();
+  Bench_SM_Dispatch();
+  puts("");
+
+  SM_Shutdown();
+  Bench_CloseJson();
+  return 0;
+}
@@ -0,0 +1,231 @@
+/*
+ * Benchmarks the state name map against uthash.
+ *
+ * Each case inserts n generated names, then looks every one of them up in
+ * shuffled order, then looks up n names that aren't there. The uthash side
+ * stores and finds names the way SM_RegisterState used to, with HASH_ADD_STR
+ * and HASH_FIND_STR. Small maps are rebuilt until about a million operations
+ * were timed.
+ * @author Vitor Betmann
+ */
+
+#include "../../external/uthash.h"
+#include "../../include/StateMachine.h"
+#include "../../src/StateMachine/StateMachineHash.h"
+#include "../../src/StateMachine/StateMachineInternal.h"
+#include "../Bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+#define NAME_SIZE 32
+
+// --------------------------------------------------
+// Data types
+// --------------------------------------------------
+
+typedef struct {
+  const char *name;
+  State *state;
+  UT_hash_handle hh;
+} UthashEntry;
+
+typedef struct {
+  int count;
+  char *names;
+  char *missingNames;
+  int *order;
+  State *states;
+} NameSet;
+
+// --------------------------------------------------
+// Variables
+// --------------------------------------------------
+static const int NAME_COUNTS[] = {10, 100, 1000, 10000, 100000, 1000000};
+static const long MIN_OPS = 1000000;
+static volatile long found; // Keeps lookups from being optimized out
+
+// --------------------------------------------------
+// Helpers
+// --------------------------------------------------
+
+static NameSet NewNameSet(int count) {
+
+  NameSet set = {
+      .count = count,
+      .names = malloc((size_t)count * NAME_SIZE),
+      .missingNames = malloc((size_t)count * NAME_SIZE),
+      .order = malloc(count * sizeof(int)),
+      .states = malloc(count * sizeof(State)),
+  };
+
+  for (int i = 0; i < count; i++) {
+    char *name = set.names + (size_t)i * NAME_SIZE;
+    snprintf(name, NAME_SIZE, "enemy_%d_state", i);
+    snprintf(set.missingNames + (size_t)i * NAME_SIZE, NAME_SIZE,
+             "missing_%d_state", i);
+    set.states[i] = (State){.name = name, .handle = i + 1};
+    set.order[i] = i;
+  }
+
+  // Lookups in registration order would be kinder to the cache than a game is
+  for (int i = count - 1; i > 0; i--) {
+    int j = rand() % (i + 1);
+    int temp = set.order[i];
+    set.order[i] = set.order[j];
+    set.order[j] = temp;
+  }
+
+  return set;
+}
+
+static void FreeNameSet(NameSet *set) {
+
+  free(set->names);
+  free(set->missingNames);
+  free(set->order);
+  free(set->states);
+}
+
+static const char *NameAt(const char *names, int index) {
+  return names + (size_t)index * NAME_SIZE;
+}
+
+// --------------------------------------------------
+// Benchmarks
+// --------------------------------------------------
+
+static void Bench_Uthash(const NameSet *set, int rounds) {
+
+  int count = set->count;
+  UthashEntry *entries = malloc(count * sizeof(UthashEntry));
+  UthashEntry *map = NULL;
+  double insertNs = 0, findNs = 0, missNs = 0;
+
+  for (int round = 0; round < rounds; round++) {
+    double start = Bench_Now();
+    for (int i = 0; i < count; i++) {
+      entries[i].name = set->states[i].name;
+      entries[i].state = &set->states[i];
+      UthashEntry *entry = &entries[i];
+      HASH_ADD_STR(map, name, entry);
+    }
+    insertNs += Bench_Now() - start;
+
+    start = Bench_Now();
+    for (int i = 0; i < count; i++) {
+      UthashEntry *entry;
+      HASH_FIND_STR(map, NameAt(set->names, set->order[i]), entry);
+      found += entry != NULL;
+    }
+    findNs += Bench_Now() - start;
+
+    start = Bench_Now();
+    for (int i = 0; i < count; i++) {
+      UthashEntry *entry;
+      HASH_FIND_STR(map, NameAt(set->missingNames, i), entry);
+      found += entry != NULL;
+    }
+    missNs += Bench_Now() - start;
+
+    HASH_CLEAR(hh, map);
+  }
+
+  long ops = (long)count * rounds;
+  Bench_Report("uthash insert", count, ops, insertNs);
+  Bench_Report("uthash find", count, ops, findNs);
+  Bench_Report("uthash find (missing)", count, ops, missNs);
+  free(entries);
+}
+
+static void Bench_StateMap(const NameSet *set, int rounds) {
+
+  int count = set->count;
+  StateMap map = {0};
+  double insertNs = 0, reservedNs = 0, findNs = 0, missNs = 0;
+
+  for (int round = 0; round < rounds; round++) {
+    double start = Bench_Now();
+    for (int i = 0; i < count; i++) {
+      const char *trimmed;
+      size_t length;
+      uint32_t hash =
+          SM_Hash_TrimmedName(set->states[i].name, 0, &trimmed, &length);
+      SM_Internal_MapReserve(&map, i + 1);
+      SM_Internal_MapInsert(&map, hash, &set->states[i]);
+    }
+    insertNs += Bench_Now() - start;
+    SM_Internal_MapFree(&map);
+
+    // As SM_InitWithCapacity would, so the map never grows
+    start = Bench_Now();
+    SM_Internal_MapReserve(&map, count);
+    for (int i = 0; i < count; i++) {
+      const char *trimmed;
+      size_t length;
+      uint32_t hash =
+          SM_Hash_TrimmedName(set->states[i].name, 0, &trimmed, &length);
+      SM_Internal_MapInsert(&map, hash, &set->states[i]);
+    }
+    reservedNs += Bench_Now() - start;
+
+    start = Bench_Now();
+    for (int i = 0; i < count; i++) {
+      const char *trimmed;
+      size_t length;
+      uint32_t hash = SM_Hash_TrimmedName(NameAt(set->names, set->order[i]), 0,
+                                          &trimmed, &length);
+      found += SM_Internal_MapFind(&map, trimmed, length, hash);
+    }
+    findNs += Bench_Now() - start;
+
+    start = Bench_Now();
+    for (int i = 0; i < count; i++) {
+      const char *trimmed;
+      size_t length;
+      uint32_t hash = SM_Hash_TrimmedName(NameAt(set->missingNames, i), 0,
+                                          &trimmed, &length);
+      found += SM_Internal_MapFind(&map, trimmed, length, hash);
+    }
+    missNs += Bench_Now() - start;
+
+    SM_Internal_MapFree(&map);
+  }
+
+  long ops = (long)count * rounds;
+  Bench_Report("StateMap insert", count, ops, insertNs);
+  Bench_Report("StateMap insert (reserved)", count, ops, reservedNs);
+  Bench_Report("StateMap find", count, ops, findNs);
+  Bench_Report("StateMap find (missing)", count, ops, missNs);
+}
+
+// --------------------------------------------------
+// Main
+// --------------------------------------------------
+
+int main(int argc, char **argv) {
+  if (!Bench_OpenJson(argc, argv, "StateMap")) {
+    return 1;
+  }
+
+  puts("");
+  puts("Benchmarking StateMap");
+
+  for (size_t i = 0; i < sizeof(NAME_COUNTS) / sizeof(*NAME_COUNTS); i++) {
+    int count = NAME_COUNTS[i];
+    int rounds = count < MIN_OPS ? (int)(MIN_OPS / count) : 1;
+    NameSet set = NewNameSet(count);
+
+    Bench_Uthash(&set, rounds);
+    Bench_StateMap(&set, rounds);
+
+    FreeNameSet(&set);
+    puts("");
+  }
+
+  Bench_CloseJson();
+  return 0;
+}
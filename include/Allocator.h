@@ -0,0 +1,93 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+// --------------------------------------------------
+// Includes
+// --------------------------------------------------
+#include <stddef.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+/**
+ * @brief Alignment SMILE uses for hot buffers. One cache line, and enough for
+ * aligned SIMD loads.
+ */
+#define AL_CACHE_LINE 64
+
+/**
+ * @brief Allocations of at least this many bytes are served from whole pages
+ * and, when the platform allows it, huge pages.
+ */
+#define AL_HUGE_PAGE_SIZE (2u * 1024u * 1024u)
+
+// --------------------------------------------------
+// Data types
+// --------------------------------------------------
+
+/**
+ * @brief A pluggable allocator used by every SMILE module that goes through
+ * AL_Alloc() and AL_Free().
+ *
+ * `alloc` must return memory aligned to `alignment` (always a power of two) or
+ * NULL. `free` receives the same size the block was allocated with, so arena
+ * and pool allocators don't need to store headers.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  void *(*alloc)(size_t size, size_t alignment, void *userData);
+  void (*free)(void *ptr, size_t size, void *userData);
+  void *userData;
+} Allocator;
+
+// --------------------------------------------------
+// Prototypes
+// --------------------------------------------------
+
+/**
+ * @brief Replaces the engine-wide allocator.
+ *
+ * Memory must be released by the allocator that created it, so set this
+ * before creating any SMILE object that allocates through it.
+ *
+ * @param allocator The allocator to use, or NULL to restore the default one.
+ * @return true if the allocator was set, false if it is missing `alloc` or
+ * `free`.
+ * @author Vitor Betmann
+ */
+bool AL_SetAllocator(const Allocator *allocator);
+
+/**
+ * @brief Enables or disables huge pages in the default allocator.
+ *
+ * When enabled (the default), allocations of at least AL_HUGE_PAGE_SIZE bytes
+ * first try MAP_HUGETLB, then fall back to ordinary pages with transparent huge
+ * pages requested. Has no effect on custom allocators or on platforms without
+ * huge page support.
+ *
+ * @param toggle true to use huge pages, false to always use ordinary pages.
+ * @author Vitor Betmann
+ */
+void AL_EnableHugePages(bool toggle);
+
+/**
+ * @brief Allocates `size` bytes aligned to `alignment`.
+ *
+ * @param size      Number of bytes to allocate (must be greater than zero).
+ * @param alignment Power of two. Values smaller than a pointer are rounded up.
+ * @return void* Pointer to the block, or NULL on failure.
+ * @author Vitor Betmann
+ */
+void *AL_Alloc(size_t size, size_t alignment);
+
+/**
+ * @brief Releases a block returned by AL_Alloc().
+ *
+ * @param ptr  Block to release. NULL is ignored.
+ * @param size The size the block was allocated with.
+ * @author Vitor Betmann
+ */
+void AL_Free(void *ptr, size_t size);
+
+#endif
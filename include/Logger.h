@@ -0,0 +1,136 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+/**
+ * @brief Messages that can wait for the logger thread. Messages logged while
+ * all of them wait are dropped. Must be a power of two.
+ */
+#define LG_RING_SIZE 256
+
+/**
+ * @brief Longest message kept, terminator included. Longer ones are cut.
+ */
+#define LG_MESSAGE_SIZE 256
+
+/**
+ * @brief Call sites LG_SetRateLimit keeps track of. Sites beyond these are
+ * never rate limited.
+ */
+#define LG_SITE_COUNT 128
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LG_PRINTF(formatIndex, firstArg)                                       \
+  __attribute__((format(printf, formatIndex, firstArg)))
+#else
+#define LG_PRINTF(formatIndex, firstArg)
+#endif
+
+// --------------------------------------------------
+// Data types
+// --------------------------------------------------
+
+/**
+ * @brief How severe a message is. LG_SetLevel discards everything below a
+ * level, and LOG_NONE discards everything.
+ * @author Vitor Betmann
+ */
+typedef enum {
+  LOG_DEBUG,
+  LOG_INFO,
+  LOG_WARNING,
+  LOG_ERROR,
+  LOG_NONE,
+} LogLevel;
+
+/**
+ * @brief Where the logger thread writes messages. Called on that thread only,
+ * one message at a time.
+ * @author Vitor Betmann
+ */
+typedef void (*LogSink)(LogLevel level, const char *message, void *userData);
+
+// --------------------------------------------------
+// Prototypes
+// --------------------------------------------------
+
+/**
+ * @brief Logs a printf-style message, without waiting for it to be written.
+ *
+ * The message is formatted on the calling thread, straight into a free slot
+ * of a ring, and written out by the logger thread. Safe to call from any
+ * number of threads at once, without locking. The logger thread starts on
+ * first use, and everything logged is written out before the program exits.
+ *
+ * Each call site (told apart by its `format` pointer) may log a limited
+ * number of messages per period, see LG_SetRateLimit; the next one to get
+ * through tells how many were suppressed. The same message logged over and
+ * over is written once, followed by how many times it was repeated.
+ *
+ * @param level  How severe the message is.
+ * @param format printf-style format. Must stay valid for as long as the
+ * program runs, e.g. a string literal, since it identifies the call site.
+ * @return true if the message was queued, false if it was below the level,
+ * rate limited, or dropped because the ring was full.
+ * @author Vitor Betmann
+ */
+bool LG_Log(LogLevel level, const char *format, ...) LG_PRINTF(2, 3);
+
+/**
+ * @brief Discards messages below a level, before they are formatted.
+ *
+ * @param level The lowest level written. LOG_INFO by default.
+ * @author Vitor Betmann
+ */
+void LG_SetLevel(LogLevel level);
+
+/**
+ * @brief Gets the lowest level written.
+ *
+ * @return The level set with LG_SetLevel.
+ * @author Vitor Betmann
+ */
+LogLevel LG_GetLevel(void);
+
+/**
+ * @brief Sets how many messages each call site may log per period.
+ *
+ * @param count    Messages per period, 10 by default. 0 or less disables rate
+ * limiting.
+ * @param periodMs Length of the period in milliseconds, 1000 by default.
+ * @return true if set, false if `periodMs` isn't positive while `count` is.
+ * @author Vitor Betmann
+ */
+bool LG_SetRateLimit(int count, int periodMs);
+
+/**
+ * @brief Replaces where messages are written.
+ *
+ * @param sink     Called on the logger thread for each message, or NULL to
+ * restore the default one, which writes to stderr.
+ * @param userData Passed along to `sink`.
+ * @author Vitor Betmann
+ */
+void LG_SetSink(LogSink sink, void *userData);
+
+/**
+ * @brief Waits until every message logged so far is written, including how
+ * many times the last one was repeated.
+ *
+ * Blocks, so don't call it every frame.
+ * @author Vitor Betmann
+ */
+void LG_Flush(void);
+
+/**
+ * @brief Counts the messages dropped because the ring was full.
+ *
+ * @return The number of dropped messages.
+ * @author Vitor Betmann
+ */
+long LG_GetDroppedCount(void);
+
+#endif
@@ -6,6 +6,7 @@
 // Includes
 // --------------------------------------------------
 #include <raylib.h>
+#include <stddef.h>
 
 // --------------------------------------------------
 // Data types
@@ -13,8 +14,19 @@
 typedef enum {
   UNIFORM,
   NORMAL,
+  DISK,
+  CIRCLE,
+  IMAGE_MASK,
+  POLYLINE,
 } Distribution;
 
+typedef enum {
+  SORT_NONE,
+  SORT_BY_AGE,
+  SORT_BY_Y,
+  SORT_BY_DEPTH,
+} SortMode;
+
 typedef struct ParticleSystem ParticleSystem;
 
 // --------------------------------------------------
@@ -39,11 +51,65 @@ void PS_SetLinearAcceleration(ParticleSystem *ps, float xMin, float yMin,
                               float xMax, float yMax);
 
 /**
+ * @brief Sets where around the system's position particles spawn.
  *
- **/
+ * - UNIFORM: a grid, configured with PS_SetUniformDist. `dx` and `dy` are
+ *   ignored.
+ * - NORMAL: a Gaussian cloud. `dx` and `dy` are the standard deviations, so
+ *   about 68% of particles land within (dx, dy) of the center and almost all
+ *   within three times that.
+ * - DISK: evenly spread inside an ellipse of radii `dx` and `dy`.
+ * - CIRCLE: on the outline of an ellipse of radii `dx` and `dy`.
+ * - IMAGE_MASK, POLYLINE: the shape set by PS_SetEmissionMask or
+ *   PS_SetEmissionPolyline. `dx` and `dy` are ignored.
+ *
+ * @param ps   The particle system.
+ * @param dist One of the Distribution values.
+ * @param dx   Horizontal spread, in pixels.
+ * @param dy   Vertical spread, in pixels.
+ * @author Vitor Betmann
+ */
 void PS_SetEmissionArea(ParticleSystem *ps, Distribution dist, float dx,
                         float dy);
 
+/**
+ * @brief Spawns particles from the opaque pixels of an image.
+ *
+ * Pixels are picked with a probability proportional to their alpha, so a
+ * sprite can dissolve into particles. The image's top-left corner sits at the
+ * system's position, one pixel per unit. The weights are precomputed here,
+ * so each spawn costs the same no matter how large the image is. The image
+ * is not kept and can be unloaded right after.
+ *
+ * @param ps    The particle system.
+ * @param image Any raylib image. Must be at most 65536 pixels on each side,
+ *              with at most INT_MAX visible pixels.
+ * @return true if the mask was set and the distribution switched to
+ * IMAGE_MASK, false if the image has no visible pixel, is too large, or
+ * memory ran out. On failure the previous shape is kept.
+ * @author Vitor Betmann
+ */
+bool PS_SetEmissionMask(ParticleSystem *ps, Image image);
+
+/**
+ * @brief Spawns particles along a polyline.
+ *
+ * Segments are picked with a probability proportional to their length, so
+ * particles spread evenly along the whole line. Points are relative to the
+ * system's position and are copied.
+ *
+ * @param ps     The particle system.
+ * @param points Vertices of the polyline.
+ * @param count  Number of vertices, at least 2.
+ * @param closed true to also join the last point back to the first.
+ * @return true if the polyline was set and the distribution switched to
+ * POLYLINE, false if it has no length or memory ran out. On failure the
+ * previous shape is kept.
+ * @author Vitor Betmann
+ */
+bool PS_SetEmissionPolyline(ParticleSystem *ps, const Vector2 *points,
+                            int count, bool closed);
+
 /**
  *
  **/
@@ -54,6 +120,50 @@ void PS_SetUniformDist(ParticleSystem *ps, Vector2 particleSize, int colsCount);
  **/
 void PS_SetColors(ParticleSystem *ps, Color color1, Color color2);
 
+/**
+ * @brief Sets the order in which particles are drawn.
+ *
+ * Translucent particles only blend correctly when drawn back to front.
+ * - SORT_NONE: emission order (the default, and the cheapest).
+ * - SORT_BY_AGE: oldest particles first, so newer ones end up on top.
+ * - SORT_BY_Y: top of the screen first, for top-down views.
+ * - SORT_BY_DEPTH: farthest first, using the depth set by PS_SetDepth.
+ *
+ * Sorting happens in PS_Update. It reuses the previous frame's order, so it
+ * stays cheap while the order barely changes.
+ *
+ * @param ps   The particle system.
+ * @param mode One of the SortMode values.
+ * @author Vitor Betmann
+ */
+void PS_SetSortMode(ParticleSystem *ps, SortMode mode);
+
+/**
+ * @brief Sets the depth range new particles are spawned with.
+ *
+ * Each particle gets a random depth in [min, max]. Larger values are farther
+ * away. Only used by SORT_BY_DEPTH.
+ *
+ * @param ps  The particle system.
+ * @param min Minimum depth.
+ * @param max Maximum depth.
+ * @author Vitor Betmann
+ */
+void PS_SetDepth(ParticleSystem *ps, float min, float max);
+
+/**
+ * @brief Seeds the system's random number generator.
+ *
+ * Every system gets its own generator, seeded from raylib's GetRandomValue
+ * when created, so SetRandomSeed still makes runs repeatable. Setting a seed
+ * makes the next emissions of this system repeatable on their own.
+ *
+ * @param ps   The particle system.
+ * @param seed Any value.
+ * @author Vitor Betmann
+ */
+void PS_SetSeed(ParticleSystem *ps, unsigned long long seed);
+
 /**
  *
  **/
@@ -74,6 +184,132 @@ void PS_Draw(ParticleSystem *ps);
  **/
 bool PS_ShouldDestroy(ParticleSystem *ps);
 
+/**
+ * @brief Returns the number of particles currently alive in a system.
+ *
+ * Particles die when their lifetime runs out. Storage grows in blocks of
+ * 4096 particles as PS_Emit is called and shrinks again as they die.
+ *
+ * @param ps The particle system.
+ * @return int Number of live particles, or 0 if `ps` is NULL.
+ * @author Vitor Betmann
+ */
+int PS_GetLiveCount(ParticleSystem *ps);
+
+/**
+ * @brief Sets how many empty particle blocks the shared pool keeps for reuse.
+ *
+ * Blocks released by dying particles go back to a pool shared by every
+ * particle system, so a new burst doesn't have to allocate. Blocks beyond the
+ * limit are freed right away. The default keeps 16 blocks.
+ *
+ * @param blocks Maximum number of pooled blocks. Negative values count as 0.
+ * @author Vitor Betmann
+ */
+void PS_SetBlockPoolLimit(int blocks);
+
+/**
+ * @brief Frees every empty block held by the shared pool.
+ *
+ * Useful after a scene with heavy effects ends. The pool limit is unchanged.
+ * @author Vitor Betmann
+ */
+void PS_TrimBlockPool(void);
+
+/**
+ * @brief Returns how many bytes PS_Snapshot needs for the system right now.
+ *
+ * @param ps The particle system.
+ * @return size_t Size of a snapshot of the current state, in bytes.
+ * @author Vitor Betmann
+ */
+size_t PS_GetSnapshotSize(const ParticleSystem *ps);
+
+/**
+ * @brief Writes the full state of a system into a compact binary snapshot.
+ *
+ * A snapshot holds the configuration, the random number generator, every
+ * live particle and the draw order, so restoring it and calling the same
+ * functions again replays the effect exactly. Particles are stored field by
+ * field, which keeps the fields that don't change between frames in one
+ * place for PS_EncodeSnapshotDelta. The texture and the shape set by
+ * PS_SetEmissionMask or PS_SetEmissionPolyline are not included: they stay
+ * with the system a snapshot is restored into. Snapshots are only meant to
+ * be read back by the same build of the game.
+ *
+ * @param ps       The particle system.
+ * @param buffer   Where to write the snapshot.
+ * @param capacity Size of `buffer` in bytes.
+ * @return size_t Bytes written, or 0 if `buffer` is smaller than
+ * PS_GetSnapshotSize.
+ * @author Vitor Betmann
+ */
+size_t PS_Snapshot(const ParticleSystem *ps, void *buffer, size_t capacity);
+
+/**
+ * @brief Replaces the state of a system with a snapshot.
+ *
+ * The system keeps its texture and spawn shape. Everything else, including
+ * live particles and the random number generator, comes from the snapshot.
+ *
+ * @param ps       The particle system.
+ * @param snapshot A snapshot written by PS_Snapshot.
+ * @param size     Size of the snapshot in bytes.
+ * @return true on success. false if the snapshot is invalid, in which case
+ * the system is unchanged, or if memory ran out, in which case the system may
+ * be left with no live particles.
+ * @author Vitor Betmann
+ */
+bool PS_Restore(ParticleSystem *ps, const void *snapshot, size_t size);
+
+/**
+ * @brief Returns the largest possible delta for snapshots up to a given size.
+ *
+ * @param snapshotSize Size of the current snapshot, in bytes.
+ * @return size_t Buffer size that always fits PS_EncodeSnapshotDelta's
+ * output.
+ * @author Vitor Betmann
+ */
+size_t PS_GetSnapshotDeltaBound(size_t snapshotSize);
+
+/**
+ * @brief Encodes a snapshot as the difference from the previous one.
+ *
+ * Bytes that didn't change cost next to nothing, so recording a delta every
+ * frame is much smaller than recording full snapshots. Keep a full snapshot
+ * every now and then to seek without replaying every delta.
+ *
+ * @param prev     Previous snapshot, or NULL to encode against nothing.
+ * @param prevSize Size of `prev` in bytes.
+ * @param curr     Snapshot to encode.
+ * @param currSize Size of `curr` in bytes.
+ * @param delta    Where to write the delta.
+ * @param capacity Size of `delta` in bytes.
+ * @return size_t Bytes written, or 0 if `delta` is too small.
+ * @author Vitor Betmann
+ */
+size_t PS_EncodeSnapshotDelta(const void *prev, size_t prevSize,
+                              const void *curr, size_t currSize, void *delta,
+                              size_t capacity);
+
+/**
+ * @brief Rebuilds a snapshot from the previous one and a delta.
+ *
+ * @param prev      The snapshot the delta was encoded against.
+ * @param prevSize  Size of `prev` in bytes.
+ * @param delta     Delta written by PS_EncodeSnapshotDelta.
+ * @param deltaSize Size of `delta` in bytes.
+ * @param snapshot  Where to write the rebuilt snapshot. Must not overlap
+ * `prev`.
+ * @param capacity  Size of `snapshot` in bytes.
+ * @return size_t Size of the rebuilt snapshot, or 0 if the delta is invalid
+ * or `snapshot` is too small.
+ * @author Vitor Betmann
+ */
+size_t PS_DecodeSnapshotDelta(const void *prev, size_t prevSize,
+                              const void *delta, size_t deltaSize,
+                              void *snapshot, size_t capacity);
+
 /**
  *
  **/
@@ -0,0 +1,150 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// --------------------------------------------------
+// Includes
+// --------------------------------------------------
+#include <stddef.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+/**
+ * @brief Zones each thread can hold until the next PF_WriteTrace. Zones
+ * ending while a thread's ring is full are dropped. Must be a power of two.
+ */
+#define PF_RING_SIZE 16384
+
+/**
+ * @brief Threads that can record zones at once. A thread that exits leaves
+ * its ring to the next one once PF_WriteTrace has drained it.
+ */
+#define PF_MAX_THREADS 64
+
+/**
+ * @brief Longest thread name PF_SetThreadName keeps, terminator included.
+ */
+#define PF_THREAD_NAME_SIZE 32
+
+#define PF_CONCAT_(a, b) a##b
+#define PF_CONCAT(a, b) PF_CONCAT_(a, b)
+
+/**
+ * @brief Times the rest of the enclosing block as a zone called `name`.
+ *
+ * Put it first thing in a function or block; the zone ends wherever the block
+ * is left, `return` included. `name` must outlive the capture, e.g. a string
+ * literal. Compiles to nothing unless SMILE is built with SMILE_PROFILER, and
+ * needs GCC or Clang for the cleanup at the end of the block.
+ */
+#if defined(SMILE_PROFILER) && (defined(__GNUC__) || defined(__clang__))
+#define PF_ZONE(name)                                                          \
+  ProfileZone PF_CONCAT(pfZone, __LINE__)                                      \
+      __attribute__((cleanup(PF_EndZone))) = PF_BeginZone(name)
+#else
+#define PF_ZONE(name) ((void)0)
+#endif
+
+// --------------------------------------------------
+// Data types
+// --------------------------------------------------
+
+/**
+ * @brief A zone started by PF_BeginZone. `name` is NULL if nothing was being
+ * captured when it started, and PF_EndZone then records nothing.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  const char *name;
+  long long start;
+} ProfileZone;
+
+// --------------------------------------------------
+// Prototypes
+// --------------------------------------------------
+
+/**
+ * @brief Starts recording zones, from every thread.
+ *
+ * Zones left over from an earlier capture and the dropped count are cleared.
+ *
+ * @return true if started, false if already capturing.
+ * @author Vitor Betmann
+ */
+bool PF_StartCapture(void);
+
+/**
+ * @brief Stops recording zones. Those recorded so far are kept for
+ * PF_WriteTrace.
+ *
+ * @return true if stopped, false if not capturing.
+ * @author Vitor Betmann
+ */
+bool PF_StopCapture(void);
+
+/**
+ * @brief Tells whether zones are being recorded.
+ *
+ * @return true between PF_StartCapture and PF_StopCapture.
+ * @author Vitor Betmann
+ */
+bool PF_IsCapturing(void);
+
+/**
+ * @brief Starts a zone on the calling thread. Prefer PF_ZONE, which ends it
+ * for you.
+ *
+ * @param name Name shown in the trace, must outlive the capture.
+ * @return The zone, to hand to PF_EndZone.
+ * @author Vitor Betmann
+ */
+ProfileZone PF_BeginZone(const char *name);
+
+/**
+ * @brief Ends a zone and records it in the calling thread's ring.
+ *
+ * Must be called on the thread that began it. Never blocks: the zone is
+ * dropped and counted instead if the ring is full or no ring is left for the
+ * thread.
+ *
+ * @param zone The zone PF_BeginZone returned.
+ * @author Vitor Betmann
+ */
+void PF_EndZone(ProfileZone *zone);
+
+/**
+ * @brief Names the calling thread in the trace, e.g. "main" or "loader".
+ *
+ * @param name The name, cut at PF_THREAD_NAME_SIZE - 1 characters.
+ * @return true if named, false if `name` is NULL or no ring is left for the
+ * thread.
+ * @author Vitor Betmann
+ */
+bool PF_SetThreadName(const char *name);
+
+/**
+ * @brief Writes the zones recorded so far to a Chrome Trace Event file and
+ * drains them from the rings.
+ *
+ * Open the file in chrome://tracing or https://ui.perfetto.dev. Safe to call
+ * while capturing, e.g. every few seconds so the rings never fill; each call
+ * writes a file of its own.
+ *
+ * @param path Where to write the JSON file.
+ * @return true if written, false if `path` is NULL or the file couldn't be
+ * written.
+ * @author Vitor Betmann
+ */
+bool PF_WriteTrace(const char *path);
+
+/**
+ * @brief Counts the zones dropped since PF_StartCapture, because a ring was
+ * full or no ring was left for a thread.
+ *
+ * @return The number of dropped zones.
+ * @author Vitor Betmann
+ */
+long PF_GetDroppedCount(void);
+
+#endif
@@ -1,12 +1,203 @@
 #ifndef STATE_MACHINE_H
 #define STATE_MACHINE_H
 
+// --------------------------------------------------
+// Includes
+// --------------------------------------------------
+#include <stddef.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+/**
+ * @brief Handle value that never refers to a state. Returned on failure.
+ * @author Vitor Betmann
+ */
+#define SM_INVALID_STATE 0
+
+/**
+ * @brief State flag: states under this one on the stack keep updating.
+ * @author Vitor Betmann
+ */
+#define SM_UPDATE_BELOW (1u << 0)
+
+/**
+ * @brief State flag: states under this one on the stack keep drawing, before
+ * it, so it draws on top of them.
+ * @author Vitor Betmann
+ */
+#define SM_DRAW_BELOW (1u << 1)
+
+/**
+ * @brief Number of posted state changes that can wait for the next SM_Update.
+ * A power of two.
+ * @author Vitor Betmann
+ */
+#define SM_POST_QUEUE_SIZE 64
+
+/**
+ * @brief How many of the latest frame times SM_Run keeps for
+ * RunStats.p99FrameMs.
+ * @author Vitor Betmann
+ */
+#define SM_RUN_FRAME_SAMPLES 1024
+
+/**
+ * @brief Buckets in a CallStats histogram. Bucket i counts the calls that
+ * took from 2^i up to 2^(i + 1) nanoseconds; the last one also counts any
+ * longer call.
+ * @author Vitor Betmann
+ */
+#define SM_STATS_BUCKETS 32
+
 // --------------------------------------------------
 // Data types
 // --------------------------------------------------
 typedef struct StateTracker StateTracker;
 typedef struct State State;
 
+/**
+ * @brief One independent instance running the registered states.
+ *
+ * States are registered once and shared by every machine. Each machine only
+ * tracks which of them it is in, plus a user data pointer, so thousands of
+ * them (e.g. one per enemy) stay cheap. Create them with SM_Create.
+ * @author Vitor Betmann
+ */
+typedef struct StateMachine StateMachine;
+
+/**
+ * @brief Small integer identifying a registered state.
+ *
+ * Handles index straight into the registered states, so changing state by
+ * handle skips hashing the name. They stay valid until SM_Shutdown.
+ * @author Vitor Betmann
+ */
+typedef unsigned int StateHandle;
+
+/**
+ * @brief Which of the state changes posted during a frame SM_Update applies.
+ *
+ * COALESCE_LAST (the default) and COALESCE_FIRST apply one of them, so a
+ * frame never pays for more than one exit/enter. COALESCE_NONE applies all of
+ * them, in the order they were posted.
+ * @author Vitor Betmann
+ */
+typedef enum {
+  COALESCE_LAST,
+  COALESCE_FIRST,
+  COALESCE_NONE,
+} CoalesceMode;
+
+/**
+ * @brief A state's name and lifecycle callbacks.
+ *
+ * SM_RegisterState creates these. To skip registration entirely, list the
+ * states in a StateTable instead, where `handle` is each state's position
+ * plus one. `pause`, `resume` and `flags` (SM_UPDATE_BELOW, SM_DRAW_BELOW)
+ * only matter for the state stack, see SM_PushState. `parent` is the handle of
+ * the state this one is nested in, or SM_INVALID_STATE, see SM_SetStateParent.
+ * @author Vitor Betmann
+ */
+struct State {
+  const char *name;
+  StateHandle handle;
+  StateHandle parent;
+  void (*enter)(void *args);
+  void (*update)(float dt);
+  void (*draw)(void);
+  void (*exit)(void);
+  void (*pause)(void);
+  void (*resume)(void);
+  unsigned int flags;
+};
+
+/**
+ * @brief Every state of a game, known at build time, with a perfect hash of
+ * their names.
+ *
+ * Don't fill one by hand: tools/StateTableGen writes it as a const C array
+ * from a list of states. The state machine reads it in place, so it can live
+ * in read-only memory and looking up a name never compares more than one
+ * string.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  const State *states;
+  int stateCount;
+  const unsigned short *displacements;
+  int bucketCount;
+  const unsigned short *slots;
+  int slotCount;
+  unsigned int seed;
+} StateTable;
+
+/**
+ * @brief How SM_Run paces the game. Fields left at 0 take their defaults.
+ *
+ * `updateRate` is fixed: every update gets the same dt, 1 / updateRate.
+ * `drawRate` caps how often a frame is drawn, so set it to the display's
+ * refresh rate (or above it, when vsync paces the draw). `maxCatchUpSteps`
+ * bounds the updates run in one go after a slow frame; the time beyond that
+ * is dropped rather than caught up, so one hitch can't snowball. `headless`
+ * runs updates back to back, with no draws and no sleeping, so a simulation
+ * runs as fast as the CPU allows. `shouldStop` is checked once per loop (e.g.
+ * raylib's WindowShouldClose).
+ * @author Vitor Betmann
+ */
+typedef struct {
+  float updateRate;     // Updates per second, 60 by default
+  float drawRate;       // Draws per second at most, updateRate by default
+  int maxCatchUpSteps;  // Updates per loop at most, 5 by default
+  long maxUpdates;      // Stops after this many updates, 0 for no limit
+  bool headless;        // No draws, no sleeping
+  bool (*shouldStop)(void);
+} RunConfig;
+
+/**
+ * @brief What SM_Run measured so far.
+ *
+ * A frame is one pass of the loop that updated or drew, timed without the
+ * sleep that follows it. An overrun is a frame that took longer than the
+ * time it had, the shorter of an update step and a draw period. The 99th
+ * percentile is over the last SM_RUN_FRAME_SAMPLES frames; the rest is over
+ * the whole run.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  long updates;
+  long draws;
+  long frames;
+  long overruns;
+  long droppedSteps;  // Updates skipped to keep up, see maxCatchUpSteps
+  double meanFrameMs;
+  double p99FrameMs;
+  double maxFrameMs;
+} RunStats;
+
+/**
+ * @brief How often and how long one lifecycle function of a state ran.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  long calls;
+  long long totalNs;
+  long long maxNs;
+  long histogram[SM_STATS_BUCKETS];
+} CallStats;
+
+/**
+ * @brief Timings of a state's lifecycle functions, see SM_GetStats.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  CallStats enter;
+  CallStats update;
+  CallStats draw;
+  CallStats exit;
+} StateStats;
+
 // --------------------------------------------------
 // Prototypes
 // --------------------------------------------------
@@ -26,6 +217,35 @@ typedef struct State State;
  */
 bool SM_Init(void);
 
+/**
+ * @brief Initializes the state machine with room for a number of states.
+ *
+ * Same as SM_Init, but reserves memory for `capacity` states up front, so
+ * registering them doesn't allocate. Registering more is still allowed.
+ *
+ * @param capacity Expected number of states. 0 reserves nothing up front,
+ * like SM_Init.
+ * @return true if initialized successfully, false if already initialized or if
+ * memory allocation failed.
+ * @author Vitor Betmann
+ */
+bool SM_InitWithCapacity(int capacity);
+
+/**
+ * @brief Initializes the state machine with a static table of states.
+ *
+ * Nothing is allocated or copied: the table is used as is, so it must
+ * outlive the state machine. SM_RegisterState is not available. Everything
+ * else works as with SM_Init. Instances created with SM_Create still
+ * allocate, as they do otherwise.
+ *
+ * @param table A table generated by tools/StateTableGen.
+ * @return true if initialized, false if already initialized or if `table` is
+ * NULL or empty.
+ * @author Vitor Betmann
+ */
+bool SM_InitStatic(const StateTable *table);
+
 /**
  * @brief Checks whether the state machine has been initialized.
  *
@@ -37,20 +257,23 @@ bool SM_IsInitialized(void);
 /**
  * @brief Registers a new named state with optional lifecycle callbacks.
  *
- * Each state must have a unique name. At least one lifecycle function must be
- * non-NULL.
+ * Each state must have a unique name. Leading and trailing whitespace is
+ * trimmed off the name, here and wherever a name is looked up. At least one
+ * lifecycle function must be non-NULL. Not available after SM_InitStatic.
  *
- * @param name     The name of the state (must be non-NULL and non-empty).
+ * @param name     The name of the state (must be non-NULL and not empty or
+ * whitespace-only).
  * @param enterFn  Called when entering this state (can be NULL).
  * @param updateFn Called every update tick while this state is active (can be
  * NULL).
  * @param drawFn   Called every frame while this state is active (can be NULL).
  * @param exitFn   Called when exiting this state (can be NULL).
  *
- * @return true if registration succeeds, false otherwise.
+ * @return The new state's handle, or SM_INVALID_STATE (0) if registration
+ * failed. Being 0 on failure, the result can still be tested like a bool.
  * @author Vitor Betmann
  */
-bool SM_RegisterState(const char *name, void (*enterFn)(void *),
+StateHandle SM_RegisterState(const char *name, void (*enterFn)(void *),
                       void (*updateFn)(float), void (*drawFn)(void),
                       void (*exitFn)(void));
 
@@ -63,12 +286,27 @@ bool SM_RegisterState(const char *name, void (*enterFn)(void *),
  */
 bool SM_IsStateRegistered(char *name);
 
+/**
+ * @brief Looks up the handle of a registered state.
+ *
+ * Resolve handles once, e.g. right after registering, then use
+ * SM_ChangeStateToHandle wherever states change often.
+ *
+ * @param name The name of the state.
+ * @return The state's handle, or SM_INVALID_STATE if no state has that name
+ * or the machine is uninitialized.
+ * @author Vitor Betmann
+ */
+StateHandle SM_GetStateHandle(const char *name);
+
 /**
  * @brief Switches to a different state by name, optionally passing arguments.
  *
  * Calls the current state's exit function (if any) and the new state's enter
  * one. Will exit and re-enter the same state if the requested name matches the
- * current state's name.
+ * current state's name. Only the top of the state stack is replaced: states
+ * pushed under it stay as they are. With nested states, parents shared by both
+ * states stay entered, see SM_SetStateParent.
  *
  * @param name The name of the state to switch to.
  * @param args Optional arguments to pass to the new state's enter function.
@@ -78,11 +316,291 @@ bool SM_IsStateRegistered(char *name);
  */
 bool SM_ChangeStateTo(const char *name, void *args);
 
+/**
+ * @brief Switches to a different state by handle, optionally passing
+ * arguments.
+ *
+ * Behaves like SM_ChangeStateTo, but finding the state is a single array
+ * lookup instead of hashing its name.
+ *
+ * @param handle Handle returned by SM_RegisterState or SM_GetStateHandle.
+ * @param args   Optional arguments to pass to the new state's enter function.
+ *
+ * @return true if the state change succeeded, false otherwise.
+ * @author Vitor Betmann
+ */
+bool SM_ChangeStateToHandle(StateHandle handle, void *args);
+
+/**
+ * @brief Switches to a different state by name, passing it a copy of `args`
+ * the state machine owns.
+ *
+ * Behaves like SM_ChangeStateTo, but `args` is copied first, so it can live
+ * on the caller's stack. The copy is handed to the new state's enter
+ * function and freed once that state exits, whether it's changed away from,
+ * popped off the stack or shut down. Copies are carved out of an arena, so
+ * nothing is allocated once it has grown large enough. Room for the copy is
+ * made before the current state exits, so if memory runs out, nothing
+ * changes. For the same reason, the exit function can't call this again.
+ *
+ * @param name The name of the state to switch to.
+ * @param args The arguments to copy, or NULL if `size` is 0.
+ * @param size Size of `args` in bytes. With 0, the enter function gets NULL.
+ *
+ * @return true if the state change succeeded, false otherwise.
+ * @author Vitor Betmann
+ */
+bool SM_ChangeStateToWithArgs(const char *name, const void *args, size_t size);
+
+/**
+ * @brief Pushes a state on top of the current one, which stays resident.
+ *
+ * Instead of exiting, the current state's pause function is called (if any),
+ * then the new state's enter function. Nothing is torn down or reloaded, so
+ * overlays like pause menus or inventories open instantly. SM_PopState goes
+ * back. With no current state, this is the same as SM_ChangeStateTo.
+ *
+ * @param name The name of the state to push.
+ * @param args Optional arguments to pass to the new state's enter function.
+ *
+ * @return true if the state was pushed, false otherwise.
+ * @author Vitor Betmann
+ */
+bool SM_PushState(const char *name, void *args);
+
+/**
+ * @brief Pushes a state by handle, see SM_PushState.
+ *
+ * @param handle Handle returned by SM_RegisterState or SM_GetStateHandle.
+ * @param args   Optional arguments to pass to the new state's enter function.
+ *
+ * @return true if the state was pushed, false otherwise.
+ * @author Vitor Betmann
+ */
+bool SM_PushStateHandle(StateHandle handle, void *args);
+
+/**
+ * @brief Exits the current state and resumes the one under it.
+ *
+ * Calls the current state's exit function (if any), then the resume function
+ * of the state below (if any), which becomes current again.
+ *
+ * @return true if a state was popped, false if there is no state under the
+ * current one or the machine is not initialized.
+ * @author Vitor Betmann
+ */
+bool SM_PopState(void);
+
+/**
+ * @brief Returns how many states are on the state stack, the current one
+ * included.
+ *
+ * @return int The stack's depth, 0 if there is no current state or the
+ * machine is not initialized.
+ * @author Vitor Betmann
+ */
+int SM_GetStackDepth(void);
+
+/**
+ * @brief Sets how a registered state behaves on the state stack.
+ *
+ * Not available for states of a static table, which set the same fields in
+ * their StateTable instead.
+ *
+ * @param name     The name of the state.
+ * @param flags    SM_UPDATE_BELOW and/or SM_DRAW_BELOW, or 0 for neither.
+ * @param pauseFn  Called when a state is pushed over this one (can be NULL).
+ * @param resumeFn Called when this state is current again after a pop (can
+ * be NULL).
+ *
+ * @return true if set, false if the state was not found or the machine is
+ * not initialized.
+ * @author Vitor Betmann
+ */
+bool SM_SetStateStackOptions(const char *name, unsigned int flags,
+                             void (*pauseFn)(void), void (*resumeFn)(void));
+
+/**
+ * @brief Nests a registered state inside another one.
+ *
+ * A parent's update and draw run before those of whichever of its children is
+ * current, so behavior shared by many states (e.g. in-game input) lives in one
+ * place. Changing between two states only exits and enters the states that
+ * actually change: parents they share stay entered, so their setup isn't
+ * repeated on every sibling transition. Parents are entered outermost first
+ * with NULL args, and exited innermost first.
+ *
+ * Not available for states of a static table, which set `parent` in their
+ * StateTable instead. Set parents before changing to the states involved.
+ *
+ * @param name   The name of the state.
+ * @param parent The name of its parent, or NULL to make it top-level.
+ * @return true if set, false if a state was not found, `parent` is `name` or
+ * one of its children, or the machine is not initialized.
+ * @author Vitor Betmann
+ */
+bool SM_SetStateParent(const char *name, const char *parent);
+
+/**
+ * @brief Gives a state a function that loads its assets ahead of time.
+ *
+ * Preload functions run on a background thread, started by SM_PrefetchState
+ * or SM_ChangeStateToWhenReady, so loading doesn't stall the frame the way
+ * loading in enter would. They run at most once per state: load what enter
+ * needs and keep it. They must not call any SM_ function, and must not touch
+ * data the main thread uses until the state is ready. Works with static
+ * tables too.
+ *
+ * @param name      The name of the state.
+ * @param preloadFn The function, or NULL to remove it.
+ * @return true if set, false if the state was not found, is being preloaded
+ * right now, memory allocation failed or the machine is not initialized.
+ * @author Vitor Betmann
+ */
+bool SM_SetStatePreload(const char *name, void (*preloadFn)(void));
+
+/**
+ * @brief Starts preloading a state in the background, if it isn't already.
+ *
+ * @param name The name of the state.
+ * @return true if preloading started, is underway or is done, or the state
+ * has nothing to preload. false if the state was not found, the loader thread
+ * could not be started or the machine is not initialized.
+ * @author Vitor Betmann
+ */
+bool SM_PrefetchState(const char *name);
+
+/**
+ * @brief Checks whether a state is done preloading.
+ *
+ * @param name The name of the state.
+ * @return true if its preload function has finished, or it has none. false if
+ * it hasn't, the state was not found or the machine is not initialized.
+ * @author Vitor Betmann
+ */
+bool SM_IsStateReady(const char *name);
+
+/**
+ * @brief Sets the state shown while SM_ChangeStateToWhenReady waits.
+ *
+ * @param name The name of the loading state, or NULL to keep the current
+ * state running while waiting instead.
+ * @return true if set, false if the state was not found or the machine is not
+ * initialized.
+ * @author Vitor Betmann
+ */
+bool SM_SetLoadingState(const char *name);
+
+/**
+ * @brief Changes state once the new state is done preloading.
+ *
+ * If the state is ready, this is SM_ChangeStateTo. Otherwise it starts
+ * preloading it, changes to the loading state (see SM_SetLoadingState), and
+ * SM_Update changes to the state on the first frame it's ready. Any other
+ * change of the current state before then cancels it, pushing or popping a
+ * state included.
+ *
+ * @param name The name of the state to switch to.
+ * @param args Optional arguments to pass to the new state's enter function.
+ * @return true if the state was changed to or will be, false otherwise.
+ * @author Vitor Betmann
+ */
+bool SM_ChangeStateToWhenReady(const char *name, void *args);
+
+/**
+ * @brief Asks for a state change to happen at the start of the next SM_Update.
+ *
+ * Unlike SM_ChangeStateTo, nothing runs now, so it is safe to call from a
+ * state's own callbacks. Can be called from any thread without locking, as
+ * long as no state is being registered at the same time. Changes posted while
+ * SM_Update applies the others wait for the next one.
+ *
+ * @param name The name of the state to change to.
+ * @param args Optional arguments for the state's enter function. Not used if
+ * the change is coalesced away.
+ * @return true if posted, false if the state was not found, the queue is full
+ * or the machine is not initialized.
+ * @author Vitor Betmann
+ */
+bool SM_PostStateChange(const char *name, void *args);
+
+/**
+ * @brief Asks for a state change by handle. Same as SM_PostStateChange.
+ *
+ * @param handle Handle returned by SM_RegisterState or SM_GetStateHandle.
+ * @param args   Optional arguments for the state's enter function.
+ * @return true if posted, false if the handle is invalid, the queue is full or
+ * the machine is not initialized.
+ * @author Vitor Betmann
+ */
+bool SM_PostStateChangeHandle(StateHandle handle, void *args);
+
+/**
+ * @brief Sets which posted state changes SM_Update applies.
+ *
+ * @param mode COALESCE_LAST, COALESCE_FIRST or COALESCE_NONE.
+ * @return true if set, false if the machine is not initialized.
+ * @author Vitor Betmann
+ */
+bool SM_SetPostCoalescing(CoalesceMode mode);
+
+/**
+ * @brief Declares that `event` moves the machine from one state to another.
+ *
+ * Transitions are kept in a dense table indexed by state and event, so
+ * SM_Dispatch finds one with a single lookup. Event IDs index that table:
+ * keep them small and contiguous, like the values of an enum. Works with
+ * static tables too.
+ *
+ * @param from  The name of the state the event applies to.
+ * @param event The event, 0 or more.
+ * @param to    The name of the state to change to.
+ * @return true if registered, false if a state was not found, `from` already
+ * has a transition for `event`, memory allocation failed or the machine is
+ * not initialized.
+ * @author Vitor Betmann
+ */
+bool SM_RegisterTransition(const char *from, int event, const char *to);
+
+/**
+ * @brief Same as SM_RegisterTransition, with a guard that can refuse it.
+ *
+ * @param from    The name of the state the event applies to.
+ * @param event   The event, 0 or more.
+ * @param to      The name of the state to change to.
+ * @param guardFn Called with the args given to SM_Dispatch. The transition
+ * only happens if it returns true.
+ * @return true if registered, false otherwise. See SM_RegisterTransition.
+ * @author Vitor Betmann
+ */
+bool SM_RegisterGuardedTransition(const char *from, int event, const char *to,
+                                  bool (*guardFn)(void *args));
+
+/**
+ * @brief Runs the current state's transition for an event, if it has one.
+ *
+ * Changes state like SM_ChangeStateToHandle. Events the current state has no
+ * transition for are ignored, without a warning, since most states only
+ * handle a few.
+ *
+ * @param event The event.
+ * @param args  Passed to the guard, then to the new state's enter function.
+ * @return true if the state changed, false if there was no transition, its
+ * guard refused it or the machine is not initialized.
+ * @author Vitor Betmann
+ */
+bool SM_Dispatch(int event, void *args);
+
 /**
  * @brief Calls the update function of the current active state.
  *
- * If no update function is defined or if the machine is not initialized,
- * returns false.
+ * A state SM_ChangeStateToWhenReady is waiting for is changed to as soon as
+ * it's ready, then state changes posted since the last call are applied. The
+ * state's parents are updated before it, outermost first. States under it on
+ * the stack are updated before all of them, for as long as each state above
+ * them has SM_UPDATE_BELOW. Parents shared by stacked states are updated once,
+ * with the lowest of them. If neither the state nor any of its parents has an
+ * update function, or the machine is not initialized, returns false.
  *
  * @param dt Delta time since last update.
  * @return true if update was successful, false otherwise.
@@ -93,19 +611,119 @@ bool SM_Update(float dt);
 /**
  * @brief Calls the draw function of the current active state.
  *
- * If no draw function is defined or if the machine is not initialized, returns
- * false.
+ * The state's parents are drawn before it, outermost first, so it draws on
+ * top of them. States under it on the stack are drawn before all of them, for
+ * as long as each state above them has SM_DRAW_BELOW. Parents shared by
+ * stacked states are drawn once, under the lowest of them. If neither the
+ * state nor any of its parents has a draw function, or the machine is not
+ * initialized, returns false.
  *
  * @return true if draw was successful, false otherwise.
  * @author Vitor Betmann
  */
 bool SM_Draw(void);
 
+/**
+ * @brief Allocates temporary memory for the current frame.
+ *
+ * Allocating is a pointer bump in one of two arenas the state machine owns.
+ * At the start of each SM_Update, the arenas swap and the one about to be
+ * used is emptied, so memory allocated in a frame stays valid through the
+ * next SM_Update and SM_Draw, then is reused. Never free it. Must be called
+ * from the thread calling SM_Update, not from SM_UpdateAllParallel.
+ *
+ * @param size Number of bytes to allocate.
+ * @return Memory aligned for any type, or NULL if the machine is not
+ * initialized, `size` is 0, or memory ran out.
+ * @author Vitor Betmann
+ */
+void *SM_FrameAlloc(size_t size);
+
+/**
+ * @brief Runs the game loop: fixed-step updates, paced draws, and sleeping in
+ * between.
+ *
+ * Real time is added up and spent in steps of exactly 1 / updateRate through
+ * SM_Update, so the game behaves the same at any frame rate. Draws happen
+ * through SM_Draw, at most drawRate times a second; while one runs,
+ * SM_GetInterpolationAlpha says how far it is between the last update and
+ * the next. Between them, the loop sleeps until the next update or draw is
+ * due instead of spinning. Returns once SM_StopRun is called, `shouldStop`
+ * returns true, `maxUpdates` updates ran, or there's no current state left.
+ *
+ * @param config How to pace the loop, or NULL for the defaults.
+ * @return true once the loop stopped, false if the machine is not initialized,
+ * has no current state, is already running, or `config` has a negative rate.
+ * @author Vitor Betmann
+ */
+bool SM_Run(const RunConfig *config);
+
+/**
+ * @brief Makes SM_Run return after the update or draw that's running.
+ *
+ * @return true if SM_Run was running, false otherwise.
+ * @author Vitor Betmann
+ */
+bool SM_StopRun(void);
+
+/**
+ * @brief Gets how far the frame being drawn is between two updates.
+ *
+ * Draw states at `previous + (current - previous) * alpha` to keep motion
+ * smooth when draws and updates don't line up.
+ *
+ * @return A value in [0, 1) while SM_Run is drawing, 0 otherwise.
+ * @author Vitor Betmann
+ */
+float SM_GetInterpolationAlpha(void);
+
+/**
+ * @brief Gets the frame times and counts of the latest SM_Run.
+ *
+ * Can be called while it runs (e.g. from a debug overlay) or after it
+ * returned. Reset when SM_Run starts.
+ *
+ * @param stats Where to write them.
+ * @return true if written, false if `stats` is NULL.
+ * @author Vitor Betmann
+ */
+bool SM_GetRunStats(RunStats *stats);
+
+/**
+ * @brief Gets how often and how long a state's enter, update, draw and exit
+ * functions ran.
+ *
+ * Only recorded when SMILE is compiled with SMILE_STATS; otherwise the calls
+ * aren't timed at all and this returns false. Covers every call made on the
+ * main thread, for the main machine and for instances alike, including those
+ * made as a parent. Calls made by SM_UpdateAll and SM_UpdateAllParallel are
+ * not counted.
+ *
+ * @param name  The name of the state.
+ * @param stats Where to write them.
+ * @return true if written, false if SMILE was compiled without SMILE_STATS,
+ * `stats` is NULL, the state was not found or the machine is not initialized.
+ * @author Vitor Betmann
+ */
+bool SM_GetStats(const char *name, StateStats *stats);
+
+/**
+ * @brief Clears the timings of every state, e.g. once loading is over.
+ *
+ * @return true if cleared, false if SMILE was compiled without SMILE_STATS or
+ * the machine is not initialized.
+ * @author Vitor Betmann
+ */
+bool SM_ResetStats(void);
+
 /**
  * @brief Shuts down the state machine and frees all internal memory.
  *
- * Calls the exit function of the current state (if defined) before cleanup.
- * After shutdown, all registered states are discarded and the tracker is reset.
+ * Calls the exit function of the current state (if defined) before cleanup,
+ * then those of the states under it on the stack, top to bottom. Posted
+ * state changes not applied yet are dropped. Waits for a preload function
+ * that is running, and drops the ones that haven't started. After shutdown,
+ * all registered states are discarded and the tracker is reset.
  *
  * @return true if shutdown succeeded, false if the machine was not initialized.
  * @author Vitor Betmann
@@ -121,4 +739,224 @@ bool SM_Shutdown(void);
  */
 const char *SM_GetCurrStateName(void);
 
+/**
+ * @brief Creates a new state machine instance.
+ *
+ * The instance starts with no current state and uses the states registered
+ * with SM_RegisterState. The functions that take no machine keep driving the
+ * main machine created by SM_Init.
+ *
+ * @param userData Pointer handed back by SM_GetUserData, e.g. the entity the
+ * machine belongs to (can be NULL).
+ * @return The new machine, or NULL if the state machine is uninitialized or
+ * memory allocation failed.
+ * @author Vitor Betmann
+ */
+StateMachine *SM_Create(void *userData);
+
+/**
+ * @brief Destroys a state machine instance.
+ *
+ * Calls the exit function of its current state (if any) before freeing it.
+ * Destroy instances before SM_Shutdown, since their exit functions are lost
+ * with the registered states.
+ * During SM_UpdateAll, the instance is only exited and freed once every
+ * state has been updated. Until then, destroying it again does nothing and
+ * changing its state fails.
+ *
+ * @param sm The machine to destroy.
+ * @return true if destroyed or already queued for destroy, false if `sm` is
+ * NULL or memory ran out while queuing it.
+ * @author Vitor Betmann
+ */
+bool SM_Destroy(StateMachine *sm);
+
+/**
+ * @brief Switches an instance to a different state by name.
+ *
+ * Same as SM_ChangeStateTo, for the given machine.
+ *
+ * @param sm   The machine to change.
+ * @param name The name of the state to switch to.
+ * @param args Optional arguments to pass to the new state's enter function.
+ * @return true if the state change succeeded, false otherwise.
+ * @author Vitor Betmann
+ */
+bool SM_MachineChangeStateTo(StateMachine *sm, const char *name, void *args);
+
+/**
+ * @brief Switches an instance to a different state by handle.
+ *
+ * Same as SM_ChangeStateToHandle, for the given machine.
+ *
+ * @param sm     The machine to change.
+ * @param handle Handle returned by SM_RegisterState or SM_GetStateHandle.
+ * @param args   Optional arguments to pass to the new state's enter function.
+ * @return true if the state change succeeded, false otherwise.
+ * @author Vitor Betmann
+ */
+bool SM_MachineChangeStateToHandle(StateMachine *sm, StateHandle handle,
+                                   void *args);
+
+/**
+ * @brief Runs an instance's transition for an event, if it has one.
+ *
+ * Same as SM_Dispatch, for the given machine. SM_GetActiveMachine returns
+ * `sm` while the guard runs.
+ *
+ * @param sm    The machine.
+ * @param event The event.
+ * @param args  Passed to the guard, then to the new state's enter function.
+ * @return true if the state changed, false otherwise.
+ * @author Vitor Betmann
+ */
+bool SM_MachineDispatch(StateMachine *sm, int event, void *args);
+
+/**
+ * @brief Calls the update function of an instance's current state.
+ *
+ * SM_GetActiveMachine returns `sm` while the update function runs.
+ *
+ * @param sm The machine to update.
+ * @param dt Delta time since last update.
+ * @return true if update was successful, false otherwise.
+ * @author Vitor Betmann
+ */
+bool SM_MachineUpdate(StateMachine *sm, float dt);
+
+/**
+ * @brief Calls the draw function of an instance's current state.
+ *
+ * SM_GetActiveMachine returns `sm` while the draw function runs.
+ *
+ * @param sm The machine to draw.
+ * @return true if draw was successful, false otherwise.
+ * @author Vitor Betmann
+ */
+bool SM_MachineDraw(StateMachine *sm);
+
+/**
+ * @brief Gets the handle of an instance's current state.
+ *
+ * @param sm The machine.
+ * @return The current state's handle, or SM_INVALID_STATE if no state is
+ * active or `sm` is NULL.
+ * @author Vitor Betmann
+ */
+StateHandle SM_MachineGetCurrState(const StateMachine *sm);
+
+/**
+ * @brief Gets the name of an instance's current state.
+ *
+ * @param sm The machine.
+ * @return The name of the current state, or NULL if no state is active, `sm`
+ * is NULL or the state machine is uninitialized.
+ * @author Vitor Betmann
+ */
+const char *SM_MachineGetCurrStateName(const StateMachine *sm);
+
+/**
+ * @brief Gets the user data pointer of an instance.
+ *
+ * @param sm The machine.
+ * @return The pointer given to SM_Create or SM_SetUserData, or NULL if `sm` is
+ * NULL.
+ * @author Vitor Betmann
+ */
+void *SM_GetUserData(const StateMachine *sm);
+
+/**
+ * @brief Replaces the user data pointer of an instance.
+ *
+ * @param sm       The machine.
+ * @param userData The new pointer (can be NULL).
+ * @author Vitor Betmann
+ */
+void SM_SetUserData(StateMachine *sm, void *userData);
+
+/**
+ * @brief Gives a state a function that updates all of its instances at once.
+ *
+ * SM_UpdateAll then calls it once per frame with the user data of every
+ * instance in the state, packed in one array, instead of calling the state's
+ * update function once per instance. Instances are grouped by state as they
+ * change state, so nothing is sorted per frame.
+ *
+ * @param name          The name of the state.
+ * @param updateBatchFn Receives the delta time, the user data of the
+ * instances in the state and their count. NULL goes back to calling the
+ * update function per instance.
+ * @return true if set, false if the state isn't registered or the machine is
+ * uninitialized.
+ * @author Vitor Betmann
+ */
+bool SM_SetStateBatchUpdate(const char *name,
+                            void (*updateBatchFn)(float dt, void **entities,
+                                                  int count));
+
+/**
+ * @brief Updates every instance created with SM_Create.
+ *
+ * Goes state by state: states with a batch update function get one call for
+ * all their instances, the others get their update function called per
+ * instance. Update functions of parent states are called per instance, before
+ * either. The main machine is not included, update it with SM_Update.
+ *
+ * Instances that change state or are destroyed while this runs keep their
+ * current state until every state has been updated. The changes then happen
+ * in the order they were requested, so each instance is updated exactly once
+ * per call. Destroyed instances are freed last, and changes requested for
+ * them after the destroy are dropped.
+ *
+ * @param dt Delta time since last update.
+ * @return true if updated, false if the machine is uninitialized or already
+ * inside SM_UpdateAll or SM_UpdateAllParallel.
+ * @author Vitor Betmann
+ */
+bool SM_UpdateAll(float dt);
+
+/**
+ * @brief Updates every instance created with SM_Create on several threads.
+ *
+ * Same as SM_UpdateAll, but states with many instances are split into slices
+ * that run on a pool of worker threads. Batch update functions get one call
+ * per slice instead of one per state. Update functions may only touch their
+ * own instance's data, since other instances are updated at the same time.
+ *
+ * State changes and destroys requested while this runs are queued and happen
+ * afterwards, in the same order SM_UpdateAll would apply them, so results
+ * don't depend on the number of threads.
+ *
+ * @param dt Delta time since last update.
+ * @return true if updated, false if the machine is uninitialized or already
+ * inside SM_UpdateAll or SM_UpdateAllParallel.
+ * @author Vitor Betmann
+ */
+bool SM_UpdateAllParallel(float dt);
+
+/**
+ * @brief Sets how many threads SM_UpdateAllParallel uses.
+ *
+ * The calling thread counts as one, so 1 runs everything on it. Defaults to
+ * the number of online CPUs. Must not be called from a state callback.
+ *
+ * @param count Number of threads. 0 or less picks the number of online CPUs.
+ * @return The number of threads that will be used.
+ * @author Vitor Betmann
+ */
+int SM_SetThreadCount(int count);
+
+/**
+ * @brief Gets the instance whose lifecycle function is running.
+ *
+ * State callbacks don't receive the machine they run for. Call this from
+ * inside one to reach it, then SM_GetUserData to reach its entity.
+ *
+ * @return The machine being entered, updated, drawn or exited on this
+ * thread, or NULL outside of an instance's callback (including the main
+ * machine's and batch update functions, which run for many instances).
+ * @author Vitor Betmann
+ */
+StateMachine *SM_GetActiveMachine(void);
+
 #endif
\ No newline at end of file
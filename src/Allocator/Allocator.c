@@ -0,0 +1,158 @@
+// --------------------------------------------------
+// Includes
+// --------------------------------------------------
+#include "Allocator.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define AL_HAS_MMAP
+#endif
+
+// --------------------------------------------------
+// Prototypes
+// --------------------------------------------------
+static void *DefaultAlloc(size_t size, size_t alignment, void *userData);
+static void DefaultFree(void *ptr, size_t size, void *userData);
+
+// --------------------------------------------------
+// Variables
+// --------------------------------------------------
+static const Allocator defaultAllocator = {
+    .alloc = DefaultAlloc,
+    .free = DefaultFree,
+    .userData = NULL,
+};
+static Allocator currAllocator = {
+    .alloc = DefaultAlloc,
+    .free = DefaultFree,
+    .userData = NULL,
+};
+static bool hugePagesEnabled = true;
+
+// --------------------------------------------------
+// Functions
+// --------------------------------------------------
+
+bool AL_SetAllocator(const Allocator *allocator) {
+
+  if (!allocator) {
+    currAllocator = defaultAllocator;
+    return true;
+  }
+
+  if (!allocator->alloc || !allocator->free) {
+    return false;
+  }
+
+  currAllocator = *allocator;
+  return true;
+}
+
+void AL_EnableHugePages(bool toggle) { hugePagesEnabled = toggle; }
+
+void *AL_Alloc(size_t size, size_t alignment) {
+
+  if (size == 0 || alignment & (alignment - 1)) {
+    return NULL;
+  }
+
+  if (alignment < sizeof(void *)) {
+    alignment = sizeof(void *);
+  }
+
+  return currAllocator.alloc(size, alignment, currAllocator.userData);
+}
+
+void AL_Free(void *ptr, size_t size) {
+
+  if (!ptr) {
+    return;
+  }
+
+  currAllocator.free(ptr, size, currAllocator.userData);
+}
+
+// --------------------------------------------------
+// Functions - Default allocator
+// --------------------------------------------------
+
+static size_t RoundUp(size_t size, size_t multiple) {
+  return (size + multiple - 1) / multiple * multiple;
+}
+
+#ifdef AL_HAS_MMAP
+static void *MapPages(size_t size, size_t alignment) {
+
+#ifdef MAP_HUGETLB
+  if (hugePagesEnabled && alignment <= AL_HUGE_PAGE_SIZE) {
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED) {
+      return ptr;
+    }
+  }
+#endif
+
+  // Over-map so the block can be trimmed to any alignment above a page
+  size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+  size_t slack = alignment > pageSize ? alignment : 0;
+
+  char *base = mmap(NULL, size + slack, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    return NULL;
+  }
+
+  char *ptr = base;
+  if (slack) {
+    ptr = (char *)RoundUp((uintptr_t)base, alignment);
+    if (ptr > base) {
+      munmap(base, ptr - base);
+    }
+    if (ptr + size < base + size + slack) {
+      munmap(ptr + size, base + size + slack - (ptr + size));
+    }
+  }
+
+#ifdef MADV_HUGEPAGE
+  if (hugePagesEnabled) {
+    madvise(ptr, size, MADV_HUGEPAGE);
+  }
+#endif
+
+  return ptr;
+}
+#endif
+
+static void *DefaultAlloc(size_t size, size_t alignment, void *userData) {
+
+  (void)userData;
+
+#ifdef AL_HAS_MMAP
+  if (size >= AL_HUGE_PAGE_SIZE) {
+    return MapPages(RoundUp(size, AL_HUGE_PAGE_SIZE), alignment);
+  }
+#endif
+
+  // aligned_alloc wants the size to be a multiple of the alignment
+  return aligned_alloc(alignment, RoundUp(size, alignment));
+}
+
+static void DefaultFree(void *ptr, size_t size, void *userData) {
+
+  // Only needed to unmap pages
+  (void)size;
+  (void)userData;
+
+#ifdef AL_HAS_MMAP
+  if (size >= AL_HUGE_PAGE_SIZE) {
+    munmap(ptr, RoundUp(size, AL_HUGE_PAGE_SIZE));
+    return;
+  }
+#endif
+
+  free(ptr);
+}
@@ -0,0 +1,449 @@
+// --------------------------------------------------
+// Includes
+// --------------------------------------------------
+#include "Logger.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+#define CACHE_LINE 64
+#define RING_MASK (LG_RING_SIZE - 1)
+#define SITE_MASK (LG_SITE_COUNT - 1)
+
+static_assert((LG_RING_SIZE & RING_MASK) == 0,
+              "LG_RING_SIZE must be a power of two");
+static_assert((LG_SITE_COUNT & SITE_MASK) == 0,
+              "LG_SITE_COUNT must be a power of two");
+
+#define DEFAULT_RATE_COUNT 10
+#define DEFAULT_RATE_PERIOD_MS 1000
+
+// A message repeated for this long is reported even if it keeps repeating
+#define REPEAT_REPORT_MS 1000
+
+// Wakeups can be missed, since logging threads signal without the lock, so
+// the logger thread never sleeps longer than this
+#define IDLE_WAIT_MS 100
+
+// --------------------------------------------------
+// Data types
+// --------------------------------------------------
+
+/**
+ * @brief One slot of the ring, same protocol as the state machine's post
+ * queue: `sequence` equal to a position means free for the thread logging
+ * at that position, one past it means that message is ready, a lap later
+ * means it was written out.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  atomic_uint sequence;
+  LogLevel level;
+  int suppressed;
+  char text[LG_MESSAGE_SIZE];
+} LogCell;
+
+/**
+ * @brief Rate limiting state of one call site, claimed by its format string.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  _Atomic(const char *) format;
+  atomic_llong periodStart;
+  atomic_int count;
+  atomic_int suppressed;
+} LogSite;
+
+typedef enum {
+  LOGGER_IDLE,
+  LOGGER_RUNNING,
+  LOGGER_STOPPED,
+} LoggerState;
+
+// --------------------------------------------------
+// Prototypes
+// --------------------------------------------------
+static bool StartLogger(void);
+static void StopLogger(void);
+static void *LoggerMain(void *arg);
+static void DrainRing(void);
+static void WriteMessage(LogLevel level, const char *text, int suppressed);
+static void ReportRepeats(void);
+static void Write(LogLevel level, const char *text);
+static bool RateLimited(const char *format, int *suppressed);
+static LogSite *SiteOf(const char *format);
+static void StderrSink(LogLevel level, const char *message, void *userData);
+static long long NowMs(void);
+
+// --------------------------------------------------
+// Variables
+// --------------------------------------------------
+static atomic_int minLevel = LOG_INFO;
+static atomic_int rateCount = DEFAULT_RATE_COUNT;
+static atomic_int ratePeriodMs = DEFAULT_RATE_PERIOD_MS;
+static atomic_long dropped;
+static LogSite sites[LG_SITE_COUNT];
+
+// Logging threads only share `tail`, and the logger thread alone owns `head`
+static _Alignas(CACHE_LINE) atomic_uint tail;
+static _Alignas(CACHE_LINE) unsigned int head;
+static LogCell cells[LG_RING_SIZE];
+
+static atomic_int state = LOGGER_IDLE;
+static pthread_mutex_t startLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t logger;
+
+static pthread_mutex_t wakeLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeLogger = PTHREAD_COND_INITIALIZER;
+static atomic_bool loggerIdle;
+static atomic_bool flushRequested;
+static atomic_uint flushTarget;
+static bool stopping;
+
+static pthread_mutex_t sinkLock = PTHREAD_MUTEX_INITIALIZER;
+static LogSink sink = StderrSink;
+static void *sinkData;
+
+// Guarded by `sinkLock`, like the sink itself
+static char lastText[LG_MESSAGE_SIZE];
+static LogLevel lastLevel = LOG_NONE;
+static int repeats;
+static long long repeatStart;
+
+// --------------------------------------------------
+// Functions
+// --------------------------------------------------
+
+bool LG_Log(LogLevel level, const char *format, ...) {
+
+  if ((int)level < atomic_load_explicit(&minLevel, memory_order_relaxed) ||
+      level >= LOG_NONE || !format) {
+    return false;
+  }
+
+  // Checked before formatting, so a flooding call site costs next to nothing
+  int suppressed = 0;
+  if (RateLimited(format, &suppressed)) {
+    return false;
+  }
+
+  va_list args;
+  va_start(args, format);
+
+  // Without a logger thread, writing on the spot beats losing the message
+  if (!StartLogger()) {
+    char text[LG_MESSAGE_SIZE];
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    pthread_mutex_lock(&sinkLock);
+    WriteMessage(level, text, suppressed);
+    pthread_mutex_unlock(&sinkLock);
+    return true;
+  }
+
+  LogCell *cell;
+  unsigned int position = atomic_load_explicit(&tail, memory_order_relaxed);
+  for (;;) {
+    cell = &cells[position & RING_MASK];
+    unsigned int sequence =
+        atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    int turn = (int)(sequence - position);
+
+    if (turn == 0) {
+      if (atomic_compare_exchange_weak_explicit(&tail, &position, position + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (turn < 0) {
+      // Full: waiting for room could stall the frame
+      va_end(args);
+      atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+      return false;
+    } else {
+      position = atomic_load_explicit(&tail, memory_order_relaxed);
+    }
+  }
+
+  cell->level = level;
+  cell->suppressed = suppressed;
+  vsnprintf(cell->text, LG_MESSAGE_SIZE, format, args);
+  va_end(args);
+  atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+
+  if (atomic_load_explicit(&loggerIdle, memory_order_relaxed)) {
+    pthread_cond_signal(&wakeLogger);
+  }
+  return true;
+}
+
+void LG_SetLevel(LogLevel level) { atomic_store(&minLevel, level); }
+
+LogLevel LG_GetLevel(void) { return atomic_load(&minLevel); }
+
+bool LG_SetRateLimit(int count, int periodMs) {
+
+  if (count > 0 && periodMs <= 0) {
+    return false;
+  }
+
+  atomic_store(&ratePeriodMs, periodMs);
+  atomic_store(&rateCount, count);
+  return true;
+}
+
+void LG_SetSink(LogSink newSink, void *userData) {
+
+  pthread_mutex_lock(&sinkLock);
+  sink = newSink ? newSink : StderrSink;
+  sinkData = userData;
+  pthread_mutex_unlock(&sinkLock);
+}
+
+void LG_Flush(void) {
+
+  // Without a logger thread, messages were written on the spot
+  if (atomic_load(&state) != LOGGER_RUNNING) {
+    pthread_mutex_lock(&sinkLock);
+    ReportRepeats();
+    pthread_mutex_unlock(&sinkLock);
+    return;
+  }
+
+  pthread_mutex_lock(&wakeLock);
+  atomic_store(&flushTarget, atomic_load(&tail));
+  atomic_store(&flushRequested, true);
+  pthread_cond_signal(&wakeLogger);
+  pthread_mutex_unlock(&wakeLock);
+
+  struct timespec pause = {.tv_nsec = 1000000};
+  while (atomic_load(&flushRequested)) {
+    nanosleep(&pause, NULL);
+  }
+}
+
+long LG_GetDroppedCount(void) { return atomic_load(&dropped); }
+
+// --------------------------------------------------
+// Functions - Helpers
+// --------------------------------------------------
+
+static bool StartLogger(void) {
+
+  int current = atomic_load_explicit(&state, memory_order_acquire);
+  if (current != LOGGER_IDLE) {
+    return current == LOGGER_RUNNING;
+  }
+
+  pthread_mutex_lock(&startLock);
+  if (atomic_load_explicit(&state, memory_order_relaxed) == LOGGER_IDLE) {
+    for (unsigned int i = 0; i < LG_RING_SIZE; i++) {
+      atomic_store_explicit(&cells[i].sequence, i, memory_order_relaxed);
+    }
+
+    // Messages logged right before exiting still get written out
+    bool started = !pthread_create(&logger, NULL, LoggerMain, NULL) &&
+                   !atexit(StopLogger);
+    atomic_store_explicit(&state, started ? LOGGER_RUNNING : LOGGER_STOPPED,
+                          memory_order_release);
+  }
+  pthread_mutex_unlock(&startLock);
+
+  return atomic_load_explicit(&state, memory_order_acquire) == LOGGER_RUNNING;
+}
+
+static void StopLogger(void) {
+
+  pthread_mutex_lock(&wakeLock);
+  stopping = true;
+  pthread_cond_signal(&wakeLogger);
+  pthread_mutex_unlock(&wakeLock);
+
+  pthread_join(logger, NULL);
+
+  // Anything logged from here on is written on the spot
+  atomic_store(&state, LOGGER_STOPPED);
+}
+
+static void *LoggerMain(void *arg) {
+
+  (void)arg;
+
+  pthread_mutex_lock(&wakeLock);
+  for (;;) {
+    pthread_mutex_unlock(&wakeLock);
+    DrainRing();
+    pthread_mutex_lock(&wakeLock);
+
+    if (stopping) {
+      break;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += IDLE_WAIT_MS * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+
+    atomic_store(&loggerIdle, true);
+    if (atomic_load(&tail) == head && !atomic_load(&flushRequested)) {
+      pthread_cond_timedwait(&wakeLogger, &wakeLock, &deadline);
+    }
+    atomic_store(&loggerIdle, false);
+  }
+  pthread_mutex_unlock(&wakeLock);
+
+  // Whatever was logged while stopping
+  DrainRing();
+  pthread_mutex_lock(&sinkLock);
+  ReportRepeats();
+  pthread_mutex_unlock(&sinkLock);
+  return NULL;
+}
+
+static void DrainRing(void) {
+
+  pthread_mutex_lock(&sinkLock);
+  for (;;) {
+    LogCell *cell = &cells[head & RING_MASK];
+    if (atomic_load_explicit(&cell->sequence, memory_order_acquire) !=
+        head + 1) {
+      break;
+    }
+
+    WriteMessage(cell->level, cell->text, cell->suppressed);
+    atomic_store_explicit(&cell->sequence, head + LG_RING_SIZE,
+                          memory_order_release);
+    head++;
+  }
+
+  if (repeats > 0 && NowMs() - repeatStart >= REPEAT_REPORT_MS) {
+    ReportRepeats();
+  }
+
+  // A flush is done once everything logged before it was written out
+  bool flushing = atomic_load(&flushRequested) &&
+                  (int)(head - atomic_load(&flushTarget)) >= 0;
+  if (flushing) {
+    ReportRepeats();
+  }
+  pthread_mutex_unlock(&sinkLock);
+
+  if (flushing) {
+    atomic_store(&flushRequested, false);
+  }
+}
+
+static void WriteMessage(LogLevel level, const char *text, int suppressed) {
+
+  // The same message over and over only adds noise, so it's counted instead
+  if (!suppressed && level == lastLevel && !strcmp(text, lastText)) {
+    if (repeats++ == 0) {
+      repeatStart = NowMs();
+    }
+    return;
+  }
+
+  ReportRepeats();
+  if (suppressed) {
+    char line[LG_MESSAGE_SIZE + 48];
+    snprintf(line, sizeof(line), "%s (%d similar messages suppressed)", text,
+             suppressed);
+    Write(level, line);
+  } else {
+    Write(level, text);
+  }
+
+  lastLevel = level;
+  snprintf(lastText, sizeof(lastText), "%s", text);
+}
+
+static void ReportRepeats(void) {
+
+  if (repeats == 0) {
+    return;
+  }
+
+  char line[64];
+  snprintf(line, sizeof(line), "Last message repeated %d more time%s",
+           repeats, repeats == 1 ? "" : "s");
+  repeats = 0;
+  Write(lastLevel, line);
+}
+
+static void Write(LogLevel level, const char *text) {
+  sink(level, text, sinkData);
+}
+
+static bool RateLimited(const char *format, int *suppressed) {
+
+  int limit = atomic_load_explicit(&rateCount, memory_order_relaxed);
+  LogSite *site = limit > 0 ? SiteOf(format) : NULL;
+  if (!site) {
+    return false;
+  }
+
+  // Whichever thread sees the period is over starts the next one
+  long long now = NowMs();
+  long long start =
+      atomic_load_explicit(&site->periodStart, memory_order_relaxed);
+  if (now - start >= atomic_load(&ratePeriodMs) &&
+      atomic_compare_exchange_strong(&site->periodStart, &start, now)) {
+    atomic_store(&site->count, 0);
+  }
+
+  if (atomic_fetch_add(&site->count, 1) >= limit) {
+    atomic_fetch_add(&site->suppressed, 1);
+    return true;
+  }
+
+  *suppressed = atomic_exchange(&site->suppressed, 0);
+  return false;
+}
+
+static LogSite *SiteOf(const char *format) {
+
+  // Formats are string literals, so their address tells call sites apart
+  uintptr_t hash = (uintptr_t)format * 2654435761u;
+  for (int i = 0; i < LG_SITE_COUNT; i++) {
+    LogSite *site = &sites[((hash >> 4) + i) & SITE_MASK];
+    const char *owner =
+        atomic_load_explicit(&site->format, memory_order_acquire);
+    if (!owner && atomic_compare_exchange_strong(&site->format, &owner,
+                                                 format)) {
+      return site;
+    }
+    if (owner == format) {
+      return site;
+    }
+  }
+  return NULL;
+}
+
+static void StderrSink(LogLevel level, const char *message, void *userData) {
+
+  (void)userData;
+
+  static const char *PREFIXES[] = {
+      [LOG_DEBUG] = "\033[36m[SMILE DEBUG]\033[0m",
+      [LOG_INFO] = "\033[32m[SMILE INFO]\033[0m",
+      [LOG_WARNING] = "\033[33m[SMILE WARNING]\033[0m",
+      [LOG_ERROR] = "\033[31m[SMILE ERROR]\033[0m",
+  };
+  fprintf(stderr, "%s %s\n", PREFIXES[level], message);
+}
+
+static long long NowMs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
@@ -2,48 +2,105 @@
 // Includes
 // --------------------------------------------------
 #include "ParticleSystem.h"
+#include "Allocator.h"
+#include "ParticleSystemInternal.h"
+#include "Profiler.h"
 #include "raylib.h"
 #include "stdio.h"
+#include <assert.h>
+#include <math.h>
 #include <raymath.h>
 #include <stdlib.h>
+#include <string.h>
+
 // --------------------------------------------------
-// Data types
+// Defines
 // --------------------------------------------------
 
-typedef struct {
-  Vector2 pos;
-  float dx, dy;
-  Vector2 size;
-  float lifeTime, initialLifeTime;
-  float linearAccelerationX, linearAccelerationY;
-  float spawnDistanceX, spawnDistanceY;
-  Texture2D *texture;
-  Color initialColor, currColor, finalColor;
-  Color colorDelta;
-} Particle;
-
-struct ParticleSystem {
-  Vector2 pos;
-  Vector2 particleSize;
-  Texture2D *texture;
-  int particleCount;
-  Particle *particles;
-  float minLifetime, maxLifetime, elapsedTime;
-  int minLinearAccelerationX, maxLinearAccelerationX;
-  int minLinearAccelerationY, maxLinearAccelerationY;
-  unsigned int maxSpawnDistanceX, maxSpawnDistanceY;
-  Distribution distribution;
-  int uniformCols;
-  bool canEmit, shouldDestroy;
-  Color initialColor, finalColor, colorDelta;
-};
+// Uniform draws per emitted particle: lifetime, acceleration x and y, depth,
+// then up to four for the spawn shape
+#define EMIT_UNIFORMS 8
+
+/*
+ * Generates one update kernel per feature combination. `features` is a
+ * constant in every expansion, so the compiler drops the blocks a kernel does
+ * not need and the loop body is branch-free.
+ */
+#define PS_DEFINE_KERNEL(features)                                             \
+  static int ParticleUpdate_##features(Particle *particles, int count,         \
+                                       float dt) {                             \
+    return UpdateParticles(particles, count, dt, features);                    \
+  }
 
 // --------------------------------------------------
 // Prototypes
 // --------------------------------------------------
-void ParticleUpdate(Particle *p, float dt);
 void PS_Draw(ParticleSystem *ps);
-void ParticleDraw(Particle *p);
+void ParticleDraw(ParticleSystem *ps, Particle *p);
+static inline bool HasShape(const ParticleSystem *ps);
+static int ShapeUniforms(const ParticleSystem *ps);
+static void RemoveDeadParticles(ParticleSystem *ps);
+
+// --------------------------------------------------
+// Variables
+// --------------------------------------------------
+
+// Empty blocks shared by every system, linked through their first bytes
+static void *pooledBlocks;
+static int pooledBlockCount;
+static int poolLimit = PS_DEFAULT_POOL_LIMIT;
+
+// --------------------------------------------------
+// Kernels
+// --------------------------------------------------
+
+static inline int UpdateParticles(Particle *particles, int count, float dt,
+                                  const unsigned features) {
+
+  int dead = 0;
+  for (int i = 0; i < count; i++) {
+    Particle *p = &particles[i];
+
+    // Update pos
+    if (features & PS_FEATURE_MOTION) {
+      p->pos.x += p->linearAccelerationX * dt;
+      p->pos.y += p->linearAccelerationY * dt;
+    }
+
+    // Update lifetime. Dead particles are removed after the kernel runs.
+    p->lifeTime -= dt;
+    dead += p->lifeTime <= 0;
+
+    // Update color
+    if (features & PS_FEATURE_COLOR_FADE) {
+      float lifeTime = p->lifeTime > 0 ? p->lifeTime : 0;
+      float ratio = p->initialLifeTime > 0 ? lifeTime / p->initialLifeTime : 0;
+
+      // LERP the hell out of it
+      p->currColor.r = Lerp(p->finalColor.r, p->initialColor.r, ratio);
+      p->currColor.g = Lerp(p->finalColor.g, p->initialColor.g, ratio);
+      p->currColor.b = Lerp(p->finalColor.b, p->initialColor.b, ratio);
+      p->currColor.a = Lerp(p->finalColor.a, p->initialColor.a, ratio);
+    }
+  }
+
+  return dead;
+}
+
+PS_DEFINE_KERNEL(0)
+PS_DEFINE_KERNEL(1)
+PS_DEFINE_KERNEL(2)
+PS_DEFINE_KERNEL(3)
+
+static_assert(PS_FEATURE_COMBINATIONS == 4,
+              "Define a kernel for every feature combination.");
+
+static const ParticleKernel kernels[PS_FEATURE_COMBINATIONS] = {
+    ParticleUpdate_0,
+    ParticleUpdate_1,
+    ParticleUpdate_2,
+    ParticleUpdate_3,
+};
 
 // --------------------------------------------------
 // Functions
@@ -51,18 +108,15 @@ void ParticleDraw(Particle *p);
 ParticleSystem *newParticleSystem(Texture2D *texture, int particleCount,
                                   Vector2 pos) {
 
-  ParticleSystem *ps = calloc(1, sizeof(ParticleSystem));
+  ParticleSystem *ps = AL_Alloc(sizeof(ParticleSystem), AL_CACHE_LINE);
   if (!ps) {
     return NULL;
   }
+  memset(ps, 0, sizeof(ParticleSystem));
 
   ps->texture = texture;
 
   ps->particleCount = particleCount;
-  ps->particles = calloc(ps->particleCount, sizeof(Particle));
-  if (!ps->particles) {
-    return NULL;
-  }
 
   ps->pos = pos;
 
@@ -70,9 +124,17 @@ ParticleSystem *newParticleSystem(Texture2D *texture, int particleCount,
 
   ps->distribution = UNIFORM;
 
+  // Seeded through raylib so SetRandomSeed still makes runs repeatable
+  PS_Internal_SeedRng(&ps->rng,
+                      (unsigned long long)GetRandomValue(0, 0xFFFF) << 16 |
+                          GetRandomValue(0, 0xFFFF));
+
   ps->initialColor = (Color){255, 0, 0, 255};
   ps->finalColor = (Color){0, 255, 0, 255};
 
+  PS_Internal_RefreshFeatures(ps);
+  ps->update = PS_Internal_GetKernel(ps->features);
+
   return ps;
 }
 
@@ -89,14 +151,16 @@ void PS_SetLinearAcceleration(ParticleSystem *ps, float xMin, float yMin,
   ps->minLinearAccelerationY = yMin;
   ps->maxLinearAccelerationX = xMax;
   ps->maxLinearAccelerationY = yMax;
+
+  PS_Internal_RefreshFeatures(ps);
 }
 
 void PS_SetEmissionArea(ParticleSystem *ps, Distribution dist, float dx,
                         float dy) {
 
   ps->distribution = dist;
-  ps->maxSpawnDistanceX = dx;
-  ps->maxSpawnDistanceY = dy;
+  ps->spawnSpreadX = dx;
+  ps->spawnSpreadY = dy;
 }
 
 void PS_SetUniformDist(ParticleSystem *ps, Vector2 particleSize,
@@ -115,132 +179,363 @@ void PS_SetColors(ParticleSystem *ps, Color color1, Color color2) {
                            ps->finalColor.g - ps->initialColor.g,
                            ps->finalColor.b - ps->initialColor.b,
                            ps->finalColor.a - ps->initialColor.a};
+
+  PS_Internal_RefreshFeatures(ps);
 }
 
 void PS_Emit(ParticleSystem *ps) {
-  int uniformRows = 0, uniformCols = 0;
+  PF_ZONE("PS_Emit");
 
-  for (int i = 0; i < ps->particleCount; i++) {
-    Particle *temp = &ps->particles[i];
+  int uniformRows = 0, uniformCols = 0;
+  int first = ps->liveCount;
+  int count = PS_Internal_ReserveParticles(ps, ps->particleCount);
+
+  // Random numbers are drawn a chunk at a time, one array per attribute
+  float uniforms[EMIT_UNIFORMS * PS_EMIT_CHUNK];
+  float normals[2 * PS_EMIT_CHUNK];
+  unsigned shapeValues[PS_EMIT_CHUNK];
+
+  float lifetimeRange = ps->maxLifetime - ps->minLifetime;
+  float accelerationRangeX =
+      ps->maxLinearAccelerationX - ps->minLinearAccelerationX;
+  float accelerationRangeY =
+      ps->maxLinearAccelerationY - ps->minLinearAccelerationY;
+  float depthRange = ps->maxDepth - ps->minDepth;
+
+  for (int start = 0; start < count; start += PS_EMIT_CHUNK) {
+    int n = count - start < PS_EMIT_CHUNK ? count - start : PS_EMIT_CHUNK;
+    const float *uLifetime = uniforms, *uAccelerationX = uniforms + n,
+                *uAccelerationY = uniforms + 2 * n, *uDepth = uniforms + 3 * n,
+                *uShape0 = uniforms + 4 * n, *uShape1 = uniforms + 5 * n,
+                *uShape2 = uniforms + 6 * n, *uShape3 = uniforms + 7 * n;
+
+    PS_Internal_FillUniform(&ps->rng, uniforms, (4 + ShapeUniforms(ps)) * n);
+    if (ps->distribution == NORMAL) {
+      PS_Internal_FillNormal(&ps->rng, normals, 2 * n);
+    }
 
-    // Texture
-    temp->texture = ps->texture;
+    // Alias lookups land anywhere in the table. Doing them in a tight loop of
+    // their own lets the CPU overlap the cache misses.
+    if ((ps->distribution == IMAGE_MASK || ps->distribution == POLYLINE) &&
+        HasShape(ps)) {
+      for (int i = 0; i < n; i++) {
+        shapeValues[i] = PS_Internal_SampleAlias(
+            ps->shape.table, ps->shape.count, uShape0[i], uShape1[i]);
+      }
+    }
 
-    // Size
-    temp->size = ps->particleSize;
+    for (int i = 0; i < n; i++) {
+      Particle *temp = PS_Internal_GetParticle(ps, first + start + i);
 
-    // Lifetime
-    temp->lifeTime = GetRandomValue(ps->minLifetime, ps->maxLifetime) / 1000.0f;
-    temp->initialLifeTime = temp->lifeTime;
+      // Lifetime
+      temp->lifeTime =
+          (ps->minLifetime + lifetimeRange * uLifetime[i]) / 1000.0f;
+      temp->initialLifeTime = temp->lifeTime;
 
-    switch (ps->distribution) {
-    case UNIFORM:
-      temp->pos.x = ps->pos.x + (uniformCols * temp->size.x);
-      uniformCols++;
-      if (uniformCols == ps->uniformCols) {
-        uniformCols = 0;
-        uniformRows++;
-      }
-      temp->pos.y = ps->pos.y + (uniformRows * temp->size.y);
-      break;
-    case NORMAL:
       // Position
-      temp->pos.x = GetRandomValue(0, ps->maxSpawnDistanceX);
-      temp->pos.x *= GetRandomValue(0, 1) == 0 ? 1 : -1;
-      temp->pos.x += ps->pos.x;
+      switch (ps->distribution) {
+      case UNIFORM:
+        temp->pos.x = ps->pos.x + (uniformCols * ps->particleSize.x);
+        uniformCols++;
+        if (uniformCols == ps->uniformCols) {
+          uniformCols = 0;
+          uniformRows++;
+        }
+        temp->pos.y = ps->pos.y + (uniformRows * ps->particleSize.y);
+        break;
+      case NORMAL:
+        temp->pos.x = ps->pos.x + ps->spawnSpreadX * normals[i];
+        temp->pos.y = ps->pos.y + ps->spawnSpreadY * normals[n + i];
+        break;
+      case DISK: {
+        // sqrt keeps the density even, otherwise particles bunch at the center
+        float radius = sqrtf(uShape0[i]);
+        float angle = 2.0f * PI * uShape1[i];
+        temp->pos.x = ps->pos.x + ps->spawnSpreadX * radius * cosf(angle);
+        temp->pos.y = ps->pos.y + ps->spawnSpreadY * radius * sinf(angle);
+        break;
+      }
+      case CIRCLE: {
+        float angle = 2.0f * PI * uShape0[i];
+        temp->pos.x = ps->pos.x + ps->spawnSpreadX * cosf(angle);
+        temp->pos.y = ps->pos.y + ps->spawnSpreadY * sinf(angle);
+        break;
+      }
+      case IMAGE_MASK: {
+        if (!HasShape(ps)) {
+          temp->pos = ps->pos;
+          break;
+        }
+        // Jitter inside the sampled pixel
+        unsigned pixel = shapeValues[i];
+        temp->pos.x = ps->pos.x + (pixel & 0xFFFF) + uShape2[i];
+        temp->pos.y = ps->pos.y + (pixel >> 16) + uShape3[i];
+        break;
+      }
+      case POLYLINE: {
+        if (!HasShape(ps)) {
+          temp->pos = ps->pos;
+          break;
+        }
+        // Slide along the sampled segment
+        unsigned segment = shapeValues[i];
+        Vector2 a = ps->shape.points[segment];
+        Vector2 b = ps->shape.points[segment + 1];
+        temp->pos.x = ps->pos.x + a.x + (b.x - a.x) * uShape2[i];
+        temp->pos.y = ps->pos.y + a.y + (b.y - a.y) * uShape2[i];
+        break;
+      }
+      }
 
-      temp->pos.y = GetRandomValue(0, ps->maxSpawnDistanceY);
-      temp->pos.y *= GetRandomValue(0, 1) == 0 ? 1 : -1;
-      temp->pos.y += ps->pos.y;
-      break;
+      // Acceleration
+      temp->linearAccelerationX =
+          ps->minLinearAccelerationX + accelerationRangeX * uAccelerationX[i];
+      temp->linearAccelerationY =
+          ps->minLinearAccelerationY + accelerationRangeY * uAccelerationY[i];
+
+      // Depth
+      temp->depth = ps->minDepth + depthRange * uDepth[i];
+
+      // Color
+      temp->initialColor = ps->initialColor;
+      temp->currColor = ps->initialColor;
+      temp->finalColor = ps->finalColor;
     }
+  }
 
-    // Velocity
-    temp->dx = temp->dy = 0.0f;
+  // Particles still in flight keep the features they were emitted with
+  ps->kernelFeatures = first ? ps->kernelFeatures | ps->features : ps->features;
+  ps->update = PS_Internal_GetKernel(ps->kernelFeatures);
 
-    // Acceleration
-    temp->linearAccelerationX =
-        GetRandomValue(ps->minLinearAccelerationX, ps->maxLinearAccelerationX);
-    temp->linearAccelerationY =
-        GetRandomValue(ps->minLinearAccelerationY, ps->maxLinearAccelerationY);
+  ps->liveCount += count;
+  ps->canEmit = ps->liveCount > 0;
 
-    // Color
-    temp->initialColor = ps->initialColor;
-    temp->currColor = ps->initialColor;
-    temp->finalColor = ps->finalColor;
-    temp->colorDelta = ps->colorDelta;
+  if (ps->sortMode != SORT_NONE) {
+    PS_Internal_TrackParticles(ps, first, count);
   }
-
-  ps->canEmit = true;
 }
 
 void PS_Update(ParticleSystem *ps, float dt) {
+  PF_ZONE("PS_Update");
 
   if (!ps || !ps->canEmit) {
     return;
   }
 
-  ps->elapsedTime += dt * 1000;
-  if (ps->elapsedTime > ps->maxLifetime) {
+  int dead = 0;
+  for (int i = 0; i < ps->blockCount; i++) {
+    int count = ps->liveCount - (i << PS_BLOCK_SHIFT);
+    dead += ps->update(ps->blocks[i],
+                       count < PS_BLOCK_SIZE ? count : PS_BLOCK_SIZE, dt);
+  }
+
+  if (dead) {
+    RemoveDeadParticles(ps);
+  }
+
+  if (ps->sortMode != SORT_NONE) {
+    PS_Internal_SortParticles(ps);
+  }
+
+  if (ps->liveCount == 0) {
     ps->canEmit = false;
     ps->shouldDestroy = true;
+  }
+}
+
+void PS_Draw(ParticleSystem *ps) {
+  PF_ZONE("PS_Draw");
+
+  if (!ps->canEmit) {
+    return;
+  }
+
+  if (ps->sortMode != SORT_NONE) {
+    for (int i = 0; i < ps->sort.count; i++) {
+      int index = ps->sort.order[i];
+      if (index >= 0) {
+        ParticleDraw(ps, PS_Internal_GetParticle(ps, index));
+      }
+    }
     return;
   }
 
-  for (int i = 0; i < ps->particleCount; i++) {
-    ParticleUpdate(&ps->particles[i], dt);
+  for (int i = 0; i < ps->liveCount; i++) {
+    ParticleDraw(ps, PS_Internal_GetParticle(ps, i));
   }
 }
 
-void ParticleUpdate(Particle *p, float dt) {
+void ParticleDraw(ParticleSystem *ps, Particle *p) {
 
-  // Update speed and pos
-  p->dx = p->linearAccelerationX;
-  p->dy = p->linearAccelerationY;
-  p->pos.x += p->dx * dt;
-  p->pos.y += p->dy * dt;
+  DrawTexture(*ps->texture, p->pos.x, p->pos.y, p->currColor);
+}
 
-  // Update color
-  p->lifeTime -= dt;
-  if (p->lifeTime < 0) {
-    p->lifeTime = 0;
-  }
+bool PS_ShouldDestroy(ParticleSystem *ps) { return ps->shouldDestroy; }
+
+int PS_GetLiveCount(ParticleSystem *ps) { return ps ? ps->liveCount : 0; }
 
-  float ratio = p->initialLifeTime > 0 ? p->lifeTime / p->initialLifeTime : 0;
+void PS_SetBlockPoolLimit(int blocks) {
 
-  // LERP the hell out of it
-  p->currColor.r = Lerp(p->finalColor.r, p->initialColor.r, ratio);
-  p->currColor.g = Lerp(p->finalColor.g, p->initialColor.g, ratio);
-  p->currColor.b = Lerp(p->finalColor.b, p->initialColor.b, ratio);
-  p->currColor.a = Lerp(p->finalColor.a, p->initialColor.a, ratio);
+  poolLimit = blocks > 0 ? blocks : 0;
+  while (pooledBlockCount > poolLimit) {
+    Particle *block = pooledBlocks;
+    pooledBlocks = *(void **)block;
+    pooledBlockCount--;
+    AL_Free(block, PS_BLOCK_SIZE * sizeof(Particle));
+  }
 }
 
-void PS_Draw(ParticleSystem *ps) {
+void PS_TrimBlockPool(void) {
 
-  if (!ps->canEmit) {
+  int limit = poolLimit;
+  PS_SetBlockPoolLimit(0);
+  poolLimit = limit;
+}
+
+void PS_Unload(ParticleSystem *ps) {
+  if (!ps) {
     return;
   }
 
-  for (int i = 0; i < ps->particleCount; i++) {
-    ParticleDraw(&ps->particles[i]);
+  for (int i = 0; i < ps->blockCount; i++) {
+    PS_Internal_ReleaseBlock(ps->blocks[i]);
   }
+  AL_Free(ps->blocks, ps->blockCapacity * sizeof(Particle *));
+  PS_Internal_FreeSort(ps);
+  PS_Internal_FreeShape(ps);
+  AL_Free(ps, sizeof(ParticleSystem));
 }
 
-void ParticleDraw(Particle *p) {
+// --------------------------------------------------
+// Functions - Internal
+// --------------------------------------------------
+
+int PS_Internal_ReserveParticles(ParticleSystem *ps, int count) {
+
+  if (count <= 0) {
+    return 0;
+  }
+
+  int needed = (ps->liveCount + count + PS_BLOCK_MASK) >> PS_BLOCK_SHIFT;
+
+  if (needed > ps->blockCapacity) {
+    int capacity = ps->blockCapacity ? ps->blockCapacity : 1;
+    while (capacity < needed) {
+      capacity *= 2;
+    }
+
+    Particle **blocks = AL_Alloc(capacity * sizeof(Particle *), sizeof(void *));
+    if (blocks) {
+      if (ps->blocks) {
+        memcpy(blocks, ps->blocks, ps->blockCount * sizeof(Particle *));
+        AL_Free(ps->blocks, ps->blockCapacity * sizeof(Particle *));
+      }
+      ps->blocks = blocks;
+      ps->blockCapacity = capacity;
+    }
+  }
+
+  while (ps->blockCount < needed && ps->blockCount < ps->blockCapacity) {
+    Particle *block = PS_Internal_AcquireBlock();
+    if (!block) {
+      break;
+    }
+    ps->blocks[ps->blockCount++] = block;
+  }
 
-  DrawTexture(*p->texture, p->pos.x, p->pos.y, p->currColor);
+  // On allocation failure, emit as many particles as fit
+  int available = (ps->blockCount << PS_BLOCK_SHIFT) - ps->liveCount;
+  return count < available ? count : available;
 }
 
-bool PS_ShouldDestroy(ParticleSystem *ps) { return ps->shouldDestroy; }
+static inline bool HasShape(const ParticleSystem *ps) {
+  return ps->shape.table && ps->shape.distribution == ps->distribution;
+}
 
-void PS_Unload(ParticleSystem *ps) {
-  if (!ps) {
+static int ShapeUniforms(const ParticleSystem *ps) {
+
+  switch (ps->distribution) {
+  case DISK:
+    return 2;
+  case CIRCLE:
+    return 1;
+  case IMAGE_MASK:
+    return HasShape(ps) ? 4 : 0;
+  case POLYLINE:
+    return HasShape(ps) ? 3 : 0;
+  default:
+    return 0;
+  }
+}
+
+static void RemoveDeadParticles(ParticleSystem *ps) {
+
+  // Swap dead particles with the last live one to keep storage packed
+  int i = 0;
+  while (i < ps->liveCount) {
+    Particle *p = PS_Internal_GetParticle(ps, i);
+    if (p->lifeTime > 0) {
+      i++;
+      continue;
+    }
+    ps->liveCount--;
+    if (ps->sortMode != SORT_NONE) {
+      PS_Internal_MoveParticle(ps, i, ps->liveCount);
+    }
+    *p = *PS_Internal_GetParticle(ps, ps->liveCount);
+  }
+
+  int needed = (ps->liveCount + PS_BLOCK_MASK) >> PS_BLOCK_SHIFT;
+  while (ps->blockCount > needed) {
+    PS_Internal_ReleaseBlock(ps->blocks[--ps->blockCount]);
+  }
+}
+
+Particle *PS_Internal_AcquireBlock(void) {
+
+  if (pooledBlocks) {
+    Particle *block = pooledBlocks;
+    pooledBlocks = *(void **)block;
+    pooledBlockCount--;
+    return block;
+  }
+
+  return AL_Alloc(PS_BLOCK_SIZE * sizeof(Particle), AL_CACHE_LINE);
+}
+
+void PS_Internal_ReleaseBlock(Particle *block) {
+
+  if (pooledBlockCount >= poolLimit) {
+    AL_Free(block, PS_BLOCK_SIZE * sizeof(Particle));
     return;
   }
 
-  if (ps->particles) {
-    free(ps->particles);
+  *(void **)block = pooledBlocks;
+  pooledBlocks = block;
+  pooledBlockCount++;
+}
+
+int PS_Internal_GetPooledBlockCount(void) { return pooledBlockCount; }
+
+ParticleKernel PS_Internal_GetKernel(unsigned features) {
+  return kernels[features & PS_FEATURE_ALL];
+}
+
+void PS_Internal_RefreshFeatures(ParticleSystem *ps) {
+
+  unsigned features = PS_FEATURE_NONE;
+
+  if (ps->minLinearAccelerationX || ps->maxLinearAccelerationX ||
+      ps->minLinearAccelerationY || ps->maxLinearAccelerationY) {
+    features |= PS_FEATURE_MOTION;
+  }
+
+  if (ps->initialColor.r != ps->finalColor.r ||
+      ps->initialColor.g != ps->finalColor.g ||
+      ps->initialColor.b != ps->finalColor.b ||
+      ps->initialColor.a != ps->finalColor.a) {
+    features |= PS_FEATURE_COLOR_FADE;
   }
 
-  free(ps);
+  ps->features = features;
 }
\ No newline at end of file
@@ -0,0 +1,420 @@
+#ifndef PARTICLE_SYSTEM_INTERNAL_H
+#define PARTICLE_SYSTEM_INTERNAL_H
+
+// --------------------------------------------------
+// Includes
+// --------------------------------------------------
+#include "ParticleSystem.h"
+#include <stddef.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+/**
+ * @brief Feature bits describing the work a particle update has to do.
+ *
+ * Each combination gets its own update kernel, generated at compile time in
+ * ParticleSystem.c. Adding a feature means adding a bit here and a block to
+ * the generic kernel body, UpdateParticles().
+ * @author Vitor Betmann
+ */
+#define PS_FEATURE_NONE 0u
+#define PS_FEATURE_MOTION (1u << 0)
+#define PS_FEATURE_COLOR_FADE (1u << 1)
+#define PS_FEATURE_ALL (PS_FEATURE_MOTION | PS_FEATURE_COLOR_FADE)
+#define PS_FEATURE_COMBINATIONS (PS_FEATURE_ALL + 1)
+
+/**
+ * @brief Number of particles per storage block. Must be a power of two so a
+ * particle index splits into block and offset with a shift and a mask.
+ * @author Vitor Betmann
+ */
+#define PS_BLOCK_SHIFT 12
+#define PS_BLOCK_SIZE (1 << PS_BLOCK_SHIFT)
+#define PS_BLOCK_MASK (PS_BLOCK_SIZE - 1)
+
+/**
+ * @brief Default number of empty blocks the shared pool keeps for reuse.
+ * @author Vitor Betmann
+ */
+#define PS_DEFAULT_POOL_LIMIT 16
+
+/**
+ * @brief Number of independent generator lanes in a ParticleRng. Batched
+ * fills step every lane at once, which the compiler turns into SIMD.
+ * @author Vitor Betmann
+ */
+#define PS_RNG_LANES 8
+
+/**
+ * @brief Number of particles PS_Emit initializes per batch of random numbers.
+ * Sized so the scratch buffers fit on the stack and stay in L1.
+ * @author Vitor Betmann
+ */
+#define PS_EMIT_CHUNK 256
+
+// --------------------------------------------------
+// Data types
+// --------------------------------------------------
+
+/**
+ * @brief Internal representation of a single particle.
+ *
+ * Only holds per-particle data. Anything shared by every particle of a system
+ * (texture, size) lives in the ParticleSystem itself.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  Vector2 pos;
+  float lifeTime, initialLifeTime;
+  float linearAccelerationX, linearAccelerationY;
+  float depth;
+  Color initialColor, currColor, finalColor;
+} Particle;
+
+/**
+ * @brief Update kernel specialized for one combination of feature bits.
+ *
+ * Returns how many of the `count` particles ran out of lifetime, so the
+ * caller only compacts storage when something actually died.
+ * @author Vitor Betmann
+ */
+typedef int (*ParticleKernel)(Particle *particles, int count, float dt);
+
+/**
+ * @brief Per-system random number generator: PS_RNG_LANES xoshiro128**
+ * generators stored lane by lane, so one step of all lanes is a vector op.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  unsigned s0[PS_RNG_LANES], s1[PS_RNG_LANES];
+  unsigned s2[PS_RNG_LANES], s3[PS_RNG_LANES];
+} ParticleRng;
+
+/**
+ * @brief One column of a Vose alias table.
+ *
+ * A uniform pick of a column returns `value` when a second uniform draw is
+ * below `threshold`, `aliasValue` otherwise. Both outcomes are stored in the
+ * entry itself, so a sample touches a single cache line.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  float threshold;
+  unsigned value, aliasValue;
+} AliasEntry;
+
+/**
+ * @brief Weighted spawn shape of a particle system.
+ *
+ * `distribution` tells which kind of shape is loaded. For IMAGE_MASK, values
+ * are pixel coordinates packed as `y << 16 | x`. For POLYLINE, values index
+ * the segment starting at `points[value]`.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  Distribution distribution;
+  AliasEntry *table;
+  int count;
+  Vector2 *points;
+  int pointCount;
+} ParticleShape;
+
+/**
+ * @brief Draw order of a particle system, kept between frames.
+ *
+ * `order` lists particle indices in draw order and `rank` is its inverse, so
+ * storage compaction can patch the order in place instead of rebuilding it.
+ * `keys` holds the sort key of each entry of `order`; the `Tmp` arrays are
+ * radix sort scratch space.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  int *order, *orderTmp, *rank;
+  unsigned *keys, *keysTmp;
+  int count, capacity;
+} ParticleSort;
+
+/**
+ * @brief Internal representation of a particle system.
+ *
+ * Live particles are packed at the front of a list of fixed-size blocks drawn
+ * from a pool shared by every system: all blocks are full except the last
+ * one. Blocks are acquired as emission grows and returned to the pool as soon
+ * as particles die out of them, so memory follows the live count.
+ * @author Vitor Betmann
+ */
+struct ParticleSystem {
+  Vector2 pos;
+  Vector2 particleSize;
+  Texture2D *texture;
+  int particleCount;
+  Particle **blocks;
+  int blockCount, blockCapacity;
+  int liveCount;
+  float minLifetime, maxLifetime;
+  int minLinearAccelerationX, maxLinearAccelerationX;
+  int minLinearAccelerationY, maxLinearAccelerationY;
+  float spawnSpreadX, spawnSpreadY;
+  Distribution distribution;
+  int uniformCols;
+  bool canEmit, shouldDestroy;
+  Color initialColor, finalColor, colorDelta;
+  unsigned features, kernelFeatures;
+  ParticleKernel update;
+  float minDepth, maxDepth;
+  SortMode sortMode;
+  ParticleSort sort;
+  ParticleRng rng;
+  ParticleShape shape;
+};
+
+// --------------------------------------------------
+// Prototypes
+// --------------------------------------------------
+
+/**
+ * @brief Returns the live particle at `index`.
+ *
+ * For internal use only. Does no bounds checking.
+ *
+ * @param ps    Particle system to read from.
+ * @param index Index in [0, liveCount).
+ * @return Particle* Pointer to the particle inside its block.
+ * @author Vitor Betmann
+ */
+static inline Particle *PS_Internal_GetParticle(const ParticleSystem *ps,
+                                                int index) {
+  return &ps->blocks[index >> PS_BLOCK_SHIFT][index & PS_BLOCK_MASK];
+}
+
+/**
+ * @brief Appends freshly emitted particles to the end of the draw order.
+ *
+ * For internal use only. New particles are drawn last until the next
+ * PS_Update sorts them into place. Disables sorting if the order can't grow.
+ *
+ * @param ps    Particle system that emitted.
+ * @param first Index of the first new particle.
+ * @param count Number of new particles.
+ * @author Vitor Betmann
+ */
+void PS_Internal_TrackParticles(ParticleSystem *ps, int first, int count);
+
+/**
+ * @brief Patches the draw order after storage compaction moved a particle.
+ *
+ * For internal use only. Called with `from == to` when the dead particle was
+ * the last one, in which case its entry is simply dropped.
+ *
+ * @param ps   Particle system being compacted.
+ * @param to   Index of the dead particle being overwritten.
+ * @param from Index of the particle moved into its place.
+ * @author Vitor Betmann
+ */
+void PS_Internal_MoveParticle(ParticleSystem *ps, int to, int from);
+
+/**
+ * @brief Brings the draw order up to date for the current sort mode.
+ *
+ * For internal use only. Drops entries of dead particles, recomputes keys and
+ * sorts, starting from last frame's order. Nearly sorted input is fixed with
+ * an insertion pass; when too much has changed, falls back to a radix sort.
+ *
+ * @param ps Particle system to sort.
+ * @author Vitor Betmann
+ */
+void PS_Internal_SortParticles(ParticleSystem *ps);
+
+/**
+ * @brief Stable LSD radix sort of 32-bit keys carrying an int payload.
+ *
+ * For internal use only. Passes where every key has the same digit are
+ * skipped. Scratch arrays must hold `count` elements.
+ *
+ * @param keys     Keys to sort, sorted in place.
+ * @param values   Payload moved along with the keys.
+ * @param keysTmp  Scratch keys.
+ * @param valuesTmp Scratch payload.
+ * @param count    Number of elements.
+ * @author Vitor Betmann
+ */
+void PS_Internal_RadixSort(unsigned *keys, int *values, unsigned *keysTmp,
+                           int *valuesTmp, int count);
+
+/**
+ * @brief Releases the draw order buffers of a system.
+ *
+ * For internal use only.
+ *
+ * @param ps Particle system whose draw order is released.
+ * @author Vitor Betmann
+ */
+void PS_Internal_FreeSort(ParticleSystem *ps);
+
+/**
+ * @brief Makes room for `count` more particles after the live ones.
+ *
+ * For internal use only. Grows the block table and takes blocks from the
+ * shared pool as needed. Does not change the live count.
+ *
+ * @param ps    Particle system to grow.
+ * @param count Number of particles to make room for.
+ * @return int How many particles fit, less than `count` if allocation failed.
+ * @author Vitor Betmann
+ */
+int PS_Internal_ReserveParticles(ParticleSystem *ps, int count);
+
+/**
+ * @brief Takes an empty block from the shared pool, allocating if it is dry.
+ *
+ * For internal use only. Blocks are allocated through AL_Alloc() aligned to
+ * AL_CACHE_LINE. At about 160 KB, they're too small for AL_Alloc() to back
+ * with huge pages.
+ *
+ * @return Particle* A block of PS_BLOCK_SIZE particles, or NULL if allocation
+ * failed.
+ * @author Vitor Betmann
+ */
+Particle *PS_Internal_AcquireBlock(void);
+
+/**
+ * @brief Gives a block back to the shared pool.
+ *
+ * For internal use only. If the pool already holds as many blocks as its
+ * limit, the block is freed instead.
+ *
+ * @param block Block previously returned by PS_Internal_AcquireBlock().
+ * @author Vitor Betmann
+ */
+void PS_Internal_ReleaseBlock(Particle *block);
+
+/**
+ * @brief Returns the number of empty blocks currently held by the pool.
+ *
+ * For internal use only.
+ *
+ * @return int Number of pooled blocks.
+ * @author Vitor Betmann
+ */
+int PS_Internal_GetPooledBlockCount(void);
+
+/**
+ * @brief Returns the update kernel generated for a set of feature bits.
+ *
+ * For internal use only. Bits outside PS_FEATURE_ALL are ignored.
+ *
+ * @param features Combination of PS_FEATURE_* bits.
+ * @return ParticleKernel The specialized kernel, never NULL.
+ * @author Vitor Betmann
+ */
+ParticleKernel PS_Internal_GetKernel(unsigned features);
+
+/**
+ * @brief Recomputes the feature bits of a system from its configuration.
+ *
+ * For internal use only. Called by every setter that changes what an update
+ * has to do. The kernel itself is only swapped at the next PS_Emit, so
+ * particles already in flight keep the kernel that matches their data.
+ *
+ * @param ps Particle system to refresh.
+ * @author Vitor Betmann
+ */
+void PS_Internal_RefreshFeatures(ParticleSystem *ps);
+
+/**
+ * @brief Builds a Vose alias table from non-negative weights.
+ *
+ * For internal use only. Runs in O(count). Entry `i` stands for `values[i]`
+ * with probability proportional to `weights[i]`.
+ *
+ * @param weights Weight of each outcome. Must sum to more than zero.
+ * @param values  Value returned for each outcome.
+ * @param count   Number of outcomes.
+ * @return AliasEntry* Table of `count` entries allocated with AL_Alloc(), or
+ * NULL on failure.
+ * @author Vitor Betmann
+ */
+AliasEntry *PS_Internal_BuildAliasTable(const float *weights,
+                                        const unsigned *values, int count);
+
+/**
+ * @brief Draws one value from an alias table in constant time.
+ *
+ * For internal use only.
+ *
+ * @param table  Table built by PS_Internal_BuildAliasTable().
+ * @param count  Number of entries in the table.
+ * @param column Uniform float in [0, 1) picking the column.
+ * @param coin   Uniform float in [0, 1) picking between value and alias.
+ * @return unsigned The sampled value.
+ * @author Vitor Betmann
+ */
+static inline unsigned PS_Internal_SampleAlias(const AliasEntry *table,
+                                               int count, float column,
+                                               float coin) {
+  int i = (int)(column * count);
+  const AliasEntry *entry = &table[i < count ? i : count - 1];
+  return coin < entry->threshold ? entry->value : entry->aliasValue;
+}
+
+/**
+ * @brief Releases the spawn shape of a system.
+ *
+ * For internal use only.
+ *
+ * @param ps Particle system whose shape is released.
+ * @author Vitor Betmann
+ */
+void PS_Internal_FreeShape(ParticleSystem *ps);
+
+/**
+ * @brief Seeds every lane of a generator from a single 64-bit seed.
+ *
+ * For internal use only. Lanes are decorrelated with splitmix64.
+ *
+ * @param rng  Generator to seed.
+ * @param seed Any value, including 0.
+ * @author Vitor Betmann
+ */
+void PS_Internal_SeedRng(ParticleRng *rng, unsigned long long seed);
+
+/**
+ * @brief Fills `out` with uniform floats in [0, 1).
+ *
+ * For internal use only. Steps all lanes together in one vectorizable loop.
+ *
+ * @param rng   Generator to draw from.
+ * @param out   Destination array.
+ * @param count Number of floats to write.
+ * @author Vitor Betmann
+ */
+void PS_Internal_FillUniform(ParticleRng *rng, float *out, int count);
+
+/**
+ * @brief Fills `out` with standard normal floats (mean 0, deviation 1).
+ *
+ * For internal use only. Uses a 128-layer ziggurat: a branch-free pass over
+ * the whole batch accepts about 99% of the samples with one table lookup,
+ * then a second pass redraws the few that fell outside their layer.
+ *
+ * @param rng   Generator to draw from.
+ * @param out   Destination array.
+ * @param count Number of floats to write.
+ * @author Vitor Betmann
+ */
+void PS_Internal_FillNormal(ParticleRng *rng, float *out, int count);
+
+/**
+ * @brief Returns one uniform float in [0, 1).
+ *
+ * For internal use only. Prefer PS_Internal_FillUniform() in loops.
+ *
+ * @param rng Generator to draw from.
+ * @return float The sample.
+ * @author Vitor Betmann
+ */
+float PS_Internal_RandomFloat(ParticleRng *rng);
+
+#endif
@@ -0,0 +1,210 @@
+// --------------------------------------------------
+// Includes
+// --------------------------------------------------
+#include "ParticleSystemInternal.h"
+#include <math.h>
+#include <stdint.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+#define ZIGGURAT_LAYERS 128
+#define ZIGGURAT_R 3.442619855899
+#define ZIGGURAT_V 9.91256303526217e-3
+
+// --------------------------------------------------
+// Variables
+// --------------------------------------------------
+
+// Ziggurat tables (Marsaglia & Tsang, 2000), built on first use
+static uint32_t zigguratK[ZIGGURAT_LAYERS];
+static float zigguratW[ZIGGURAT_LAYERS];
+static float zigguratF[ZIGGURAT_LAYERS];
+static bool zigguratReady;
+
+// --------------------------------------------------
+// Prototypes
+// --------------------------------------------------
+static void BuildZiggurat(void);
+static float NormalTail(ParticleRng *rng, int32_t hz, int iz);
+
+// --------------------------------------------------
+// Functions
+// --------------------------------------------------
+
+void PS_SetSeed(ParticleSystem *ps, unsigned long long seed) {
+  PS_Internal_SeedRng(&ps->rng, seed);
+}
+
+// --------------------------------------------------
+// Functions - Internal
+// --------------------------------------------------
+
+static inline uint32_t Rotl(uint32_t x, int k) {
+  return (x << k) | (x >> (32 - k));
+}
+
+static inline uint32_t NextLane(ParticleRng *rng, int lane) {
+
+  // xoshiro128**
+  uint32_t result = Rotl(rng->s1[lane] * 5, 7) * 9;
+  uint32_t t = rng->s1[lane] << 9;
+
+  rng->s2[lane] ^= rng->s0[lane];
+  rng->s3[lane] ^= rng->s1[lane];
+  rng->s1[lane] ^= rng->s2[lane];
+  rng->s0[lane] ^= rng->s3[lane];
+  rng->s2[lane] ^= t;
+  rng->s3[lane] = Rotl(rng->s3[lane], 11);
+
+  return result;
+}
+
+static inline float ToUnitFloat(uint32_t bits) {
+  return (bits >> 8) * 0x1.0p-24f;
+}
+
+void PS_Internal_SeedRng(ParticleRng *rng, unsigned long long seed) {
+
+  // splitmix64 spreads one seed over every lane
+  for (int lane = 0; lane < PS_RNG_LANES; lane++) {
+    uint32_t words[4];
+    for (int w = 0; w < 4; w += 2) {
+      uint64_t z = (seed += 0x9E3779B97F4A7C15ull);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+      z ^= z >> 31;
+      words[w] = (uint32_t)z;
+      words[w + 1] = (uint32_t)(z >> 32);
+    }
+    rng->s0[lane] = words[0];
+    rng->s1[lane] = words[1];
+    rng->s2[lane] = words[2];
+    rng->s3[lane] = words[3] | 1u; // Never all zero
+  }
+}
+
+void PS_Internal_FillUniform(ParticleRng *rng, float *out, int count) {
+
+  int i = 0;
+
+  // Lanes are independent, so this loop vectorizes
+  for (; i + PS_RNG_LANES <= count; i += PS_RNG_LANES) {
+    for (int lane = 0; lane < PS_RNG_LANES; lane++) {
+      out[i + lane] = ToUnitFloat(NextLane(rng, lane));
+    }
+  }
+
+  for (int lane = 0; i < count; i++, lane++) {
+    out[i] = ToUnitFloat(NextLane(rng, lane));
+  }
+}
+
+void PS_Internal_FillNormal(ParticleRng *rng, float *out, int count) {
+
+  if (!zigguratReady) {
+    BuildZiggurat();
+  }
+
+  // Fast path for every sample first: one table lookup and a compare. Roughly
+  // 1.2% of the samples land outside their layer's rectangle and are marked.
+  int32_t hz[PS_EMIT_CHUNK];
+  bool reject[PS_EMIT_CHUNK];
+
+  for (int start = 0; start < count; start += PS_EMIT_CHUNK) {
+    int n = count - start < PS_EMIT_CHUNK ? count - start : PS_EMIT_CHUNK;
+    int rejects = 0;
+
+    int i = 0;
+    for (; i + PS_RNG_LANES <= n; i += PS_RNG_LANES) {
+      for (int lane = 0; lane < PS_RNG_LANES; lane++) {
+        hz[i + lane] = (int32_t)NextLane(rng, lane);
+      }
+    }
+    for (int lane = 0; i < n; i++, lane++) {
+      hz[i] = (int32_t)NextLane(rng, lane);
+    }
+
+    for (i = 0; i < n; i++) {
+      int iz = hz[i] & (ZIGGURAT_LAYERS - 1);
+      uint32_t absHz = hz[i] < 0 ? 0u - (uint32_t)hz[i] : (uint32_t)hz[i];
+      out[start + i] = hz[i] * zigguratW[iz];
+      reject[i] = absHz >= zigguratK[iz];
+      rejects += reject[i];
+    }
+
+    // Slow path for the few rejected samples
+    for (i = 0; rejects && i < n; i++) {
+      if (reject[i]) {
+        out[start + i] =
+            NormalTail(rng, hz[i], hz[i] & (ZIGGURAT_LAYERS - 1));
+        rejects--;
+      }
+    }
+  }
+}
+
+float PS_Internal_RandomFloat(ParticleRng *rng) {
+  return ToUnitFloat(NextLane(rng, 0));
+}
+
+// --------------------------------------------------
+// Functions - Helpers
+// --------------------------------------------------
+
+static void BuildZiggurat(void) {
+
+  const double m1 = 2147483648.0;
+  double dn = ZIGGURAT_R, tn = dn;
+  double q = ZIGGURAT_V / exp(-0.5 * dn * dn);
+
+  zigguratK[0] = (uint32_t)((dn / q) * m1);
+  zigguratK[1] = 0;
+  zigguratW[0] = (float)(q / m1);
+  zigguratW[ZIGGURAT_LAYERS - 1] = (float)(dn / m1);
+  zigguratF[0] = 1.0f;
+  zigguratF[ZIGGURAT_LAYERS - 1] = (float)exp(-0.5 * dn * dn);
+
+  for (int i = ZIGGURAT_LAYERS - 2; i >= 1; i--) {
+    dn = sqrt(-2.0 * log(ZIGGURAT_V / dn + exp(-0.5 * dn * dn)));
+    zigguratK[i + 1] = (uint32_t)((dn / tn) * m1);
+    tn = dn;
+    zigguratF[i] = (float)exp(-0.5 * dn * dn);
+    zigguratW[i] = (float)(dn / m1);
+  }
+
+  zigguratReady = true;
+}
+
+static float NormalTail(ParticleRng *rng, int32_t hz, int iz) {
+
+  for (;;) {
+    float x = hz * zigguratW[iz];
+
+    // Base layer: sample the tail beyond R
+    if (iz == 0) {
+      float y;
+      do {
+        x = -logf(1.0f - PS_Internal_RandomFloat(rng)) /
+            (float)ZIGGURAT_R;
+        y = -logf(1.0f - PS_Internal_RandomFloat(rng));
+      } while (y + y < x * x);
+      return hz > 0 ? (float)ZIGGURAT_R + x : -(float)ZIGGURAT_R - x;
+    }
+
+    // Wedge: accept under the curve
+    float f = zigguratF[iz] + PS_Internal_RandomFloat(rng) *
+                                  (zigguratF[iz - 1] - zigguratF[iz]);
+    if (f < expf(-0.5f * x * x)) {
+      return x;
+    }
+
+    hz = (int32_t)NextLane(rng, 0);
+    iz = hz & (ZIGGURAT_LAYERS - 1);
+    uint32_t absHz = hz < 0 ? 0u - (uint32_t)hz : (uint32_t)hz;
+    if (absHz < zigguratK[iz]) {
+      return hz * zigguratW[iz];
+    }
+  }
+}
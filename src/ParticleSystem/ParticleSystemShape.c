@@ -0,0 +1,219 @@
+// --------------------------------------------------
+// Includes
+// --------------------------------------------------
+#include "Allocator.h"
+#include "ParticleSystem.h"
+#include "ParticleSystemInternal.h"
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+// Pixel coordinates are packed in 16 bits each
+#define MASK_MAX_SIDE 65536
+
+// --------------------------------------------------
+// Prototypes
+// --------------------------------------------------
+static void SetShape(ParticleSystem *ps, Distribution distribution,
+                     AliasEntry *table, int count, Vector2 *points,
+                     int pointCount);
+
+// --------------------------------------------------
+// Functions
+// --------------------------------------------------
+
+bool PS_SetEmissionMask(ParticleSystem *ps, Image image) {
+
+  if (image.width <= 0 || image.height <= 0 || image.width > MASK_MAX_SIDE ||
+      image.height > MASK_MAX_SIDE) {
+    return false;
+  }
+
+  Color *colors = LoadImageColors(image);
+  if (!colors) {
+    return false;
+  }
+
+  // Only visible pixels get an entry, so transparent borders cost nothing.
+  // Both sides may be up to 65536, so the pixel count may not fit an int.
+  size_t pixels = (size_t)image.width * image.height;
+  size_t visible = 0;
+  for (size_t i = 0; i < pixels; i++) {
+    visible += colors[i].a > 0;
+  }
+  if (visible > INT_MAX) {
+    UnloadImageColors(colors);
+    return false;
+  }
+  int count = (int)visible;
+
+  float *weights = count ? AL_Alloc(count * sizeof(float), AL_CACHE_LINE) : 0;
+  unsigned *values =
+      count ? AL_Alloc(count * sizeof(unsigned), AL_CACHE_LINE) : 0;
+  AliasEntry *table = NULL;
+
+  if (weights && values) {
+    int entry = 0;
+    for (size_t i = 0; i < pixels; i++) {
+      if (colors[i].a > 0) {
+        unsigned x = i % image.width, y = i / image.width;
+        weights[entry] = colors[i].a;
+        values[entry] = y << 16 | x;
+        entry++;
+      }
+    }
+    table = PS_Internal_BuildAliasTable(weights, values, count);
+  }
+
+  UnloadImageColors(colors);
+  AL_Free(weights, count * sizeof(float));
+  AL_Free(values, count * sizeof(unsigned));
+
+  if (!table) {
+    return false;
+  }
+
+  SetShape(ps, IMAGE_MASK, table, count, NULL, 0);
+  return true;
+}
+
+bool PS_SetEmissionPolyline(ParticleSystem *ps, const Vector2 *points,
+                            int count, bool closed) {
+
+  if (!points || count < 2) {
+    return false;
+  }
+
+  int pointCount = closed ? count + 1 : count;
+  int segments = pointCount - 1;
+  Vector2 *copy = AL_Alloc(pointCount * sizeof(Vector2), AL_CACHE_LINE);
+  float *weights = AL_Alloc(segments * sizeof(float), AL_CACHE_LINE);
+  unsigned *values = AL_Alloc(segments * sizeof(unsigned), AL_CACHE_LINE);
+  AliasEntry *table = NULL;
+
+  if (copy && weights && values) {
+    memcpy(copy, points, count * sizeof(Vector2));
+    if (closed) {
+      copy[count] = points[0];
+    }
+
+    float length = 0;
+    for (int i = 0; i < segments; i++) {
+      weights[i] =
+          hypotf(copy[i + 1].x - copy[i].x, copy[i + 1].y - copy[i].y);
+      values[i] = i;
+      length += weights[i];
+    }
+
+    if (length > 0) {
+      table = PS_Internal_BuildAliasTable(weights, values, segments);
+    }
+  }
+
+  AL_Free(weights, segments * sizeof(float));
+  AL_Free(values, segments * sizeof(unsigned));
+
+  if (!table) {
+    AL_Free(copy, pointCount * sizeof(Vector2));
+    return false;
+  }
+
+  SetShape(ps, POLYLINE, table, segments, copy, pointCount);
+  return true;
+}
+
+// --------------------------------------------------
+// Functions - Internal
+// --------------------------------------------------
+
+AliasEntry *PS_Internal_BuildAliasTable(const float *weights,
+                                        const unsigned *values, int count) {
+
+  if (count <= 0) {
+    return NULL;
+  }
+
+  double total = 0;
+  for (int i = 0; i < count; i++) {
+    total += weights[i];
+  }
+  if (total <= 0) {
+    return NULL;
+  }
+
+  AliasEntry *table = AL_Alloc(count * sizeof(AliasEntry), AL_CACHE_LINE);
+  float *scaled = AL_Alloc(count * sizeof(float), AL_CACHE_LINE);
+  int *worklist = AL_Alloc(count * sizeof(int), AL_CACHE_LINE);
+
+  if (!table || !scaled || !worklist) {
+    AL_Free(table, count * sizeof(AliasEntry));
+    AL_Free(scaled, count * sizeof(float));
+    AL_Free(worklist, count * sizeof(int));
+    return NULL;
+  }
+
+  // Vose's method. Columns below the average weight are filled up by columns
+  // above it. Small ones are stacked from the front of the worklist, large
+  // ones from the back.
+  int small = 0, large = count;
+  for (int i = 0; i < count; i++) {
+    scaled[i] = (float)(weights[i] * count / total);
+    if (scaled[i] < 1.0f) {
+      worklist[small++] = i;
+    } else {
+      worklist[--large] = i;
+    }
+  }
+
+  while (small > 0 && large < count) {
+    int less = worklist[--small];
+    int more = worklist[large];
+
+    table[less] = (AliasEntry){scaled[less], values[less], values[more]};
+    scaled[more] -= 1.0f - scaled[less];
+
+    if (scaled[more] < 1.0f) {
+      large++;
+      worklist[small++] = more;
+    }
+  }
+
+  // Whatever is left is full, up to rounding error
+  while (small > 0) {
+    int i = worklist[--small];
+    table[i] = (AliasEntry){1.0f, values[i], values[i]};
+  }
+  while (large < count) {
+    int i = worklist[large++];
+    table[i] = (AliasEntry){1.0f, values[i], values[i]};
+  }
+
+  AL_Free(scaled, count * sizeof(float));
+  AL_Free(worklist, count * sizeof(int));
+  return table;
+}
+
+void PS_Internal_FreeShape(ParticleSystem *ps) {
+
+  ParticleShape *shape = &ps->shape;
+  AL_Free(shape->table, shape->count * sizeof(AliasEntry));
+  AL_Free(shape->points, shape->pointCount * sizeof(Vector2));
+  memset(shape, 0, sizeof(ParticleShape));
+}
+
+// --------------------------------------------------
+// Functions - Helpers
+// --------------------------------------------------
+
+static void SetShape(ParticleSystem *ps, Distribution distribution,
+                     AliasEntry *table, int count, Vector2 *points,
+                     int pointCount) {
+
+  PS_Internal_FreeShape(ps);
+  ps->shape = (ParticleShape){distribution, table, count, points, pointCount};
+  ps->distribution = distribution;
+}
@@ -0,0 +1,454 @@
+// --------------------------------------------------
+// Includes
+// --------------------------------------------------
+#include "Allocator.h"
+#include "ParticleSystem.h"
+#include "ParticleSystemInternal.h"
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+#define SNAPSHOT_MAGIC 0x53535350u // "PSSS"
+#define SNAPSHOT_VERSION 1u
+
+// Snapshots are padded to whole words so deltas can compare 8 bytes at a time
+#define SNAPSHOT_WORD sizeof(uint64_t)
+
+// Longest LEB128 encoding of a size_t
+#define VARINT_MAX 10
+
+// Every Particle field is 4 bytes wide. Snapshots store the particles
+// transposed, one column per field, so a field that doesn't change between
+// frames is one long run of unchanged bytes.
+#define COLUMN_COUNT (sizeof(Particle) / sizeof(uint32_t))
+
+static_assert(7 * sizeof(float) + 3 * sizeof(Color) == sizeof(Particle) &&
+                  sizeof(Color) == sizeof(uint32_t),
+              "Snapshot columns assume 4-byte Particle fields.");
+
+// --------------------------------------------------
+// Data types
+// --------------------------------------------------
+
+// Everything but the particles, the draw order and resources like the texture.
+// Laid out without implicit padding, so snapshots of equal states are equal.
+typedef struct {
+  unsigned magic, version;
+  int liveCount;
+  Vector2 pos, particleSize;
+  int particleCount;
+  float minLifetime, maxLifetime;
+  int minLinearAccelerationX, maxLinearAccelerationX;
+  int minLinearAccelerationY, maxLinearAccelerationY;
+  float spawnSpreadX, spawnSpreadY;
+  int distribution, uniformCols;
+  unsigned char canEmit, shouldDestroy, padding[2];
+  Color initialColor, finalColor, colorDelta;
+  unsigned features, kernelFeatures;
+  float minDepth, maxDepth;
+  int sortMode;
+  ParticleRng rng;
+} SnapshotHeader;
+
+// --------------------------------------------------
+// Prototypes
+// --------------------------------------------------
+static size_t SnapshotSize(int liveCount, SortMode sortMode);
+static void WriteColumns(const ParticleSystem *ps, unsigned char *dst);
+static void ReadColumns(ParticleSystem *ps, const unsigned char *src,
+                        int count);
+static bool IsPermutation(const unsigned char *order, int count);
+static uint64_t LoadWord(const unsigned char *data, size_t size,
+                         size_t offset);
+static size_t WriteVarint(unsigned char *dst, size_t value);
+static size_t ReadVarint(const unsigned char *src, size_t size, size_t *value);
+
+// --------------------------------------------------
+// Functions
+// --------------------------------------------------
+
+size_t PS_GetSnapshotSize(const ParticleSystem *ps) {
+  return SnapshotSize(ps->liveCount, ps->sortMode);
+}
+
+size_t PS_Snapshot(const ParticleSystem *ps, void *buffer, size_t capacity) {
+
+  size_t size = PS_GetSnapshotSize(ps);
+  if (!buffer || capacity < size) {
+    return 0;
+  }
+
+  unsigned char *dst = buffer;
+  SnapshotHeader header = {
+      .magic = SNAPSHOT_MAGIC,
+      .version = SNAPSHOT_VERSION,
+      .liveCount = ps->liveCount,
+      .pos = ps->pos,
+      .particleSize = ps->particleSize,
+      .particleCount = ps->particleCount,
+      .minLifetime = ps->minLifetime,
+      .maxLifetime = ps->maxLifetime,
+      .minLinearAccelerationX = ps->minLinearAccelerationX,
+      .maxLinearAccelerationX = ps->maxLinearAccelerationX,
+      .minLinearAccelerationY = ps->minLinearAccelerationY,
+      .maxLinearAccelerationY = ps->maxLinearAccelerationY,
+      .spawnSpreadX = ps->spawnSpreadX,
+      .spawnSpreadY = ps->spawnSpreadY,
+      .distribution = ps->distribution,
+      .uniformCols = ps->uniformCols,
+      .canEmit = ps->canEmit,
+      .shouldDestroy = ps->shouldDestroy,
+      .initialColor = ps->initialColor,
+      .finalColor = ps->finalColor,
+      .colorDelta = ps->colorDelta,
+      .features = ps->features,
+      .kernelFeatures = ps->kernelFeatures,
+      .minDepth = ps->minDepth,
+      .maxDepth = ps->maxDepth,
+      .sortMode = ps->sortMode,
+      .rng = ps->rng,
+  };
+
+  // Zero everything first so padding is the same in every snapshot
+  memset(dst, 0, size);
+  memcpy(dst, &header, sizeof(header));
+  dst += sizeof(header);
+
+  WriteColumns(ps, dst);
+  dst += ps->liveCount * sizeof(Particle);
+
+  // Draw order without the entries of dead particles
+  if (ps->sortMode != SORT_NONE) {
+    int *order = (int *)dst;
+    for (int i = 0, written = 0; i < ps->sort.count; i++) {
+      if (ps->sort.order[i] >= 0) {
+        memcpy(&order[written++], &ps->sort.order[i], sizeof(int));
+      }
+    }
+  }
+
+  return size;
+}
+
+bool PS_Restore(ParticleSystem *ps, const void *snapshot, size_t size) {
+
+  const unsigned char *src = snapshot;
+  SnapshotHeader header;
+
+  if (!src || size < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, src, sizeof(header));
+
+  if (header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION ||
+      header.liveCount < 0 || header.sortMode < SORT_NONE ||
+      header.sortMode > SORT_BY_DEPTH || header.distribution < UNIFORM ||
+      header.distribution > POLYLINE ||
+      size != SnapshotSize(header.liveCount, header.sortMode)) {
+    return false;
+  }
+
+  int count = header.liveCount;
+  const unsigned char *columns = src + sizeof(header);
+  const unsigned char *order = columns + count * sizeof(Particle);
+
+  if (header.sortMode != SORT_NONE && !IsPermutation(order, count)) {
+    return false;
+  }
+
+  // Drop the current particles, keeping their blocks for the new ones
+  ps->liveCount = 0;
+  ps->sortMode = SORT_NONE;
+  PS_Internal_FreeSort(ps);
+
+  bool reserved = PS_Internal_ReserveParticles(ps, count) == count;
+
+  ps->pos = header.pos;
+  ps->particleSize = header.particleSize;
+  ps->particleCount = header.particleCount;
+  ps->minLifetime = header.minLifetime;
+  ps->maxLifetime = header.maxLifetime;
+  ps->minLinearAccelerationX = header.minLinearAccelerationX;
+  ps->maxLinearAccelerationX = header.maxLinearAccelerationX;
+  ps->minLinearAccelerationY = header.minLinearAccelerationY;
+  ps->maxLinearAccelerationY = header.maxLinearAccelerationY;
+  ps->spawnSpreadX = header.spawnSpreadX;
+  ps->spawnSpreadY = header.spawnSpreadY;
+  ps->distribution = header.distribution;
+  ps->uniformCols = header.uniformCols;
+  ps->canEmit = header.canEmit;
+  ps->shouldDestroy = header.shouldDestroy;
+  ps->initialColor = header.initialColor;
+  ps->finalColor = header.finalColor;
+  ps->colorDelta = header.colorDelta;
+  ps->features = header.features;
+  ps->kernelFeatures = header.kernelFeatures;
+  ps->update = PS_Internal_GetKernel(ps->kernelFeatures);
+  ps->minDepth = header.minDepth;
+  ps->maxDepth = header.maxDepth;
+  ps->rng = header.rng;
+
+  if (reserved) {
+    ReadColumns(ps, columns, count);
+    ps->liveCount = count;
+  } else {
+    ps->canEmit = false;
+  }
+
+  int needed = (ps->liveCount + PS_BLOCK_MASK) >> PS_BLOCK_SHIFT;
+  while (ps->blockCount > needed) {
+    PS_Internal_ReleaseBlock(ps->blocks[--ps->blockCount]);
+  }
+
+  if (reserved && header.sortMode != SORT_NONE) {
+    ps->sortMode = header.sortMode;
+    PS_Internal_TrackParticles(ps, 0, count);
+    // An empty system may have no order array to copy into yet
+    if (ps->sortMode != SORT_NONE && count > 0) {
+      memcpy(ps->sort.order, order, count * sizeof(int));
+      for (int i = 0; i < count; i++) {
+        ps->sort.rank[ps->sort.order[i]] = i;
+      }
+    }
+  }
+
+  return reserved;
+}
+
+size_t PS_GetSnapshotDeltaBound(size_t snapshotSize) {
+
+  // Literal runs are separated by at least one unchanged word, so there are
+  // at most about half as many runs as words
+  size_t words = snapshotSize / SNAPSHOT_WORD;
+  return VARINT_MAX + (words / 2 + 2) * 2 * VARINT_MAX + snapshotSize;
+}
+
+size_t PS_EncodeSnapshotDelta(const void *prev, size_t prevSize,
+                              const void *curr, size_t currSize, void *delta,
+                              size_t capacity) {
+
+  const unsigned char *a = prev, *b = curr;
+  unsigned char *dst = delta, *end = dst + capacity;
+  size_t words = currSize / SNAPSHOT_WORD;
+
+  if (!curr || !delta || capacity < VARINT_MAX) {
+    return 0;
+  }
+  if (!prev) {
+    prevSize = 0;
+  }
+
+  dst += WriteVarint(dst, currSize);
+
+  // Runs of unchanged words, each followed by a run of XORed words
+  size_t i = 0;
+  while (i < words) {
+    size_t zeroStart = i;
+    while (i < words && LoadWord(a, prevSize, i * SNAPSHOT_WORD) ==
+                            LoadWord(b, currSize, i * SNAPSHOT_WORD)) {
+      i++;
+    }
+    size_t literalStart = i;
+    while (i < words && LoadWord(a, prevSize, i * SNAPSHOT_WORD) !=
+                            LoadWord(b, currSize, i * SNAPSHOT_WORD)) {
+      i++;
+    }
+
+    if ((size_t)(end - dst) <
+        2 * VARINT_MAX + (i - literalStart) * SNAPSHOT_WORD) {
+      return 0;
+    }
+    dst += WriteVarint(dst, literalStart - zeroStart);
+    dst += WriteVarint(dst, i - literalStart);
+    for (size_t w = literalStart; w < i; w++) {
+      uint64_t x = LoadWord(a, prevSize, w * SNAPSHOT_WORD) ^
+                   LoadWord(b, currSize, w * SNAPSHOT_WORD);
+      memcpy(dst, &x, SNAPSHOT_WORD);
+      dst += SNAPSHOT_WORD;
+    }
+  }
+
+  // Bytes past the last whole word, if any
+  for (size_t t = words * SNAPSHOT_WORD; t < currSize; t++) {
+    if (dst == end) {
+      return 0;
+    }
+    *dst++ = b[t] ^ (t < prevSize ? a[t] : 0);
+  }
+
+  return dst - (unsigned char *)delta;
+}
+
+size_t PS_DecodeSnapshotDelta(const void *prev, size_t prevSize,
+                              const void *delta, size_t deltaSize,
+                              void *snapshot, size_t capacity) {
+
+  const unsigned char *a = prev, *src = delta;
+  unsigned char *dst = snapshot;
+  size_t size, read;
+
+  if (!delta || !snapshot) {
+    return 0;
+  }
+  if (!prev) {
+    prevSize = 0;
+  }
+
+  if (!(read = ReadVarint(src, deltaSize, &size)) || size > capacity) {
+    return 0;
+  }
+  src += read;
+  deltaSize -= read;
+
+  size_t words = size / SNAPSHOT_WORD;
+  size_t i = 0;
+  while (i < words) {
+    size_t zeros, literals;
+    if (!(read = ReadVarint(src, deltaSize, &zeros))) {
+      return 0;
+    }
+    src += read;
+    deltaSize -= read;
+    if (!(read = ReadVarint(src, deltaSize, &literals))) {
+      return 0;
+    }
+    src += read;
+    deltaSize -= read;
+
+    if (zeros > words - i || literals > words - i - zeros ||
+        literals * SNAPSHOT_WORD > deltaSize) {
+      return 0;
+    }
+
+    for (size_t end = i + zeros; i < end; i++) {
+      uint64_t x = LoadWord(a, prevSize, i * SNAPSHOT_WORD);
+      memcpy(dst + i * SNAPSHOT_WORD, &x, SNAPSHOT_WORD);
+    }
+    for (size_t end = i + literals; i < end; i++) {
+      uint64_t x;
+      memcpy(&x, src, SNAPSHOT_WORD);
+      x ^= LoadWord(a, prevSize, i * SNAPSHOT_WORD);
+      memcpy(dst + i * SNAPSHOT_WORD, &x, SNAPSHOT_WORD);
+      src += SNAPSHOT_WORD;
+      deltaSize -= SNAPSHOT_WORD;
+    }
+  }
+
+  if (deltaSize != size - words * SNAPSHOT_WORD) {
+    return 0;
+  }
+  for (size_t t = words * SNAPSHOT_WORD; t < size; t++) {
+    dst[t] = *src++ ^ (t < prevSize ? a[t] : 0);
+  }
+
+  return size;
+}
+
+// --------------------------------------------------
+// Functions - Helpers
+// --------------------------------------------------
+
+static size_t SnapshotSize(int liveCount, SortMode sortMode) {
+
+  size_t size = sizeof(SnapshotHeader) + liveCount * sizeof(Particle);
+  if (sortMode != SORT_NONE) {
+    size += liveCount * sizeof(int);
+  }
+  return (size + SNAPSHOT_WORD - 1) / SNAPSHOT_WORD * SNAPSHOT_WORD;
+}
+
+static void WriteColumns(const ParticleSystem *ps, unsigned char *dst) {
+
+  size_t count = ps->liveCount;
+  for (size_t i = 0; i < count; i++) {
+    const unsigned char *particle =
+        (const unsigned char *)PS_Internal_GetParticle(ps, (int)i);
+    for (size_t c = 0; c < COLUMN_COUNT; c++) {
+      memcpy(dst + (c * count + i) * sizeof(uint32_t),
+             particle + c * sizeof(uint32_t), sizeof(uint32_t));
+    }
+  }
+}
+
+static void ReadColumns(ParticleSystem *ps, const unsigned char *src,
+                        int count) {
+
+  for (size_t i = 0; i < (size_t)count; i++) {
+    unsigned char *particle =
+        (unsigned char *)PS_Internal_GetParticle(ps, (int)i);
+    for (size_t c = 0; c < COLUMN_COUNT; c++) {
+      memcpy(particle + c * sizeof(uint32_t),
+             src + (c * count + i) * sizeof(uint32_t), sizeof(uint32_t));
+    }
+  }
+}
+
+static bool IsPermutation(const unsigned char *order, int count) {
+
+  if (count == 0) {
+    return true;
+  }
+
+  // Every particle must be drawn exactly once, or the ranks built from the
+  // order would point at the wrong entries
+  size_t words = ((size_t)count + 63) / 64;
+  uint64_t *seen = AL_Alloc(words * sizeof(uint64_t), sizeof(uint64_t));
+  if (!seen) {
+    return false;
+  }
+  memset(seen, 0, words * sizeof(uint64_t));
+
+  bool valid = true;
+  for (int i = 0; valid && i < count; i++) {
+    int index;
+    memcpy(&index, order + i * sizeof(int), sizeof(int));
+    valid = index >= 0 && index < count &&
+            !(seen[index / 64] & (uint64_t)1 << (index % 64));
+    if (valid) {
+      seen[index / 64] |= (uint64_t)1 << (index % 64);
+    }
+  }
+
+  AL_Free(seen, words * sizeof(uint64_t));
+  return valid;
+}
+
+static uint64_t LoadWord(const unsigned char *data, size_t size,
+                         size_t offset) {
+
+  uint64_t word = 0;
+  if (offset + SNAPSHOT_WORD <= size) {
+    memcpy(&word, data + offset, SNAPSHOT_WORD);
+  } else if (offset < size) {
+    memcpy(&word, data + offset, size - offset);
+  }
+  return word;
+}
+
+static size_t WriteVarint(unsigned char *dst, size_t value) {
+
+  size_t written = 0;
+  while (value >= 0x80) {
+    dst[written++] = (unsigned char)(value | 0x80);
+    value >>= 7;
+  }
+  dst[written++] = (unsigned char)value;
+  return written;
+}
+
+static size_t ReadVarint(const unsigned char *src, size_t size,
+                         size_t *value) {
+
+  *value = 0;
+  for (size_t i = 0; i < size && i < VARINT_MAX; i++) {
+    *value |= (size_t)(src[i] & 0x7F) << (7 * i);
+    if (!(src[i] & 0x80)) {
+      return i + 1;
+    }
+  }
+  return 0;
+}
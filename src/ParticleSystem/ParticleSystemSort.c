@@ -0,0 +1,283 @@
+// --------------------------------------------------
+// Includes
+// --------------------------------------------------
+#include "Allocator.h"
+#include "ParticleSystem.h"
+#include "ParticleSystemInternal.h"
+#include <string.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+#define RADIX_BITS 11
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_MASK (RADIX_BUCKETS - 1)
+#define RADIX_PASSES 3
+
+// Shifts an insertion pass may spend before handing over to the radix sort
+#define INSERTION_BUDGET(count) ((long)(count) / 4 + 256)
+
+// --------------------------------------------------
+// Prototypes
+// --------------------------------------------------
+static bool ReserveSort(ParticleSort *sort, int capacity);
+static unsigned ParticleKey(const Particle *p, SortMode mode);
+static bool InsertionSort(unsigned *keys, int *values, int count, long budget);
+
+// --------------------------------------------------
+// Functions
+// --------------------------------------------------
+
+void PS_SetSortMode(ParticleSystem *ps, SortMode mode) {
+
+  if (ps->sortMode == mode) {
+    return;
+  }
+
+  ps->sortMode = mode;
+  PS_Internal_FreeSort(ps);
+
+  if (mode != SORT_NONE) {
+    // Start from emission order. The next PS_Update sorts it.
+    PS_Internal_TrackParticles(ps, 0, ps->liveCount);
+  }
+}
+
+void PS_SetDepth(ParticleSystem *ps, float min, float max) {
+
+  ps->minDepth = min;
+  ps->maxDepth = max;
+}
+
+// --------------------------------------------------
+// Functions - Internal
+// --------------------------------------------------
+
+void PS_Internal_TrackParticles(ParticleSystem *ps, int first, int count) {
+
+  ParticleSort *sort = &ps->sort;
+
+  if (!ReserveSort(sort, sort->count + count)) {
+    PS_Internal_FreeSort(ps);
+    ps->sortMode = SORT_NONE;
+    return;
+  }
+
+  for (int i = 0; i < count; i++) {
+    sort->order[sort->count] = first + i;
+    sort->rank[first + i] = sort->count;
+    sort->count++;
+  }
+}
+
+void PS_Internal_MoveParticle(ParticleSystem *ps, int to, int from) {
+
+  ParticleSort *sort = &ps->sort;
+
+  sort->order[sort->rank[to]] = -1;
+  if (from != to) {
+    sort->order[sort->rank[from]] = to;
+    sort->rank[to] = sort->rank[from];
+  }
+}
+
+void PS_Internal_SortParticles(ParticleSystem *ps) {
+
+  ParticleSort *sort = &ps->sort;
+
+  // Compute keys in storage order, which walks memory linearly. keysTmp is
+  // indexed by particle here and only becomes radix scratch afterwards.
+  for (int b = 0; b < ps->blockCount; b++) {
+    const Particle *block = ps->blocks[b];
+    int first = b << PS_BLOCK_SHIFT;
+    int last = ps->liveCount - first;
+    last = last < PS_BLOCK_SIZE ? last : PS_BLOCK_SIZE;
+    for (int i = 0; i < last; i++) {
+      sort->keysTmp[first + i] = ParticleKey(&block[i], ps->sortMode);
+    }
+  }
+
+  // Drop dead entries and gather keys, keeping last frame's order
+  int count = 0;
+  for (int i = 0; i < sort->count; i++) {
+    int index = sort->order[i];
+    if (index < 0) {
+      continue;
+    }
+    sort->order[count] = index;
+    sort->keys[count] = sort->keysTmp[index];
+    count++;
+  }
+  sort->count = count;
+
+  if (!InsertionSort(sort->keys, sort->order, count, INSERTION_BUDGET(count))) {
+    PS_Internal_RadixSort(sort->keys, sort->order, sort->keysTmp,
+                          sort->orderTmp, count);
+  }
+
+  for (int i = 0; i < count; i++) {
+    sort->rank[sort->order[i]] = i;
+  }
+}
+
+void PS_Internal_RadixSort(unsigned *keys, int *values, unsigned *keysTmp,
+                           int *valuesTmp, int count) {
+
+  int histograms[RADIX_PASSES][RADIX_BUCKETS] = {0};
+
+  for (int i = 0; i < count; i++) {
+    for (int pass = 0; pass < RADIX_PASSES; pass++) {
+      histograms[pass][(keys[i] >> (pass * RADIX_BITS)) & RADIX_MASK]++;
+    }
+  }
+
+  unsigned *srcKeys = keys, *dstKeys = keysTmp;
+  int *srcValues = values, *dstValues = valuesTmp;
+
+  for (int pass = 0; pass < RADIX_PASSES; pass++) {
+    int *histogram = histograms[pass];
+    int shift = pass * RADIX_BITS;
+
+    // Every key has the same digit, this pass wouldn't move anything
+    if (count == 0 || histogram[(srcKeys[0] >> shift) & RADIX_MASK] == count) {
+      continue;
+    }
+
+    int offset = 0;
+    for (int b = 0; b < RADIX_BUCKETS; b++) {
+      int bucketCount = histogram[b];
+      histogram[b] = offset;
+      offset += bucketCount;
+    }
+
+    for (int i = 0; i < count; i++) {
+      int dst = histogram[(srcKeys[i] >> shift) & RADIX_MASK]++;
+      dstKeys[dst] = srcKeys[i];
+      dstValues[dst] = srcValues[i];
+    }
+
+    unsigned *tmpKeys = srcKeys;
+    srcKeys = dstKeys;
+    dstKeys = tmpKeys;
+    int *tmpValues = srcValues;
+    srcValues = dstValues;
+    dstValues = tmpValues;
+  }
+
+  if (srcKeys != keys) {
+    memcpy(keys, srcKeys, count * sizeof(unsigned));
+    memcpy(values, srcValues, count * sizeof(int));
+  }
+}
+
+void PS_Internal_FreeSort(ParticleSystem *ps) {
+
+  ParticleSort *sort = &ps->sort;
+  size_t capacity = sort->capacity;
+
+  AL_Free(sort->order, capacity * sizeof(int));
+  AL_Free(sort->orderTmp, capacity * sizeof(int));
+  AL_Free(sort->rank, capacity * sizeof(int));
+  AL_Free(sort->keys, capacity * sizeof(unsigned));
+  AL_Free(sort->keysTmp, capacity * sizeof(unsigned));
+
+  memset(sort, 0, sizeof(ParticleSort));
+}
+
+// --------------------------------------------------
+// Functions - Helpers
+// --------------------------------------------------
+
+static bool ReserveSort(ParticleSort *sort, int capacity) {
+
+  if (capacity <= sort->capacity) {
+    return true;
+  }
+
+  int newCapacity = sort->capacity ? sort->capacity : PS_BLOCK_SIZE;
+  while (newCapacity < capacity) {
+    newCapacity *= 2;
+  }
+
+  ParticleSort grown = {
+      .order = AL_Alloc(newCapacity * sizeof(int), AL_CACHE_LINE),
+      .orderTmp = AL_Alloc(newCapacity * sizeof(int), AL_CACHE_LINE),
+      .rank = AL_Alloc(newCapacity * sizeof(int), AL_CACHE_LINE),
+      .keys = AL_Alloc(newCapacity * sizeof(unsigned), AL_CACHE_LINE),
+      .keysTmp = AL_Alloc(newCapacity * sizeof(unsigned), AL_CACHE_LINE),
+      .count = sort->count,
+      .capacity = newCapacity,
+  };
+
+  if (!grown.order || !grown.orderTmp || !grown.rank || !grown.keys ||
+      !grown.keysTmp) {
+    AL_Free(grown.order, newCapacity * sizeof(int));
+    AL_Free(grown.orderTmp, newCapacity * sizeof(int));
+    AL_Free(grown.rank, newCapacity * sizeof(int));
+    AL_Free(grown.keys, newCapacity * sizeof(unsigned));
+    AL_Free(grown.keysTmp, newCapacity * sizeof(unsigned));
+    return false;
+  }
+
+  if (sort->capacity) {
+    memcpy(grown.order, sort->order, sort->count * sizeof(int));
+    memcpy(grown.rank, sort->rank, sort->capacity * sizeof(int));
+
+    AL_Free(sort->order, sort->capacity * sizeof(int));
+    AL_Free(sort->orderTmp, sort->capacity * sizeof(int));
+    AL_Free(sort->rank, sort->capacity * sizeof(int));
+    AL_Free(sort->keys, sort->capacity * sizeof(unsigned));
+    AL_Free(sort->keysTmp, sort->capacity * sizeof(unsigned));
+  }
+
+  *sort = grown;
+  return true;
+}
+
+static inline unsigned FloatKey(float f) {
+
+  // Flips the bits so unsigned comparison matches float comparison
+  unsigned bits;
+  memcpy(&bits, &f, sizeof(bits));
+  return bits & 0x80000000u ? ~bits : bits | 0x80000000u;
+}
+
+static unsigned ParticleKey(const Particle *p, SortMode mode) {
+
+  switch (mode) {
+  case SORT_BY_AGE:
+    return ~FloatKey(p->initialLifeTime - p->lifeTime);
+  case SORT_BY_Y:
+    return FloatKey(p->pos.y);
+  case SORT_BY_DEPTH:
+    return ~FloatKey(p->depth);
+  default:
+    return 0;
+  }
+}
+
+static bool InsertionSort(unsigned *keys, int *values, int count, long budget) {
+
+  for (int i = 1; i < count; i++) {
+    unsigned key = keys[i];
+    int value = values[i];
+    int j = i - 1;
+
+    while (j >= 0 && keys[j] > key) {
+      keys[j + 1] = keys[j];
+      values[j + 1] = values[j];
+      j--;
+      if (--budget < 0) {
+        keys[j + 1] = key;
+        values[j + 1] = value;
+        return false;
+      }
+    }
+
+    keys[j + 1] = key;
+    values[j + 1] = value;
+  }
+
+  return true;
+}
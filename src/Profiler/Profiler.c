@@ -0,0 +1,286 @@
+// --------------------------------------------------
+// Includes
+// --------------------------------------------------
+#include "Profiler.h"
+#include "Allocator.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+#define RING_MASK (PF_RING_SIZE - 1)
+
+static_assert((PF_RING_SIZE & RING_MASK) == 0,
+              "PF_RING_SIZE must be a power of two");
+
+// --------------------------------------------------
+// Data types
+// --------------------------------------------------
+
+typedef struct {
+  const char *name;
+  long long start;
+  long long duration;
+} ZoneEvent;
+
+/**
+ * @brief One thread's zones, waiting for PF_WriteTrace.
+ *
+ * Only the owning thread bumps `written` and only PF_WriteTrace bumps `read`,
+ * so recording a zone takes no lock. Each counter sits on its own cache line.
+ * `retired` is set once the owner has exited. Everything below `read` is
+ * guarded by `ringsLock`.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  _Alignas(AL_CACHE_LINE) atomic_uint written;
+  _Alignas(AL_CACHE_LINE) atomic_uint read;
+  bool retired;
+  int id;
+  char threadName[PF_THREAD_NAME_SIZE];
+  ZoneEvent events[PF_RING_SIZE];
+} ThreadRing;
+
+// --------------------------------------------------
+// Prototypes
+// --------------------------------------------------
+static ThreadRing *OwnRing(void);
+static ThreadRing *ClaimRing(void);
+static void RetireRing(void *ring);
+static void CreateRingKey(void);
+static void WriteEvents(FILE *file, ThreadRing *ring, bool *first);
+static void WriteJsonString(FILE *file, const char *str);
+static long long Now(void);
+
+// --------------------------------------------------
+// Variables
+// --------------------------------------------------
+static atomic_bool capturing;
+static atomic_long dropped;
+static long long captureStart;
+
+static pthread_mutex_t ringsLock = PTHREAD_MUTEX_INITIALIZER;
+static ThreadRing *rings[PF_MAX_THREADS];
+static int ringCount;
+
+static pthread_once_t ringKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t ringKey;
+static _Thread_local ThreadRing *ownRing;
+static _Thread_local bool noRingLeft;
+
+// --------------------------------------------------
+// Functions
+// --------------------------------------------------
+
+bool PF_StartCapture(void) {
+
+  if (atomic_load(&capturing)) {
+    return false;
+  }
+
+  // Zones of an earlier capture would land before this one's start
+  pthread_mutex_lock(&ringsLock);
+  for (int i = 0; i < ringCount; i++) {
+    unsigned int written =
+        atomic_load_explicit(&rings[i]->written, memory_order_acquire);
+    atomic_store_explicit(&rings[i]->read, written, memory_order_release);
+  }
+  captureStart = Now();
+  pthread_mutex_unlock(&ringsLock);
+
+  atomic_store(&dropped, 0);
+  atomic_store(&capturing, true);
+  return true;
+}
+
+bool PF_StopCapture(void) { return atomic_exchange(&capturing, false); }
+
+bool PF_IsCapturing(void) { return atomic_load(&capturing); }
+
+ProfileZone PF_BeginZone(const char *name) {
+
+  if (!atomic_load_explicit(&capturing, memory_order_relaxed)) {
+    return (ProfileZone){0};
+  }
+
+  return (ProfileZone){.name = name, .start = Now()};
+}
+
+void PF_EndZone(ProfileZone *zone) {
+
+  if (!zone->name) {
+    return;
+  }
+
+  long long end = Now();
+  ThreadRing *ring = OwnRing();
+  if (!ring) {
+    atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+    return;
+  }
+
+  unsigned int written =
+      atomic_load_explicit(&ring->written, memory_order_relaxed);
+  unsigned int read = atomic_load_explicit(&ring->read, memory_order_acquire);
+  if (written - read == PF_RING_SIZE) {
+    atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+    return;
+  }
+
+  ring->events[written & RING_MASK] = (ZoneEvent){
+      .name = zone->name, .start = zone->start, .duration = end - zone->start};
+  atomic_store_explicit(&ring->written, written + 1, memory_order_release);
+}
+
+bool PF_SetThreadName(const char *name) {
+
+  ThreadRing *ring = name ? OwnRing() : NULL;
+  if (!ring) {
+    return false;
+  }
+
+  pthread_mutex_lock(&ringsLock);
+  snprintf(ring->threadName, PF_THREAD_NAME_SIZE, "%s", name);
+  pthread_mutex_unlock(&ringsLock);
+  return true;
+}
+
+bool PF_WriteTrace(const char *path) {
+
+  FILE *file = path ? fopen(path, "w") : NULL;
+  if (!file) {
+    return false;
+  }
+
+  fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", file);
+  bool first = true;
+
+  pthread_mutex_lock(&ringsLock);
+  for (int i = 0; i < ringCount; i++) {
+    WriteEvents(file, rings[i], &first);
+  }
+  pthread_mutex_unlock(&ringsLock);
+
+  fputs("\n]}\n", file);
+  bool failed = ferror(file);
+  return !(fclose(file) || failed);
+}
+
+long PF_GetDroppedCount(void) { return atomic_load(&dropped); }
+
+// --------------------------------------------------
+// Functions - Helpers
+// --------------------------------------------------
+
+static ThreadRing *OwnRing(void) {
+
+  if (!ownRing && !noRingLeft) {
+    ownRing = ClaimRing();
+    noRingLeft = !ownRing;
+  }
+  return ownRing;
+}
+
+static ThreadRing *ClaimRing(void) {
+
+  pthread_once(&ringKeyOnce, CreateRingKey);
+  pthread_mutex_lock(&ringsLock);
+
+  // Reuse the ring of a thread that exited, once its zones were written out
+  ThreadRing *ring = NULL;
+  for (int i = 0; i < ringCount && !ring; i++) {
+    if (rings[i]->retired &&
+        atomic_load_explicit(&rings[i]->read, memory_order_relaxed) ==
+            atomic_load_explicit(&rings[i]->written, memory_order_relaxed)) {
+      ring = rings[i];
+    }
+  }
+
+  if (!ring && ringCount < PF_MAX_THREADS) {
+    ring = AL_Alloc(sizeof(ThreadRing), AL_CACHE_LINE);
+    if (ring) {
+      atomic_init(&ring->written, 0);
+      atomic_init(&ring->read, 0);
+      ring->id = ringCount + 1;
+      rings[ringCount++] = ring;
+    }
+  }
+
+  if (ring) {
+    ring->retired = false;
+    ring->threadName[0] = '\0';
+    pthread_setspecific(ringKey, ring);
+  }
+
+  pthread_mutex_unlock(&ringsLock);
+  return ring;
+}
+
+static void RetireRing(void *ring) {
+
+  pthread_mutex_lock(&ringsLock);
+  ((ThreadRing *)ring)->retired = true;
+  pthread_mutex_unlock(&ringsLock);
+}
+
+static void CreateRingKey(void) { pthread_key_create(&ringKey, RetireRing); }
+
+static void WriteEvents(FILE *file, ThreadRing *ring, bool *first) {
+
+  unsigned int written =
+      atomic_load_explicit(&ring->written, memory_order_acquire);
+  unsigned int read = atomic_load_explicit(&ring->read, memory_order_relaxed);
+  if (read == written && !ring->threadName[0]) {
+    return;
+  }
+
+  if (ring->threadName[0]) {
+    fprintf(file,
+            "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+            "\"args\":{\"name\":",
+            *first ? "" : ",", ring->id);
+    WriteJsonString(file, ring->threadName);
+    fputs("}}", file);
+    *first = false;
+  }
+
+  // Chrome wants microseconds, the fraction keeps nanoseconds
+  for (; read != written; read++) {
+    const ZoneEvent *event = &ring->events[read & RING_MASK];
+    fprintf(file, "%s\n{\"name\":", *first ? "" : ",");
+    WriteJsonString(file, event->name);
+    fprintf(file,
+            ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+            (event->start - captureStart) / 1000.0, event->duration / 1000.0,
+            ring->id);
+    *first = false;
+  }
+
+  atomic_store_explicit(&ring->read, written, memory_order_release);
+}
+
+static void WriteJsonString(FILE *file, const char *str) {
+
+  fputc('"', file);
+  for (const unsigned char *c = (const unsigned char *)str; *c; c++) {
+    if (*c == '"' || *c == '\\') {
+      fprintf(file, "\\%c", *c);
+    } else if (*c < 0x20) {
+      fprintf(file, "\\u%04x", *c);
+    } else {
+      fputc(*c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+static long long Now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
@@ -1,30 +1,108 @@
-// TODO(#7) trim state name when registering state and reject whitespace only
-// TODO(#8) trim state name when changing states and reject whitespace only
-// TODO(#9) create internal function to trim leading and trailing whitespace
-
 // --------------------------------------------------
 // Includes
 // --------------------------------------------------
 
 #include "StateMachine.h"
 #include "../tests/StateMachine/StateMachineTest.h"
+#include "Logger.h"
+#include "Profiler.h"
+#include "StateMachineHash.h"
 #include "StateMachineInternal.h"
 #include <stddef.h>
-#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 // --------------------------------------------------
 // Defines
 // --------------------------------------------------
 
+// Both go through the logger, so a warning repeated every frame never stalls it
 #define SM_WARN(str, ...)                                                      \
   if (warningsEnabled) {                                                       \
-    fprintf(stderr, "\033[33m[SMILE WARNING]\033[0m " str "\n",                \
-            ##__VA_ARGS__);                                                    \
+    LG_Log(LOG_WARNING, str, ##__VA_ARGS__);                                   \
   }
 
-#define SM_ERR(str, ...)                                                       \
-  fprintf(stderr, "\033[31m[SMILE ERROR]\033[0m " str "\n", ##__VA_ARGS__)
+#define SM_ERR(str, ...) LG_Log(LOG_ERROR, str, ##__VA_ARGS__)
+
+// Arena blocks start this big, then double. Names are guessed at this length
+// when reserving room for a number of states.
+#define SM_ARENA_BLOCK_SIZE 4096
+#define SM_ARENA_NAME_GUESS 32
+
+// Instances per parallel task. Large enough to hide the cost of claiming one.
+#define SM_PARALLEL_CHUNK 1024
+
+// Times a lifecycle call into its state's StateStats. Compiled without
+// SMILE_STATS, it's the bare call.
+#ifdef SMILE_STATS
+#define SM_TIMED(state, field, call)                                           \
+  do {                                                                         \
+    long long statsStart = StatsNow();                                         \
+    call;                                                                      \
+    RecordCall(state, offsetof(StateStats, field), StatsNow() - statsStart);   \
+  } while (0)
+#else
+#define SM_TIMED(state, field, call) call
+#endif
+
+// --------------------------------------------------
+// Prototypes
+// --------------------------------------------------
+static const State *StateToChangeTo(const char *name);
+static void ChangeState(const State *nextState, void *args);
+static const State *ExitForChange(const State *nextState);
+static bool PushState(const State *nextState, void *args);
+static int FirstRunningBelow(unsigned int flag);
+static void ApplyPostedChanges(void);
+static const Transition *FindTransition(StateHandle from, int event);
+static bool ReserveTransitions(int rows, int events);
+static const State *ParentOf(const State *state);
+static const State *SharedAncestor(const State *from, const State *to);
+static void ExitUpTo(const State *state, const State *ancestor);
+static void EnterFrom(const State *ancestor, const State *state, void *args);
+static void UpdateParents(const State *state, const State *done, float dt);
+static void DrawParents(const State *state, const State *done);
+static bool ParentRuns(const State *state, bool draw);
+static StatePreload *PreloadOf(const State *state);
+static bool ReservePreloads(int count);
+static bool IsPreloaded(const State *state);
+static bool Prefetch(const State *state);
+static void ApplyWaitingChange(void);
+#ifdef SMILE_STATS
+static long long StatsNow(void);
+static void RecordCall(const State *state, size_t field, long long ns);
+static bool ReserveStateStats(int count);
+#endif
+static const State *StateAt(int index);
+static const State *FindStaticState(const char *name, size_t length,
+                                    uint32_t hash);
+static StateGroup *GroupOf(const State *state);
+static bool ReserveStates(int capacity);
+static bool ReserveArena(ArenaBlock **arena, size_t size);
+static void *ArenaAlloc(ArenaBlock **arena, size_t size);
+static size_t ArenaPieceSize(size_t size);
+static void ResetArena(ArenaBlock **arena);
+static void FreeArena(ArenaBlock **arena);
+static ArgsCopy *FirstArgsFrom(int depth);
+static ArenaBlock *BlockHolding(const void *ptr);
+static bool ReserveArgs(size_t size, int depth);
+static ArgsCopy *CopyArgs(const void *args, size_t size, int depth);
+static void ReleaseArgs(int depth);
+static bool ChangeMachineState(StateMachine *sm, const State *nextState,
+                               void *args);
+static bool DeferChange(StateMachine *sm, const State *nextState, void *args,
+                        bool destroy);
+static bool ApplyChange(StateMachine *sm, const State *nextState, void *args);
+static void ApplyPendingChanges(PendingList *list);
+static void FreeDestroyedMachines(PendingList *list);
+static bool BuildUpdateTasks(int *taskCount);
+static void RunUpdateTask(int task, void *context);
+static void UpdateSpan(const State *state, const StateGroup *group, int start,
+                       int count, float dt);
+static bool ReserveGroup(StateGroup *group);
+static void JoinGroup(StateMachine *sm, const State *state);
+static void LeaveGroup(StateMachine *sm);
 
 // --------------------------------------------------
 // Variables
@@ -32,13 +110,19 @@
 static bool warningsEnabled;
 static int stateCount;
 static StateTracker *tracker;
+static StateTracker staticTracker;
 static bool canMalloc = true;
+static _Thread_local StateMachine *activeMachine;
+static _Thread_local UpdateTask *activeTask;
+static float parallelDt;
 
 // --------------------------------------------------
 // Functions
 // --------------------------------------------------
 
-bool SM_Init(void) {
+bool SM_Init(void) { return SM_InitWithCapacity(0); }
+
+bool SM_InitWithCapacity(int capacity) {
 
   if (tracker) {
     SM_WARN("State Machine already initialized.");
@@ -50,9 +134,80 @@ bool SM_Init(void) {
     SM_ERR("Failed to allocate memory. State Machine not initialized.");
     return false;
   }
-  tracker->stateMap = NULL;
+  tracker->table = NULL;
+  tracker->arena = NULL;
+  tracker->stateMap = (StateMap){0};
+  tracker->states = NULL;
+  tracker->groups = NULL;
+  tracker->stateCapacity = 0;
   tracker->currState = NULL;
+  tracker->stack = NULL;
+  tracker->stackCount = 0;
+  tracker->stackCapacity = 0;
+  tracker->coalescing = COALESCE_LAST;
+  tracker->transitions = NULL;
+  tracker->transitionRows = 0;
+  tracker->eventCount = 0;
+  tracker->preloads = NULL;
+  tracker->preloadCount = 0;
+  tracker->loadingState = NULL;
+  tracker->waiting = NULL;
+  tracker->waitingArgs = NULL;
+  tracker->pending = (PendingList){0};
+  tracker->tasks = NULL;
+  tracker->taskCapacity = 0;
+  tracker->updatingAll = false;
+  tracker->applyingChanges = false;
+  tracker->frameArenas[0] = NULL;
+  tracker->frameArenas[1] = NULL;
+  tracker->frameIndex = 0;
+  tracker->argsArena = NULL;
+  tracker->argsSpare = NULL;
+  tracker->lastArgs = NULL;
+  tracker->copyingArgs = false;
+#ifdef SMILE_STATS
+  tracker->stats = NULL;
+  tracker->statsCount = 0;
+#endif
   stateCount = 0;
+  SM_Internal_ResetPostQueue();
+
+  size_t arenaSize = capacity * (sizeof(StateEntry) + SM_ARENA_NAME_GUESS);
+  if (capacity > 0 &&
+      (!ReserveStates(capacity) || !ReserveArena(&tracker->arena, arenaSize))) {
+    SM_ERR("Failed to allocate memory. State Machine not initialized.");
+    free(tracker->states);
+    free(tracker->groups);
+    SM_Internal_MapFree(&tracker->stateMap);
+    free(tracker);
+    tracker = NULL;
+    return false;
+  }
+
+#if defined(SMILE_WARNINGS) && !defined(SMILE_RELEASE)
+  SM_Internal_EnableWarnings(true);
+#endif
+
+  return true;
+}
+
+bool SM_InitStatic(const StateTable *table) {
+
+  if (tracker) {
+    SM_WARN("State Machine already initialized.");
+    return false;
+  }
+
+  if (!table || table->stateCount <= 0) {
+    SM_ERR("Can't initialize with an empty state table.");
+    return false;
+  }
+
+  // Lookups read the table in place, so there is nothing to build
+  staticTracker = (StateTracker){.table = table};
+  tracker = &staticTracker;
+  stateCount = table->stateCount;
+  SM_Internal_ResetPostQueue();
 
 #if defined(SMILE_WARNINGS) && !defined(SMILE_RELEASE)
   SM_Internal_EnableWarnings(true);
@@ -65,238 +220,1995 @@ void SM_Internal_EnableWarnings(bool toggle) { warningsEnabled = toggle; }
 
 bool SM_IsInitialized(void) { return tracker; }
 
-bool SM_RegisterState(const char *name, void (*enterFn)(void *),
-                      void (*updateFn)(float), void (*drawFn)(void),
-                      void (*exitFn)(void)) {
+StateHandle SM_RegisterState(const char *name, void (*enterFn)(void *),
+                             void (*updateFn)(float), void (*drawFn)(void),
+                             void (*exitFn)(void)) {
 
   if (!tracker) {
     SM_ERR("State Machine not initialized.");
-    return false;
+    return SM_INVALID_STATE;
+  }
+
+  if (tracker->table) {
+    SM_ERR("Can't register states with a static state table. No new state "
+           "created.");
+    return SM_INVALID_STATE;
   }
 
   if (!name) {
     SM_ERR("Can't register state with NULL name. No new state created.");
-    return false;
+    return SM_INVALID_STATE;
   }
 
-  if (strlen(name) == 0) {
-    SM_ERR("Can't register state with empty name. No new state created.");
-    return false;
+  // Names are stored trimmed, so lookups can trim and hash in one pass
+  const char *trimmed;
+  size_t length;
+  uint32_t hash = SM_Hash_TrimmedName(name, 0, &trimmed, &length);
+  if (length == 0) {
+    SM_ERR("Can't register state with empty or whitespace-only name. No new "
+           "state created.");
+    return SM_INVALID_STATE;
   }
 
-  if (SM_IsStateRegistered((char *)name)) {
+  if (SM_Internal_MapFind(&tracker->stateMap, trimmed, length, hash)) {
     SM_WARN("A state called '%s' already exists. No new state created.", name);
-    return false;
+    return SM_INVALID_STATE;
   }
 
   if (!enterFn && !updateFn && !drawFn && !exitFn) {
     SM_ERR("State '%s' has no valid functions. No new state created.", name);
-    return false;
+    return SM_INVALID_STATE;
   }
 
-  State *newState = malloc(sizeof(State));
-  if (!newState) {
+  if (stateCount == tracker->stateCapacity &&
+      !ReserveStates(tracker->stateCapacity ? tracker->stateCapacity * 2
+                                            : 16)) {
     SM_ERR("Failed to allocate memory. No new state '%s' created.", name);
-    return false;
+    return SM_INVALID_STATE;
   }
 
-  char *stateName = malloc(strlen(name) + 1);
-  if (!stateName) {
+  StateEntry *entry =
+      ArenaAlloc(&tracker->arena, sizeof(StateEntry) + length + 1);
+  if (!entry) {
     SM_ERR("Failed to allocate memory. No new state '%s' created.", name);
-    free(newState);
+    return SM_INVALID_STATE;
+  }
+  memcpy(entry->name, trimmed, length);
+  entry->name[length] = '\0';
+
+  State *newState = &entry->state;
+  *newState = (State){
+      .name = entry->name,
+      .handle = stateCount + 1,
+      .enter = enterFn,
+      .update = updateFn,
+      .draw = drawFn,
+      .exit = exitFn,
+  };
+
+  // Room was made by ReserveStates, so this can't fail
+  SM_Internal_MapInsert(&tracker->stateMap, hash, newState);
+  tracker->groups[stateCount] = (StateGroup){0};
+  tracker->states[stateCount++] = newState;
+
+  return newState->handle;
+}
+
+bool SM_IsStateRegistered(char *name) {
+  if (!tracker) {
+    SM_ERR("Can't find state. State Machine not initialized.");
     return false;
   }
-  strcpy(stateName, name);
 
-  newState->name = stateName;
-  newState->enter = enterFn;
-  newState->update = updateFn;
-  newState->draw = drawFn;
-  newState->exit = exitFn;
+  return SM_Internal_GetState(name);
+}
 
-  StateMap *temp = malloc(sizeof(StateMap));
-  if (!temp) {
-    free((char *)newState->name);
-    free(newState);
-    SM_ERR("Failed to allocate memory. No new state '%s' created.", name);
+StateHandle SM_GetStateHandle(const char *name) {
+
+  if (!name) {
+    return SM_INVALID_STATE;
+  }
+
+  const State *state = SM_Internal_GetState(name);
+  return state ? state->handle : SM_INVALID_STATE;
+}
+
+bool SM_ChangeStateTo(const char *name, void *args) {
+  PF_ZONE("SM_ChangeStateTo");
+
+  if (!tracker) {
+    SM_ERR("Can't change state. State Machine not initialized.");
     return false;
   }
-  temp->state = newState;
-  temp->name = newState->name;
-  HASH_ADD_STR(tracker->stateMap, name, temp);
 
-  stateCount++;
+  const State *nextState = StateToChangeTo(name);
+  if (!nextState) {
+    return false;
+  }
 
+  ChangeState(nextState, args);
   return true;
 }
 
-bool SM_IsStateRegistered(char *name) {
+bool SM_ChangeStateToHandle(StateHandle handle, void *args) {
+  PF_ZONE("SM_ChangeStateToHandle");
+
   if (!tracker) {
-    SM_ERR("Can't find state. State Machine not initialized.");
+    SM_ERR("Can't change state. State Machine not initialized.");
+    return false;
+  }
+
+  const State *nextState = SM_Internal_GetStateByHandle(handle);
+  if (!nextState) {
+    SM_WARN("Failed to find state with handle %u. Current state not changed.",
+            handle);
     return false;
   }
 
-  StateMap *entry;
-  HASH_FIND_STR(tracker->stateMap, name, entry);
-  return entry;
+  ChangeState(nextState, args);
+  return true;
 }
 
-bool SM_ChangeStateTo(const char *name, void *args) {
+bool SM_ChangeStateToWithArgs(const char *name, const void *args, size_t size) {
+  PF_ZONE("SM_ChangeStateToWithArgs");
 
   if (!tracker) {
     SM_ERR("Can't change state. State Machine not initialized.");
     return false;
   }
 
-  if (!name) {
-    SM_ERR("Can't change to state with NULL name. Current state not changed.");
+  const State *nextState = StateToChangeTo(name);
+  if (!nextState) {
     return false;
   }
 
-  if (strlen(name) == 0) {
-    SM_ERR("Can't change to state with empty name. Current state not changed.");
+  if (!args && size > 0) {
+    SM_ERR("Can't copy NULL args. Current state not changed.");
     return false;
   }
 
-  State *nextState = (State *)SM_Internal_GetState(name);
-  if (!nextState) {
-    SM_WARN("Failed to find state '%s'. Current state not changed.", name);
+  if (size == 0) {
+    ChangeState(nextState, NULL);
+    return true;
+  }
+
+  // The room made below is only safe until the copy if nothing else copies
+  if (tracker->copyingArgs) {
+    SM_ERR("Can't copy args from an exit function. Current state not changed.");
     return false;
   }
 
-  State *currState = (State *)SM_Internal_GetCurrState();
-  if (currState && currState->exit) {
-    currState->exit();
+  // Make room first, so a change never fails after the exit function ran
+  int depth = tracker->stackCount;
+  if (!ReserveArgs(size, depth)) {
+    SM_ERR("Failed to allocate memory. Current state not changed.");
+    return false;
   }
 
+  tracker->copyingArgs = true;
+  const State *shared = ExitForChange(nextState);
+  ArgsCopy *copy = CopyArgs(args, size, depth);
+  tracker->copyingArgs = false;
+
   SM_Internal_SetCurrState(nextState);
+  EnterFrom(shared, nextState, copy->data);
+  return true;
+}
+
+bool SM_PushState(const char *name, void *args) {
+
+  if (!tracker) {
+    SM_ERR("Can't push state. State Machine not initialized.");
+    return false;
+  }
+
+  const State *nextState = StateToChangeTo(name);
+  if (!nextState) {
+    return false;
+  }
+
+  return PushState(nextState, args);
+}
+
+bool SM_PushStateHandle(StateHandle handle, void *args) {
+
+  if (!tracker) {
+    SM_ERR("Can't push state. State Machine not initialized.");
+    return false;
+  }
+
+  const State *nextState = SM_Internal_GetStateByHandle(handle);
+  if (!nextState) {
+    SM_WARN("Failed to find state with handle %u. Current state not changed.",
+            handle);
+    return false;
+  }
+
+  return PushState(nextState, args);
+}
 
-  currState = (State *)SM_Internal_GetCurrState();
-  if (currState && currState->enter) {
-    currState->enter(args);
+bool SM_PopState(void) {
+
+  if (!tracker) {
+    SM_ERR("Can't pop state. State Machine not initialized.");
+    return false;
+  }
+
+  if (tracker->stackCount == 0) {
+    SM_WARN("No state under the current one. Current state not popped.");
+    return false;
   }
 
+  const State *currState = SM_Internal_GetCurrState();
+  const State *below = tracker->stack[--tracker->stackCount];
+  ExitUpTo(currState, SharedAncestor(currState, below));
+  ReleaseArgs(tracker->stackCount + 1);
+
+  tracker->waiting = NULL;
+  SM_Internal_SetCurrState(below);
+  if (below->resume) {
+    below->resume();
+  }
   return true;
 }
 
-bool SM_Update(float dt) {
+int SM_GetStackDepth(void) {
+
+  if (!tracker || !tracker->currState) {
+    return 0;
+  }
+  return tracker->stackCount + 1;
+}
+
+bool SM_SetStateStackOptions(const char *name, unsigned int flags,
+                             void (*pauseFn)(void), void (*resumeFn)(void)) {
+
   if (!tracker) {
-    SM_ERR("Not possible to update. State Machine not initialized.");
+    SM_ERR("Can't set stack options. State Machine not initialized.");
     return false;
   }
 
-  State *currState = (State *)SM_Internal_GetCurrState();
+  if (tracker->table) {
+    SM_ERR("Can't change the states of a static state table. Stack options "
+           "not set.");
+    return false;
+  }
 
-  if (!currState) {
-    SM_ERR("Not possible to update. No state set to current.");
+  if (!name) {
+    SM_ERR("Can't set stack options of state with NULL name.");
     return false;
   }
 
-  if (!currState->update) {
-    SM_WARN("Not possible to update state: \"%s\". Update function is NULL.",
-            currState->name);
+  // Registered states live in the arena, so they can be changed in place
+  State *state = (State *)SM_Internal_GetState(name);
+  if (!state) {
+    SM_WARN("Failed to find state '%s'. Stack options not set.", name);
     return false;
   }
 
-  currState->update(dt);
+  state->flags = flags;
+  state->pause = pauseFn;
+  state->resume = resumeFn;
   return true;
 }
 
-bool SM_Draw(void) {
+bool SM_SetStateParent(const char *name, const char *parent) {
+
   if (!tracker) {
-    SM_ERR("Not possible to draw. State Machine not initialized.");
+    SM_ERR("Can't set state parent. State Machine not initialized.");
     return false;
   }
 
-  State *currState = (State *)SM_Internal_GetCurrState();
+  if (tracker->table) {
+    SM_ERR("Can't change the states of a static state table. Parent not set.");
+    return false;
+  }
 
-  if (!currState) {
-    SM_ERR("Not possible to draw. No state set to current.");
+  if (!name) {
+    SM_ERR("Can't set parent of state with NULL name.");
     return false;
   }
 
-  if (!currState->draw) {
-    SM_WARN("Not possible to draw state: \"%s\". Draw function is NULL.",
-            currState->name);
+  State *state = (State *)SM_Internal_GetState(name);
+  const State *parentState = parent ? SM_Internal_GetState(parent) : NULL;
+  if (!state || (parent && !parentState)) {
+    SM_WARN("Failed to find state '%s'. Parent not set.",
+            state ? parent : name);
     return false;
   }
 
-  currState->draw();
+  // A state can't end up inside itself
+  for (const State *above = parentState; above; above = ParentOf(above)) {
+    if (above == state) {
+      SM_ERR("State '%s' is inside '%s' already. Parent not set.",
+             parentState->name, state->name);
+      return false;
+    }
+  }
+
+  state->parent = parentState ? parentState->handle : SM_INVALID_STATE;
   return true;
 }
 
-bool SM_Shutdown(void) {
+bool SM_SetStatePreload(const char *name, void (*preloadFn)(void)) {
 
   if (!tracker) {
-    SM_ERR("Failed to shutdown. State Machine not initialized.");
+    SM_ERR("Can't set preload function. State Machine not initialized.");
+    return false;
+  }
+
+  if (!name) {
+    SM_ERR("Can't set preload function of state with NULL name.");
     return false;
   }
 
-  State *currState = (State *)SM_Internal_GetCurrState();
-  if (currState && currState->exit) {
-    currState->exit();
+  const State *state = SM_Internal_GetState(name);
+  if (!state) {
+    SM_WARN("Failed to find state '%s'. Preload function not set.", name);
+    return false;
   }
-  SM_Internal_SetCurrState(NULL);
 
-  StateMap *el, *tmp;
-  HASH_ITER(hh, tracker->stateMap, el, tmp) {
-    HASH_DEL(tracker->stateMap, el);
-    free((char *)el->state->name);
-    free(el->state);
-    free(el);
-    stateCount--;
+  StatePreload *preload = PreloadOf(state);
+  if (preload) {
+    int status = atomic_load_explicit(&preload->status, memory_order_acquire);
+    if (status == PRELOAD_QUEUED || status == PRELOAD_RUNNING) {
+      SM_ERR("State '%s' is being preloaded. Preload function not set.",
+             state->name);
+      return false;
+    }
   }
 
-  free(tracker);
-  tracker = NULL;
+  if (!preloadFn) {
+    if (preload) {
+      free(preload);
+      tracker->preloads[state->handle - 1] = NULL;
+    }
+    return true;
+  }
+
+  if (!preload) {
+    if (!ReservePreloads(state->handle) ||
+        !(preload = calloc(1, sizeof(StatePreload)))) {
+      SM_ERR("Failed to allocate memory. Preload function not set.");
+      return false;
+    }
+    tracker->preloads[state->handle - 1] = preload;
+  }
 
+  preload->preload = preloadFn;
+  atomic_store_explicit(&preload->status, PRELOAD_IDLE, memory_order_relaxed);
   return true;
 }
 
-const char *SM_GetCurrStateName(void) {
+bool SM_PrefetchState(const char *name) {
 
   if (!tracker) {
-    SM_ERR("Can't get current state name. State Machine not initialized.");
-    return NULL;
+    SM_ERR("Can't prefetch state. State Machine not initialized.");
+    return false;
   }
 
-  return tracker->currState ? tracker->currState->name : NULL;
+  if (!name) {
+    SM_ERR("Can't prefetch state with NULL name.");
+    return false;
+  }
+
+  const State *state = SM_Internal_GetState(name);
+  if (!state) {
+    SM_WARN("Failed to find state '%s'. State not prefetched.", name);
+    return false;
+  }
+
+  return Prefetch(state);
 }
 
-// --------------------------------------------------
-// Functions - Internal
-// --------------------------------------------------
+bool SM_IsStateReady(const char *name) {
 
-bool SM_Internal_SetCurrState(const State *state) {
   if (!tracker) {
-    SM_ERR("State Machine not initialized.");
+    SM_ERR("Can't check state. State Machine not initialized.");
     return false;
   }
 
-  tracker->currState = state;
+  const State *state = SM_Internal_GetState(name);
+  return state && IsPreloaded(state);
+}
+
+bool SM_SetLoadingState(const char *name) {
+
+  if (!tracker) {
+    SM_ERR("Can't set loading state. State Machine not initialized.");
+    return false;
+  }
+
+  const State *state = name ? SM_Internal_GetState(name) : NULL;
+  if (name && !state) {
+    SM_WARN("Failed to find state '%s'. Loading state not set.", name);
+    return false;
+  }
+
+  tracker->loadingState = state;
   return true;
 }
 
-const State *SM_Internal_GetCurrState(void) {
+bool SM_ChangeStateToWhenReady(const char *name, void *args) {
 
   if (!tracker) {
-    SM_ERR("State Machine not initialized.");
-    return NULL;
+    SM_ERR("Can't change state. State Machine not initialized.");
+    return false;
   }
 
-  return tracker->currState;
+  const State *nextState = StateToChangeTo(name);
+  if (!nextState) {
+    return false;
+  }
+
+  if (IsPreloaded(nextState)) {
+    ChangeState(nextState, args);
+    return true;
+  }
+
+  if (!Prefetch(nextState)) {
+    return false;
+  }
+
+  const State *loadingState = tracker->loadingState;
+  if (loadingState && tracker->currState != loadingState) {
+    ChangeState(loadingState, NULL);
+  }
+
+  // Set last, since changing to the loading state cancels any earlier wait
+  tracker->waiting = nextState;
+  tracker->waitingArgs = args;
+  return true;
 }
 
-const State *SM_Internal_GetState(const char *name) {
+bool SM_PostStateChange(const char *name, void *args) {
 
   if (!tracker) {
-    SM_ERR("State Machine not initialized.");
-    return NULL;
+    SM_ERR("Can't post state change. State Machine not initialized.");
+    return false;
+  }
+
+  const State *nextState = StateToChangeTo(name);
+  if (!nextState) {
+    return false;
+  }
+
+  return SM_PostStateChangeHandle(nextState->handle, args);
+}
+
+bool SM_PostStateChangeHandle(StateHandle handle, void *args) {
+
+  if (!tracker) {
+    SM_ERR("Can't post state change. State Machine not initialized.");
+    return false;
+  }
+
+  if (!SM_Internal_GetStateByHandle(handle)) {
+    SM_WARN("Failed to find state with handle %u. State change not posted.",
+            handle);
+    return false;
+  }
+
+  if (!SM_Internal_PostChange((PostedChange){.handle = handle, .args = args})) {
+    SM_WARN("Post queue is full. State change not posted.");
+    return false;
+  }
+  return true;
+}
+
+bool SM_SetPostCoalescing(CoalesceMode mode) {
+
+  if (!tracker) {
+    SM_ERR("Can't set post coalescing. State Machine not initialized.");
+    return false;
+  }
+
+  tracker->coalescing = mode;
+  return true;
+}
+
+bool SM_RegisterTransition(const char *from, int event, const char *to) {
+  return SM_RegisterGuardedTransition(from, event, to, NULL);
+}
+
+bool SM_RegisterGuardedTransition(const char *from, int event, const char *to,
+                                  bool (*guardFn)(void *args)) {
+
+  if (!tracker) {
+    SM_ERR("Can't register transition. State Machine not initialized.");
+    return false;
+  }
+
+  if (!from || !to) {
+    SM_ERR("Can't register transition with NULL state name.");
+    return false;
+  }
+
+  if (event < 0) {
+    SM_ERR("Can't register transition for negative event %d.", event);
+    return false;
+  }
+
+  const State *fromState = SM_Internal_GetState(from);
+  const State *toState = SM_Internal_GetState(to);
+  if (!fromState || !toState) {
+    SM_WARN("Failed to find state '%s'. Transition not registered.",
+            fromState ? to : from);
+    return false;
+  }
+
+  if (!ReserveTransitions(fromState->handle, event + 1)) {
+    SM_ERR("Failed to allocate memory. Transition not registered.");
+    return false;
   }
 
-  StateMap *sm;
-  HASH_FIND_STR(tracker->stateMap, name, sm);
-  return sm ? sm->state : NULL;
+  Transition *transition =
+      &tracker->transitions[(fromState->handle - 1) * tracker->eventCount +
+                            event];
+  if (transition->to != SM_INVALID_STATE) {
+    SM_WARN("State '%s' already has a transition for event %d. Transition "
+            "not registered.",
+            fromState->name, event);
+    return false;
+  }
+
+  *transition = (Transition){.to = toState->handle, .guard = guardFn};
+  return true;
+}
+
+bool SM_Dispatch(int event, void *args) {
+
+  if (!tracker) {
+    SM_ERR("Can't dispatch event. State Machine not initialized.");
+    return false;
+  }
+
+  const State *currState = tracker->currState;
+  const Transition *transition =
+      FindTransition(currState ? currState->handle : SM_INVALID_STATE, event);
+  if (!transition || (transition->guard && !transition->guard(args))) {
+    return false;
+  }
+
+  ChangeState(StateAt(transition->to - 1), args);
+  return true;
+}
+
+bool SM_Update(float dt) {
+  PF_ZONE("SM_Update");
+  if (!tracker) {
+    SM_ERR("Not possible to update. State Machine not initialized.");
+    return false;
+  }
+
+  // The other arena keeps what the last frame allocated, for one more frame
+  tracker->frameIndex ^= 1;
+  ResetArena(&tracker->frameArenas[tracker->frameIndex]);
+
+  ApplyWaitingChange();
+  ApplyPostedChanges();
+
+  const State *currState = SM_Internal_GetCurrState();
+
+  if (!currState) {
+    SM_ERR("Not possible to update. No state set to current.");
+    return false;
+  }
+
+  // Bottom first, so an overlay sees the world it covers already updated.
+  // Parents shared with the state beneath already ran for it
+  const State *below = NULL;
+  for (int i = FirstRunningBelow(SM_UPDATE_BELOW); i < tracker->stackCount;
+       i++) {
+    const State *state = tracker->stack[i];
+    UpdateParents(state, SharedAncestor(below, state), dt);
+    if (state->update) {
+      SM_TIMED(state, update, state->update(dt));
+    }
+    below = state;
+  }
+
+  UpdateParents(currState, SharedAncestor(below, currState), dt);
+
+  if (!currState->update) {
+    if (ParentRuns(currState, false)) {
+      return true;
+    }
+    SM_WARN("Not possible to update state: \"%s\". Update function is NULL.",
+            currState->name);
+    return false;
+  }
+
+  SM_TIMED(currState, update, currState->update(dt));
+  return true;
+}
+
+bool SM_Draw(void) {
+  PF_ZONE("SM_Draw");
+  if (!tracker) {
+    SM_ERR("Not possible to draw. State Machine not initialized.");
+    return false;
+  }
+
+  const State *currState = SM_Internal_GetCurrState();
+
+  if (!currState) {
+    SM_ERR("Not possible to draw. No state set to current.");
+    return false;
+  }
+
+  // Bottom first, so each state draws over the ones under it. Parents shared
+  // with the state beneath were already drawn under it
+  const State *below = NULL;
+  for (int i = FirstRunningBelow(SM_DRAW_BELOW); i < tracker->stackCount;
+       i++) {
+    const State *state = tracker->stack[i];
+    DrawParents(state, SharedAncestor(below, state));
+    if (state->draw) {
+      SM_TIMED(state, draw, state->draw());
+    }
+    below = state;
+  }
+
+  DrawParents(currState, SharedAncestor(below, currState));
+
+  if (!currState->draw) {
+    if (ParentRuns(currState, true)) {
+      return true;
+    }
+    SM_WARN("Not possible to draw state: \"%s\". Draw function is NULL.",
+            currState->name);
+    return false;
+  }
+
+  SM_TIMED(currState, draw, currState->draw());
+  return true;
+}
+
+void *SM_FrameAlloc(size_t size) {
+
+  if (!tracker) {
+    SM_ERR("Can't allocate frame memory. State Machine not initialized.");
+    return NULL;
+  }
+
+  if (size == 0) {
+    SM_WARN("Can't allocate 0 bytes of frame memory.");
+    return NULL;
+  }
+
+  void *ptr = ArenaAlloc(&tracker->frameArenas[tracker->frameIndex], size);
+  if (!ptr) {
+    SM_ERR("Failed to allocate memory. No frame memory allocated.");
+  }
+  return ptr;
+}
+
+bool SM_GetStats(const char *name, StateStats *stats) {
+
+#ifdef SMILE_STATS
+  if (!tracker) {
+    SM_ERR("Can't get stats. State Machine not initialized.");
+    return false;
+  }
+
+  if (!stats) {
+    SM_ERR("Can't get stats into NULL.");
+    return false;
+  }
+
+  const State *state = SM_Internal_GetState(name);
+  if (!state) {
+    SM_ERR("Can't get stats of state: \"%s\". State not found.",
+           name ? name : "NULL");
+    return false;
+  }
+
+  // A state no function of which ran yet has no entry
+  if (state->handle <= (StateHandle)tracker->statsCount) {
+    *stats = tracker->stats[state->handle - 1];
+  } else {
+    *stats = (StateStats){0};
+  }
+  return true;
+#else
+  (void)name;
+  (void)stats;
+  SM_WARN("Can't get stats. SMILE was compiled without SMILE_STATS.");
+  return false;
+#endif
+}
+
+bool SM_ResetStats(void) {
+
+#ifdef SMILE_STATS
+  if (!tracker) {
+    SM_ERR("Can't reset stats. State Machine not initialized.");
+    return false;
+  }
+
+  for (int i = 0; i < tracker->statsCount; i++) {
+    tracker->stats[i] = (StateStats){0};
+  }
+  return true;
+#else
+  SM_WARN("Can't reset stats. SMILE was compiled without SMILE_STATS.");
+  return false;
+#endif
+}
+
+bool SM_Shutdown(void) {
+
+  if (!tracker) {
+    SM_ERR("Failed to shutdown. State Machine not initialized.");
+    return false;
+  }
+
+  // A preload may be using what the exit functions below free
+  SM_Internal_StopLoader();
+
+  // Paused states are still resident, so they get to clean up too. Parents
+  // shared with the state below are left for it to exit.
+  const State *state = SM_Internal_GetCurrState();
+  while (state) {
+    const State *below =
+        tracker->stackCount > 0 ? tracker->stack[--tracker->stackCount] : NULL;
+    ExitUpTo(state, below ? SharedAncestor(state, below) : NULL);
+    state = below;
+  }
+  SM_Internal_SetCurrState(NULL);
+  FreeArena(&tracker->argsArena);
+  FreeArena(&tracker->argsSpare);
+  FreeArena(&tracker->frameArenas[0]);
+  FreeArena(&tracker->frameArenas[1]);
+  free(tracker->stack);
+  free(tracker->transitions);
+  for (int i = 0; i < tracker->preloadCount; i++) {
+    free(tracker->preloads[i]);
+  }
+  free(tracker->preloads);
+#ifdef SMILE_STATS
+  free(tracker->stats);
+#endif
+
+  for (int i = 0; tracker->groups && i < stateCount; i++) {
+    free(tracker->groups[i].machines);
+    free(tracker->groups[i].entities);
+  }
+  free(tracker->groups);
+  stateCount = 0;
+
+  // States live in the arena, so only the map's slots are left to free
+  SM_Internal_MapFree(&tracker->stateMap);
+  FreeArena(&tracker->arena);
+
+  SM_Internal_StopWorkers();
+  for (int i = 0; i < tracker->taskCapacity; i++) {
+    free(tracker->tasks[i].pending.changes);
+  }
+  free(tracker->tasks);
+
+  free(tracker->states);
+  free(tracker->pending.changes);
+  if (tracker != &staticTracker) {
+    free(tracker);
+  }
+  tracker = NULL;
+
+  return true;
+}
+
+const char *SM_GetCurrStateName(void) {
+
+  if (!tracker) {
+    SM_ERR("Can't get current state name. State Machine not initialized.");
+    return NULL;
+  }
+
+  return tracker->currState ? tracker->currState->name : NULL;
+}
+
+StateMachine *SM_Create(void *userData) {
+
+  if (!tracker) {
+    SM_ERR("Can't create state machine. State Machine not initialized.");
+    return NULL;
+  }
+
+  StateMachine *sm = SM_Test_Malloc(sizeof(StateMachine));
+  if (!sm) {
+    SM_ERR("Failed to allocate memory. No new state machine created.");
+    return NULL;
+  }
+  sm->currState = SM_INVALID_STATE;
+  sm->groupIndex = -1;
+  sm->destroyed = false;
+  sm->userData = userData;
+
+  return sm;
+}
+
+bool SM_Destroy(StateMachine *sm) {
+
+  if (!sm) {
+    SM_ERR("Can't destroy NULL state machine.");
+    return false;
+  }
+
+  // Already queued, and freed once the queued changes are applied
+  if (sm->destroyed) {
+    return true;
+  }
+
+  // Queued changes may still name it, so it's only marked until they're done
+  if (tracker && (tracker->updatingAll || tracker->applyingChanges)) {
+    sm->destroyed = DeferChange(sm, NULL, NULL, true);
+    return sm->destroyed;
+  }
+
+  // After SM_Shutdown the handle means nothing anymore, so there is no exit
+  if (tracker) {
+    ChangeMachineState(sm, NULL, NULL);
+  }
+
+  free(sm);
+  return true;
+}
+
+bool SM_MachineChangeStateTo(StateMachine *sm, const char *name, void *args) {
+
+  if (!tracker) {
+    SM_ERR("Can't change state. State Machine not initialized.");
+    return false;
+  }
+
+  if (!sm) {
+    SM_ERR("Can't change state of NULL state machine.");
+    return false;
+  }
+
+  const State *nextState = StateToChangeTo(name);
+  if (!nextState) {
+    return false;
+  }
+
+  return ChangeMachineState(sm, nextState, args);
+}
+
+bool SM_MachineChangeStateToHandle(StateMachine *sm, StateHandle handle,
+                                   void *args) {
+
+  if (!tracker) {
+    SM_ERR("Can't change state. State Machine not initialized.");
+    return false;
+  }
+
+  if (!sm) {
+    SM_ERR("Can't change state of NULL state machine.");
+    return false;
+  }
+
+  const State *nextState = SM_Internal_GetStateByHandle(handle);
+  if (!nextState) {
+    SM_WARN("Failed to find state with handle %u. Current state not changed.",
+            handle);
+    return false;
+  }
+
+  return ChangeMachineState(sm, nextState, args);
+}
+
+bool SM_MachineDispatch(StateMachine *sm, int event, void *args) {
+
+  if (!tracker) {
+    SM_ERR("Can't dispatch event. State Machine not initialized.");
+    return false;
+  }
+
+  if (!sm) {
+    SM_ERR("Can't dispatch event to NULL state machine.");
+    return false;
+  }
+
+  const Transition *transition = FindTransition(sm->currState, event);
+  if (!transition) {
+    return false;
+  }
+
+  if (transition->guard) {
+    StateMachine *prevMachine = activeMachine;
+    activeMachine = sm;
+    bool allowed = transition->guard(args);
+    activeMachine = prevMachine;
+    if (!allowed) {
+      return false;
+    }
+  }
+
+  return ChangeMachineState(sm, StateAt(transition->to - 1), args);
+}
+
+bool SM_MachineUpdate(StateMachine *sm, float dt) {
+
+  if (!tracker) {
+    SM_ERR("Not possible to update. State Machine not initialized.");
+    return false;
+  }
+
+  if (!sm) {
+    SM_ERR("Not possible to update NULL state machine.");
+    return false;
+  }
+
+  const State *currState = SM_Internal_GetStateByHandle(sm->currState);
+
+  if (!currState) {
+    SM_ERR("Not possible to update. No state set to current.");
+    return false;
+  }
+
+  StateMachine *prevMachine = activeMachine;
+  activeMachine = sm;
+  UpdateParents(currState, NULL, dt);
+  if (currState->update) {
+    SM_TIMED(currState, update, currState->update(dt));
+  }
+  activeMachine = prevMachine;
+
+  if (!currState->update && !ParentRuns(currState, false)) {
+    SM_WARN("Not possible to update state: \"%s\". Update function is NULL.",
+            currState->name);
+    return false;
+  }
+  return true;
+}
+
+bool SM_MachineDraw(StateMachine *sm) {
+
+  if (!tracker) {
+    SM_ERR("Not possible to draw. State Machine not initialized.");
+    return false;
+  }
+
+  if (!sm) {
+    SM_ERR("Not possible to draw NULL state machine.");
+    return false;
+  }
+
+  const State *currState = SM_Internal_GetStateByHandle(sm->currState);
+
+  if (!currState) {
+    SM_ERR("Not possible to draw. No state set to current.");
+    return false;
+  }
+
+  StateMachine *prevMachine = activeMachine;
+  activeMachine = sm;
+  DrawParents(currState, NULL);
+  if (currState->draw) {
+    SM_TIMED(currState, draw, currState->draw());
+  }
+  activeMachine = prevMachine;
+
+  if (!currState->draw && !ParentRuns(currState, true)) {
+    SM_WARN("Not possible to draw state: \"%s\". Draw function is NULL.",
+            currState->name);
+    return false;
+  }
+  return true;
+}
+
+StateHandle SM_MachineGetCurrState(const StateMachine *sm) {
+  return sm ? sm->currState : SM_INVALID_STATE;
+}
+
+const char *SM_MachineGetCurrStateName(const StateMachine *sm) {
+
+  if (!tracker) {
+    SM_ERR("Can't get current state name. State Machine not initialized.");
+    return NULL;
+  }
+
+  if (!sm) {
+    return NULL;
+  }
+
+  const State *currState = SM_Internal_GetStateByHandle(sm->currState);
+  return currState ? currState->name : NULL;
+}
+
+void *SM_GetUserData(const StateMachine *sm) {
+  return sm ? sm->userData : NULL;
+}
+
+void SM_SetUserData(StateMachine *sm, void *userData) {
+
+  if (!sm) {
+    return;
+  }
+
+  sm->userData = userData;
+
+  const State *currState = SM_Internal_GetStateByHandle(sm->currState);
+  if (currState) {
+    GroupOf(currState)->entities[sm->groupIndex] = userData;
+  }
+}
+
+bool SM_SetStateBatchUpdate(const char *name,
+                            void (*updateBatchFn)(float dt, void **entities,
+                                                  int count)) {
+
+  if (!tracker) {
+    SM_ERR("Can't set batch update. State Machine not initialized.");
+    return false;
+  }
+
+  if (!name) {
+    SM_ERR("Can't set batch update of state with NULL name.");
+    return false;
+  }
+
+  const State *state = SM_Internal_GetState(name);
+  if (!state) {
+    SM_WARN("Failed to find state '%s'. Batch update not set.", name);
+    return false;
+  }
+
+  StateGroup *group = GroupOf(state);
+  if (!group) {
+    SM_ERR("Failed to allocate memory. Batch update not set.");
+    return false;
+  }
+
+  group->updateBatch = updateBatchFn;
+  return true;
+}
+
+bool SM_UpdateAll(float dt) {
+
+  if (!tracker) {
+    SM_ERR("Not possible to update all. State Machine not initialized.");
+    return false;
+  }
+
+  if (tracker->updatingAll || tracker->applyingChanges) {
+    SM_ERR("Not possible to update all from inside SM_UpdateAll.");
+    return false;
+  }
+
+  // Groups stay put while states update, so each one is walked as is
+  tracker->updatingAll = true;
+
+  for (int i = 0; tracker->groups && i < stateCount; i++) {
+    const StateGroup *group = &tracker->groups[i];
+    UpdateSpan(StateAt(i), group, 0, group->count, dt);
+  }
+
+  tracker->updatingAll = false;
+  tracker->applyingChanges = true;
+  ApplyPendingChanges(&tracker->pending);
+  tracker->applyingChanges = false;
+  FreeDestroyedMachines(&tracker->pending);
+
+  return true;
+}
+
+bool SM_UpdateAllParallel(float dt) {
+
+  if (!tracker) {
+    SM_ERR("Not possible to update all. State Machine not initialized.");
+    return false;
+  }
+
+  if (tracker->updatingAll || tracker->applyingChanges) {
+    SM_ERR("Not possible to update all from inside SM_UpdateAll.");
+    return false;
+  }
+
+  int taskCount;
+  if (!BuildUpdateTasks(&taskCount)) {
+    SM_ERR("Failed to allocate memory. Updating on one thread instead.");
+    return SM_UpdateAll(dt);
+  }
+
+  tracker->updatingAll = true;
+  parallelDt = dt;
+  SM_Internal_RunParallel(taskCount, RunUpdateTask, tracker->tasks);
+  tracker->updatingAll = false;
+
+  // Task order is state order, then group order, same as SM_UpdateAll.
+  // Destroys requested by enter and exit functions meanwhile go last
+  tracker->applyingChanges = true;
+  for (int i = 0; i < taskCount; i++) {
+    ApplyPendingChanges(&tracker->tasks[i].pending);
+  }
+  ApplyPendingChanges(&tracker->pending);
+  tracker->applyingChanges = false;
+
+  for (int i = 0; i < taskCount; i++) {
+    FreeDestroyedMachines(&tracker->tasks[i].pending);
+  }
+  FreeDestroyedMachines(&tracker->pending);
+
+  return true;
+}
+
+StateMachine *SM_GetActiveMachine(void) { return activeMachine; }
+
+// --------------------------------------------------
+// Functions - Internal
+// --------------------------------------------------
+
+bool SM_Internal_SetCurrState(const State *state) {
+  if (!tracker) {
+    SM_ERR("State Machine not initialized.");
+    return false;
+  }
+
+  tracker->currState = state;
+  return true;
+}
+
+const State *SM_Internal_GetCurrState(void) {
+
+  if (!tracker) {
+    SM_ERR("State Machine not initialized.");
+    return NULL;
+  }
+
+  return tracker->currState;
+}
+
+const State *SM_Internal_GetState(const char *name) {
+
+  if (!tracker) {
+    SM_ERR("State Machine not initialized.");
+    return NULL;
+  }
+
+  if (!name) {
+    return NULL;
+  }
+
+  // Whitespace-only names trim down to nothing, which never matches
+  const char *trimmed;
+  size_t length;
+  uint32_t hash = SM_Hash_TrimmedName(
+      name, tracker->table ? tracker->table->seed : 0, &trimmed, &length);
+
+  if (tracker->table) {
+    return FindStaticState(trimmed, length, hash);
+  }
+
+  StateHandle handle =
+      SM_Internal_MapFind(&tracker->stateMap, trimmed, length, hash);
+  return handle ? tracker->states[handle - 1] : NULL;
+}
+
+const State *SM_Internal_GetStateByHandle(StateHandle handle) {
+
+  if (!tracker) {
+    SM_ERR("State Machine not initialized.");
+    return NULL;
+  }
+
+  // Handles start at 1, so 0 wraps around and fails the bounds check too
+  unsigned index = handle - 1;
+  return index < (unsigned)stateCount ? StateAt(index) : NULL;
+}
+
+// --------------------------------------------------
+// Functions - Helpers
+// --------------------------------------------------
+
+static const State *StateAt(int index) {
+  return tracker->table ? &tracker->table->states[index]
+                        : tracker->states[index];
+}
+
+static const State *FindStaticState(const char *name, size_t length,
+                                    uint32_t hash) {
+
+  const StateTable *table = tracker->table;
+  uint32_t displacement = table->displacements[hash % table->bucketCount];
+  uint32_t slot = SM_Hash_Slot(hash, displacement, table->slotCount);
+
+  // Slots hold a handle, so 0 means empty. Unknown names can still land on a
+  // used slot, hence the one comparison.
+  StateHandle handle = table->slots[slot];
+  if (handle == SM_INVALID_STATE) {
+    return NULL;
+  }
+
+  const State *state = &table->states[handle - 1];
+  return SM_Hash_NameEquals(state->name, name, length) ? state : NULL;
+}
+
+static StateGroup *GroupOf(const State *state) {
+
+  // Static tables only get groups once an instance needs them
+  if (!tracker->groups) {
+    tracker->groups = calloc(stateCount, sizeof(StateGroup));
+    if (!tracker->groups) {
+      return NULL;
+    }
+  }
+
+  return &tracker->groups[state->handle - 1];
+}
+
+static bool ReserveStates(int capacity) {
+
+  if (capacity <= tracker->stateCapacity) {
+    return true;
+  }
+
+  State **states = realloc(tracker->states, capacity * sizeof(State *));
+  if (!states) {
+    return false;
+  }
+  tracker->states = states;
+
+  StateGroup *groups = realloc(tracker->groups, capacity * sizeof(StateGroup));
+  if (!groups) {
+    return false;
+  }
+  tracker->groups = groups;
+
+  if (!SM_Internal_MapReserve(&tracker->stateMap, capacity)) {
+    return false;
+  }
+
+  tracker->stateCapacity = capacity;
+  return true;
+}
+
+static bool ReserveArena(ArenaBlock **arena, size_t size) {
+
+  ArenaBlock *block = *arena;
+  if (block && block->capacity - block->used >= size) {
+    return true;
+  }
+
+  size_t capacity = block ? block->capacity * 2 : SM_ARENA_BLOCK_SIZE;
+  if (capacity < size) {
+    capacity = size;
+  }
+
+  // The rest of a full block is left unused, the next one is larger anyway
+  ArenaBlock *newBlock = SM_Test_Malloc(sizeof(ArenaBlock) + capacity);
+  if (!newBlock) {
+    return false;
+  }
+  newBlock->next = block;
+  newBlock->used = 0;
+  newBlock->capacity = capacity;
+  *arena = newBlock;
+  return true;
+}
+
+static void *ArenaAlloc(ArenaBlock **arena, size_t size) {
+
+  size = ArenaPieceSize(size);
+  if (!ReserveArena(arena, size)) {
+    return NULL;
+  }
+
+  ArenaBlock *block = *arena;
+  void *ptr = (char *)block->data + block->used;
+  block->used += size;
+  return ptr;
+}
+
+static size_t ArenaPieceSize(size_t size) {
+
+  // Every piece starts aligned like the block itself
+  return (size + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1);
+}
+
+static void ResetArena(ArenaBlock **arena) {
+
+  ArenaBlock *block = *arena;
+  if (!block) {
+    return;
+  }
+
+  // The newest block is the largest, keeping it alone is enough next time
+  FreeArena(&block->next);
+  block->used = 0;
+}
+
+static void FreeArena(ArenaBlock **arena) {
+
+  while (*arena) {
+    ArenaBlock *next = (*arena)->next;
+    free(*arena);
+    *arena = next;
+  }
+}
+
+static ArgsCopy *FirstArgsFrom(int depth) {
+
+  // Copies are stacked like their states, so those at `depth` and above are
+  // the newest ones
+  ArgsCopy *first = NULL;
+  for (ArgsCopy *copy = tracker->lastArgs; copy && copy->depth >= depth;
+       copy = copy->prev) {
+    first = copy;
+  }
+  return first;
+}
+
+static ArenaBlock *BlockHolding(const void *ptr) {
+
+  ArenaBlock *block = tracker->argsArena;
+  while ((const char *)ptr < (const char *)block->data ||
+         (const char *)ptr >= (const char *)block->data + block->capacity) {
+    block = block->next;
+  }
+  return block;
+}
+
+static bool ReserveArgs(size_t size, int depth) {
+
+  // Whatever this finds stays free until CopyArgs, since the exit function
+  // run in between can't copy args of its own
+
+  size = ArenaPieceSize(sizeof(ArgsCopy) + size);
+  ArenaBlock *head = tracker->argsArena;
+  ArenaBlock *spare = tracker->argsSpare;
+
+  // Room left once the copies ReleaseArgs(depth) frees are gone
+  ArgsCopy *first = FirstArgsFrom(depth);
+  ArenaBlock *block = first ? BlockHolding(first) : head;
+  size_t used = first ? (size_t)((char *)first - (char *)block->data)
+                      : (block ? block->used : 0);
+  if (block && block->capacity - used >= size) {
+    return true;
+  }
+
+  // Blocks newer than `block` are emptied too, and the largest one kept
+  if (block != head && head->capacity >= size) {
+    return true;
+  }
+  if (spare && spare->capacity >= size) {
+    return true;
+  }
+
+  ArenaBlock *newSpare = NULL;
+  if (!ReserveArena(&newSpare, size)) {
+    return false;
+  }
+  free(spare);
+  tracker->argsSpare = newSpare;
+  return true;
+}
+
+static ArgsCopy *CopyArgs(const void *args, size_t size, int depth) {
+
+  // A spare block large enough saves allocating a new one
+  ArenaBlock *head = tracker->argsArena;
+  ArenaBlock *spare = tracker->argsSpare;
+  size_t needed = ArenaPieceSize(sizeof(ArgsCopy) + size);
+  if ((!head || head->capacity - head->used < needed) && spare &&
+      spare->capacity >= needed) {
+    spare->next = head;
+    spare->used = 0;
+    tracker->argsArena = spare;
+    tracker->argsSpare = NULL;
+  }
+
+  ArgsCopy *copy = ArenaAlloc(&tracker->argsArena, needed);
+  if (!copy) {
+    return NULL;
+  }
+  copy->prev = tracker->lastArgs;
+  copy->depth = depth;
+  memcpy(copy->data, args, size);
+  tracker->lastArgs = copy;
+  return copy;
+}
+
+static void ReleaseArgs(int depth) {
+
+  ArgsCopy *first = FirstArgsFrom(depth);
+  if (!first) {
+    return;
+  }
+  tracker->lastArgs = first->prev;
+
+  // Blocks newer than the one holding `first` are emptied. Only the largest
+  // is kept, as the spare.
+  while (BlockHolding(first) != tracker->argsArena) {
+    ArenaBlock *block = tracker->argsArena;
+    tracker->argsArena = block->next;
+    if (!tracker->argsSpare ||
+        tracker->argsSpare->capacity < block->capacity) {
+      free(tracker->argsSpare);
+      block->next = NULL;
+      tracker->argsSpare = block;
+    } else {
+      free(block);
+    }
+  }
+  tracker->argsArena->used = (char *)first - (char *)tracker->argsArena->data;
+}
+
+static const State *StateToChangeTo(const char *name) {
+
+  if (!name) {
+    SM_ERR("Can't change to state with NULL name. Current state not changed.");
+    return NULL;
+  }
+
+  if (strlen(name) == 0) {
+    SM_ERR("Can't change to state with empty name. Current state not changed.");
+    return NULL;
+  }
+
+  const State *nextState = SM_Internal_GetState(name);
+  if (!nextState) {
+    SM_WARN("Failed to find state '%s'. Current state not changed.", name);
+  }
+  return nextState;
+}
+
+static void ChangeState(const State *nextState, void *args) {
+
+  const State *shared = ExitForChange(nextState);
+  SM_Internal_SetCurrState(nextState);
+  EnterFrom(shared, nextState, args);
+}
+
+static const State *ExitForChange(const State *nextState) {
+
+  // Moving on cancels waiting for a state to preload
+  tracker->waiting = NULL;
+
+  const State *currState = SM_Internal_GetCurrState();
+  const State *shared = SharedAncestor(currState, nextState);
+  ExitUpTo(currState, shared);
+
+  // Args copied for the state just exited go with it
+  ReleaseArgs(tracker->stackCount);
+  return shared;
+}
+
+static bool PushState(const State *nextState, void *args) {
+
+  const State *currState = SM_Internal_GetCurrState();
+  if (!currState) {
+    ChangeState(nextState, args);
+    return true;
+  }
+
+  if (tracker->stackCount == tracker->stackCapacity) {
+    int capacity = tracker->stackCapacity ? tracker->stackCapacity * 2 : 4;
+    const State **stack =
+        realloc(tracker->stack, capacity * sizeof(const State *));
+    if (!stack) {
+      SM_ERR("Failed to allocate memory. State '%s' not pushed.",
+             nextState->name);
+      return false;
+    }
+    tracker->stack = stack;
+    tracker->stackCapacity = capacity;
+  }
+
+  if (currState->pause) {
+    currState->pause();
+  }
+  tracker->stack[tracker->stackCount++] = currState;
+
+  // Covering the state waited from cancels the wait, like changing it does
+  tracker->waiting = NULL;
+  SM_Internal_SetCurrState(nextState);
+  EnterFrom(SharedAncestor(currState, nextState), nextState, args);
+  return true;
+}
+
+static int FirstRunningBelow(unsigned int flag) {
+
+  // Walk down for as long as each state lets the one under it run
+  int first = tracker->stackCount;
+  const State *above = tracker->currState;
+  while (first > 0 && (above->flags & flag)) {
+    above = tracker->stack[--first];
+  }
+  return first;
+}
+
+static void ApplyPostedChanges(void) {
+
+  // Only take what is there now, so changes posted by the enter functions
+  // below wait for the next frame instead of looping
+  PostedChange changes[SM_POST_QUEUE_SIZE];
+  int count = 0;
+  while (count < SM_POST_QUEUE_SIZE &&
+         SM_Internal_TakePostedChange(&changes[count])) {
+    count++;
+  }
+
+  if (count == 0) {
+    return;
+  }
+
+  int first = 0;
+  int end = count;
+  if (tracker->coalescing == COALESCE_LAST) {
+    first = count - 1;
+  } else if (tracker->coalescing == COALESCE_FIRST) {
+    end = 1;
+  }
+
+  for (int i = first; i < end; i++) {
+    ChangeState(SM_Internal_GetStateByHandle(changes[i].handle),
+                changes[i].args);
+  }
+}
+
+static const Transition *FindTransition(StateHandle from, int event) {
+
+  // Unsigned compares also reject SM_INVALID_STATE and negative events
+  if (from - 1 >= (unsigned int)tracker->transitionRows ||
+      (unsigned int)event >= (unsigned int)tracker->eventCount) {
+    return NULL;
+  }
+
+  const Transition *transition =
+      &tracker->transitions[(from - 1) * tracker->eventCount + event];
+  return transition->to != SM_INVALID_STATE ? transition : NULL;
+}
+
+static bool ReserveTransitions(int rows, int events) {
+
+  if (rows <= tracker->transitionRows && events <= tracker->eventCount) {
+    return true;
+  }
+
+  // Cover every state registered so far, so most tables are built only once
+  int newRows = rows > stateCount ? rows : stateCount;
+  int newEvents = events > tracker->eventCount ? events : tracker->eventCount;
+  Transition *transitions =
+      calloc((size_t)newRows * newEvents, sizeof(Transition));
+  if (!transitions) {
+    return false;
+  }
+
+  for (int row = 0; row < tracker->transitionRows; row++) {
+    memcpy(&transitions[row * newEvents],
+           &tracker->transitions[row * tracker->eventCount],
+           tracker->eventCount * sizeof(Transition));
+  }
+
+  free(tracker->transitions);
+  tracker->transitions = transitions;
+  tracker->transitionRows = newRows;
+  tracker->eventCount = newEvents;
+  return true;
+}
+
+static const State *ParentOf(const State *state) {
+  return state->parent != SM_INVALID_STATE ? StateAt(state->parent - 1) : NULL;
+}
+
+static const State *SharedAncestor(const State *from, const State *to) {
+
+  if (!from || !to) {
+    return NULL;
+  }
+
+  // Changing to the same state still exits and enters it, just not its parents
+  if (from == to) {
+    return ParentOf(from);
+  }
+
+  // A state counts as its own ancestor, so moving to a parent or a child only
+  // exits or enters what lies between them. Trees are shallow, so two plain
+  // walks beat keeping depths around.
+  for (const State *a = from; a; a = ParentOf(a)) {
+    for (const State *b = to; b; b = ParentOf(b)) {
+      if (a == b) {
+        return a;
+      }
+    }
+  }
+  return NULL;
+}
+
+static void ExitUpTo(const State *state, const State *ancestor) {
+
+  // Innermost first, `ancestor` itself stays entered
+  for (; state && state != ancestor; state = ParentOf(state)) {
+    if (state->exit) {
+      SM_TIMED(state, exit, state->exit());
+    }
+  }
+}
+
+static void EnterFrom(const State *ancestor, const State *state, void *args) {
+
+  if (!state || state == ancestor) {
+    return;
+  }
+
+  // Outermost first, and only the state changed to gets the args
+  EnterFrom(ancestor, ParentOf(state), NULL);
+  if (state->enter) {
+    SM_TIMED(state, enter, state->enter(args));
+  }
+}
+
+static void UpdateParents(const State *state, const State *done, float dt) {
+
+  // Outermost first, stopping at `done`, which ran along with its parents
+  const State *parent = ParentOf(state);
+  if (parent && parent != done) {
+    UpdateParents(parent, done, dt);
+    if (parent->update) {
+      SM_TIMED(parent, update, parent->update(dt));
+    }
+  }
+}
+
+static void DrawParents(const State *state, const State *done) {
+
+  const State *parent = ParentOf(state);
+  if (parent && parent != done) {
+    DrawParents(parent, done);
+    if (parent->draw) {
+      SM_TIMED(parent, draw, parent->draw());
+    }
+  }
+}
+
+static bool ParentRuns(const State *state, bool draw) {
+
+  // A child may leave the work to its parents, which is no mistake
+  for (const State *parent = ParentOf(state); parent;
+       parent = ParentOf(parent)) {
+    if (draw ? parent->draw != NULL : parent->update != NULL) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static StatePreload *PreloadOf(const State *state) {
+  return state->handle <= (StateHandle)tracker->preloadCount
+             ? tracker->preloads[state->handle - 1]
+             : NULL;
+}
+
+static bool ReservePreloads(int count) {
+
+  if (count <= tracker->preloadCount) {
+    return true;
+  }
+
+  // Only the pointers move, the loader thread holds on to the preloads
+  int capacity = count > stateCount ? count : stateCount;
+  StatePreload **preloads =
+      realloc(tracker->preloads, capacity * sizeof(StatePreload *));
+  if (!preloads) {
+    return false;
+  }
+
+  for (int i = tracker->preloadCount; i < capacity; i++) {
+    preloads[i] = NULL;
+  }
+  tracker->preloads = preloads;
+  tracker->preloadCount = capacity;
+  return true;
+}
+
+static bool IsPreloaded(const State *state) {
+
+  const StatePreload *preload = PreloadOf(state);
+  return !preload || atomic_load_explicit(&preload->status,
+                                          memory_order_acquire) == PRELOAD_DONE;
+}
+
+static bool Prefetch(const State *state) {
+
+  StatePreload *preload = PreloadOf(state);
+  if (preload && !SM_Internal_QueuePreload(preload)) {
+    SM_ERR("Failed to start the loader thread. State '%s' not prefetched.",
+           state->name);
+    return false;
+  }
+  return true;
+}
+
+static void ApplyWaitingChange(void) {
+
+  if (tracker->waiting && IsPreloaded(tracker->waiting)) {
+    ChangeState(tracker->waiting, tracker->waitingArgs);
+  }
+}
+
+#ifdef SMILE_STATS
+static long long StatsNow(void) {
+
+  // Read through the vDSO, so no system call is made
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void RecordCall(const State *state, size_t field, long long ns) {
+
+  // Worker threads would race on the counts, so parallel updates are left out
+  if (tracker->updatingAll || state->handle == SM_INVALID_STATE ||
+      !ReserveStateStats((int)state->handle)) {
+    return;
+  }
+
+  StateStats *stats = &tracker->stats[state->handle - 1];
+  CallStats *calls = (CallStats *)((char *)stats + field);
+  calls->calls++;
+  calls->totalNs += ns;
+  if (ns > calls->maxNs) {
+    calls->maxNs = ns;
+  }
+
+  int bucket = 0;
+  while ((ns >>= 1) && bucket < SM_STATS_BUCKETS - 1) {
+    bucket++;
+  }
+  calls->histogram[bucket]++;
+}
+
+static bool ReserveStateStats(int count) {
+
+  if (count <= tracker->statsCount) {
+    return true;
+  }
+
+  int capacity = count > stateCount ? count : stateCount;
+  StateStats *stats = realloc(tracker->stats, capacity * sizeof(StateStats));
+  if (!stats) {
+    return false;
+  }
+
+  for (int i = tracker->statsCount; i < capacity; i++) {
+    stats[i] = (StateStats){0};
+  }
+  tracker->stats = stats;
+  tracker->statsCount = capacity;
+  return true;
+}
+#endif
+
+static bool ChangeMachineState(StateMachine *sm, const State *nextState,
+                               void *args) {
+
+  // It's exited by its queued destroy, so it can't enter anything meanwhile
+  if (sm->destroyed) {
+    SM_WARN("State machine is being destroyed. Current state not changed.");
+    return false;
+  }
+
+  if (tracker->updatingAll) {
+    return DeferChange(sm, nextState, args, false);
+  }
+
+  return ApplyChange(sm, nextState, args);
+}
+
+static bool ApplyChange(StateMachine *sm, const State *nextState, void *args) {
+
+  // Make room first, so a change never fails after the exit function ran
+  const State *next = nextState;
+  StateGroup *nextGroup = next ? GroupOf(next) : NULL;
+  if (next && (!nextGroup || !ReserveGroup(nextGroup))) {
+    SM_ERR("Failed to allocate memory. Current state not changed.");
+    return false;
+  }
+
+  // Callbacks may drive another machine, so restore whichever was active
+  StateMachine *prevMachine = activeMachine;
+  activeMachine = sm;
+
+  const State *currState = SM_Internal_GetStateByHandle(sm->currState);
+  const State *shared = SharedAncestor(currState, next);
+  ExitUpTo(currState, shared);
+
+  LeaveGroup(sm);
+
+  // The exit function may have filled the room made above, or registered a
+  // state and moved the groups
+  if (next && ReserveGroup(GroupOf(next))) {
+    JoinGroup(sm, next);
+  } else if (next) {
+    SM_ERR("Failed to allocate memory. State '%s' not entered.", next->name);
+    ExitUpTo(shared, NULL);
+    next = NULL;
+  }
+
+  if (next) {
+    EnterFrom(shared, next, args);
+  }
+
+  activeMachine = prevMachine;
+  return next || !nextState;
+}
+
+static bool DeferChange(StateMachine *sm, const State *nextState, void *args,
+                        bool destroy) {
+
+  // Worker threads each queue into the task they are running
+  PendingList *list = activeTask ? &activeTask->pending : &tracker->pending;
+
+  if (list->count == list->capacity) {
+    int capacity = list->capacity ? list->capacity * 2 : 64;
+    PendingChange *changes =
+        realloc(list->changes, capacity * sizeof(PendingChange));
+    if (!changes) {
+      SM_ERR("Failed to allocate memory. Current state not changed.");
+      return false;
+    }
+    list->changes = changes;
+    list->capacity = capacity;
+  }
+
+  list->changes[list->count++] = (PendingChange){sm, nextState, args, destroy};
+  return true;
+}
+
+static void ApplyPendingChanges(PendingList *list) {
+
+  // No longer updating, so enter and exit functions change states right away.
+  // Those may queue destroys onto this list, which moves it
+  for (int i = 0; i < list->count; i++) {
+    PendingChange change = list->changes[i];
+    ApplyChange(change.machine, change.nextState, change.args);
+  }
+}
+
+static void FreeDestroyedMachines(PendingList *list) {
+
+  // A machine is only queued for destroy once, and nothing is queued for it
+  // after that, so every list is done with it by now
+  for (int i = 0; i < list->count; i++) {
+    if (list->changes[i].destroy) {
+      free(list->changes[i].machine);
+    }
+  }
+
+  list->count = 0;
+}
+
+static bool BuildUpdateTasks(int *taskCount) {
+
+  int count = 0;
+  for (int i = 0; tracker->groups && i < stateCount; i++) {
+    count += (tracker->groups[i].count + SM_PARALLEL_CHUNK - 1) /
+             SM_PARALLEL_CHUNK;
+  }
+
+  // Tasks are kept between calls so their pending lists keep their memory
+  if (count > tracker->taskCapacity) {
+    UpdateTask *tasks = realloc(tracker->tasks, count * sizeof(UpdateTask));
+    if (!tasks) {
+      return false;
+    }
+    for (int i = tracker->taskCapacity; i < count; i++) {
+      tasks[i].pending = (PendingList){0};
+    }
+    tracker->tasks = tasks;
+    tracker->taskCapacity = count;
+  }
+
+  int task = 0;
+  for (int i = 0; tracker->groups && i < stateCount; i++) {
+    const StateGroup *group = &tracker->groups[i];
+    for (int start = 0; start < group->count; start += SM_PARALLEL_CHUNK) {
+      int remaining = group->count - start;
+      tracker->tasks[task].state = StateAt(i);
+      tracker->tasks[task].group = group;
+      tracker->tasks[task].start = start;
+      tracker->tasks[task].count =
+          remaining < SM_PARALLEL_CHUNK ? remaining : SM_PARALLEL_CHUNK;
+      task++;
+    }
+  }
+
+  *taskCount = count;
+  return true;
+}
+
+static void RunUpdateTask(int task, void *context) {
+
+  UpdateTask *tasks = context;
+  activeTask = &tasks[task];
+  UpdateSpan(activeTask->state, activeTask->group, activeTask->start,
+             activeTask->count, parallelDt);
+  activeTask = NULL;
+}
+
+static void UpdateSpan(const State *state, const StateGroup *group, int start,
+                       int count, float dt) {
+
+  if (count == 0) {
+    return;
+  }
+
+  // Parents run per instance, before the state itself
+  if (state->parent != SM_INVALID_STATE) {
+    StateMachine *prevMachine = activeMachine;
+    for (int i = start; i < start + count; i++) {
+      activeMachine = group->machines[i];
+      UpdateParents(state, NULL, dt);
+    }
+    activeMachine = prevMachine;
+  }
+
+  if (group->updateBatch) {
+    group->updateBatch(dt, group->entities + start, count);
+  } else if (state->update) {
+    StateMachine *prevMachine = activeMachine;
+    for (int i = start; i < start + count; i++) {
+      activeMachine = group->machines[i];
+      state->update(dt);
+    }
+    activeMachine = prevMachine;
+  }
+}
+
+static bool ReserveGroup(StateGroup *group) {
+
+  if (group->count < group->capacity) {
+    return true;
+  }
+
+  int capacity = group->capacity ? group->capacity * 2 : 16;
+  StateMachine **machines =
+      realloc(group->machines, capacity * sizeof(StateMachine *));
+  if (!machines) {
+    return false;
+  }
+  group->machines = machines;
+
+  void **entities = realloc(group->entities, capacity * sizeof(void *));
+  if (!entities) {
+    return false;
+  }
+  group->entities = entities;
+
+  group->capacity = capacity;
+  return true;
+}
+
+static void JoinGroup(StateMachine *sm, const State *state) {
+
+  StateGroup *group = &tracker->groups[state->handle - 1];
+  sm->currState = state->handle;
+  sm->groupIndex = group->count;
+  group->machines[group->count] = sm;
+  group->entities[group->count] = sm->userData;
+  group->count++;
+}
+
+static void LeaveGroup(StateMachine *sm) {
+
+  StateHandle handle = sm->currState;
+  sm->currState = SM_INVALID_STATE;
+
+  if (!SM_Internal_GetStateByHandle(handle)) {
+    return;
+  }
+
+  // Swap the last member into the hole, so groups stay packed
+  StateGroup *group = &tracker->groups[handle - 1];
+  int last = --group->count;
+  if (sm->groupIndex != last) {
+    group->machines[sm->groupIndex] = group->machines[last];
+    group->entities[sm->groupIndex] = group->entities[last];
+    group->machines[sm->groupIndex]->groupIndex = sm->groupIndex;
+  }
+  sm->groupIndex = -1;
 }
 
 // --------------------------------------------------
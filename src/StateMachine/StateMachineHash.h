@@ -0,0 +1,126 @@
+#ifndef STATE_MACHINE_HASH_H
+#define STATE_MACHINE_HASH_H
+
+// --------------------------------------------------
+// Includes
+// --------------------------------------------------
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// --------------------------------------------------
+// Prototypes
+// --------------------------------------------------
+
+/**
+ * @brief Checks for whitespace like isspace in the C locale, without a call.
+ *
+ * @param c Character to check.
+ * @return true for spaces, tabs, line breaks, vertical tabs and form feeds.
+ * @author Vitor Betmann
+ */
+static inline bool SM_Hash_IsSpace(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/**
+ * @brief Trims a state name and hashes what is left, in a single pass.
+ *
+ * Leading and trailing whitespace is not part of a name, so " title " and
+ * "title" hash the same. Shared by the state machine and
+ * tools/StateTableGen.c, so generated tables always agree with the lookup.
+ * FNV-1a, finished with MurmurHash3's mixer.
+ *
+ * @param name   Null-terminated state name.
+ * @param seed   Seed of the table being searched.
+ * @param start  Set to the first character of the trimmed name.
+ * @param length Set to the length of the trimmed name, 0 if it was all
+ *               whitespace.
+ * @return uint32_t The hash of the trimmed name.
+ * @author Vitor Betmann
+ */
+static inline uint32_t SM_Hash_TrimmedName(const char *name, uint32_t seed,
+                                           const char **start,
+                                           size_t *length) {
+
+  while (SM_Hash_IsSpace(*name)) {
+    name++;
+  }
+
+  // Keep the hash as of the last non-space, so trailing spaces drop out
+  uint32_t hash = 2166136261u ^ seed;
+  uint32_t trimmedHash = hash;
+  const char *end = name;
+  for (const char *c = name; *c; c++) {
+    hash ^= (unsigned char)*c;
+    hash *= 16777619u;
+    if (!SM_Hash_IsSpace(*c)) {
+      trimmedHash = hash;
+      end = c + 1;
+    }
+  }
+
+  *start = name;
+  *length = (size_t)(end - name);
+
+  trimmedHash ^= trimmedHash >> 16;
+  trimmedHash *= 0x85EBCA6Bu;
+  trimmedHash ^= trimmedHash >> 13;
+  trimmedHash *= 0xC2B2AE35u;
+  trimmedHash ^= trimmedHash >> 16;
+  return trimmedHash;
+}
+
+/**
+ * @brief Hashes a state name, ignoring surrounding whitespace.
+ *
+ * @param name Null-terminated state name.
+ * @param seed Seed of the table being searched.
+ * @return uint32_t The hash.
+ * @author Vitor Betmann
+ */
+static inline uint32_t SM_Hash_Name(const char *name, uint32_t seed) {
+
+  const char *start;
+  size_t length;
+  return SM_Hash_TrimmedName(name, seed, &start, &length);
+}
+
+/**
+ * @brief Checks a state's name against a trimmed name.
+ *
+ * @param stateName Null-terminated name of a state.
+ * @param name      Trimmed name, not null-terminated.
+ * @param length    Length of `name`.
+ * @return true if they match.
+ * @author Vitor Betmann
+ */
+static inline bool SM_Hash_NameEquals(const char *stateName, const char *name,
+                                      size_t length) {
+  return strncmp(stateName, name, length) == 0 && stateName[length] == '\0';
+}
+
+/**
+ * @brief Picks a name's slot in a static state table.
+ *
+ * Names are spread over buckets by their hash first. Each bucket then has a
+ * displacement, chosen by the generator, that moves all of its names into
+ * free slots. The name is only read once, by SM_Hash_Name.
+ *
+ * @param hash         The name's SM_Hash_Name.
+ * @param displacement Displacement of the name's bucket.
+ * @param slotCount    Number of slots in the table.
+ * @return uint32_t The slot.
+ * @author Vitor Betmann
+ */
+static inline uint32_t SM_Hash_Slot(uint32_t hash, uint32_t displacement,
+                                    uint32_t slotCount) {
+
+  hash ^= displacement * 0x9E3779B9u;
+  hash ^= hash >> 16;
+  hash *= 0x7FEB352Du;
+  hash ^= hash >> 15;
+  return hash % slotCount;
+}
+
+#endif
@@ -1,49 +1,263 @@
-// TODO(#9) create internal function to trim leading and trailing whitespace
-
 #ifndef STATE_MACHINE_INTERNAL_H
 #define STATE_MACHINE_INTERNAL_H
 
 // --------------------------------------------------
 // Includes
 // --------------------------------------------------
-#include "../../external/uthash.h"
 #include "StateMachine.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
 
 // --------------------------------------------------
 // Data types
 // --------------------------------------------------
 
 /**
- * @brief Internal representation of a state.
+ * @brief Internal list of the instances currently in one state.
  *
- * Each state can optionally define enter, update, draw, and exit callbacks.
+ * `entities` holds the user data of `machines`, in the same order, packed
+ * next to each other for `updateBatch`. Kept apart from State, so states can
+ * live in a const table.
  * @author Vitor Betmann
  */
-struct State {
-  const char *name;
-  void (*enter)(void *args);
-  void (*update)(float dt);
-  void (*draw)();
-  void (*exit)();
-};
+typedef struct {
+  StateMachine **machines;
+  void **entities;
+  int count;
+  int capacity;
+  void (*updateBatch)(float dt, void **entities, int count);
+} StateGroup;
 
 /**
- * @brief Internal hash entry mapping a state's name to its struct.
+ * @brief Internal slot of the name map.
+ *
+ * `handle` is SM_INVALID_STATE while the slot is free. The name's hash is
+ * kept next to it, so most mismatches are rejected without reading a name,
+ * and a match reads the name straight from the slot.
  * @author Vitor Betmann
  */
 typedef struct {
+  uint32_t hash;
+  StateHandle handle;
   const char *name;
-  State *state;
-  UT_hash_handle hh;
+} StateSlot;
+
+/**
+ * @brief Internal open-addressing map from state names to handles.
+ *
+ * One flat array of slots with linear, Robin Hood probing. `capacity` is
+ * always a power of two.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  StateSlot *slots;
+  int capacity;
+  int count;
 } StateMap;
 
+/**
+ * @brief Internal registration record of a state.
+ *
+ * The state and its trimmed name are carved out of the tracker's arena as
+ * one piece, so registering a state is a single bump of a pointer and
+ * consecutive states sit next to each other in memory.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  State state;
+  char name[];
+} StateEntry;
+
+/**
+ * @brief Internal block of one of the tracker's arenas.
+ *
+ * Blocks are chained, newest first. Each is twice as large as the one before,
+ * so the newest is also the largest. The state arena's are only freed by
+ * SM_Shutdown.
+ * @author Vitor Betmann
+ */
+typedef struct ArenaBlock {
+  struct ArenaBlock *next;
+  size_t used;
+  size_t capacity;
+  max_align_t data[];
+} ArenaBlock;
+
+/**
+ * @brief Internal copy of the args SM_ChangeStateToWithArgs was given.
+ *
+ * Carved out of the tracker's args arena, after whatever was copied for the
+ * states under it on the stack, so copies are always freed newest first.
+ * `depth` is the stack level of the state the copy belongs to, and `prev` the
+ * copy made before it.
+ * @author Vitor Betmann
+ */
+typedef struct ArgsCopy {
+  struct ArgsCopy *prev;
+  int depth;
+  max_align_t data[];
+} ArgsCopy;
+
+/**
+ * @brief Internal state change queued until SM_UpdateAll or
+ * SM_UpdateAllParallel is done.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  StateMachine *machine;
+  const State *nextState;
+  void *args;
+  bool destroy;
+} PendingChange;
+
+/**
+ * @brief Internal list of queued state changes.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  PendingChange *changes;
+  int count;
+  int capacity;
+} PendingList;
+
+/**
+ * @brief Internal entry of the transition table.
+ *
+ * `to` is SM_INVALID_STATE where a state has no transition for an event.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  StateHandle to;
+  bool (*guard)(void *args);
+} Transition;
+
+/**
+ * @brief Internal progress of a state's preload function.
+ * @author Vitor Betmann
+ */
+typedef enum {
+  PRELOAD_IDLE,
+  PRELOAD_QUEUED,
+  PRELOAD_RUNNING,
+  PRELOAD_DONE,
+} PreloadStatus;
+
+/**
+ * @brief Internal preload function of a state, and how far it got.
+ *
+ * Allocated on its own and never moved, so the loader thread can hold on to
+ * it while states are registered. Kept apart from State, so states can live
+ * in a const table. `status` is a PreloadStatus, read by the main thread
+ * without locking. `next` chains the loader's queue.
+ * @author Vitor Betmann
+ */
+typedef struct StatePreload {
+  void (*preload)(void);
+  atomic_int status;
+  struct StatePreload *next;
+} StatePreload;
+
+/**
+ * @brief Internal state change posted with SM_PostStateChange.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  StateHandle handle;
+  void *args;
+} PostedChange;
+
+/**
+ * @brief Internal slice of a state's group updated as one unit of work.
+ *
+ * SM_UpdateAllParallel splits groups into tasks. Each task queues the state
+ * changes its instances request in its own `pending` list, and the lists are
+ * applied in task order, which is the order SM_UpdateAll would use.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  const State *state;
+  const StateGroup *group;
+  int start;
+  int count;
+  PendingList pending;
+} UpdateTask;
+
 /**
  * @brief Internal tracker holding the registered states and the current state.
+ *
+ * `states` lists every state in registration order, so a handle is its index
+ * plus one. `stateMap` resolves names to handles. `states` points into
+ * `arena`, which holds every StateEntry. With SM_InitStatic, `table` replaces
+ * all three. `groups` is indexed like the states. `stack` holds the states
+ * pushed under `currState`, bottom first. `coalescing` picks which posted
+ * changes SM_Update applies. `transitions` has a row of `eventCount` entries
+ * for each of the first `transitionRows` states. `preloads` is indexed like
+ * the states, with NULL for states without a preload function. `waiting` is
+ * the state SM_ChangeStateToWhenReady will change to once it's preloaded, and
+ * `waitingArgs` its args. Instances changing state during SM_UpdateAll are
+ * queued in `pending` and moved once it's done, and `applyingChanges` is set
+ * while they are, since destroys stay queued until then. SM_FrameAlloc carves
+ * from `frameArenas[frameIndex]`, and SM_Update swaps the two. `argsArena`
+ * holds the ArgsCopy list ending in `lastArgs`, and `argsSpare` the largest
+ * block it emptied, kept for the next copy. `copyingArgs` is set while
+ * SM_ChangeStateToWithArgs exits the current state, between making room for
+ * its copy and making it. With SMILE_STATS, `stats` is indexed
+ * like the states and grows as they're first called.
  * @author Vitor Betmann
  */
 struct StateTracker {
-  StateMap *stateMap;
+  const StateTable *table;
+  ArenaBlock *arena;
+  StateMap stateMap;
+  State **states;
+  StateGroup *groups;
+  int stateCapacity;
   const State *currState;
+  const State **stack;
+  int stackCount;
+  int stackCapacity;
+  CoalesceMode coalescing;
+  Transition *transitions;
+  int transitionRows;
+  int eventCount;
+  StatePreload **preloads;
+  int preloadCount;
+  const State *loadingState;
+  const State *waiting;
+  void *waitingArgs;
+  PendingList pending;
+  UpdateTask *tasks;
+  int taskCapacity;
+  bool updatingAll;
+  bool applyingChanges;
+  ArenaBlock *frameArenas[2];
+  int frameIndex;
+  ArenaBlock *argsArena;
+  ArenaBlock *argsSpare;
+  ArgsCopy *lastArgs;
+  bool copyingArgs;
+#ifdef SMILE_STATS
+  StateStats *stats;
+  int statsCount;
+#endif
+};
+
+/**
+ * @brief Internal representation of a state machine instance.
+ *
+ * Holds a handle rather than a pointer, so every instance shares the states
+ * registered in the tracker and stays small. `groupIndex` is its slot in its
+ * current state's group, or -1 if it has no state. `destroyed` is set once
+ * SM_Destroy queued it during SM_UpdateAll, and shares `groupIndex`'s word so
+ * the instance doesn't grow.
+ * @author Vitor Betmann
+ */
+struct StateMachine {
+  StateHandle currState;
+  int groupIndex : 31;
+  bool destroyed : 1;
+  void *userData;
 };
 
 // --------------------------------------------------
@@ -77,8 +291,9 @@ const State *SM_Internal_GetCurrState(void);
 /**
  * @brief Looks up a state by its registered name.
  *
- * For internal use only. Performs a hash table lookup and returns a pointer
- * to the internal state if found.
+ * For internal use only. Surrounding whitespace in `name` is ignored.
+ * Performs a hash table lookup and returns a pointer to the internal state if
+ * found.
  *
  * @param name Name of the state to find.
  * @return const State* Pointer to the matching state, or NULL if not found or
@@ -87,6 +302,18 @@ const State *SM_Internal_GetCurrState(void);
  */
 const State *SM_Internal_GetState(const char *name);
 
+/**
+ * @brief Looks up a state by its handle.
+ *
+ * For internal use only.
+ *
+ * @param handle Handle of the state to find.
+ * @return const State* Pointer to the matching state, or NULL if the handle
+ * is invalid or the machine is uninitialized.
+ * @author Vitor Betmann
+ */
+const State *SM_Internal_GetStateByHandle(StateHandle handle);
+
 /**
  * @brief Enables or disables debug-mode warnings at runtime.
  *
@@ -103,4 +330,131 @@ const State *SM_Internal_GetState(const char *name);
  */
 void SM_Internal_EnableWarnings(bool toggle);
 
+/**
+ * @brief Runs tasks on the worker threads and waits for all of them.
+ *
+ * For internal use only. Tasks are split evenly between the threads, and a
+ * thread that runs out steals from the others. The calling thread works too.
+ * Starts the workers on first use.
+ *
+ * @param taskCount Number of tasks.
+ * @param run       Called once per task index, from any thread.
+ * @param context   Passed along to `run`.
+ * @author Vitor Betmann
+ */
+void SM_Internal_RunParallel(int taskCount, void (*run)(int task, void *context),
+                             void *context);
+
+/**
+ * @brief Stops and joins the worker threads.
+ *
+ * For internal use only. They start again on the next parallel update.
+ * @author Vitor Betmann
+ */
+void SM_Internal_StopWorkers(void);
+
+/**
+ * @brief Empties the post queue.
+ *
+ * For internal use only. Must not be called while any thread is posting.
+ * @author Vitor Betmann
+ */
+void SM_Internal_ResetPostQueue(void);
+
+/**
+ * @brief Adds a state change to the post queue.
+ *
+ * For internal use only. Safe to call from any number of threads at once,
+ * without locking.
+ *
+ * @param change The change to post.
+ * @return true if posted, false if the queue is full.
+ * @author Vitor Betmann
+ */
+bool SM_Internal_PostChange(PostedChange change);
+
+/**
+ * @brief Takes the oldest state change out of the post queue.
+ *
+ * For internal use only. Must only be called from one thread at a time.
+ *
+ * @param change Set to the change, if there was one.
+ * @return true if a change was taken, false if the queue was empty.
+ * @author Vitor Betmann
+ */
+bool SM_Internal_TakePostedChange(PostedChange *change);
+
+/**
+ * @brief Queues a state's preload function on the loader thread.
+ *
+ * For internal use only. Starts the loader thread on first use. Does nothing
+ * unless the preload is PRELOAD_IDLE.
+ *
+ * @param preload The state's preload.
+ * @return true if queued or already queued, running or done, false if the
+ * loader thread could not be started.
+ * @author Vitor Betmann
+ */
+bool SM_Internal_QueuePreload(StatePreload *preload);
+
+/**
+ * @brief Stops and joins the loader thread.
+ *
+ * For internal use only. Waits for the preload function running, if any.
+ * Queued ones that haven't started go back to PRELOAD_IDLE.
+ * @author Vitor Betmann
+ */
+void SM_Internal_StopLoader(void);
+
+/**
+ * @brief Makes room in a name map for `count` names.
+ *
+ * For internal use only. Inserting up to `count` names never allocates after
+ * this.
+ *
+ * @param map   The map.
+ * @param count Number of names it should hold.
+ * @return true on success, false if memory allocation failed.
+ * @author Vitor Betmann
+ */
+bool SM_Internal_MapReserve(StateMap *map, int count);
+
+/**
+ * @brief Adds a name to a name map.
+ *
+ * For internal use only. Room must have been made with
+ * SM_Internal_MapReserve, and the name must not be in the map yet.
+ *
+ * @param map   The map.
+ * @param hash  SM_Hash_TrimmedName of the state's name, with seed 0.
+ * @param state The state, whose name must outlive the map.
+ * @author Vitor Betmann
+ */
+void SM_Internal_MapInsert(StateMap *map, uint32_t hash, const State *state);
+
+/**
+ * @brief Finds a name in a name map.
+ *
+ * For internal use only.
+ *
+ * @param map    The map.
+ * @param name   Trimmed name, not null-terminated.
+ * @param length Length of `name`.
+ * @param hash   SM_Hash_TrimmedName of the name, with seed 0.
+ * @return StateHandle The state's handle, or SM_INVALID_STATE if not found.
+ * @author Vitor Betmann
+ */
+StateHandle SM_Internal_MapFind(const StateMap *map, const char *name,
+                                size_t length, uint32_t hash);
+
+/**
+ * @brief Frees a name map's slots and empties it.
+ *
+ * For internal use only.
+ *
+ * @param map The map.
+ * @author Vitor Betmann
+ */
+void SM_Internal_MapFree(StateMap *map);
+
 #endif
\ No newline at end of file
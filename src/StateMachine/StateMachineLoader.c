@@ -0,0 +1,118 @@
+// --------------------------------------------------
+// Includes
+// --------------------------------------------------
+#include "StateMachine.h"
+#include "StateMachineInternal.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+// --------------------------------------------------
+// Prototypes
+// --------------------------------------------------
+static void *LoaderMain(void *arg);
+
+// --------------------------------------------------
+// Variables
+// --------------------------------------------------
+static pthread_t loader;
+static bool loaderRunning;
+
+static pthread_mutex_t loaderLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeLoader = PTHREAD_COND_INITIALIZER;
+static StatePreload *queueHead;
+static StatePreload *queueTail;
+static bool stopping;
+
+// --------------------------------------------------
+// Functions - Internal
+// --------------------------------------------------
+
+bool SM_Internal_QueuePreload(StatePreload *preload) {
+
+  if (atomic_load_explicit(&preload->status, memory_order_acquire) !=
+      PRELOAD_IDLE) {
+    return true;
+  }
+
+  // One thread is enough: loading is bound by the disk, not the CPU
+  if (!loaderRunning) {
+    if (pthread_create(&loader, NULL, LoaderMain, NULL)) {
+      return false;
+    }
+    loaderRunning = true;
+  }
+
+  pthread_mutex_lock(&loaderLock);
+  atomic_store_explicit(&preload->status, PRELOAD_QUEUED,
+                        memory_order_relaxed);
+  preload->next = NULL;
+  if (queueTail) {
+    queueTail->next = preload;
+  } else {
+    queueHead = preload;
+  }
+  queueTail = preload;
+  pthread_cond_signal(&wakeLoader);
+  pthread_mutex_unlock(&loaderLock);
+  return true;
+}
+
+void SM_Internal_StopLoader(void) {
+
+  if (!loaderRunning) {
+    return;
+  }
+
+  pthread_mutex_lock(&loaderLock);
+  stopping = true;
+  for (StatePreload *preload = queueHead; preload; preload = preload->next) {
+    atomic_store_explicit(&preload->status, PRELOAD_IDLE,
+                          memory_order_relaxed);
+  }
+  queueHead = NULL;
+  queueTail = NULL;
+  pthread_cond_signal(&wakeLoader);
+  pthread_mutex_unlock(&loaderLock);
+
+  pthread_join(loader, NULL);
+  loaderRunning = false;
+  stopping = false;
+}
+
+// --------------------------------------------------
+// Functions - Helpers
+// --------------------------------------------------
+
+static void *LoaderMain(void *arg) {
+
+  (void)arg;
+
+  pthread_mutex_lock(&loaderLock);
+  for (;;) {
+    while (!queueHead && !stopping) {
+      pthread_cond_wait(&wakeLoader, &loaderLock);
+    }
+    if (stopping) {
+      break;
+    }
+
+    StatePreload *preload = queueHead;
+    queueHead = preload->next;
+    if (!queueHead) {
+      queueTail = NULL;
+    }
+    atomic_store_explicit(&preload->status, PRELOAD_RUNNING,
+                          memory_order_relaxed);
+    pthread_mutex_unlock(&loaderLock);
+
+    // Whatever the preload function wrote is published along with DONE
+    preload->preload();
+    atomic_store_explicit(&preload->status, PRELOAD_DONE,
+                          memory_order_release);
+
+    pthread_mutex_lock(&loaderLock);
+  }
+  pthread_mutex_unlock(&loaderLock);
+
+  return NULL;
+}
@@ -0,0 +1,126 @@
+// --------------------------------------------------
+// Includes
+// --------------------------------------------------
+#include "StateMachine.h"
+#include "StateMachineHash.h"
+#include "StateMachineInternal.h"
+#include <stdlib.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+// Smallest table, and the most a table fills before it grows: 3/4
+#define MAP_MIN_CAPACITY 16
+#define MAP_LOAD_NUM 3
+#define MAP_LOAD_DEN 4
+
+// --------------------------------------------------
+// Prototypes
+// --------------------------------------------------
+static void Insert(StateSlot *slots, int capacity, StateSlot entry);
+static uint32_t DistanceAt(const StateSlot *slot, uint32_t index,
+                           uint32_t mask);
+
+// --------------------------------------------------
+// Functions - Internal
+// --------------------------------------------------
+
+bool SM_Internal_MapReserve(StateMap *map, int count) {
+
+  int capacity = map->capacity ? map->capacity : MAP_MIN_CAPACITY;
+  while ((long)count * MAP_LOAD_DEN > (long)capacity * MAP_LOAD_NUM) {
+    capacity *= 2;
+  }
+
+  if (capacity == map->capacity) {
+    return true;
+  }
+
+  StateSlot *slots = calloc(capacity, sizeof(StateSlot));
+  if (!slots) {
+    return false;
+  }
+
+  // Hashes are stored, so growing never reads a name
+  for (int i = 0; i < map->capacity; i++) {
+    if (map->slots[i].handle != SM_INVALID_STATE) {
+      Insert(slots, capacity, map->slots[i]);
+    }
+  }
+
+  free(map->slots);
+  map->slots = slots;
+  map->capacity = capacity;
+  return true;
+}
+
+void SM_Internal_MapInsert(StateMap *map, uint32_t hash, const State *state) {
+
+  StateSlot entry = {
+      .hash = hash, .handle = state->handle, .name = state->name};
+  Insert(map->slots, map->capacity, entry);
+  map->count++;
+}
+
+StateHandle SM_Internal_MapFind(const StateMap *map, const char *name,
+                                size_t length, uint32_t hash) {
+
+  if (map->count == 0) {
+    return SM_INVALID_STATE;
+  }
+
+  uint32_t mask = (uint32_t)map->capacity - 1;
+  uint32_t index = hash & mask;
+  for (uint32_t distance = 0;; distance++, index = (index + 1) & mask) {
+    const StateSlot *slot = &map->slots[index];
+
+    // Robin Hood keeps runs sorted by distance, so a closer resident means
+    // the name would have been placed here already
+    if (slot->handle == SM_INVALID_STATE ||
+        DistanceAt(slot, index, mask) < distance) {
+      return SM_INVALID_STATE;
+    }
+
+    if (slot->hash == hash && SM_Hash_NameEquals(slot->name, name, length)) {
+      return slot->handle;
+    }
+  }
+}
+
+void SM_Internal_MapFree(StateMap *map) {
+
+  free(map->slots);
+  *map = (StateMap){0};
+}
+
+// --------------------------------------------------
+// Functions - Helpers
+// --------------------------------------------------
+
+static void Insert(StateSlot *slots, int capacity, StateSlot entry) {
+
+  uint32_t mask = (uint32_t)capacity - 1;
+  uint32_t index = entry.hash & mask;
+  for (uint32_t distance = 0;; distance++, index = (index + 1) & mask) {
+    StateSlot *slot = &slots[index];
+    if (slot->handle == SM_INVALID_STATE) {
+      *slot = entry;
+      return;
+    }
+
+    // Take the place of entries closer to home, and carry them on instead
+    uint32_t slotDistance = DistanceAt(slot, index, mask);
+    if (slotDistance < distance) {
+      StateSlot evicted = *slot;
+      *slot = entry;
+      entry = evicted;
+      distance = slotDistance;
+    }
+  }
+}
+
+static uint32_t DistanceAt(const StateSlot *slot, uint32_t index,
+                           uint32_t mask) {
+  return (index - (slot->hash & mask)) & mask;
+}
@@ -0,0 +1,221 @@
+// --------------------------------------------------
+// Includes
+// --------------------------------------------------
+#include "StateMachine.h"
+#include "StateMachineInternal.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+#define CACHE_LINE 64
+
+// --------------------------------------------------
+// Data types
+// --------------------------------------------------
+
+/**
+ * @brief Range of tasks handed to one thread.
+ *
+ * The owner and any thief claim tasks the same way, by bumping `next`, so a
+ * task is never run twice. Each queue sits on its own cache line.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  _Alignas(CACHE_LINE) atomic_int next;
+  int end;
+} TaskQueue;
+
+// --------------------------------------------------
+// Prototypes
+// --------------------------------------------------
+static bool StartWorkers(void);
+static void *WorkerMain(void *arg);
+static void RunQueues(int self);
+static int OnlineCpuCount(void);
+
+// --------------------------------------------------
+// Variables
+// --------------------------------------------------
+static int threadCount;
+static pthread_t *workers;
+static int workerCount;
+static TaskQueue *queues;
+
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeWorkers = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t workersDone = PTHREAD_COND_INITIALIZER;
+static unsigned long generation;
+static unsigned long startGeneration;
+static int busyWorkers;
+static bool stopping;
+
+static void (*jobRun)(int task, void *context);
+static void *jobContext;
+
+// --------------------------------------------------
+// Functions
+// --------------------------------------------------
+
+int SM_SetThreadCount(int count) {
+
+  SM_Internal_StopWorkers();
+  threadCount = count > 0 ? count : OnlineCpuCount();
+  return threadCount;
+}
+
+// --------------------------------------------------
+// Functions - Internal
+// --------------------------------------------------
+
+void SM_Internal_RunParallel(int taskCount, void (*run)(int task, void *context),
+                             void *context) {
+
+  if (!queues && !StartWorkers()) {
+    for (int i = 0; i < taskCount; i++) {
+      run(i, context);
+    }
+    return;
+  }
+
+  int threads = workerCount + 1;
+  for (int i = 0; i < threads; i++) {
+    atomic_store_explicit(&queues[i].next, (int)((long)taskCount * i / threads),
+                          memory_order_relaxed);
+    queues[i].end = (int)((long)taskCount * (i + 1) / threads);
+  }
+
+  // Everything above is published to the workers by the lock
+  pthread_mutex_lock(&poolLock);
+  jobRun = run;
+  jobContext = context;
+  busyWorkers = workerCount;
+  generation++;
+  pthread_cond_broadcast(&wakeWorkers);
+  pthread_mutex_unlock(&poolLock);
+
+  RunQueues(0);
+
+  pthread_mutex_lock(&poolLock);
+  while (busyWorkers > 0) {
+    pthread_cond_wait(&workersDone, &poolLock);
+  }
+  pthread_mutex_unlock(&poolLock);
+}
+
+void SM_Internal_StopWorkers(void) {
+
+  if (!queues) {
+    return;
+  }
+
+  pthread_mutex_lock(&poolLock);
+  stopping = true;
+  pthread_cond_broadcast(&wakeWorkers);
+  pthread_mutex_unlock(&poolLock);
+
+  for (int i = 0; i < workerCount; i++) {
+    pthread_join(workers[i], NULL);
+  }
+
+  free(workers);
+  free(queues);
+  workers = NULL;
+  queues = NULL;
+  workerCount = 0;
+  stopping = false;
+}
+
+// --------------------------------------------------
+// Functions - Helpers
+// --------------------------------------------------
+
+static bool StartWorkers(void) {
+
+  if (threadCount <= 0) {
+    threadCount = OnlineCpuCount();
+  }
+
+  queues = aligned_alloc(CACHE_LINE, threadCount * sizeof(TaskQueue));
+  workers = threadCount > 1 ? malloc((threadCount - 1) * sizeof(pthread_t))
+                            : NULL;
+  if (!queues || (threadCount > 1 && !workers)) {
+    free(queues);
+    free(workers);
+    queues = NULL;
+    workers = NULL;
+    return false;
+  }
+
+  // Workers only wake for jobs posted after they were started
+  startGeneration = generation;
+
+  // If the system refuses threads, run with the ones that did start
+  for (workerCount = 0; workerCount < threadCount - 1; workerCount++) {
+    if (pthread_create(&workers[workerCount], NULL, WorkerMain,
+                       (void *)(long)(workerCount + 1))) {
+      break;
+    }
+  }
+
+  return true;
+}
+
+static void *WorkerMain(void *arg) {
+
+  int self = (int)(long)arg;
+  unsigned long seen = startGeneration;
+
+  pthread_mutex_lock(&poolLock);
+  for (;;) {
+    while (generation == seen && !stopping) {
+      pthread_cond_wait(&wakeWorkers, &poolLock);
+    }
+    if (stopping) {
+      break;
+    }
+    seen = generation;
+    pthread_mutex_unlock(&poolLock);
+
+    RunQueues(self);
+
+    pthread_mutex_lock(&poolLock);
+    if (--busyWorkers == 0) {
+      pthread_cond_signal(&workersDone);
+    }
+  }
+  pthread_mutex_unlock(&poolLock);
+
+  return NULL;
+}
+
+static void RunQueues(int self) {
+
+  // Own queue first, then steal from the others in turn
+  int threads = workerCount + 1;
+  for (int i = 0; i < threads; i++) {
+    TaskQueue *queue = &queues[(self + i) % threads];
+    for (;;) {
+      int task =
+          atomic_fetch_add_explicit(&queue->next, 1, memory_order_relaxed);
+      if (task >= queue->end) {
+        break;
+      }
+      jobRun(task, jobContext);
+    }
+  }
+}
+
+static int OnlineCpuCount(void) {
+
+#ifdef _SC_NPROCESSORS_ONLN
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (int)count : 1;
+#else
+  return 1;
+#endif
+}
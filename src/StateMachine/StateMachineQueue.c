@@ -0,0 +1,102 @@
+// --------------------------------------------------
+// Includes
+// --------------------------------------------------
+#include "StateMachine.h"
+#include "StateMachineInternal.h"
+#include <stdatomic.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+#define CACHE_LINE 64
+#define QUEUE_MASK (SM_POST_QUEUE_SIZE - 1)
+
+static_assert((SM_POST_QUEUE_SIZE & QUEUE_MASK) == 0,
+              "SM_POST_QUEUE_SIZE must be a power of two");
+
+// --------------------------------------------------
+// Data types
+// --------------------------------------------------
+
+/**
+ * @brief One slot of the post queue.
+ *
+ * `sequence` says whose turn the slot is: equal to a position, it is free for
+ * the thread posting at that position; one past it, it holds that position's
+ * change; a lap later, it has been taken and is free again.
+ * @author Vitor Betmann
+ */
+typedef struct {
+  atomic_uint sequence;
+  PostedChange change;
+} QueueCell;
+
+// --------------------------------------------------
+// Variables
+// --------------------------------------------------
+
+// Posting threads only share `tail`, and the main thread alone owns `head`,
+// so each sits on its own cache line
+static _Alignas(CACHE_LINE) atomic_uint tail;
+static _Alignas(CACHE_LINE) unsigned int head;
+static QueueCell cells[SM_POST_QUEUE_SIZE];
+
+// --------------------------------------------------
+// Functions - Internal
+// --------------------------------------------------
+
+void SM_Internal_ResetPostQueue(void) {
+
+  for (unsigned int i = 0; i < SM_POST_QUEUE_SIZE; i++) {
+    atomic_store_explicit(&cells[i].sequence, i, memory_order_relaxed);
+  }
+  head = 0;
+  atomic_store_explicit(&tail, 0, memory_order_release);
+}
+
+bool SM_Internal_PostChange(PostedChange change) {
+
+  QueueCell *cell;
+  unsigned int position = atomic_load_explicit(&tail, memory_order_relaxed);
+  for (;;) {
+    cell = &cells[position & QUEUE_MASK];
+    unsigned int sequence =
+        atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    int turn = (int)(sequence - position);
+
+    if (turn == 0) {
+      // Free for this position, claim it before another thread does
+      if (atomic_compare_exchange_weak_explicit(&tail, &position, position + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (turn < 0) {
+      // Still holds a change from the last lap, nobody has taken it yet
+      return false;
+    } else {
+      position = atomic_load_explicit(&tail, memory_order_relaxed);
+    }
+  }
+
+  cell->change = change;
+  atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+  return true;
+}
+
+bool SM_Internal_TakePostedChange(PostedChange *change) {
+
+  QueueCell *cell = &cells[head & QUEUE_MASK];
+  unsigned int sequence =
+      atomic_load_explicit(&cell->sequence, memory_order_acquire);
+  if (sequence != head + 1) {
+    return false;
+  }
+
+  *change = cell->change;
+  atomic_store_explicit(&cell->sequence, head + SM_POST_QUEUE_SIZE,
+                        memory_order_release);
+  head++;
+  return true;
+}
@@ -0,0 +1,252 @@
+// --------------------------------------------------
+// Includes
+// --------------------------------------------------
+#include "StateMachine.h"
+#include "StateMachineInternal.h"
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+#define NS_PER_SEC 1000000000LL
+#define NS_PER_MS 1000000.0
+
+#define DEFAULT_UPDATE_RATE 60.0f
+#define DEFAULT_CATCH_UP_STEPS 5
+
+// Sleeping can overshoot by about a scheduler tick, so the last stretch
+// before a deadline is spent yielding instead
+#define SPIN_MARGIN_NS 1000000LL
+
+// --------------------------------------------------
+// Prototypes
+// --------------------------------------------------
+static void RunHeadless(const RunConfig *config, int64_t step);
+static void RunPaced(const RunConfig *config, int64_t step,
+                     int64_t drawPeriod);
+static bool KeepRunning(const RunConfig *config);
+static bool ShouldStop(const RunConfig *config);
+static void RecordFrame(int64_t ns, int64_t budget);
+static int64_t Now(void);
+static void SleepUntil(int64_t deadline);
+static int CompareDoubles(const void *a, const void *b);
+
+// --------------------------------------------------
+// Variables
+// --------------------------------------------------
+static bool running;
+static atomic_bool stopRequested;
+static float alpha;
+
+static RunStats stats;
+static double frameSumMs;
+static double frameSamples[SM_RUN_FRAME_SAMPLES];
+
+// --------------------------------------------------
+// Functions
+// --------------------------------------------------
+
+bool SM_Run(const RunConfig *config) {
+
+  if (running || !SM_IsInitialized() || !SM_Internal_GetCurrState()) {
+    return false;
+  }
+
+  RunConfig settings = config ? *config : (RunConfig){0};
+  if (settings.updateRate < 0 || settings.drawRate < 0) {
+    return false;
+  }
+  if (settings.updateRate == 0) {
+    settings.updateRate = DEFAULT_UPDATE_RATE;
+  }
+  if (settings.drawRate == 0) {
+    settings.drawRate = settings.updateRate;
+  }
+  if (settings.maxCatchUpSteps <= 0) {
+    settings.maxCatchUpSteps = DEFAULT_CATCH_UP_STEPS;
+  }
+
+  stats = (RunStats){0};
+  frameSumMs = 0;
+  atomic_store(&stopRequested, false);
+  running = true;
+
+  // Whole nanoseconds, so every update gets exactly the same dt
+  int64_t step = (int64_t)(NS_PER_SEC / settings.updateRate);
+  if (settings.headless) {
+    RunHeadless(&settings, step);
+  } else {
+    RunPaced(&settings, step, (int64_t)(NS_PER_SEC / settings.drawRate));
+  }
+
+  running = false;
+  alpha = 0;
+  return true;
+}
+
+bool SM_StopRun(void) {
+
+  if (!running) {
+    return false;
+  }
+
+  atomic_store(&stopRequested, true);
+  return true;
+}
+
+float SM_GetInterpolationAlpha(void) { return alpha; }
+
+bool SM_GetRunStats(RunStats *out) {
+
+  if (!out) {
+    return false;
+  }
+
+  *out = stats;
+  long sampleCount = stats.frames < SM_RUN_FRAME_SAMPLES
+                         ? stats.frames
+                         : SM_RUN_FRAME_SAMPLES;
+  if (sampleCount == 0) {
+    return true;
+  }
+
+  double sorted[SM_RUN_FRAME_SAMPLES];
+  memcpy(sorted, frameSamples, sampleCount * sizeof(double));
+  qsort(sorted, sampleCount, sizeof(double), CompareDoubles);
+
+  out->meanFrameMs = frameSumMs / stats.frames;
+  out->p99FrameMs = sorted[(sampleCount * 99 - 1) / 100];
+  return true;
+}
+
+// --------------------------------------------------
+// Functions - Helpers
+// --------------------------------------------------
+
+static void RunHeadless(const RunConfig *config, int64_t step) {
+
+  float dt = (float)step / NS_PER_SEC;
+  while (KeepRunning(config) && !ShouldStop(config)) {
+    int64_t start = Now();
+    SM_Update(dt);
+    stats.updates++;
+    RecordFrame(Now() - start, step);
+  }
+}
+
+static void RunPaced(const RunConfig *config, int64_t step,
+                     int64_t drawPeriod) {
+
+  float dt = (float)step / NS_PER_SEC;
+  int64_t budget = step < drawPeriod ? step : drawPeriod;
+  int64_t previous = Now();
+  int64_t nextDraw = previous;
+  int64_t accumulator = 0;
+
+  while (KeepRunning(config) && !ShouldStop(config)) {
+    int64_t start = Now();
+    accumulator += start - previous;
+    previous = start;
+
+    int steps = 0;
+    while (accumulator >= step && steps < config->maxCatchUpSteps &&
+           KeepRunning(config)) {
+      SM_Update(dt);
+      stats.updates++;
+      accumulator -= step;
+      steps++;
+    }
+
+    // Catching up on all of it would only make the next frame slower
+    if (steps == config->maxCatchUpSteps && accumulator >= step) {
+      stats.droppedSteps += accumulator / step;
+      accumulator %= step;
+    }
+
+    bool drew = false;
+    if (start >= nextDraw && KeepRunning(config)) {
+      alpha = (float)accumulator / (float)step;
+      SM_Draw();
+      alpha = 0;
+      stats.draws++;
+      drew = true;
+
+      // A late draw moves the next one back instead of bunching them up
+      nextDraw += drawPeriod;
+      if (nextDraw <= start) {
+        nextDraw = start + drawPeriod;
+      }
+    }
+
+    if (steps > 0 || drew) {
+      RecordFrame(Now() - start, budget);
+    }
+
+    int64_t nextUpdate = previous + step - accumulator;
+    SleepUntil(nextUpdate < nextDraw ? nextUpdate : nextDraw);
+  }
+}
+
+static bool KeepRunning(const RunConfig *config) {
+
+  if (atomic_load_explicit(&stopRequested, memory_order_relaxed)) {
+    return false;
+  }
+  if (config->maxUpdates > 0 && stats.updates >= config->maxUpdates) {
+    return false;
+  }
+
+  // A state may shut the machine down or leave it without a state
+  return SM_IsInitialized() && SM_Internal_GetCurrState();
+}
+
+static bool ShouldStop(const RunConfig *config) {
+  return config->shouldStop && config->shouldStop();
+}
+
+static void RecordFrame(int64_t ns, int64_t budget) {
+
+  double ms = ns / NS_PER_MS;
+  frameSamples[stats.frames % SM_RUN_FRAME_SAMPLES] = ms;
+  frameSumMs += ms;
+  stats.frames++;
+
+  if (ns > budget) {
+    stats.overruns++;
+  }
+  if (ms > stats.maxFrameMs) {
+    stats.maxFrameMs = ms;
+  }
+}
+
+static int64_t Now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static void SleepUntil(int64_t deadline) {
+
+  int64_t wake = deadline - SPIN_MARGIN_NS;
+  if (wake > Now()) {
+    struct timespec ts = {.tv_sec = wake / NS_PER_SEC,
+                          .tv_nsec = wake % NS_PER_SEC};
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+  }
+
+  while (Now() < deadline) {
+    sched_yield();
+  }
+}
+
+static int CompareDoubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
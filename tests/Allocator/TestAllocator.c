@@ -0,0 +1,151 @@
+#include "../include/Allocator.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+#define TEST_PASS(funcName) printf("\t[PASS] %s\n", funcName)
+#define IS_ALIGNED(ptr, alignment) (((uintptr_t)(ptr) & ((alignment) - 1)) == 0)
+
+// --------------------------------------------------
+// Data types
+// --------------------------------------------------
+
+typedef struct {
+  int allocs, frees;
+  size_t lastSize;
+} MockAllocatorData;
+
+// --------------------------------------------------
+// Variables
+// --------------------------------------------------
+static MockAllocatorData mad;
+
+// --------------------------------------------------
+// Mock Functions
+// --------------------------------------------------
+
+void *mockAlloc(size_t size, size_t alignment, void *userData) {
+  MockAllocatorData *data = userData;
+  data->allocs++;
+  data->lastSize = size;
+  return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+void mockFree(void *ptr, size_t size, void *userData) {
+  MockAllocatorData *data = userData;
+  data->frees++;
+  data->lastSize = size;
+  free(ptr);
+}
+
+// --------------------------------------------------
+// Default allocator
+// --------------------------------------------------
+
+void Test_AL_Alloc_ReturnsNullForZeroSize(void) {
+  assert(!AL_Alloc(0, AL_CACHE_LINE));
+  TEST_PASS("Test_AL_Alloc_ReturnsNullForZeroSize");
+}
+
+void Test_AL_Alloc_ReturnsNullForNonPowerOfTwoAlignment(void) {
+  assert(!AL_Alloc(64, 48));
+  TEST_PASS("Test_AL_Alloc_ReturnsNullForNonPowerOfTwoAlignment");
+}
+
+void Test_AL_Alloc_ReturnsCacheLineAlignedBlocks(void) {
+  for (size_t size = 1; size < 4096; size *= 3) {
+    void *ptr = AL_Alloc(size, AL_CACHE_LINE);
+    assert(ptr && IS_ALIGNED(ptr, AL_CACHE_LINE));
+    memset(ptr, 0xAB, size);
+    AL_Free(ptr, size);
+  }
+  TEST_PASS("Test_AL_Alloc_ReturnsCacheLineAlignedBlocks");
+}
+
+void Test_AL_Alloc_ReturnsUsableHugeBlocks(void) {
+  size_t size = 3 * AL_HUGE_PAGE_SIZE + 123;
+  unsigned char *ptr = AL_Alloc(size, AL_CACHE_LINE);
+  assert(ptr && IS_ALIGNED(ptr, AL_CACHE_LINE));
+  ptr[0] = 1;
+  ptr[size - 1] = 2;
+  AL_Free(ptr, size);
+  TEST_PASS("Test_AL_Alloc_ReturnsUsableHugeBlocks");
+}
+
+void Test_AL_Alloc_HonorsAlignmentAbovePageSize(void) {
+  size_t alignment = 1u << 16;
+  void *ptr = AL_Alloc(AL_HUGE_PAGE_SIZE, alignment);
+  assert(ptr && IS_ALIGNED(ptr, alignment));
+  AL_Free(ptr, AL_HUGE_PAGE_SIZE);
+  TEST_PASS("Test_AL_Alloc_HonorsAlignmentAbovePageSize");
+}
+
+void Test_AL_EnableHugePages_FallsBackToOrdinaryPages(void) {
+  AL_EnableHugePages(false);
+  void *ptr = AL_Alloc(AL_HUGE_PAGE_SIZE, AL_CACHE_LINE);
+  assert(ptr);
+  AL_Free(ptr, AL_HUGE_PAGE_SIZE);
+  AL_EnableHugePages(true);
+  TEST_PASS("Test_AL_EnableHugePages_FallsBackToOrdinaryPages");
+}
+
+// --------------------------------------------------
+// Custom allocator
+// --------------------------------------------------
+
+void Test_AL_SetAllocator_ReturnsFalseIfFunctionsMissing(void) {
+  assert(!AL_SetAllocator(&(Allocator){.alloc = mockAlloc}));
+  assert(!AL_SetAllocator(&(Allocator){.free = mockFree}));
+  TEST_PASS("Test_AL_SetAllocator_ReturnsFalseIfFunctionsMissing");
+}
+
+void Test_AL_SetAllocator_RoutesAllocationsThroughHook(void) {
+  assert(AL_SetAllocator(&(Allocator){mockAlloc, mockFree, &mad}));
+
+  void *ptr = AL_Alloc(100, AL_CACHE_LINE);
+  assert(mad.allocs == 1 && mad.lastSize == 100);
+  assert(IS_ALIGNED(ptr, AL_CACHE_LINE));
+
+  AL_Free(ptr, 100);
+  assert(mad.frees == 1 && mad.lastSize == 100);
+  TEST_PASS("Test_AL_SetAllocator_RoutesAllocationsThroughHook");
+}
+
+void Test_AL_SetAllocator_NullRestoresDefault(void) {
+  assert(AL_SetAllocator(NULL));
+  void *ptr = AL_Alloc(100, AL_CACHE_LINE);
+  AL_Free(ptr, 100);
+  assert(mad.allocs == 1 && mad.frees == 1);
+  TEST_PASS("Test_AL_SetAllocator_NullRestoresDefault");
+}
+
+// --------------------------------------------------
+// Finger's crossed!
+// --------------------------------------------------
+
+int main() {
+  puts("");
+  puts("Testing Default Allocator");
+  Test_AL_Alloc_ReturnsNullForZeroSize();
+  Test_AL_Alloc_ReturnsNullForNonPowerOfTwoAlignment();
+  Test_AL_Alloc_ReturnsCacheLineAlignedBlocks();
+  Test_AL_Alloc_ReturnsUsableHugeBlocks();
+  Test_AL_Alloc_HonorsAlignmentAbovePageSize();
+  Test_AL_EnableHugePages_FallsBackToOrdinaryPages();
+  puts("");
+
+  puts("Testing Custom Allocator");
+  Test_AL_SetAllocator_ReturnsFalseIfFunctionsMissing();
+  Test_AL_SetAllocator_RoutesAllocationsThroughHook();
+  Test_AL_SetAllocator_NullRestoresDefault();
+  puts("");
+
+  puts("All tests completed successfully!");
+  return 0;
+}
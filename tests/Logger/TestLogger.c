@@ -0,0 +1,256 @@
+#include "../include/Logger.h"
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+#define TEST_PASS(funcName) printf("\t[PASS] %s\n", funcName)
+#define MAX_LINES 1024
+#define LOGGING_THREADS 4
+#define MESSAGES_PER_THREAD 50
+
+// --------------------------------------------------
+// Data types
+// --------------------------------------------------
+
+typedef struct {
+  LogLevel level;
+  char text[LG_MESSAGE_SIZE + 64];
+} LoggedLine;
+
+// --------------------------------------------------
+// Variables
+// --------------------------------------------------
+
+// Written by the logger thread, read once LG_Flush returns
+static LoggedLine lines[MAX_LINES];
+static int lineCount;
+static atomic_bool releaseSink;
+
+// --------------------------------------------------
+// Mock Functions
+// --------------------------------------------------
+
+void mockSink(LogLevel level, const char *message, void *userData) {
+  if (lineCount < MAX_LINES) {
+    lines[lineCount].level = level;
+    snprintf(lines[lineCount].text, sizeof(lines[lineCount].text), "%s",
+             message);
+    lineCount++;
+  }
+}
+
+void mockBlockingSink(LogLevel level, const char *message, void *userData) {
+  while (!atomic_load(&releaseSink)) {
+    sched_yield();
+  }
+  mockSink(level, message, userData);
+}
+
+// --------------------------------------------------
+// Helpers
+// --------------------------------------------------
+
+static void ClearLines(void) {
+  LG_Flush();
+  lineCount = 0;
+}
+
+static int CountLines(const char *text) {
+  int count = 0;
+  for (int i = 0; i < lineCount; i++) {
+    count += strcmp(lines[i].text, text) == 0;
+  }
+  return count;
+}
+
+static void *LogFromThread(void *arg) {
+  for (int i = 0; i < MESSAGES_PER_THREAD; i++) {
+    LG_Log(LOG_INFO, "Thread %d message %d", *(int *)arg, i);
+  }
+  return NULL;
+}
+
+// --------------------------------------------------
+// Logging
+// --------------------------------------------------
+
+void Test_LG_Log_WritesThroughSink(void) {
+  LG_SetSink(mockSink, NULL);
+  assert(LG_Log(LOG_WARNING, "Value is %d", 42));
+  LG_Flush();
+  assert(lineCount == 1);
+  assert(lines[0].level == LOG_WARNING);
+  assert(!strcmp(lines[0].text, "Value is 42"));
+  TEST_PASS("Test_LG_Log_WritesThroughSink");
+}
+
+void Test_LG_Log_ReturnsFalseForNullFormatOrNoneLevel(void) {
+  assert(!LG_Log(LOG_ERROR, NULL));
+  assert(!LG_Log(LOG_NONE, "Never written"));
+  TEST_PASS("Test_LG_Log_ReturnsFalseForNullFormatOrNoneLevel");
+}
+
+void Test_LG_Log_TruncatesLongMessages(void) {
+  ClearLines();
+  char longText[LG_MESSAGE_SIZE * 2];
+  memset(longText, 'a', sizeof(longText) - 1);
+  longText[sizeof(longText) - 1] = '\0';
+  assert(LG_Log(LOG_INFO, "%s", longText));
+  LG_Flush();
+  assert(lineCount == 1);
+  assert(strlen(lines[0].text) == LG_MESSAGE_SIZE - 1);
+  TEST_PASS("Test_LG_Log_TruncatesLongMessages");
+}
+
+void Test_LG_SetLevel_FiltersLowerSeverities(void) {
+  ClearLines();
+  LG_SetLevel(LOG_WARNING);
+  assert(LG_GetLevel() == LOG_WARNING);
+  assert(!LG_Log(LOG_DEBUG, "Debug"));
+  assert(!LG_Log(LOG_INFO, "Info"));
+  assert(LG_Log(LOG_ERROR, "Error"));
+  LG_SetLevel(LOG_NONE);
+  assert(!LG_Log(LOG_ERROR, "Muted"));
+  LG_SetLevel(LOG_INFO);
+  LG_Flush();
+  assert(lineCount == 1 && !strcmp(lines[0].text, "Error"));
+  TEST_PASS("Test_LG_SetLevel_FiltersLowerSeverities");
+}
+
+void Test_LG_Log_CollapsesRepeatedMessages(void) {
+  ClearLines();
+  for (int i = 0; i < 5; i++) {
+    LG_Log(LOG_WARNING, "Update function is NULL");
+  }
+  LG_Log(LOG_WARNING, "Something else");
+  LG_Flush();
+  assert(lineCount == 3);
+  assert(!strcmp(lines[0].text, "Update function is NULL"));
+  assert(!strcmp(lines[1].text, "Last message repeated 4 more times"));
+  assert(!strcmp(lines[2].text, "Something else"));
+  TEST_PASS("Test_LG_Log_CollapsesRepeatedMessages");
+}
+
+void Test_LG_Flush_ReportsPendingRepeats(void) {
+  ClearLines();
+  LG_Log(LOG_INFO, "Tick");
+  LG_Log(LOG_INFO, "Tick");
+  LG_Flush();
+  assert(lineCount == 2);
+  assert(!strcmp(lines[1].text, "Last message repeated 1 more time"));
+  TEST_PASS("Test_LG_Flush_ReportsPendingRepeats");
+}
+
+// --------------------------------------------------
+// Rate limiting
+// --------------------------------------------------
+
+void Test_LG_SetRateLimit_ReturnsFalseForNonPositivePeriod(void) {
+  assert(!LG_SetRateLimit(5, 0));
+  assert(LG_SetRateLimit(0, 0));
+  TEST_PASS("Test_LG_SetRateLimit_ReturnsFalseForNonPositivePeriod");
+}
+
+void Test_LG_Log_RateLimitsEachCallSite(void) {
+  ClearLines();
+  assert(LG_SetRateLimit(3, 50));
+  int queued = 0;
+  for (int i = 0; i < 10; i++) {
+    queued += LG_Log(LOG_INFO, "Frame %d", i);
+  }
+  assert(LG_Log(LOG_INFO, "Another call site"));
+  assert(queued == 3);
+
+  // The next message through tells how many were held back
+  struct timespec pause = {.tv_nsec = 60 * 1000000L};
+  nanosleep(&pause, NULL);
+  assert(LG_Log(LOG_INFO, "Frame %d", 10));
+  LG_Flush();
+  assert(CountLines("Frame 10 (7 similar messages suppressed)") == 1);
+  assert(lineCount == 5);
+
+  LG_SetRateLimit(10, 1000);
+  TEST_PASS("Test_LG_Log_RateLimitsEachCallSite");
+}
+
+// --------------------------------------------------
+// Threads
+// --------------------------------------------------
+
+void Test_LG_Log_KeepsMessagesFromEveryThread(void) {
+  ClearLines();
+  LG_SetRateLimit(0, 0);
+  pthread_t threads[LOGGING_THREADS];
+  int ids[LOGGING_THREADS];
+  for (int i = 0; i < LOGGING_THREADS; i++) {
+    ids[i] = i;
+    pthread_create(&threads[i], NULL, LogFromThread, &ids[i]);
+  }
+  for (int i = 0; i < LOGGING_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  LG_Flush();
+
+  assert(lineCount + LG_GetDroppedCount() ==
+         LOGGING_THREADS * MESSAGES_PER_THREAD);
+  assert(CountLines("Thread 0 message 0") <= 1);
+  TEST_PASS("Test_LG_Log_KeepsMessagesFromEveryThread");
+}
+
+void Test_LG_Log_DropsInsteadOfBlockingWhenRingIsFull(void) {
+  ClearLines();
+  long droppedBefore = LG_GetDroppedCount();
+  atomic_store(&releaseSink, false);
+  LG_SetSink(mockBlockingSink, NULL);
+
+  int queued = 0;
+  for (int i = 0; i < LG_RING_SIZE + 10; i++) {
+    queued += LG_Log(LOG_INFO, "Message %d", i);
+  }
+  assert(queued <= LG_RING_SIZE + 1);
+  assert(LG_GetDroppedCount() - droppedBefore == LG_RING_SIZE + 10 - queued);
+
+  atomic_store(&releaseSink, true);
+  LG_Flush();
+  assert(lineCount == queued);
+  LG_SetSink(NULL, NULL);
+  LG_SetRateLimit(10, 1000);
+  TEST_PASS("Test_LG_Log_DropsInsteadOfBlockingWhenRingIsFull");
+}
+
+// --------------------------------------------------
+// Finger's crossed!
+// --------------------------------------------------
+
+int main() {
+  puts("");
+  puts("Testing Logging");
+  Test_LG_Log_WritesThroughSink();
+  Test_LG_Log_ReturnsFalseForNullFormatOrNoneLevel();
+  Test_LG_Log_TruncatesLongMessages();
+  Test_LG_SetLevel_FiltersLowerSeverities();
+  Test_LG_Log_CollapsesRepeatedMessages();
+  Test_LG_Flush_ReportsPendingRepeats();
+  puts("");
+
+  puts("Testing Rate Limiting");
+  Test_LG_SetRateLimit_ReturnsFalseForNonPositivePeriod();
+  Test_LG_Log_RateLimitsEachCallSite();
+  puts("");
+
+  puts("Testing Threads");
+  Test_LG_Log_KeepsMessagesFromEveryThread();
+  Test_LG_Log_DropsInsteadOfBlockingWhenRingIsFull();
+  puts("");
+
+  puts("All tests completed successfully!");
+  return 0;
+}
@@ -1,13 +1,688 @@
 // TODO create tests
 
 #include "../include/ParticleSystem.h"
+#include "../include/Allocator.h"
+#include "../src/ParticleSystem/ParticleSystemInternal.h"
 #include <assert.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+#define TEST_PASS(funcName) printf("\t[PASS] %s\n", funcName)
+
+#define NORMAL_SAMPLES 1000000
+// Optimized builds reach well over 100M/s; this still holds under sanitizers
+#define MIN_NORMAL_SAMPLES_PER_SEC 5e6
+
+// --------------------------------------------------
+// Variables
+// --------------------------------------------------
+static Texture2D mockTexture;
+static const Color WHITE_COLOR = {255, 255, 255, 255};
+
+// --------------------------------------------------
+// Kernels
+// --------------------------------------------------
+
+void Test_PS_SetColors_SameColorsDisableColorFade(void) {
+  ParticleSystem *ps = newParticleSystem(&mockTexture, 4, (Vector2){0, 0});
+  PS_SetColors(ps, WHITE_COLOR, WHITE_COLOR);
+  assert(!(ps->features & PS_FEATURE_COLOR_FADE));
+  PS_Unload(ps);
+  TEST_PASS("Test_PS_SetColors_SameColorsDisableColorFade");
+}
+
+void Test_PS_SetLinearAcceleration_ZeroDisablesMotion(void) {
+  ParticleSystem *ps = newParticleSystem(&mockTexture, 4, (Vector2){0, 0});
+  PS_SetLinearAcceleration(ps, 0, 0, 0, 0);
+  assert(!(ps->features & PS_FEATURE_MOTION));
+  PS_SetLinearAcceleration(ps, -1, 0, 1, 0);
+  assert(ps->features & PS_FEATURE_MOTION);
+  PS_Unload(ps);
+  TEST_PASS("Test_PS_SetLinearAcceleration_ZeroDisablesMotion");
+}
+
+void Test_PS_Emit_SelectsKernelMatchingFeatures(void) {
+  ParticleSystem *ps = newParticleSystem(&mockTexture, 4, (Vector2){0, 0});
+  PS_SetColors(ps, WHITE_COLOR, WHITE_COLOR);
+  PS_Emit(ps);
+  assert(ps->update == PS_Internal_GetKernel(PS_FEATURE_NONE));
+
+  PS_SetLinearAcceleration(ps, 10, 10, 10, 10);
+  assert(ps->update == PS_Internal_GetKernel(PS_FEATURE_NONE));
+  PS_Emit(ps);
+  assert(ps->update == PS_Internal_GetKernel(PS_FEATURE_MOTION));
+  PS_Unload(ps);
+  TEST_PASS("Test_PS_Emit_SelectsKernelMatchingFeatures");
+}
+
+void Test_PS_Update_SpecializedKernelMatchesFullKernel(void) {
+  // Each kernel only skips work its particles don't need, so running the
+  // full kernel on the same particles must give the same result
+  for (unsigned features = 0; features < PS_FEATURE_COMBINATIONS;
+       features++) {
+    ParticleSystem *ps = newParticleSystem(&mockTexture, 1, (Vector2){0, 0});
+    PS_SetParticleLifetime(ps, 1000, 1000);
+    if (features & PS_FEATURE_MOTION) {
+      PS_SetLinearAcceleration(ps, 10, 20, 10, 20);
+    }
+    if (features & PS_FEATURE_COLOR_FADE) {
+      PS_SetColors(ps, (Color){255, 128, 64, 255}, (Color){0, 32, 192, 0});
+    } else {
+      PS_SetColors(ps, WHITE_COLOR, WHITE_COLOR);
+    }
+    PS_Emit(ps);
+    assert(ps->update == PS_Internal_GetKernel(features));
+
+    Particle specialized = *PS_Internal_GetParticle(ps, 0);
+    Particle full = *PS_Internal_GetParticle(ps, 0);
+    PS_Internal_GetKernel(features)(&specialized, 1, 0.5f);
+    PS_Internal_GetKernel(PS_FEATURE_ALL)(&full, 1, 0.5f);
+
+    assert(specialized.pos.x == full.pos.x && specialized.pos.y == full.pos.y);
+    assert(specialized.lifeTime == full.lifeTime);
+    assert(specialized.currColor.r == full.currColor.r &&
+           specialized.currColor.g == full.currColor.g &&
+           specialized.currColor.b == full.currColor.b &&
+           specialized.currColor.a == full.currColor.a);
+    PS_Unload(ps);
+  }
+  TEST_PASS("Test_PS_Update_SpecializedKernelMatchesFullKernel");
+}
+
+// --------------------------------------------------
+// Storage
+// --------------------------------------------------
+
+void Test_PS_Emit_GrowsStorageByBlocks(void) {
+  ParticleSystem *ps =
+      newParticleSystem(&mockTexture, PS_BLOCK_SIZE + 1, (Vector2){0, 0});
+  assert(PS_GetLiveCount(ps) == 0 && ps->blockCount == 0);
+
+  PS_Emit(ps);
+  assert(PS_GetLiveCount(ps) == PS_BLOCK_SIZE + 1 && ps->blockCount == 2);
+
+  PS_Emit(ps);
+  assert(PS_GetLiveCount(ps) == 2 * (PS_BLOCK_SIZE + 1) &&
+         ps->blockCount == 3);
+  PS_Unload(ps);
+  TEST_PASS("Test_PS_Emit_GrowsStorageByBlocks");
+}
+
+void Test_PS_Update_RemovesDeadParticlesAndReleasesBlocks(void) {
+  ParticleSystem *ps =
+      newParticleSystem(&mockTexture, 2 * PS_BLOCK_SIZE, (Vector2){0, 0});
+  PS_SetParticleLifetime(ps, 1000, 1000);
+  PS_Emit(ps);
+  PS_SetParticleLifetime(ps, 3000, 3000);
+  ps->particleCount = 10;
+  PS_Emit(ps);
+  assert(ps->blockCount == 3);
+
+  PS_Update(ps, 2.0f);
+  assert(PS_GetLiveCount(ps) == 10 && ps->blockCount == 1);
+  for (int i = 0; i < PS_GetLiveCount(ps); i++) {
+    assert(PS_Internal_GetParticle(ps, i)->initialLifeTime == 3.0f);
+  }
+  assert(!PS_ShouldDestroy(ps));
+
+  PS_Update(ps, 2.0f);
+  assert(PS_GetLiveCount(ps) == 0 && ps->blockCount == 0);
+  assert(PS_ShouldDestroy(ps));
+  PS_Unload(ps);
+  TEST_PASS("Test_PS_Update_RemovesDeadParticlesAndReleasesBlocks");
+}
+
+void Test_PS_Internal_AcquireBlock_ReusesPooledBlocks(void) {
+  PS_TrimBlockPool();
+  Particle *block = PS_Internal_AcquireBlock();
+  PS_Internal_ReleaseBlock(block);
+  assert(PS_Internal_GetPooledBlockCount() == 1);
+  assert(PS_Internal_AcquireBlock() == block);
+  assert(PS_Internal_GetPooledBlockCount() == 0);
+  PS_Internal_ReleaseBlock(block);
+  TEST_PASS("Test_PS_Internal_AcquireBlock_ReusesPooledBlocks");
+}
+
+void Test_PS_SetBlockPoolLimit_FreesBlocksAboveLimit(void) {
+  Particle *blocks[4];
+  for (int i = 0; i < 4; i++) {
+    blocks[i] = PS_Internal_AcquireBlock();
+  }
+  for (int i = 0; i < 4; i++) {
+    PS_Internal_ReleaseBlock(blocks[i]);
+  }
+  assert(PS_Internal_GetPooledBlockCount() == 4);
+
+  PS_SetBlockPoolLimit(2);
+  assert(PS_Internal_GetPooledBlockCount() == 2);
+  PS_TrimBlockPool();
+  assert(PS_Internal_GetPooledBlockCount() == 0);
+  PS_SetBlockPoolLimit(PS_DEFAULT_POOL_LIMIT);
+  TEST_PASS("Test_PS_SetBlockPoolLimit_FreesBlocksAboveLimit");
+}
+
+// --------------------------------------------------
+// Sorting
+// --------------------------------------------------
+
+static bool IsDrawOrderSorted(ParticleSystem *ps) {
+  if (ps->sort.count != PS_GetLiveCount(ps)) {
+    return false;
+  }
+
+  // Every live particle must appear exactly once
+  bool *seen = calloc(ps->sort.count + 1, sizeof(bool));
+  for (int i = 0; i < ps->sort.count; i++) {
+    int index = ps->sort.order[i];
+    assert(index >= 0 && index < ps->sort.count && !seen[index]);
+    seen[index] = true;
+  }
+  free(seen);
+
+  for (int i = 1; i < ps->sort.count; i++) {
+    Particle *prev = PS_Internal_GetParticle(ps, ps->sort.order[i - 1]);
+    Particle *curr = PS_Internal_GetParticle(ps, ps->sort.order[i]);
+    switch (ps->sortMode) {
+    case SORT_BY_Y:
+      if (prev->pos.y > curr->pos.y) {
+        return false;
+      }
+      break;
+    case SORT_BY_DEPTH:
+      if (prev->depth < curr->depth) {
+        return false;
+      }
+      break;
+    case SORT_BY_AGE:
+      if (prev->initialLifeTime - prev->lifeTime <
+          curr->initialLifeTime - curr->lifeTime) {
+        return false;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  return true;
+}
+
+void Test_PS_Internal_RadixSort_SortsKeysStably(void) {
+  enum { COUNT = 5000 };
+  static unsigned keys[COUNT], keysTmp[COUNT];
+  static int values[COUNT], valuesTmp[COUNT];
+  for (int i = 0; i < COUNT; i++) {
+    keys[i] = (unsigned)(i * 2654435761u) % 1000u * 40503u;
+    values[i] = i;
+  }
+  PS_Internal_RadixSort(keys, values, keysTmp, valuesTmp, COUNT);
+  for (int i = 1; i < COUNT; i++) {
+    assert(keys[i - 1] <= keys[i]);
+    assert(keys[i - 1] != keys[i] || values[i - 1] < values[i]);
+  }
+  TEST_PASS("Test_PS_Internal_RadixSort_SortsKeysStably");
+}
+
+void Test_PS_SetSortMode_SortsByYAfterUpdate(void) {
+  ParticleSystem *ps = newParticleSystem(&mockTexture, 3000, (Vector2){0, 0});
+  PS_SetParticleLifetime(ps, 1000, 3000);
+  PS_SetEmissionArea(ps, NORMAL, 200, 200);
+  PS_SetLinearAcceleration(ps, -100, -100, 100, 100);
+  PS_SetSortMode(ps, SORT_BY_Y);
+  PS_Emit(ps);
+
+  for (int frame = 0; frame < 200; frame++) {
+    PS_Update(ps, 0.016f);
+    assert(IsDrawOrderSorted(ps));
+    if (frame % 20 == 0) {
+      PS_Emit(ps);
+    }
+  }
+  PS_Unload(ps);
+  TEST_PASS("Test_PS_SetSortMode_SortsByYAfterUpdate");
+}
+
+void Test_PS_SetSortMode_KeepsOrderThroughDeaths(void) {
+  ParticleSystem *ps = newParticleSystem(&mockTexture, 5000, (Vector2){0, 0});
+  PS_SetParticleLifetime(ps, 100, 2000);
+  PS_SetDepth(ps, 0.0f, 100.0f);
+  PS_Emit(ps);
+  PS_SetSortMode(ps, SORT_BY_DEPTH);
+
+  while (PS_GetLiveCount(ps) > 0) {
+    PS_Update(ps, 0.05f);
+    assert(IsDrawOrderSorted(ps));
+  }
+  PS_Unload(ps);
+  TEST_PASS("Test_PS_SetSortMode_KeepsOrderThroughDeaths");
+}
+
+void Test_PS_SetSortMode_SortsByAge(void) {
+  ParticleSystem *ps = newParticleSystem(&mockTexture, 100, (Vector2){0, 0});
+  PS_SetParticleLifetime(ps, 5000, 5000);
+  PS_SetSortMode(ps, SORT_BY_AGE);
+  for (int frame = 0; frame < 10; frame++) {
+    PS_Emit(ps);
+    PS_Update(ps, 0.1f);
+    assert(IsDrawOrderSorted(ps));
+  }
+  PS_Unload(ps);
+  TEST_PASS("Test_PS_SetSortMode_SortsByAge");
+}
+
+// --------------------------------------------------
+// Emission
+// --------------------------------------------------
+
+void Test_PS_Internal_FillNormal_MatchesStandardNormal(void) {
+  ParticleRng rng;
+  PS_Internal_SeedRng(&rng, 1234);
+  float *samples = malloc(NORMAL_SAMPLES * sizeof(float));
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  PS_Internal_FillNormal(&rng, samples, NORMAL_SAMPLES);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double sum = 0, sumSquares = 0;
+  int withinOne = 0, beyondThree = 0;
+  for (int i = 0; i < NORMAL_SAMPLES; i++) {
+    sum += samples[i];
+    sumSquares += (double)samples[i] * samples[i];
+    withinOne += fabsf(samples[i]) < 1.0f;
+    beyondThree += fabsf(samples[i]) > 3.0f;
+  }
+  double mean = sum / NORMAL_SAMPLES;
+  double variance = sumSquares / NORMAL_SAMPLES - mean * mean;
+
+  assert(fabs(mean) < 0.01);
+  assert(fabs(variance - 1.0) < 0.01);
+  assert(fabs((double)withinOne / NORMAL_SAMPLES - 0.6827) < 0.005);
+  assert(fabs((double)beyondThree / NORMAL_SAMPLES - 0.0027) < 0.0005);
+
+  double seconds =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  assert(NORMAL_SAMPLES / seconds > MIN_NORMAL_SAMPLES_PER_SEC);
+
+  free(samples);
+  TEST_PASS("Test_PS_Internal_FillNormal_MatchesStandardNormal");
+}
+
+void Test_PS_Emit_NormalSpreadMatchesDeviation(void) {
+  ParticleSystem *ps =
+      newParticleSystem(&mockTexture, 20000, (Vector2){100, 50});
+  PS_SetEmissionArea(ps, NORMAL, 10, 20);
+  PS_Emit(ps);
+
+  double sumX = 0, sumY = 0, sumSquaresX = 0, sumSquaresY = 0;
+  for (int i = 0; i < ps->liveCount; i++) {
+    Particle *p = PS_Internal_GetParticle(ps, i);
+    sumX += p->pos.x;
+    sumY += p->pos.y;
+    sumSquaresX += (double)p->pos.x * p->pos.x;
+    sumSquaresY += (double)p->pos.y * p->pos.y;
+  }
+  double meanX = sumX / ps->liveCount, meanY = sumY / ps->liveCount;
+  double deviationX = sqrt(sumSquaresX / ps->liveCount - meanX * meanX);
+  double deviationY = sqrt(sumSquaresY / ps->liveCount - meanY * meanY);
+
+  assert(fabs(meanX - 100) < 0.5 && fabs(meanY - 50) < 1.0);
+  assert(fabs(deviationX - 10) < 0.5 && fabs(deviationY - 20) < 1.0);
+  PS_Unload(ps);
+  TEST_PASS("Test_PS_Emit_NormalSpreadMatchesDeviation");
+}
+
+void Test_PS_Emit_DiskStaysInsideEllipse(void) {
+  ParticleSystem *ps = newParticleSystem(&mockTexture, 5000, (Vector2){0, 0});
+  PS_SetEmissionArea(ps, DISK, 40, 10);
+  PS_Emit(ps);
+
+  int outerHalf = 0;
+  for (int i = 0; i < ps->liveCount; i++) {
+    Particle *p = PS_Internal_GetParticle(ps, i);
+    float x = p->pos.x / 40, y = p->pos.y / 10;
+    assert(x * x + y * y <= 1.0001f);
+    outerHalf += x * x + y * y > 0.5f;
+  }
+
+  // Evenly spread: half the area lies beyond radius sqrt(0.5)
+  assert(abs(outerHalf - ps->liveCount / 2) < ps->liveCount / 20);
+  PS_Unload(ps);
+  TEST_PASS("Test_PS_Emit_DiskStaysInsideEllipse");
+}
+
+void Test_PS_SetSeed_MakesEmissionRepeatable(void) {
+  ParticleSystem *a = newParticleSystem(&mockTexture, 1000, (Vector2){0, 0});
+  ParticleSystem *b = newParticleSystem(&mockTexture, 1000, (Vector2){0, 0});
+  PS_SetSeed(a, 42);
+  PS_SetSeed(b, 42);
+
+  // Setters called after seeding must leave the generator alone
+  PS_SetUniformDist(a, (Vector2){4, 4}, 10);
+  PS_SetUniformDist(b, (Vector2){4, 4}, 10);
+  PS_SetEmissionArea(a, NORMAL, 30, 30);
+  PS_SetEmissionArea(b, NORMAL, 30, 30);
+  PS_SetLinearAcceleration(a, -5, -5, 5, 5);
+  PS_SetLinearAcceleration(b, -5, -5, 5, 5);
+  PS_Emit(a);
+  PS_Emit(b);
+
+  for (int i = 0; i < a->liveCount; i++) {
+    Particle *pa = PS_Internal_GetParticle(a, i);
+    Particle *pb = PS_Internal_GetParticle(b, i);
+    assert(pa->pos.x == pb->pos.x && pa->pos.y == pb->pos.y);
+    assert(pa->linearAccelerationX == pb->linearAccelerationX);
+    assert(pa->lifeTime == pb->lifeTime);
+  }
+  PS_Unload(a);
+  PS_Unload(b);
+  TEST_PASS("Test_PS_SetSeed_MakesEmissionRepeatable");
+}
+
+// --------------------------------------------------
+// Shapes
+// --------------------------------------------------
+
+void Test_PS_Internal_BuildAliasTable_MatchesWeights(void) {
+  const float weights[] = {1, 2, 3, 0, 4};
+  const unsigned values[] = {10, 20, 30, 40, 50};
+  const int samples = 200000;
+  AliasEntry *table = PS_Internal_BuildAliasTable(weights, values, 5);
+  assert(table);
+
+  ParticleRng rng;
+  PS_Internal_SeedRng(&rng, 7);
+  int hits[5] = {0};
+  for (int i = 0; i < samples; i++) {
+    float column = PS_Internal_RandomFloat(&rng);
+    float coin = PS_Internal_RandomFloat(&rng);
+    hits[PS_Internal_SampleAlias(table, 5, column, coin) / 10 - 1]++;
+  }
+
+  assert(hits[3] == 0);
+  for (int i = 0; i < 5; i++) {
+    double expected = weights[i] / 10.0;
+    assert(fabs((double)hits[i] / samples - expected) < 0.005);
+  }
+
+  AL_Free(table, 5 * sizeof(AliasEntry));
+  TEST_PASS("Test_PS_Internal_BuildAliasTable_MatchesWeights");
+}
+
+void Test_PS_SetEmissionMask_SpawnsOnVisiblePixels(void) {
+  // 4x4 image: one opaque pixel at (1, 2), one half transparent at (3, 0)
+  Color pixels[16] = {0};
+  pixels[2 * 4 + 1] = (Color){255, 255, 255, 255};
+  pixels[0 * 4 + 3] = (Color){255, 255, 255, 85};
+  Image image = {pixels, 4, 4, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+
+  ParticleSystem *ps = newParticleSystem(&mockTexture, 8000, (Vector2){10, 20});
+  assert(PS_SetEmissionMask(ps, image));
+  PS_Emit(ps);
+
+  int opaque = 0;
+  for (int i = 0; i < ps->liveCount; i++) {
+    Particle *p = PS_Internal_GetParticle(ps, i);
+    int x = (int)floorf(p->pos.x - 10), y = (int)floorf(p->pos.y - 20);
+    assert((x == 1 && y == 2) || (x == 3 && y == 0));
+    opaque += x == 1;
+  }
+
+  // Alpha 255 against 85: three out of four particles
+  assert(abs(opaque - ps->liveCount * 3 / 4) < ps->liveCount / 50);
+
+  Color empty[4] = {0};
+  assert(!PS_SetEmissionMask(ps, (Image){empty, 2, 2, 1,
+                                         PIXELFORMAT_UNCOMPRESSED_R8G8B8A8}));
+  assert(ps->distribution == IMAGE_MASK);
+  PS_Unload(ps);
+  TEST_PASS("Test_PS_SetEmissionMask_SpawnsOnVisiblePixels");
+}
+
+void Test_PS_SetEmissionPolyline_SpreadsByLength(void) {
+  // An L: 30 units right, then 10 units down
+  const Vector2 points[] = {{0, 0}, {30, 0}, {30, 10}};
+  ParticleSystem *ps = newParticleSystem(&mockTexture, 8000, (Vector2){5, 5});
+  assert(PS_SetEmissionPolyline(ps, points, 3, false));
+  PS_Emit(ps);
+
+  int horizontal = 0;
+  for (int i = 0; i < ps->liveCount; i++) {
+    Particle *p = PS_Internal_GetParticle(ps, i);
+    float x = p->pos.x - 5, y = p->pos.y - 5;
+    bool onFirst = fabsf(y) < 1e-4f && x >= 0 && x <= 30;
+    bool onSecond = fabsf(x - 30) < 1e-4f && y >= 0 && y <= 10;
+    assert(onFirst || onSecond);
+    horizontal += onFirst;
+  }
+
+  assert(abs(horizontal - ps->liveCount * 3 / 4) < ps->liveCount / 50);
+  assert(!PS_SetEmissionPolyline(ps, points, 1, false));
+  PS_Unload(ps);
+  TEST_PASS("Test_PS_SetEmissionPolyline_SpreadsByLength");
+}
+
+void Test_PS_Emit_CircleStaysOnOutline(void) {
+  ParticleSystem *ps = newParticleSystem(&mockTexture, 1000, (Vector2){0, 0});
+  PS_SetEmissionArea(ps, CIRCLE, 20, 20);
+  PS_Emit(ps);
+
+  for (int i = 0; i < ps->liveCount; i++) {
+    Particle *p = PS_Internal_GetParticle(ps, i);
+    assert(fabsf(hypotf(p->pos.x, p->pos.y) - 20) < 1e-3f);
+  }
+  PS_Unload(ps);
+  TEST_PASS("Test_PS_Emit_CircleStaysOnOutline");
+}
+
+// --------------------------------------------------
+// Snapshots
+// --------------------------------------------------
+
+static ParticleSystem *NewSnapshotSystem(void) {
+  ParticleSystem *ps = newParticleSystem(&mockTexture, 5000, (Vector2){0, 0});
+  PS_SetSeed(ps, 99);
+  PS_SetParticleLifetime(ps, 100, 3000);
+  PS_SetEmissionArea(ps, NORMAL, 40, 40);
+  PS_SetLinearAcceleration(ps, -20, -20, 20, 20);
+  PS_SetColors(ps, WHITE_COLOR, (Color){0, 0, 0, 0});
+  PS_SetDepth(ps, 0, 10);
+  PS_SetSortMode(ps, SORT_BY_DEPTH);
+  return ps;
+}
+
+static void *TakeSnapshot(ParticleSystem *ps, size_t *size) {
+  *size = PS_GetSnapshotSize(ps);
+  void *snapshot = malloc(*size);
+  assert(PS_Snapshot(ps, snapshot, *size) == *size);
+  return snapshot;
+}
+
+void Test_PS_Restore_RoundTripsAndReplaysExactly(void) {
+  ParticleSystem *original = NewSnapshotSystem();
+  for (int frame = 0; frame < 5; frame++) {
+    PS_Emit(original);
+    PS_Update(original, 0.3f);
+  }
+
+  size_t size;
+  void *snapshot = TakeSnapshot(original, &size);
+
+  ParticleSystem *copy = newParticleSystem(&mockTexture, 1, (Vector2){5, 5});
+  assert(PS_Restore(copy, snapshot, size));
+  assert(copy->liveCount == original->liveCount);
+
+  size_t copySize;
+  void *copySnapshot = TakeSnapshot(copy, &copySize);
+  assert(copySize == size && memcmp(copySnapshot, snapshot, size) == 0);
+  free(copySnapshot);
+
+  // Same calls on both must keep them identical, random numbers included
+  for (int frame = 0; frame < 5; frame++) {
+    PS_Emit(original);
+    PS_Emit(copy);
+    PS_Update(original, 0.3f);
+    PS_Update(copy, 0.3f);
+  }
+  free(snapshot);
+  snapshot = TakeSnapshot(original, &size);
+  copySnapshot = TakeSnapshot(copy, &copySize);
+  assert(copySize == size && memcmp(copySnapshot, snapshot, size) == 0);
+  assert(IsDrawOrderSorted(copy));
+
+  free(snapshot);
+  free(copySnapshot);
+  PS_Unload(original);
+  PS_Unload(copy);
+  TEST_PASS("Test_PS_Restore_RoundTripsAndReplaysExactly");
+}
+
+void Test_PS_Restore_RejectsInvalidSnapshot(void) {
+  ParticleSystem *ps = NewSnapshotSystem();
+  PS_Emit(ps);
+
+  size_t size;
+  unsigned char *snapshot = TakeSnapshot(ps, &size);
+  assert(!PS_Restore(ps, snapshot, size - 8));
+  snapshot[0] ^= 0xFF;
+  assert(!PS_Restore(ps, snapshot, size));
+  assert(ps->liveCount == 5000);
+  assert(PS_Snapshot(ps, snapshot, size - 1) == 0);
+
+  // Every index is in range, but one particle would be drawn twice. The
+  // order ends the snapshot, give or take padding, so these are two entries
+  snapshot[0] ^= 0xFF;
+  int *order = (int *)(snapshot + size - 5000 * sizeof(int));
+  assert(PS_Restore(ps, snapshot, size));
+  int second = order[1];
+  order[1] = order[0];
+  assert(!PS_Restore(ps, snapshot, size));
+
+  order[1] = second;
+  size_t unchangedSize;
+  void *unchanged = TakeSnapshot(ps, &unchangedSize);
+  assert(unchangedSize == size && memcmp(unchanged, snapshot, size) == 0);
+  free(unchanged);
+
+  free(snapshot);
+  PS_Unload(ps);
+  TEST_PASS("Test_PS_Restore_RejectsInvalidSnapshot");
+}
+
+void Test_PS_Restore_SortedSystemWithNoLiveParticles(void) {
+  ParticleSystem *empty = NewSnapshotSystem();
+  size_t size;
+  void *snapshot = TakeSnapshot(empty, &size);
+
+  ParticleSystem *copy = newParticleSystem(&mockTexture, 1, (Vector2){5, 5});
+  assert(PS_Restore(copy, snapshot, size));
+  assert(copy->liveCount == 0);
+  assert(copy->sortMode == SORT_BY_DEPTH);
+
+  // Still sorts what it emits afterwards
+  PS_Emit(copy);
+  PS_Update(copy, 0.1f);
+  assert(IsDrawOrderSorted(copy));
+
+  free(snapshot);
+  PS_Unload(empty);
+  PS_Unload(copy);
+  TEST_PASS("Test_PS_Restore_SortedSystemWithNoLiveParticles");
+}
+
+void Test_PS_EncodeSnapshotDelta_RoundTripsAndShrinks(void) {
+  ParticleSystem *ps = NewSnapshotSystem();
+  PS_Emit(ps);
+  PS_Update(ps, 0.01f);
+
+  size_t prevSize, currSize;
+  void *prev = TakeSnapshot(ps, &prevSize);
+  PS_Update(ps, 0.01f);
+  void *curr = TakeSnapshot(ps, &currSize);
+
+  size_t bound = PS_GetSnapshotDeltaBound(currSize);
+  void *delta = malloc(bound);
+  void *rebuilt = malloc(currSize);
+
+  // Against the previous frame, only moving fields take space
+  size_t deltaSize =
+      PS_EncodeSnapshotDelta(prev, prevSize, curr, currSize, delta, bound);
+  assert(deltaSize > 0 && deltaSize < currSize * 3 / 4);
+  assert(PS_DecodeSnapshotDelta(prev, prevSize, delta, deltaSize, rebuilt,
+                                currSize) == currSize);
+  assert(memcmp(rebuilt, curr, currSize) == 0);
+
+  // Against nothing, it is a plain copy
+  deltaSize = PS_EncodeSnapshotDelta(NULL, 0, curr, currSize, delta, bound);
+  assert(deltaSize > 0 && deltaSize <= bound);
+  assert(PS_DecodeSnapshotDelta(NULL, 0, delta, deltaSize, rebuilt,
+                                currSize) == currSize);
+  assert(memcmp(rebuilt, curr, currSize) == 0);
+
+  // Truncated deltas are rejected
+  assert(PS_DecodeSnapshotDelta(NULL, 0, delta, deltaSize - 1, rebuilt,
+                                currSize) == 0);
+
+  free(prev);
+  free(curr);
+  free(delta);
+  free(rebuilt);
+  PS_Unload(ps);
+  TEST_PASS("Test_PS_EncodeSnapshotDelta_RoundTripsAndShrinks");
+}
 
 int main() {
   puts("");
   puts("Testing Initialization");
 
+  puts("Testing Kernels");
+  Test_PS_SetColors_SameColorsDisableColorFade();
+  Test_PS_SetLinearAcceleration_ZeroDisablesMotion();
+  Test_PS_Emit_SelectsKernelMatchingFeatures();
+  Test_PS_Update_SpecializedKernelMatchesFullKernel();
+  puts("");
+
+  puts("Testing Storage");
+  Test_PS_Emit_GrowsStorageByBlocks();
+  Test_PS_Update_RemovesDeadParticlesAndReleasesBlocks();
+  Test_PS_Internal_AcquireBlock_ReusesPooledBlocks();
+  Test_PS_SetBlockPoolLimit_FreesBlocksAboveLimit();
+  puts("");
+
+  puts("Testing Sorting");
+  Test_PS_Internal_RadixSort_SortsKeysStably();
+  Test_PS_SetSortMode_SortsByYAfterUpdate();
+  Test_PS_SetSortMode_KeepsOrderThroughDeaths();
+  Test_PS_SetSortMode_SortsByAge();
+  puts("");
+
+  puts("Testing Emission");
+  Test_PS_Internal_FillNormal_MatchesStandardNormal();
+  Test_PS_Emit_NormalSpreadMatchesDeviation();
+  Test_PS_Emit_DiskStaysInsideEllipse();
+  Test_PS_SetSeed_MakesEmissionRepeatable();
+  puts("");
+
+  puts("Testing Shapes");
+  Test_PS_Internal_BuildAliasTable_MatchesWeights();
+  Test_PS_SetEmissionMask_SpawnsOnVisiblePixels();
+  Test_PS_SetEmissionPolyline_SpreadsByLength();
+  Test_PS_Emit_CircleStaysOnOutline();
+  puts("");
+
+  puts("Testing Snapshots");
+  Test_PS_Restore_RoundTripsAndReplaysExactly();
+  Test_PS_Restore_RejectsInvalidSnapshot();
+  Test_PS_Restore_SortedSystemWithNoLiveParticles();
+  Test_PS_EncodeSnapshotDelta_RoundTripsAndShrinks();
+  puts("");
+
   puts("Testing Transition");
 
   puts("Testing Shutdown");
@@ -15,4 +690,4 @@ int main() {
   puts("");
   puts("ALL TESTS PASSED!!");
   return 0;
-}
\ No newline at end of file
+}
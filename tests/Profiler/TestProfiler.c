@@ -0,0 +1,220 @@
+#include "../include/Profiler.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+#define TEST_PASS(funcName) printf("\t[PASS] %s\n", funcName)
+#define TRACE_PATH "TestProfilerTrace.json"
+#define ZONE_THREADS 4
+#define ZONES_PER_THREAD 1000
+
+// --------------------------------------------------
+// Variables
+// --------------------------------------------------
+static char *trace;
+
+// --------------------------------------------------
+// Helpers
+// --------------------------------------------------
+
+static void ReadTrace(void) {
+
+  free(trace);
+  FILE *file = fopen(TRACE_PATH, "r");
+  assert(file);
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  rewind(file);
+
+  trace = malloc(size + 1);
+  assert(fread(trace, 1, size, file) == (size_t)size);
+  trace[size] = '\0';
+  fclose(file);
+}
+
+static int CountInTrace(const char *str) {
+
+  int count = 0;
+  for (const char *at = strstr(trace, str); at; at = strstr(at + 1, str)) {
+    count++;
+  }
+  return count;
+}
+
+static void RecordZone(const char *name) {
+  ProfileZone zone = PF_BeginZone(name);
+  PF_EndZone(&zone);
+}
+
+static void *RecordFromThread(void *arg) {
+
+  char name[PF_THREAD_NAME_SIZE];
+  snprintf(name, sizeof(name), "worker %d", *(int *)arg);
+  PF_SetThreadName(name);
+  for (int i = 0; i < ZONES_PER_THREAD; i++) {
+    RecordZone("WorkerZone");
+  }
+  return NULL;
+}
+
+// --------------------------------------------------
+// Capture
+// --------------------------------------------------
+
+void Test_PF_BeginZone_RecordsNothingWhenNotCapturing(void) {
+  RecordZone("Ignored");
+  assert(PF_WriteTrace(TRACE_PATH));
+  ReadTrace();
+  assert(!CountInTrace("\"ph\":\"X\""));
+  TEST_PASS("Test_PF_BeginZone_RecordsNothingWhenNotCapturing");
+}
+
+void Test_PF_StartCapture_ReturnsFalseIfAlreadyCapturing(void) {
+  assert(PF_StartCapture());
+  assert(!PF_StartCapture());
+  assert(PF_IsCapturing());
+  TEST_PASS("Test_PF_StartCapture_ReturnsFalseIfAlreadyCapturing");
+}
+
+void Test_PF_WriteTrace_WritesCompleteEvents(void) {
+  PF_SetThreadName("main");
+  {
+    ProfileZone outer = PF_BeginZone("Outer");
+    RecordZone("Inner");
+    PF_EndZone(&outer);
+  }
+  assert(PF_WriteTrace(TRACE_PATH));
+  ReadTrace();
+  assert(CountInTrace("\"ph\":\"X\"") == 2);
+  assert(CountInTrace("{\"name\":\"Inner\",\"ph\":\"X\""));
+  assert(CountInTrace("{\"name\":\"Outer\",\"ph\":\"X\""));
+  assert(CountInTrace("\"args\":{\"name\":\"main\"}"));
+  assert(strstr(trace, "]}"));
+  TEST_PASS("Test_PF_WriteTrace_WritesCompleteEvents");
+}
+
+void Test_PF_WriteTrace_DrainsTheRings(void) {
+  assert(PF_WriteTrace(TRACE_PATH));
+  ReadTrace();
+  assert(!CountInTrace("\"ph\":\"X\""));
+  TEST_PASS("Test_PF_WriteTrace_DrainsTheRings");
+}
+
+void Test_PF_WriteTrace_EscapesNames(void) {
+  RecordZone("Say \"hi\"\\n");
+  assert(PF_WriteTrace(TRACE_PATH));
+  ReadTrace();
+  assert(CountInTrace("\"Say \\\"hi\\\"\\\\n\""));
+  TEST_PASS("Test_PF_WriteTrace_EscapesNames");
+}
+
+void Test_PF_WriteTrace_ReturnsFalseIfFileCantBeWritten(void) {
+  assert(!PF_WriteTrace(NULL));
+  assert(!PF_WriteTrace("missing_directory/trace.json"));
+  TEST_PASS("Test_PF_WriteTrace_ReturnsFalseIfFileCantBeWritten");
+}
+
+void Test_PF_ZONE_EndsWithTheBlock(void) {
+#ifdef SMILE_PROFILER
+  {
+    PF_ZONE("Scoped");
+  }
+  assert(PF_WriteTrace(TRACE_PATH));
+  ReadTrace();
+  assert(CountInTrace("{\"name\":\"Scoped\",\"ph\":\"X\"") == 1);
+#endif
+  TEST_PASS("Test_PF_ZONE_EndsWithTheBlock");
+}
+
+// --------------------------------------------------
+// Threads
+// --------------------------------------------------
+
+void Test_PF_EndZone_RecordsFromEveryThread(void) {
+  pthread_t threads[ZONE_THREADS];
+  int ids[ZONE_THREADS];
+  for (int i = 0; i < ZONE_THREADS; i++) {
+    ids[i] = i;
+    pthread_create(&threads[i], NULL, RecordFromThread, &ids[i]);
+  }
+  for (int i = 0; i < ZONE_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  assert(PF_WriteTrace(TRACE_PATH));
+  ReadTrace();
+  assert(CountInTrace("\"WorkerZone\"") == ZONE_THREADS * ZONES_PER_THREAD);
+  for (int i = 0; i < ZONE_THREADS; i++) {
+    char name[64];
+    snprintf(name, sizeof(name), "{\"name\":\"worker %d\"}", i);
+    assert(CountInTrace(name) == 1);
+  }
+  TEST_PASS("Test_PF_EndZone_RecordsFromEveryThread");
+}
+
+void Test_PF_EndZone_ReusesRingsOfExitedThreads(void) {
+  // The rings of the threads above were drained, so these take them over
+  for (int round = 0; round < PF_MAX_THREADS / ZONE_THREADS + 1; round++) {
+    Test_PF_EndZone_RecordsFromEveryThread();
+  }
+  assert(PF_GetDroppedCount() == 0);
+  TEST_PASS("Test_PF_EndZone_ReusesRingsOfExitedThreads");
+}
+
+void Test_PF_EndZone_DropsZonesWhenRingIsFull(void) {
+  for (int i = 0; i < PF_RING_SIZE + 10; i++) {
+    RecordZone("Flood");
+  }
+  assert(PF_GetDroppedCount() == 10);
+  assert(PF_WriteTrace(TRACE_PATH));
+  ReadTrace();
+  assert(CountInTrace("\"Flood\"") == PF_RING_SIZE);
+  TEST_PASS("Test_PF_EndZone_DropsZonesWhenRingIsFull");
+}
+
+void Test_PF_StopCapture_KeepsRecordedZones(void) {
+  RecordZone("BeforeStop");
+  assert(PF_StopCapture());
+  assert(!PF_StopCapture());
+  RecordZone("AfterStop");
+  assert(PF_WriteTrace(TRACE_PATH));
+  ReadTrace();
+  assert(CountInTrace("\"BeforeStop\"") == 1);
+  assert(!CountInTrace("\"AfterStop\""));
+  TEST_PASS("Test_PF_StopCapture_KeepsRecordedZones");
+}
+
+// --------------------------------------------------
+// Finger's crossed!
+// --------------------------------------------------
+
+int main() {
+  puts("");
+  puts("Testing Capture");
+  Test_PF_BeginZone_RecordsNothingWhenNotCapturing();
+  Test_PF_StartCapture_ReturnsFalseIfAlreadyCapturing();
+  Test_PF_WriteTrace_WritesCompleteEvents();
+  Test_PF_WriteTrace_DrainsTheRings();
+  Test_PF_WriteTrace_EscapesNames();
+  Test_PF_WriteTrace_ReturnsFalseIfFileCantBeWritten();
+  Test_PF_ZONE_EndsWithTheBlock();
+  puts("");
+
+  puts("Testing Threads");
+  Test_PF_EndZone_RecordsFromEveryThread();
+  Test_PF_EndZone_ReusesRingsOfExitedThreads();
+  Test_PF_EndZone_DropsZonesWhenRingIsFull();
+  Test_PF_StopCapture_KeepsRecordedZones();
+  puts("");
+
+  free(trace);
+  remove(TRACE_PATH);
+  puts("All tests completed successfully!");
+  return 0;
+}
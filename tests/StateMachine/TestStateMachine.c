@@ -1,4 +1,3 @@
-// TODO(#1) add tests for failed memory allocation in SM_RegisterState
 // TODO(#10) implement tests for `SM_Internal_EnableWarnings()`
 
 /*
@@ -27,6 +26,10 @@
 #include "../src/StateMachine/StateMachineInternal.h"
 #include "StateMachineTest.h"
 #include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -36,6 +39,9 @@
 
 #define SM_COMP_NAME(name1, name2) strcmp(name1, name2) == 0
 #define TEST_PASS(funcName) printf("\t[PASS] %s\n", funcName)
+#define POSTING_THREADS 4
+
+enum { EVENT_OPEN, EVENT_CLOSE, EVENT_CONFIRM, EVENT_UNUSED };
 
 // --------------------------------------------------
 // Data types
@@ -50,12 +56,20 @@ typedef struct {
 
   bool hasExited;
   int exitedTimes;
+
+  int pausedTimes;
+  int resumedTimes;
 } MockData;
 
 typedef struct {
   bool flag;
 } MockStateArgs;
 
+typedef struct {
+  int value;
+  StateMachine *machine;
+} MockEntity;
+
 // --------------------------------------------------
 // variables
 // --------------------------------------------------
@@ -63,6 +77,25 @@ static unsigned int MULTIPLE_STATES = 1000;
 static float mockDT = 0.016;
 MockData md;
 static State mockState = {.name = "mockState"};
+static void *activeUserData;
+static int machineUpdates;
+static int batchCalls, batchCount, batchSum;
+static bool batchMovesEntities;
+static unsigned int PARALLEL_ENTITIES = 5000;
+static int *enterOrder;
+static int enterCount;
+static char stackLog[16];
+static int stackLogCount;
+static atomic_bool releasePreload;
+static atomic_int preloadedTimes;
+static int runUpdates, runDraws, runStopAfter;
+static float runDt;
+static bool runAlphasInRange, runNestedResult;
+static void *enteredArgs;
+static StateMachine *destroyTarget;
+static bool targetChanged;
+static bool nestedArgsResult;
+extern const StateTable testStateTable; // TestStateTable.c
 
 // --------------------------------------------------
 // Mock Functions
@@ -83,6 +116,96 @@ void mockExit(void) {
   md.hasExited = true;
   md.exitedTimes++;
 }
+void mockPause(void) { md.pausedTimes++; }
+void mockResume(void) { md.resumedTimes++; }
+void mockBaseUpdate(float dt) { stackLog[stackLogCount++] = 'b'; }
+void mockBaseDraw(void) { stackLog[stackLogCount++] = 'B'; }
+void mockOverlayUpdate(float dt) { stackLog[stackLogCount++] = 'o'; }
+void mockOverlayDraw(void) { stackLog[stackLogCount++] = 'O'; }
+void mockParentEnter(void *args) { stackLog[stackLogCount++] = 'P'; }
+void mockParentUpdate(float dt) { stackLog[stackLogCount++] = 'u'; }
+void mockParentDraw(void) { stackLog[stackLogCount++] = 'd'; }
+void mockParentExit(void) { stackLog[stackLogCount++] = 'p'; }
+void mockChildEnter(void *args) { stackLog[stackLogCount++] = 'C'; }
+void mockChildExit(void) { stackLog[stackLogCount++] = 'c'; }
+void mockPreload(void) {
+  while (!atomic_load(&releasePreload)) {
+    sched_yield();
+  }
+  atomic_fetch_add(&preloadedTimes, 1);
+}
+void mockRunUpdate(float dt) {
+  runDt = dt;
+  if (++runUpdates == runStopAfter) {
+    SM_StopRun();
+  }
+}
+void mockRunDraw(void) {
+  float alpha = SM_GetInterpolationAlpha();
+  runAlphasInRange = runAlphasInRange && alpha >= 0 && alpha < 1;
+  runDraws++;
+}
+void mockNestedRunUpdate(float dt) { runNestedResult = SM_Run(NULL); }
+void mockArgsEnter(void *args) {
+  enteredArgs = args;
+  mockEnter(args);
+}
+void mockArgsExit(void) {
+  char largeArgs[4096] = {0};
+  nestedArgsResult =
+      SM_ChangeStateToWithArgs("testFrame", largeArgs, sizeof(largeArgs));
+}
+void mockPostingUpdate(float dt) { SM_PostStateChange("testPostA", NULL); }
+bool mockGuard(void *args) { return args && ((MockStateArgs *)args)->flag; }
+bool mockMachineGuard(void *args) {
+  activeUserData = SM_GetUserData(SM_GetActiveMachine());
+  return true;
+}
+void mockMachineEnter(void *args) {
+  activeUserData = SM_GetUserData(SM_GetActiveMachine());
+}
+void mockMachineUpdate(float dt) {
+  activeUserData = SM_GetUserData(SM_GetActiveMachine());
+  machineUpdates++;
+}
+void mockBatchUpdate(float dt, void **entities, int count) {
+  batchCalls++;
+  batchCount = count;
+  batchSum = 0;
+  for (int i = 0; i < count; i++) {
+    MockEntity *entity = entities[i];
+    batchSum += entity->value;
+    if (batchMovesEntities) {
+      SM_MachineChangeStateTo(entity->machine, "testMachine", NULL);
+      assert(SM_COMP_NAME(SM_MachineGetCurrStateName(entity->machine),
+                          "testBatch"));
+    }
+  }
+}
+
+// Only touch their own entity, so they can run on any thread
+void mockParallelBatchUpdate(float dt, void **entities, int count) {
+  for (int i = 0; i < count; i++) {
+    MockEntity *entity = entities[i];
+    if (entity->value % 3 == 0) {
+      SM_MachineChangeStateTo(entity->machine, "testParallelDone", entity);
+    }
+  }
+}
+void mockParallelUpdate(float dt) {
+  MockEntity *entity = SM_GetUserData(SM_GetActiveMachine());
+  if (entity->value % 2 == 0) {
+    SM_MachineChangeStateTo(entity->machine, "testParallelDone", entity);
+  }
+}
+void mockParallelDoneEnter(void *args) {
+  enterOrder[enterCount++] = ((MockEntity *)args)->value;
+}
+void mockDestroyerUpdate(float dt) { assert(SM_Destroy(destroyTarget)); }
+void mockTargetUpdate(float dt) {
+  targetChanged =
+      SM_MachineChangeStateTo(SM_GetActiveMachine(), "testMachine", NULL);
+}
 
 // --------------------------------------------------
 // Pre-initialization - Internal
@@ -146,6 +269,16 @@ void Test_SM_ChangeStateTo_ReturnsFalseBeforeInitialization(void) {
   TEST_PASS("Test_SM_ChangeStateTo_ReturnsFalseBeforeInitialization");
 }
 
+void Test_SM_PostStateChange_ReturnsFalseBeforeInitialization(void) {
+  assert(!SM_PostStateChange("testBeforeInit", NULL));
+  TEST_PASS("Test_SM_PostStateChange_ReturnsFalseBeforeInitialization");
+}
+
+void Test_SM_Dispatch_ReturnsFalseBeforeInitialization(void) {
+  assert(!SM_Dispatch(EVENT_OPEN, NULL));
+  TEST_PASS("Test_SM_Dispatch_ReturnsFalseBeforeInitialization");
+}
+
 void Test_SM_Update_ReturnsFalseBeforeInitialization(void) {
   assert(!SM_Update(mockDT));
   TEST_PASS("Test_SM_Update_ReturnsFalseBeforeInitialization");
@@ -166,6 +299,28 @@ void Test_SM_GetCurrStateName_ReturnsNullBeforeInitialization(void) {
   TEST_PASS("Test_SM_GetCurrStateName_ReturnsNullBeforeInitialization");
 }
 
+void Test_SM_Run_ReturnsFalseBeforeInitialization(void) {
+  assert(!SM_Run(NULL));
+  assert(!SM_StopRun());
+  TEST_PASS("Test_SM_Run_ReturnsFalseBeforeInitialization");
+}
+
+void Test_SM_ChangeStateToWithArgs_ReturnsFalseBeforeInitialization(void) {
+  MockStateArgs args = {.flag = true};
+  assert(!SM_ChangeStateToWithArgs("testBeforeInit", &args, sizeof(args)));
+  TEST_PASS("Test_SM_ChangeStateToWithArgs_ReturnsFalseBeforeInitialization");
+}
+
+void Test_SM_FrameAlloc_ReturnsNullBeforeInitialization(void) {
+  assert(!SM_FrameAlloc(16));
+  TEST_PASS("Test_SM_FrameAlloc_ReturnsNullBeforeInitialization");
+}
+
+void Test_SM_Create_ReturnsNullBeforeInitialization(void) {
+  assert(!SM_Create(NULL));
+  TEST_PASS("Test_SM_Create_ReturnsNullBeforeInitialization");
+}
+
 // --------------------------------------------------
 // Initialization
 // --------------------------------------------------
@@ -233,6 +388,19 @@ void Test_SM_RegisterState_ReturnsFalseIfNameIsEmpty(void) {
   TEST_PASS("Test_SM_RegisterState_ReturnsFalseIfNameIsEmpty");
 }
 
+void Test_SM_RegisterState_ReturnsFalseIfNameIsWhitespaceOnly(void) {
+  assert(!SM_RegisterState(" \t\n ", mockEnter, NULL, NULL, NULL));
+  TEST_PASS("Test_SM_RegisterState_ReturnsFalseIfNameIsWhitespaceOnly");
+}
+
+void Test_SM_RegisterState_TrimsName(void) {
+  assert(SM_RegisterState("  testTrimmed\t", mockEnter, NULL, NULL, NULL));
+  assert(SM_COMP_NAME(SM_Internal_GetState("testTrimmed")->name,
+                      "testTrimmed"));
+  assert(!SM_RegisterState("testTrimmed", mockEnter, NULL, NULL, NULL));
+  TEST_PASS("Test_SM_RegisterState_TrimsName");
+}
+
 void Test_SM_RegisterState_ReturnsTrueIfAllFunctionsPresent(void) {
   assert(SM_RegisterState("testNoNULL", mockEnter, mockUpdate, mockDraw,
                           mockExit));
@@ -256,6 +424,36 @@ void Test_SM_RegisterState_ReturnsTrueIfDrawAndExitNULL(void) {
   TEST_PASS("Test_SM_RegisterState_ReturnsTrueIfDrawAndExitNULL");
 }
 
+void Test_SM_RegisterState_StoresStatesNextToEachOther(void) {
+  SM_RegisterState("testArenaFirst", mockEnter, NULL, NULL, NULL);
+  SM_RegisterState("testArenaSecond", mockEnter, NULL, NULL, NULL);
+  const char *first = (const char *)SM_Internal_GetState("testArenaFirst");
+  const char *second = (const char *)SM_Internal_GetState("testArenaSecond");
+  assert(second > first && second - first <= sizeof(StateEntry) + 64);
+  TEST_PASS("Test_SM_RegisterState_StoresStatesNextToEachOther");
+}
+
+void Test_SM_RegisterState_ReturnsFalseIfMallocFails(void) {
+  SM_Test_SetCanMalloc(false);
+
+  // Fill up the current arena block until a new one is needed
+  char name[32];
+  int registered = SM_Test_GetStateCount();
+  for (int i = 0; i < 100000; i++) {
+    snprintf(name, sizeof(name), "testArenaFull%d", i);
+    if (!SM_RegisterState(name, mockEnter, NULL, NULL, NULL)) {
+      break;
+    }
+    registered++;
+  }
+  assert(!SM_IsStateRegistered(name));
+  assert(SM_Test_GetStateCount() == registered);
+
+  SM_Test_SetCanMalloc(true);
+  assert(SM_RegisterState(name, mockEnter, NULL, NULL, NULL));
+  TEST_PASS("Test_SM_RegisterState_ReturnsFalseIfMallocFails");
+}
+
 void Test_SM_RegisterState_ReturnsFalseIfAllFunctionsNULL(void) {
   assert(!SM_RegisterState("testAllNULL", NULL, NULL, NULL, NULL));
   TEST_PASS("Test_SM_RegisterState_ReturnsFalseIfAllFunctionsNULL");
@@ -310,6 +508,17 @@ void Test_SM_ChangeStateTo_ReturnsFalseIfStateIsUnregistered(void) {
   TEST_PASS("Test_SM_ChangeStateTo_ReturnsFalseIfStateIsUnregistered");
 }
 
+void Test_SM_ChangeStateTo_ReturnsFalseIfNameIsWhitespaceOnly(void) {
+  assert(!SM_ChangeStateTo("   ", NULL));
+  TEST_PASS("Test_SM_ChangeStateTo_ReturnsFalseIfNameIsWhitespaceOnly");
+}
+
+void Test_SM_ChangeStateTo_IgnoresSurroundingWhitespace(void) {
+  assert(SM_ChangeStateTo(" testTrimmed  ", NULL));
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testTrimmed"));
+  TEST_PASS("Test_SM_ChangeStateTo_IgnoresSurroundingWhitespace");
+}
+
 void Test_SM_ChangeStateTo_ReturnsTrueChangingFromOneValidStateToAnother(void) {
   assert(SM_ChangeStateTo("testNULLEnterAndUpdate", NULL));
   TEST_PASS(
@@ -374,6 +583,295 @@ void Test_SM_IsStateRegistered_ReturnsFalseForInvalidStateName(void) {
   TEST_PASS("Test_SM_IsStateRegistered_ReturnsFalseForInvalidStateName");
 }
 
+// --------------------------------------------------
+// Handles
+// --------------------------------------------------
+
+void Test_SM_GetStateHandle_ReturnsHandleOfRegisteredState(void) {
+  StateHandle handle = SM_GetStateHandle("testNoNULL");
+  assert(handle != SM_INVALID_STATE);
+  assert(SM_Internal_GetStateByHandle(handle) ==
+         SM_Internal_GetState("testNoNULL"));
+  TEST_PASS("Test_SM_GetStateHandle_ReturnsHandleOfRegisteredState");
+}
+
+void Test_SM_GetStateHandle_ReturnsInvalidForUnregisteredName(void) {
+  assert(SM_GetStateHandle("testUnregistered") == SM_INVALID_STATE);
+  assert(SM_GetStateHandle(NULL) == SM_INVALID_STATE);
+  TEST_PASS("Test_SM_GetStateHandle_ReturnsInvalidForUnregisteredName");
+}
+
+void Test_SM_RegisterState_ReturnsUsableHandle(void) {
+  StateHandle handle =
+      SM_RegisterState("testHandle", mockEnter, mockUpdate, mockDraw, mockExit);
+  assert(handle != SM_INVALID_STATE);
+  assert(handle == SM_GetStateHandle("testHandle"));
+  assert(handle != SM_GetStateHandle("testNoNULL"));
+  TEST_PASS("Test_SM_RegisterState_ReturnsUsableHandle");
+}
+
+void Test_SM_ChangeStateToHandle_CallsExitAndEnter(void) {
+  md.hasEntered = md.hasExited = md.hasEnteredArgs = false;
+  MockStateArgs temp = {.flag = true};
+  assert(SM_ChangeStateToHandle(SM_GetStateHandle("testHandle"), &temp));
+  assert(md.hasEntered && md.hasExited && md.hasEnteredArgs);
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testHandle"));
+  TEST_PASS("Test_SM_ChangeStateToHandle_CallsExitAndEnter");
+}
+
+void Test_SM_ChangeStateToHandle_ReturnsFalseForInvalidHandle(void) {
+  assert(!SM_ChangeStateToHandle(SM_INVALID_STATE, NULL));
+  assert(!SM_ChangeStateToHandle(1000000, NULL));
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testHandle"));
+  SM_ChangeStateTo("testNoNULL", NULL);
+  TEST_PASS("Test_SM_ChangeStateToHandle_ReturnsFalseForInvalidHandle");
+}
+
+// --------------------------------------------------
+// Machines
+// --------------------------------------------------
+
+void Test_SM_Create_ReturnsMachineWithNoCurrentState(void) {
+  int userData;
+  StateMachine *sm = SM_Create(&userData);
+  assert(sm);
+  assert(SM_MachineGetCurrState(sm) == SM_INVALID_STATE);
+  assert(!SM_MachineGetCurrStateName(sm));
+  assert(SM_GetUserData(sm) == &userData);
+  assert(!SM_MachineUpdate(sm, mockDT));
+  SM_Destroy(sm);
+  TEST_PASS("Test_SM_Create_ReturnsMachineWithNoCurrentState");
+}
+
+void Test_SM_Create_ReturnsNullIfMallocFails(void) {
+  SM_Test_SetCanMalloc(false);
+  assert(!SM_Create(NULL));
+  SM_Test_SetCanMalloc(true);
+  TEST_PASS("Test_SM_Create_ReturnsNullIfMallocFails");
+}
+
+void Test_SM_Create_MachineStaysSmall(void) {
+  assert(sizeof(StateMachine) <=
+         sizeof(StateHandle) + sizeof(int) + sizeof(void *));
+  TEST_PASS("Test_SM_Create_MachineStaysSmall");
+}
+
+void Test_SM_MachineChangeStateTo_TracksStateIndependently(void) {
+  StateMachine *first = SM_Create(NULL);
+  StateMachine *second = SM_Create(NULL);
+
+  assert(SM_MachineChangeStateTo(first, "testHandle", NULL));
+  assert(SM_MachineChangeStateToHandle(
+      second, SM_GetStateHandle("testNULLDrawAndExit"), NULL));
+  assert(!SM_MachineChangeStateTo(second, "testUnregistered", NULL));
+  assert(!SM_MachineChangeStateTo(second, "", NULL));
+
+  assert(SM_COMP_NAME(SM_MachineGetCurrStateName(first), "testHandle"));
+  assert(
+      SM_COMP_NAME(SM_MachineGetCurrStateName(second), "testNULLDrawAndExit"));
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testNoNULL"));
+
+  SM_Destroy(first);
+  SM_Destroy(second);
+  TEST_PASS("Test_SM_MachineChangeStateTo_TracksStateIndependently");
+}
+
+void Test_SM_MachineUpdate_ExposesActiveMachine(void) {
+  int firstData, secondData;
+  StateMachine *first = SM_Create(&firstData);
+  StateMachine *second = SM_Create(&secondData);
+
+  SM_RegisterState("testMachine", mockMachineEnter, mockMachineUpdate, NULL,
+                   NULL);
+  SM_MachineChangeStateTo(first, "testMachine", NULL);
+  assert(activeUserData == &firstData);
+
+  SM_MachineChangeStateTo(second, "testMachine", NULL);
+  assert(SM_MachineUpdate(first, mockDT));
+  assert(activeUserData == &firstData);
+  assert(SM_MachineUpdate(second, mockDT));
+  assert(activeUserData == &secondData);
+  assert(!SM_GetActiveMachine());
+
+  SM_Destroy(first);
+  SM_Destroy(second);
+  TEST_PASS("Test_SM_MachineUpdate_ExposesActiveMachine");
+}
+
+void Test_SM_Destroy_CallsExitFunctionOfCurrentState(void) {
+  StateMachine *sm = SM_Create(NULL);
+  SM_MachineChangeStateTo(sm, "testHandle", NULL);
+  md.hasExited = false;
+  assert(SM_Destroy(sm));
+  assert(md.hasExited);
+  assert(!SM_Destroy(NULL));
+  TEST_PASS("Test_SM_Destroy_CallsExitFunctionOfCurrentState");
+}
+
+// --------------------------------------------------
+// Batch updates
+// --------------------------------------------------
+
+static MockEntity batchEntities[4];
+
+void Test_SM_SetStateBatchUpdate_ReturnsFalseIfStateIsUnregistered(void) {
+  assert(!SM_SetStateBatchUpdate("testUnregistered", mockBatchUpdate));
+  assert(!SM_SetStateBatchUpdate(NULL, mockBatchUpdate));
+  TEST_PASS("Test_SM_SetStateBatchUpdate_ReturnsFalseIfStateIsUnregistered");
+}
+
+void Test_SM_UpdateAll_CallsBatchUpdateOncePerState(void) {
+  SM_RegisterState("testBatch", NULL, mockUpdate, NULL, NULL);
+  assert(SM_SetStateBatchUpdate("testBatch", mockBatchUpdate));
+
+  for (int i = 0; i < 4; i++) {
+    batchEntities[i] = (MockEntity){i + 1, SM_Create(&batchEntities[i])};
+  }
+  for (int i = 0; i < 3; i++) {
+    SM_MachineChangeStateTo(batchEntities[i].machine, "testBatch", NULL);
+  }
+  SM_MachineChangeStateTo(batchEntities[3].machine, "testMachine", NULL);
+
+  batchCalls = machineUpdates = 0;
+  md.hasUpdated = false;
+  assert(SM_UpdateAll(mockDT));
+  assert(batchCalls == 1 && batchCount == 3 && batchSum == 1 + 2 + 3);
+  assert(machineUpdates == 1 && activeUserData == &batchEntities[3]);
+  assert(!md.hasUpdated);
+  TEST_PASS("Test_SM_UpdateAll_CallsBatchUpdateOncePerState");
+}
+
+void Test_SM_UpdateAll_KeepsGroupsInSyncWithTransitions(void) {
+  SM_MachineChangeStateTo(batchEntities[0].machine, "testMachine", NULL);
+  assert(SM_UpdateAll(mockDT));
+  assert(batchCount == 2 && batchSum == 2 + 3);
+
+  batchEntities[0].value = 10;
+  SM_MachineChangeStateTo(batchEntities[0].machine, "testBatch", NULL);
+  SM_SetUserData(batchEntities[1].machine, &batchEntities[3]);
+  assert(SM_UpdateAll(mockDT));
+  assert(batchCount == 3 && batchSum == 10 + 4 + 3);
+
+  SM_SetUserData(batchEntities[1].machine, &batchEntities[1]);
+  TEST_PASS("Test_SM_UpdateAll_KeepsGroupsInSyncWithTransitions");
+}
+
+void Test_SM_UpdateAll_DefersStateChangesUntilDone(void) {
+  batchMovesEntities = true;
+  machineUpdates = 0;
+  assert(SM_UpdateAll(mockDT));
+  batchMovesEntities = false;
+
+  // Only the one already in testMachine was updated there
+  assert(machineUpdates == 1);
+  for (int i = 0; i < 4; i++) {
+    assert(SM_COMP_NAME(SM_MachineGetCurrStateName(batchEntities[i].machine),
+                        "testMachine"));
+  }
+
+  batchCalls = 0;
+  assert(SM_UpdateAll(mockDT));
+  assert(batchCalls == 0 && machineUpdates == 1 + 4);
+
+  for (int i = 0; i < 4; i++) {
+    SM_Destroy(batchEntities[i].machine);
+  }
+  TEST_PASS("Test_SM_UpdateAll_DefersStateChangesUntilDone");
+}
+
+// --------------------------------------------------
+// Parallel updates
+// --------------------------------------------------
+
+static void RunParallelScene(bool parallel, int *order) {
+  MockEntity *entities = malloc(PARALLEL_ENTITIES * sizeof(MockEntity));
+  enterOrder = order;
+  enterCount = 0;
+
+  for (int i = 0; i < PARALLEL_ENTITIES; i++) {
+    entities[i] = (MockEntity){i, SM_Create(&entities[i])};
+    SM_MachineChangeStateTo(entities[i].machine,
+                            i % 2 ? "testParallelBatch" : "testParallelSingle",
+                            NULL);
+  }
+
+  assert(parallel ? SM_UpdateAllParallel(mockDT) : SM_UpdateAll(mockDT));
+
+  for (int i = 0; i < PARALLEL_ENTITIES; i++) {
+    SM_Destroy(entities[i].machine);
+  }
+  free(entities);
+}
+
+void Test_SM_SetThreadCount_ReturnsThreadsUsed(void) {
+  assert(SM_SetThreadCount(3) == 3);
+  assert(SM_SetThreadCount(0) >= 1);
+  TEST_PASS("Test_SM_SetThreadCount_ReturnsThreadsUsed");
+}
+
+void Test_SM_UpdateAllParallel_MatchesSerialOrder(void) {
+  SM_RegisterState("testParallelBatch", NULL, mockUpdate, NULL, NULL);
+  SM_SetStateBatchUpdate("testParallelBatch", mockParallelBatchUpdate);
+  SM_RegisterState("testParallelSingle", NULL, mockParallelUpdate, NULL, NULL);
+  SM_RegisterState("testParallelDone", mockParallelDoneEnter, NULL, NULL, NULL);
+
+  int *serial = malloc(PARALLEL_ENTITIES * sizeof(int));
+  int *parallel = malloc(PARALLEL_ENTITIES * sizeof(int));
+
+  RunParallelScene(false, serial);
+  int serialCount = enterCount;
+  assert(serialCount > 0);
+
+  int threadCounts[] = {1, 2, 4, 7};
+  for (int i = 0; i < 4; i++) {
+    SM_SetThreadCount(threadCounts[i]);
+    RunParallelScene(true, parallel);
+    assert(enterCount == serialCount);
+    assert(memcmp(serial, parallel, serialCount * sizeof(int)) == 0);
+  }
+
+  free(serial);
+  free(parallel);
+  TEST_PASS("Test_SM_UpdateAllParallel_MatchesSerialOrder");
+}
+
+// One thread, so the destroyer may reach into another task's instance
+static void RunDestroyScene(bool parallel, int destroyers) {
+  StateMachine *machines[2];
+  for (int i = 0; i < destroyers; i++) {
+    machines[i] = SM_Create(NULL);
+    SM_MachineChangeStateTo(machines[i], "testDestroyer", NULL);
+  }
+  destroyTarget = SM_Create(NULL);
+  SM_MachineChangeStateTo(destroyTarget, "testDestroyTarget", NULL);
+
+  md.exitedTimes = 0;
+  targetChanged = true;
+  SM_SetThreadCount(1);
+  assert(parallel ? SM_UpdateAllParallel(mockDT) : SM_UpdateAll(mockDT));
+  assert(!targetChanged && md.exitedTimes == 1);
+
+  for (int i = 0; i < destroyers; i++) {
+    SM_Destroy(machines[i]);
+  }
+  SM_SetThreadCount(0);
+}
+
+void Test_SM_Destroy_DropsLaterChangesDuringUpdateAll(void) {
+  SM_RegisterState("testDestroyer", NULL, mockDestroyerUpdate, NULL, NULL);
+  SM_RegisterState("testDestroyTarget", NULL, mockTargetUpdate, NULL,
+                   mockExit);
+  RunDestroyScene(false, 1);
+  RunDestroyScene(true, 1);
+  TEST_PASS("Test_SM_Destroy_DropsLaterChangesDuringUpdateAll");
+}
+
+void Test_SM_Destroy_FreesOnceWhenDestroyedTwiceDuringUpdateAll(void) {
+  RunDestroyScene(false, 2);
+  RunDestroyScene(true, 2);
+  TEST_PASS("Test_SM_Destroy_FreesOnceWhenDestroyedTwiceDuringUpdateAll");
+}
+
 // --------------------------------------------------
 // Update and Draw
 // --------------------------------------------------
@@ -404,6 +902,756 @@ void Test_SM_Draw_CallsValidDrawFunctionEvenIfNullDraw(void) {
   TEST_PASS("Test_SM_Draw_CallsValidDrawFunctionEvenIfNullDraw");
 }
 
+// --------------------------------------------------
+// State Stack
+// --------------------------------------------------
+
+static bool StackLogIs(const char *expected) {
+  stackLog[stackLogCount] = '\0';
+  bool matches = SM_COMP_NAME(stackLog, expected);
+  stackLogCount = 0;
+  return matches;
+}
+
+void Test_SM_PushState_ReturnsFalseIfStateIsUnregistered(void) {
+  assert(!SM_PushState("testUnregistered", NULL));
+  assert(!SM_PushState(NULL, NULL));
+  assert(!SM_PushState("", NULL));
+  assert(!SM_PushStateHandle(SM_INVALID_STATE, NULL));
+  TEST_PASS("Test_SM_PushState_ReturnsFalseIfStateIsUnregistered");
+}
+
+void Test_SM_PopState_ReturnsFalseWithNothingBelow(void) {
+  assert(SM_GetStackDepth() == 1);
+  assert(!SM_PopState());
+  assert(SM_GetStackDepth() == 1);
+  TEST_PASS("Test_SM_PopState_ReturnsFalseWithNothingBelow");
+}
+
+void Test_SM_SetStateStackOptions_ReturnsFalseIfStateIsUnregistered(void) {
+  assert(!SM_SetStateStackOptions("testUnregistered", SM_DRAW_BELOW, NULL,
+                                  NULL));
+  TEST_PASS("Test_SM_SetStateStackOptions_ReturnsFalseIfStateIsUnregistered");
+}
+
+void Test_SM_PushState_PausesInsteadOfExiting(void) {
+  SM_RegisterState("testStackBase", mockEnter, mockBaseUpdate, mockBaseDraw,
+                   mockExit);
+  SM_RegisterState("testStackOverlay", mockEnter, mockOverlayUpdate,
+                   mockOverlayDraw, mockExit);
+  assert(SM_SetStateStackOptions("testStackBase", 0, mockPause, mockResume));
+  SM_ChangeStateTo("testStackBase", NULL);
+
+  md = (MockData){0};
+  assert(SM_PushState("testStackOverlay", NULL));
+  assert(md.pausedTimes == 1 && md.enteredTimes == 1);
+  assert(md.exitedTimes == 0);
+  assert(SM_GetStackDepth() == 2);
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testStackOverlay"));
+  TEST_PASS("Test_SM_PushState_PausesInsteadOfExiting");
+}
+
+void Test_SM_Update_OnlyRunsTopOfStackByDefault(void) {
+  stackLogCount = 0;
+  assert(SM_Update(mockDT) && SM_Draw());
+  assert(StackLogIs("oO"));
+  TEST_PASS("Test_SM_Update_OnlyRunsTopOfStackByDefault");
+}
+
+void Test_SM_Update_RunsStatesBelowWithFlags(void) {
+  SM_SetStateStackOptions("testStackOverlay", SM_UPDATE_BELOW | SM_DRAW_BELOW,
+                          NULL, NULL);
+  assert(SM_Update(mockDT) && SM_Draw());
+  assert(StackLogIs("boBO"));
+
+  SM_SetStateStackOptions("testStackOverlay", SM_DRAW_BELOW, NULL, NULL);
+  assert(SM_Update(mockDT) && SM_Draw());
+  assert(StackLogIs("oBO"));
+  TEST_PASS("Test_SM_Update_RunsStatesBelowWithFlags");
+}
+
+void Test_SM_Update_StopsAtStateWithoutFlags(void) {
+  // The base doesn't let the state under it draw, whatever the overlay says
+  assert(SM_PushStateHandle(SM_GetStateHandle("testStackBase"), NULL));
+  assert(SM_PushState("testStackOverlay", NULL));
+  assert(SM_GetStackDepth() == 4);
+  assert(SM_Draw());
+  assert(StackLogIs("BO"));
+
+  SM_PopState();
+  SM_PopState();
+  TEST_PASS("Test_SM_Update_StopsAtStateWithoutFlags");
+}
+
+void Test_SM_PopState_ResumesInsteadOfEntering(void) {
+  md = (MockData){0};
+  assert(SM_PopState());
+  assert(md.exitedTimes == 1 && md.resumedTimes == 1);
+  assert(md.enteredTimes == 0);
+  assert(SM_GetStackDepth() == 1);
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testStackBase"));
+  TEST_PASS("Test_SM_PopState_ResumesInsteadOfEntering");
+}
+
+void Test_SM_ChangeStateTo_OnlyReplacesTopOfStack(void) {
+  SM_PushState("testStackOverlay", NULL);
+  md = (MockData){0};
+  assert(SM_ChangeStateTo("testNoNULL", NULL));
+  assert(md.exitedTimes == 1 && md.enteredTimes == 1);
+  assert(SM_GetStackDepth() == 2);
+
+  assert(SM_PopState());
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testStackBase"));
+  TEST_PASS("Test_SM_ChangeStateTo_OnlyReplacesTopOfStack");
+}
+
+// --------------------------------------------------
+// Posted Changes
+// --------------------------------------------------
+
+static void *PostFromThread(void *arg) {
+  StateHandle handle = SM_GetStateHandle("testPostA");
+  int *posted = arg;
+  for (int i = 0; i < SM_POST_QUEUE_SIZE / POSTING_THREADS; i++) {
+    *posted += SM_PostStateChangeHandle(handle, NULL);
+  }
+  return NULL;
+}
+
+void Test_SM_PostStateChange_ReturnsFalseIfStateIsUnregistered(void) {
+  assert(!SM_PostStateChange("testUnregistered", NULL));
+  assert(!SM_PostStateChange(NULL, NULL));
+  assert(!SM_PostStateChange("", NULL));
+  assert(!SM_PostStateChangeHandle(SM_INVALID_STATE, NULL));
+  TEST_PASS("Test_SM_PostStateChange_ReturnsFalseIfStateIsUnregistered");
+}
+
+void Test_SM_PostStateChange_WaitsForNextUpdate(void) {
+  SM_RegisterState("testPostA", mockEnter, mockUpdate, NULL, mockExit);
+  SM_RegisterState("testPostB", mockEnter, mockUpdate, NULL, mockExit);
+
+  md = (MockData){0};
+  assert(SM_PostStateChange("testPostA", NULL));
+  assert(md.enteredTimes == 0 && md.exitedTimes == 0);
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testStackBase"));
+
+  assert(SM_Update(mockDT));
+  assert(md.enteredTimes == 1 && md.exitedTimes == 1);
+  assert(md.hasUpdated);
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testPostA"));
+  TEST_PASS("Test_SM_PostStateChange_WaitsForNextUpdate");
+}
+
+void Test_SM_PostStateChange_KeepsLastByDefault(void) {
+  MockStateArgs first = {false};
+  MockStateArgs last = {true};
+
+  md = (MockData){0};
+  SM_PostStateChange("testPostA", &first);
+  SM_PostStateChangeHandle(SM_GetStateHandle("testPostB"), &last);
+  SM_Update(mockDT);
+  assert(md.enteredTimes == 1 && md.exitedTimes == 1);
+  assert(md.hasEnteredArgs);
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testPostB"));
+  TEST_PASS("Test_SM_PostStateChange_KeepsLastByDefault");
+}
+
+void Test_SM_SetPostCoalescing_ChangesWhichPostsApply(void) {
+  assert(SM_SetPostCoalescing(COALESCE_FIRST));
+  md = (MockData){0};
+  SM_PostStateChange("testPostA", NULL);
+  SM_PostStateChange("testPostB", NULL);
+  SM_Update(mockDT);
+  assert(md.enteredTimes == 1);
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testPostA"));
+
+  assert(SM_SetPostCoalescing(COALESCE_NONE));
+  md = (MockData){0};
+  SM_PostStateChange("testPostB", NULL);
+  SM_PostStateChange("testPostA", NULL);
+  SM_PostStateChange("testPostB", NULL);
+  SM_Update(mockDT);
+  assert(md.enteredTimes == 3 && md.exitedTimes == 3);
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testPostB"));
+
+  SM_SetPostCoalescing(COALESCE_LAST);
+  TEST_PASS("Test_SM_SetPostCoalescing_ChangesWhichPostsApply");
+}
+
+void Test_SM_PostStateChange_FromUpdateAppliesNextFrame(void) {
+  SM_RegisterState("testPosting", NULL, mockPostingUpdate, NULL, NULL);
+  SM_ChangeStateTo("testPosting", NULL);
+
+  assert(SM_Update(mockDT));
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testPosting"));
+  assert(SM_Update(mockDT));
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testPostA"));
+  TEST_PASS("Test_SM_PostStateChange_FromUpdateAppliesNextFrame");
+}
+
+void Test_SM_PostStateChange_ReturnsFalseIfQueueIsFull(void) {
+  for (int i = 0; i < SM_POST_QUEUE_SIZE; i++) {
+    assert(SM_PostStateChange("testPostB", NULL));
+  }
+  assert(!SM_PostStateChange("testPostB", NULL));
+
+  SM_Update(mockDT);
+  assert(SM_PostStateChange("testPostA", NULL));
+  SM_Update(mockDT);
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testPostA"));
+  TEST_PASS("Test_SM_PostStateChange_ReturnsFalseIfQueueIsFull");
+}
+
+void Test_SM_PostStateChange_WorksFromManyThreads(void) {
+  pthread_t threads[POSTING_THREADS];
+  int posted[POSTING_THREADS];
+  for (int i = 0; i < POSTING_THREADS; i++) {
+    posted[i] = 0;
+    assert(pthread_create(&threads[i], NULL, PostFromThread, &posted[i]) == 0);
+  }
+
+  int total = 0;
+  for (int i = 0; i < POSTING_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+    total += posted[i];
+  }
+  assert(total == SM_POST_QUEUE_SIZE);
+
+  SM_SetPostCoalescing(COALESCE_NONE);
+  md = (MockData){0};
+  SM_Update(mockDT);
+  assert(md.enteredTimes == SM_POST_QUEUE_SIZE);
+
+  SM_SetPostCoalescing(COALESCE_LAST);
+  TEST_PASS("Test_SM_PostStateChange_WorksFromManyThreads");
+}
+
+// --------------------------------------------------
+// Events
+// --------------------------------------------------
+
+void Test_SM_RegisterTransition_ReturnsFalseIfStateIsUnregistered(void) {
+  SM_RegisterState("testEventIdle", mockEnter, mockUpdate, NULL, mockExit);
+  SM_RegisterState("testEventMenu", mockEnter, mockUpdate, NULL, mockExit);
+
+  assert(!SM_RegisterTransition("testUnregistered", EVENT_OPEN,
+                                "testEventMenu"));
+  assert(!SM_RegisterTransition("testEventIdle", EVENT_OPEN,
+                                "testUnregistered"));
+  assert(!SM_RegisterTransition(NULL, EVENT_OPEN, "testEventMenu"));
+  assert(!SM_RegisterTransition("testEventIdle", -1, "testEventMenu"));
+  TEST_PASS("Test_SM_RegisterTransition_ReturnsFalseIfStateIsUnregistered");
+}
+
+void Test_SM_RegisterTransition_ReturnsFalseIfAlreadyRegistered(void) {
+  assert(SM_RegisterTransition("testEventIdle", EVENT_OPEN, "testEventMenu"));
+  assert(!SM_RegisterTransition("testEventIdle", EVENT_OPEN, "testEventIdle"));
+  assert(SM_RegisterTransition("testEventMenu", EVENT_CLOSE, "testEventIdle"));
+  assert(SM_RegisterGuardedTransition("testEventMenu", EVENT_CONFIRM,
+                                      "testEventIdle", mockGuard));
+  TEST_PASS("Test_SM_RegisterTransition_ReturnsFalseIfAlreadyRegistered");
+}
+
+void Test_SM_Dispatch_ChangesStateThroughTable(void) {
+  SM_ChangeStateTo("testEventIdle", NULL);
+
+  md = (MockData){0};
+  assert(SM_Dispatch(EVENT_OPEN, NULL));
+  assert(md.exitedTimes == 1 && md.enteredTimes == 1);
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testEventMenu"));
+
+  assert(SM_Dispatch(EVENT_CLOSE, NULL));
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testEventIdle"));
+  TEST_PASS("Test_SM_Dispatch_ChangesStateThroughTable");
+}
+
+void Test_SM_Dispatch_IgnoresUnhandledEvents(void) {
+  md = (MockData){0};
+  assert(!SM_Dispatch(EVENT_CLOSE, NULL));
+  assert(!SM_Dispatch(EVENT_UNUSED, NULL));
+  assert(!SM_Dispatch(-1, NULL));
+  assert(md.exitedTimes == 0 && md.enteredTimes == 0);
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testEventIdle"));
+  TEST_PASS("Test_SM_Dispatch_IgnoresUnhandledEvents");
+}
+
+void Test_SM_Dispatch_SkipsTransitionIfGuardRefuses(void) {
+  MockStateArgs refuse = {false};
+  MockStateArgs allow = {true};
+  SM_Dispatch(EVENT_OPEN, NULL);
+
+  assert(!SM_Dispatch(EVENT_CONFIRM, &refuse));
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testEventMenu"));
+
+  md = (MockData){0};
+  assert(SM_Dispatch(EVENT_CONFIRM, &allow));
+  assert(md.hasEnteredArgs);
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testEventIdle"));
+  TEST_PASS("Test_SM_Dispatch_SkipsTransitionIfGuardRefuses");
+}
+
+void Test_SM_RegisterTransition_KeepsTableWhenGrowing(void) {
+  // A new state and a new event both make the table grow
+  SM_RegisterState("testEventLate", mockEnter, NULL, NULL, NULL);
+  assert(SM_RegisterTransition("testEventLate", EVENT_UNUSED + 10,
+                               "testEventIdle"));
+
+  assert(SM_Dispatch(EVENT_OPEN, NULL));
+  assert(SM_Dispatch(EVENT_CLOSE, NULL));
+  SM_ChangeStateTo("testEventLate", NULL);
+  assert(SM_Dispatch(EVENT_UNUSED + 10, NULL));
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testEventIdle"));
+  TEST_PASS("Test_SM_RegisterTransition_KeepsTableWhenGrowing");
+}
+
+void Test_SM_MachineDispatch_UsesMachineState(void) {
+  int data = 7;
+  StateMachine *sm = SM_Create(&data);
+  SM_RegisterGuardedTransition("testEventLate", EVENT_CLOSE, "testEventMenu",
+                               mockMachineGuard);
+
+  assert(!SM_MachineDispatch(sm, EVENT_OPEN, NULL));
+  SM_MachineChangeStateTo(sm, "testEventLate", NULL);
+  activeUserData = NULL;
+  assert(SM_MachineDispatch(sm, EVENT_CLOSE, NULL));
+  assert(activeUserData == &data);
+  assert(SM_COMP_NAME(SM_MachineGetCurrStateName(sm), "testEventMenu"));
+
+  // The global machine is still in its own state
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testEventIdle"));
+  SM_Destroy(sm);
+  TEST_PASS("Test_SM_MachineDispatch_UsesMachineState");
+}
+
+// --------------------------------------------------
+// Nested States
+// --------------------------------------------------
+
+void Test_SM_SetStateParent_ReturnsFalseIfStateIsUnregistered(void) {
+  SM_RegisterState("testInGame", mockParentEnter, mockParentUpdate,
+                   mockParentDraw, mockParentExit);
+  SM_RegisterState("testLevelA", mockChildEnter, mockBaseUpdate, mockBaseDraw,
+                   mockChildExit);
+  SM_RegisterState("testLevelB", mockChildEnter, mockBaseUpdate, mockBaseDraw,
+                   mockChildExit);
+
+  assert(!SM_SetStateParent("testUnregistered", "testInGame"));
+  assert(!SM_SetStateParent("testLevelA", "testUnregistered"));
+  assert(!SM_SetStateParent(NULL, "testInGame"));
+  TEST_PASS("Test_SM_SetStateParent_ReturnsFalseIfStateIsUnregistered");
+}
+
+void Test_SM_SetStateParent_ReturnsFalseIfStateWouldContainItself(void) {
+  assert(SM_SetStateParent("testLevelA", "testInGame"));
+  assert(SM_SetStateParent("testLevelB", "testInGame"));
+  assert(!SM_SetStateParent("testInGame", "testInGame"));
+  assert(!SM_SetStateParent("testInGame", "testLevelA"));
+  TEST_PASS("Test_SM_SetStateParent_ReturnsFalseIfStateWouldContainItself");
+}
+
+void Test_SM_ChangeStateTo_EntersParentsOutermostFirst(void) {
+  stackLogCount = 0;
+  assert(SM_ChangeStateTo("testLevelA", NULL));
+  assert(StackLogIs("PC"));
+  TEST_PASS("Test_SM_ChangeStateTo_EntersParentsOutermostFirst");
+}
+
+void Test_SM_ChangeStateTo_KeepsSharedParentsEntered(void) {
+  assert(SM_ChangeStateTo("testLevelB", NULL));
+  assert(StackLogIs("cC"));
+
+  // Same state: only the state itself is exited and entered again
+  assert(SM_ChangeStateTo("testLevelB", NULL));
+  assert(StackLogIs("cC"));
+  TEST_PASS("Test_SM_ChangeStateTo_KeepsSharedParentsEntered");
+}
+
+void Test_SM_Update_RunsParentsFirst(void) {
+  assert(SM_Update(mockDT) && SM_Draw());
+  assert(StackLogIs("ubdB"));
+  TEST_PASS("Test_SM_Update_RunsParentsFirst");
+}
+
+void Test_SM_ChangeStateTo_MovesBetweenParentAndChild(void) {
+  assert(SM_ChangeStateTo("testInGame", NULL));
+  assert(StackLogIs("c"));
+  assert(SM_ChangeStateTo("testLevelA", NULL));
+  assert(StackLogIs("C"));
+  TEST_PASS("Test_SM_ChangeStateTo_MovesBetweenParentAndChild");
+}
+
+void Test_SM_ChangeStateTo_ExitsParentsInnermostFirst(void) {
+  assert(SM_ChangeStateTo("testEventIdle", NULL));
+  assert(StackLogIs("cp"));
+  TEST_PASS("Test_SM_ChangeStateTo_ExitsParentsInnermostFirst");
+}
+
+void Test_SM_Update_RunsParentsSharedByStackedStatesOnce(void) {
+  // The pause menu leaves updating and drawing to its parent
+  SM_RegisterState("testPauseMenu", mockEnter, NULL, NULL, mockExit);
+  assert(SM_SetStateParent("testPauseMenu", "testInGame"));
+  SM_SetStateStackOptions("testPauseMenu", SM_UPDATE_BELOW | SM_DRAW_BELOW,
+                          NULL, NULL);
+  SM_ChangeStateTo("testLevelA", NULL);
+  assert(SM_PushState("testPauseMenu", NULL));
+
+  stackLogCount = 0;
+  assert(SM_Update(mockDT) && SM_Draw());
+  assert(StackLogIs("ubdB"));
+
+  SM_PopState();
+  SM_ChangeStateTo("testEventIdle", NULL);
+  TEST_PASS("Test_SM_Update_RunsParentsSharedByStackedStatesOnce");
+}
+
+void Test_SM_MachineChangeStateTo_UsesParents(void) {
+  StateMachine *sm = SM_Create(NULL);
+  stackLogCount = 0;
+  assert(SM_MachineChangeStateTo(sm, "testLevelA", NULL));
+  assert(StackLogIs("PC"));
+
+  assert(SM_MachineUpdate(sm, mockDT));
+  assert(StackLogIs("ub"));
+  assert(SM_UpdateAll(mockDT));
+  assert(StackLogIs("ub"));
+
+  SM_Destroy(sm);
+  assert(StackLogIs("cp"));
+  TEST_PASS("Test_SM_MachineChangeStateTo_UsesParents");
+}
+
+// --------------------------------------------------
+// Preloading
+// --------------------------------------------------
+
+static void WaitUntilReady(const char *name) {
+  while (!SM_IsStateReady(name)) {
+    sched_yield();
+  }
+}
+
+void Test_SM_SetStatePreload_ReturnsFalseIfStateIsUnregistered(void) {
+  assert(!SM_SetStatePreload("testUnregistered", mockPreload));
+  assert(!SM_PrefetchState("testUnregistered"));
+  assert(!SM_SetLoadingState("testUnregistered"));
+  assert(!SM_ChangeStateToWhenReady("testUnregistered", NULL));
+  assert(!SM_ChangeStateToWhenReady("", NULL));
+  TEST_PASS("Test_SM_SetStatePreload_ReturnsFalseIfStateIsUnregistered");
+}
+
+void Test_SM_PrefetchState_ReturnsTrueWithNothingToPreload(void) {
+  SM_RegisterState("testLoading", mockEnter, mockUpdate, NULL, mockExit);
+  SM_RegisterState("testHeavy", mockEnter, mockUpdate, NULL, mockExit);
+  SM_RegisterState("testHeavier", mockEnter, mockUpdate, NULL, mockExit);
+
+  assert(SM_IsStateReady("testLoading"));
+  assert(SM_PrefetchState("testLoading"));
+  TEST_PASS("Test_SM_PrefetchState_ReturnsTrueWithNothingToPreload");
+}
+
+void Test_SM_ChangeStateToWhenReady_ShowsLoadingStateMeanwhile(void) {
+  MockStateArgs args = {true};
+  assert(SM_SetStatePreload("testHeavy", mockPreload));
+  assert(SM_SetLoadingState("testLoading"));
+  assert(!SM_IsStateReady("testHeavy"));
+
+  atomic_store(&releasePreload, false);
+  assert(SM_ChangeStateToWhenReady("testHeavy", &args));
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testLoading"));
+  assert(!SM_SetStatePreload("testHeavy", NULL));
+
+  // Still loading, so the loading state keeps running
+  assert(SM_Update(mockDT));
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testLoading"));
+
+  atomic_store(&releasePreload, true);
+  WaitUntilReady("testHeavy");
+  md = (MockData){0};
+  assert(SM_Update(mockDT));
+  assert(md.enteredTimes == 1 && md.hasEnteredArgs);
+  assert(atomic_load(&preloadedTimes) == 1);
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testHeavy"));
+  TEST_PASS("Test_SM_ChangeStateToWhenReady_ShowsLoadingStateMeanwhile");
+}
+
+void Test_SM_ChangeStateToWhenReady_ChangesAtOnceIfReady(void) {
+  SM_ChangeStateTo("testEventIdle", NULL);
+  assert(SM_ChangeStateToWhenReady("testHeavy", NULL));
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testHeavy"));
+  assert(atomic_load(&preloadedTimes) == 1);
+  TEST_PASS("Test_SM_ChangeStateToWhenReady_ChangesAtOnceIfReady");
+}
+
+void Test_SM_ChangeStateTo_CancelsWaitingForPreload(void) {
+  SM_SetStatePreload("testHeavier", mockPreload);
+  SM_SetLoadingState(NULL);
+
+  atomic_store(&releasePreload, false);
+  assert(SM_ChangeStateToWhenReady("testHeavier", NULL));
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testHeavy"));
+  SM_ChangeStateTo("testEventIdle", NULL);
+
+  atomic_store(&releasePreload, true);
+  WaitUntilReady("testHeavier");
+  SM_Update(mockDT);
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testEventIdle"));
+  TEST_PASS("Test_SM_ChangeStateTo_CancelsWaitingForPreload");
+}
+
+void Test_SM_PushState_CancelsWaitingForPreload(void) {
+  SM_RegisterState("testHeaviest", mockEnter, mockUpdate, NULL, mockExit);
+  SM_SetStatePreload("testHeaviest", mockPreload);
+  SM_SetLoadingState("testLoading");
+
+  atomic_store(&releasePreload, false);
+  assert(SM_ChangeStateToWhenReady("testHeaviest", NULL));
+  assert(SM_PushState("testStackOverlay", NULL));
+
+  // The overlay stays on top, and the loading state is back once it's gone
+  atomic_store(&releasePreload, true);
+  WaitUntilReady("testHeaviest");
+  SM_Update(mockDT);
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testStackOverlay"));
+  assert(SM_PopState());
+  SM_Update(mockDT);
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testLoading"));
+  assert(SM_GetStackDepth() == 1);
+
+  SM_SetLoadingState(NULL);
+  SM_ChangeStateTo("testEventIdle", NULL);
+  TEST_PASS("Test_SM_PushState_CancelsWaitingForPreload");
+}
+
+// --------------------------------------------------
+// Main Loop
+// --------------------------------------------------
+
+void Test_SM_Run_ReturnsFalseForNegativeRates(void) {
+  SM_RegisterState("testRun", NULL, mockRunUpdate, mockRunDraw, NULL);
+  SM_ChangeStateTo("testRun", NULL);
+  assert(!SM_Run(&(RunConfig){.updateRate = -60}));
+  assert(!SM_Run(&(RunConfig){.drawRate = -60}));
+  TEST_PASS("Test_SM_Run_ReturnsFalseForNegativeRates");
+}
+
+void Test_SM_Run_HeadlessRunsFixedStepsWithoutDrawing(void) {
+  runUpdates = runDraws = runStopAfter = 0;
+  assert(SM_Run(&(RunConfig){
+      .updateRate = 100, .maxUpdates = 1000, .headless = true}));
+  assert(runUpdates == 1000);
+  assert(runDraws == 0);
+  assert(runDt == 0.01f);
+
+  RunStats stats;
+  assert(SM_GetRunStats(&stats));
+  assert(stats.updates == 1000 && stats.frames == 1000);
+  assert(stats.draws == 0 && stats.droppedSteps == 0);
+  assert(stats.meanFrameMs <= stats.maxFrameMs);
+  assert(stats.p99FrameMs <= stats.maxFrameMs);
+  TEST_PASS("Test_SM_Run_HeadlessRunsFixedStepsWithoutDrawing");
+}
+
+void Test_SM_Run_DrawsWithInterpolationAlpha(void) {
+  runUpdates = runDraws = runStopAfter = 0;
+  runAlphasInRange = true;
+  assert(SM_Run(&(RunConfig){
+      .updateRate = 1000, .drawRate = 500, .maxUpdates = 20}));
+  assert(runUpdates == 20);
+  assert(runDraws > 0);
+  assert(runAlphasInRange);
+  assert(SM_GetInterpolationAlpha() == 0);
+
+  RunStats stats;
+  SM_GetRunStats(&stats);
+  assert(stats.draws == runDraws);
+  TEST_PASS("Test_SM_Run_DrawsWithInterpolationAlpha");
+}
+
+void Test_SM_Run_StopsWhenStopRunIsCalled(void) {
+  runUpdates = 0;
+  runStopAfter = 3;
+  assert(SM_Run(&(RunConfig){.headless = true}));
+  assert(runUpdates == 3);
+  assert(!SM_StopRun());
+  TEST_PASS("Test_SM_Run_StopsWhenStopRunIsCalled");
+}
+
+void Test_SM_Run_ReturnsFalseIfAlreadyRunning(void) {
+  SM_RegisterState("testNestedRun", NULL, mockNestedRunUpdate, NULL, NULL);
+  SM_ChangeStateTo("testNestedRun", NULL);
+  runNestedResult = true;
+  assert(SM_Run(&(RunConfig){.maxUpdates = 1, .headless = true}));
+  assert(!runNestedResult);
+  TEST_PASS("Test_SM_Run_ReturnsFalseIfAlreadyRunning");
+}
+
+// --------------------------------------------------
+// Stats
+// --------------------------------------------------
+
+#ifdef SMILE_STATS
+static long HistogramTotal(const CallStats *calls) {
+  long total = 0;
+  for (int i = 0; i < SM_STATS_BUCKETS; i++) {
+    total += calls->histogram[i];
+  }
+  return total;
+}
+
+void Test_SM_GetStats_CountsCallsOfEachFunction(void) {
+  SM_RegisterState("testStats", mockEnter, mockUpdate, mockDraw, mockExit);
+  SM_ChangeStateTo("testStats", NULL);
+  SM_Update(mockDT);
+  SM_Update(mockDT);
+  SM_Update(mockDT);
+  SM_Draw();
+  SM_Draw();
+  SM_ChangeStateTo("testRun", NULL);
+
+  StateStats stats;
+  assert(SM_GetStats("testStats", &stats));
+  assert(stats.enter.calls == 1 && stats.exit.calls == 1);
+  assert(stats.update.calls == 3 && stats.draw.calls == 2);
+  assert(HistogramTotal(&stats.update) == 3);
+  assert(stats.update.maxNs <= stats.update.totalNs);
+  TEST_PASS("Test_SM_GetStats_CountsCallsOfEachFunction");
+}
+
+void Test_SM_GetStats_ReturnsFalseIfStateIsUnregistered(void) {
+  StateStats stats;
+  assert(!SM_GetStats("testUnregistered", &stats));
+  assert(!SM_GetStats("testStats", NULL));
+  TEST_PASS("Test_SM_GetStats_ReturnsFalseIfStateIsUnregistered");
+}
+
+void Test_SM_ResetStats_ClearsCounts(void) {
+  StateStats stats;
+  assert(SM_ResetStats());
+  assert(SM_GetStats("testStats", &stats));
+  assert(stats.update.calls == 0 && stats.update.totalNs == 0);
+  assert(HistogramTotal(&stats.update) == 0);
+  TEST_PASS("Test_SM_ResetStats_ClearsCounts");
+}
+#else
+void Test_SM_GetStats_ReturnsFalseWithoutStats(void) {
+  StateStats stats;
+  assert(!SM_GetStats("testRun", &stats));
+  assert(!SM_ResetStats());
+  TEST_PASS("Test_SM_GetStats_ReturnsFalseWithoutStats");
+}
+#endif
+
+// --------------------------------------------------
+// Frame Memory
+// --------------------------------------------------
+
+void Test_SM_FrameAlloc_ReturnsAlignedMemory(void) {
+  char *small = SM_FrameAlloc(1);
+  char *large = SM_FrameAlloc(100000);
+  assert(small && large && small != large);
+  assert((uintptr_t)small % _Alignof(max_align_t) == 0);
+  assert((uintptr_t)large % _Alignof(max_align_t) == 0);
+  memset(large, 1, 100000);
+  assert(!SM_FrameAlloc(0));
+  TEST_PASS("Test_SM_FrameAlloc_ReturnsAlignedMemory");
+}
+
+void Test_SM_FrameAlloc_KeepsMemoryForOneMoreFrame(void) {
+  SM_RegisterState("testFrame", mockArgsEnter, mockUpdate, mockDraw, mockExit);
+  SM_ChangeStateTo("testFrame", NULL);
+
+  SM_Update(mockDT);
+  int *kept = SM_FrameAlloc(sizeof(int));
+  *kept = 42;
+
+  SM_Update(mockDT);
+  int *next = SM_FrameAlloc(sizeof(int));
+  assert(next != kept && *kept == 42);
+
+  // Two updates on, the memory is handed out again
+  SM_Update(mockDT);
+  assert(SM_FrameAlloc(sizeof(int)) == kept);
+  TEST_PASS("Test_SM_FrameAlloc_KeepsMemoryForOneMoreFrame");
+}
+
+void Test_SM_ChangeStateToWithArgs_ReturnsFalseForNullArgs(void) {
+  MockStateArgs args = {.flag = true};
+  assert(!SM_ChangeStateToWithArgs("testFrame", NULL, sizeof(args)));
+  assert(!SM_ChangeStateToWithArgs("testUnregistered", &args, sizeof(args)));
+  assert(!SM_ChangeStateToWithArgs(NULL, &args, sizeof(args)));
+  assert(!SM_ChangeStateToWithArgs("", &args, sizeof(args)));
+
+  enteredArgs = &args;
+  assert(SM_ChangeStateToWithArgs("testFrame", NULL, 0));
+  assert(!enteredArgs);
+  TEST_PASS("Test_SM_ChangeStateToWithArgs_ReturnsFalseForNullArgs");
+}
+
+void Test_SM_ChangeStateToWithArgs_PassesACopy(void) {
+  md = (MockData){0};
+  {
+    MockStateArgs args = {.flag = true};
+    assert(SM_ChangeStateToWithArgs("testFrame", &args, sizeof(args)));
+    assert(enteredArgs && enteredArgs != &args);
+  }
+  assert(md.hasEnteredArgs);
+  assert(((MockStateArgs *)enteredArgs)->flag);
+  TEST_PASS("Test_SM_ChangeStateToWithArgs_PassesACopy");
+}
+
+void Test_SM_ChangeStateToWithArgs_FreesCopyAfterExit(void) {
+  MockStateArgs args = {.flag = true};
+  void *first = enteredArgs;
+
+  // The copy of the state exited is freed before the next one is made
+  assert(SM_ChangeStateToWithArgs("testFrame", &args, sizeof(args)));
+  assert(enteredArgs == first);
+
+  // States under the current one keep theirs until they exit too
+  SM_PushState("testStackOverlay", NULL);
+  assert(SM_ChangeStateToWithArgs("testFrame", &args, sizeof(args)));
+  void *above = enteredArgs;
+  assert(above != first && ((MockStateArgs *)first)->flag);
+
+  assert(SM_PopState());
+  assert(SM_PushState("testStackOverlay", NULL));
+  assert(SM_ChangeStateToWithArgs("testFrame", &args, sizeof(args)));
+  assert(enteredArgs == above);
+
+  assert(SM_PopState());
+  assert(SM_ChangeStateToWithArgs("testFrame", &args, sizeof(args)));
+  assert(enteredArgs == first);
+  TEST_PASS("Test_SM_ChangeStateToWithArgs_FreesCopyAfterExit");
+}
+
+void Test_SM_ChangeStateToWithArgs_ReturnsFalseIfMallocFails(void) {
+  static char largeArgs[1 << 16];
+  md = (MockData){0};
+  SM_Test_SetCanMalloc(false);
+  assert(!SM_ChangeStateToWithArgs("testFrame", largeArgs, sizeof(largeArgs)));
+  SM_Test_SetCanMalloc(true);
+  assert(md.exitedTimes == 0);
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testFrame"));
+
+  assert(SM_ChangeStateToWithArgs("testFrame", largeArgs, sizeof(largeArgs)));
+  assert(md.exitedTimes == 1 && md.enteredTimes == 1);
+  TEST_PASS("Test_SM_ChangeStateToWithArgs_ReturnsFalseIfMallocFails");
+}
+
+void Test_SM_ChangeStateToWithArgs_ReturnsFalseFromExitFunction(void) {
+  SM_RegisterState("testArgsExit", NULL, mockUpdate, NULL, mockArgsExit);
+  MockStateArgs args = {.flag = true};
+  assert(SM_ChangeStateToWithArgs("testArgsExit", &args, sizeof(args)));
+
+  // The copy made for the change the exit function interrupts still fits
+  nestedArgsResult = true;
+  assert(SM_ChangeStateToWithArgs("testFrame", &args, sizeof(args)));
+  assert(!nestedArgsResult);
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "testFrame"));
+  assert(((MockStateArgs *)enteredArgs)->flag);
+  TEST_PASS("Test_SM_ChangeStateToWithArgs_ReturnsFalseFromExitFunction");
+}
+
 // --------------------------------------------------
 // Shutdown
 // --------------------------------------------------
@@ -426,6 +1674,21 @@ void Test_SM_Shutdown_SkipsExitIfNull(void) {
   TEST_PASS("Test_SM_Shutdown_SkipsExitIfNull");
 }
 
+void Test_SM_Shutdown_ExitsStatesUnderTheCurrentOne(void) {
+  SM_Init();
+  SM_RegisterState("testStackBase", mockEnter, NULL, NULL, mockExit);
+  SM_RegisterState("testStackOverlay", mockEnter, NULL, NULL, mockExit);
+  SM_ChangeStateTo("testStackBase", NULL);
+  SM_PushState("testStackOverlay", NULL);
+  SM_PushState("testStackOverlay", NULL);
+
+  md.exitedTimes = 0;
+  SM_Shutdown();
+  assert(md.exitedTimes == 3);
+  assert(SM_GetStackDepth() == 0);
+  TEST_PASS("Test_SM_Shutdown_ExitsStatesUnderTheCurrentOne");
+}
+
 void Test_SM_Shutdown_SetsTrackerToNull(void) {
   assert(!SM_Test_GetTracker());
   TEST_PASS("Test_SM_Shutdown_SetsTrackerToNull");
@@ -461,6 +1724,21 @@ void Test_SM_ChangeStateTo_ReturnsFalseAfterShutdown(void) {
   TEST_PASS("Test_SM_ChangeStateTo_ReturnsFalseAfterShutdown");
 }
 
+void Test_SM_ChangeStateToHandle_ReturnsFalseAfterShutdown(void) {
+  assert(!SM_ChangeStateToHandle(1, NULL));
+  TEST_PASS("Test_SM_ChangeStateToHandle_ReturnsFalseAfterShutdown");
+}
+
+void Test_SM_UpdateAll_ReturnsFalseAfterShutdown(void) {
+  assert(!SM_UpdateAll(mockDT));
+  TEST_PASS("Test_SM_UpdateAll_ReturnsFalseAfterShutdown");
+}
+
+void Test_SM_UpdateAllParallel_ReturnsFalseAfterShutdown(void) {
+  assert(!SM_UpdateAllParallel(mockDT));
+  TEST_PASS("Test_SM_UpdateAllParallel_ReturnsFalseAfterShutdown");
+}
+
 void Test_SM_Shutdown_ReturnsFalseIfCalledMultipleTimesAfterShutdown(void) {
   assert(!SM_Shutdown());
   assert(!SM_Shutdown());
@@ -531,12 +1809,182 @@ void Test_SM_ChangingStatesOftenCausesNoSkips(void) {
       MULTIPLE_STATES);
 }
 
+void Test_SM_ChangingStatesOftenByHandleCausesNoSkips(void) {
+  md.enteredTimes = 0;
+  md.exitedTimes = 0;
+  for (int i = 0; i < MULTIPLE_STATES; i++) {
+    SM_ChangeStateToHandle(i + 1, NULL);
+  }
+
+  assert(md.enteredTimes == MULTIPLE_STATES &&
+         md.exitedTimes == MULTIPLE_STATES);
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "999"));
+
+  printf("\t[PASS] Test_SM_ChangingStatesOftenByHandleCausesNoSkips: %d state "
+         "changes\n",
+         MULTIPLE_STATES);
+}
+
 void Test_SM_Shutdown_FreeingMultipleStatesCausesNoSkips(void) {
   SM_Shutdown();
   assert(SM_Test_GetStateCount() == 0);
   printf("\t[PASS] Test_SM_Shutdown_FreeingMultipleStatesCausesNoSkips\n");
 }
 
+void Test_SM_InitWithCapacity_RegistersStatesWithoutAllocating(void) {
+  assert(SM_InitWithCapacity(MULTIPLE_STATES));
+  SM_Test_SetCanMalloc(false);
+  for (int i = 0; i < MULTIPLE_STATES; i++) {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%d", i);
+    assert(SM_RegisterState(buffer, mockEnter, mockUpdate, mockDraw, mockExit));
+  }
+  SM_Test_SetCanMalloc(true);
+
+  assert(SM_Test_GetStateCount() == MULTIPLE_STATES);
+  assert(SM_Test_GetTracker()->arena && !SM_Test_GetTracker()->arena->next);
+  SM_Shutdown();
+  printf("\t[PASS] Test_SM_InitWithCapacity_RegistersStatesWithoutAllocating: "
+         "%d states registered\n",
+         MULTIPLE_STATES);
+}
+
+// --------------------------------------------------
+// Static Tables
+// --------------------------------------------------
+
+void Test_SM_InitStatic_ReturnsFalseIfTableIsNULL(void) {
+  assert(!SM_InitStatic(NULL));
+  assert(!SM_IsInitialized());
+  TEST_PASS("Test_SM_InitStatic_ReturnsFalseIfTableIsNULL");
+}
+
+void Test_SM_InitStatic_InitializesWithoutAllocating(void) {
+  SM_Test_SetCanMalloc(false);
+  assert(SM_InitStatic(&testStateTable));
+  SM_Test_SetCanMalloc(true);
+
+  assert(SM_IsInitialized());
+  assert(SM_Test_GetStateCount() == testStateTable.stateCount);
+  assert(!SM_Test_GetTracker()->arena &&
+         !SM_Test_GetTracker()->stateMap.slots);
+  TEST_PASS("Test_SM_InitStatic_InitializesWithoutAllocating");
+}
+
+void Test_SM_InitStatic_ReturnsFalseIfCalledTwice(void) {
+  assert(!SM_InitStatic(&testStateTable));
+  assert(!SM_Init());
+  TEST_PASS("Test_SM_InitStatic_ReturnsFalseIfCalledTwice");
+}
+
+void Test_SM_GetStateHandle_FindsEveryStaticState(void) {
+  for (int i = 0; i < testStateTable.stateCount; i++) {
+    const State *state = &testStateTable.states[i];
+    assert(SM_GetStateHandle(state->name) == (StateHandle)i + 1);
+    assert(SM_Internal_GetState(state->name) == state);
+    assert(SM_Internal_GetStateByHandle(i + 1) == state);
+  }
+  TEST_PASS("Test_SM_GetStateHandle_FindsEveryStaticState");
+}
+
+void Test_SM_GetStateHandle_ReturnsInvalidForUnknownStaticName(void) {
+  assert(SM_GetStateHandle("") == SM_INVALID_STATE);
+  assert(SM_GetStateHandle("Title") == SM_INVALID_STATE);
+  assert(SM_GetStateHandle("   ") == SM_INVALID_STATE);
+  assert(SM_GetStateHandle(" title\t") == SM_GetStateHandle("title"));
+
+  // Plenty of these land on used slots, so the name check must catch them
+  for (int i = 0; i < MULTIPLE_STATES; i++) {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%d", i);
+    assert(SM_GetStateHandle(buffer) == SM_INVALID_STATE);
+  }
+  assert(!SM_IsStateRegistered("testUnregistered"));
+  TEST_PASS("Test_SM_GetStateHandle_ReturnsInvalidForUnknownStaticName");
+}
+
+void Test_SM_RegisterState_ReturnsInvalidWithStaticTable(void) {
+  assert(SM_RegisterState("testStatic", mockEnter, mockUpdate, mockDraw,
+                          mockExit) == SM_INVALID_STATE);
+  assert(SM_Test_GetStateCount() == testStateTable.stateCount);
+  TEST_PASS("Test_SM_RegisterState_ReturnsInvalidWithStaticTable");
+}
+
+void Test_SM_ChangeStateTo_UsesStaticStates(void) {
+  md = (MockData){0};
+  assert(SM_ChangeStateTo("title", NULL));
+  assert(SM_ChangeStateToHandle(SM_GetStateHandle("level3"), NULL));
+  assert(md.enteredTimes == 2 && md.exitedTimes == 1);
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "level3"));
+
+  assert(SM_Update(mockDT) && SM_Draw());
+  assert(md.hasUpdated && md.hasDrawn);
+  TEST_PASS("Test_SM_ChangeStateTo_UsesStaticStates");
+}
+
+void Test_SM_PushState_UsesStaticStackOptions(void) {
+  md = (MockData){0};
+  assert(SM_PushState("pause", NULL));
+  assert(md.pausedTimes == 1 && md.exitedTimes == 0);
+  assert(SM_GetStackDepth() == 2);
+
+  assert(SM_PopState());
+  assert(md.resumedTimes == 1);
+  assert(!SM_SetStateStackOptions("level3", SM_DRAW_BELOW, NULL, NULL));
+  TEST_PASS("Test_SM_PushState_UsesStaticStackOptions");
+}
+
+void Test_SM_ChangeStateTo_UsesStaticParents(void) {
+  SM_ChangeStateTo("level1", NULL);
+  md = (MockData){0};
+  assert(SM_ChangeStateTo("level2", NULL));
+  assert(md.exitedTimes == 1 && md.enteredTimes == 2);
+
+  md = (MockData){0};
+  assert(SM_ChangeStateTo("lobby", NULL));
+  assert(md.exitedTimes == 1 && md.enteredTimes == 0);
+  assert(!SM_SetStateParent("level1", "lobby"));
+  TEST_PASS("Test_SM_ChangeStateTo_UsesStaticParents");
+}
+
+void Test_SM_Dispatch_UsesStaticStates(void) {
+  assert(SM_RegisterTransition("shop", EVENT_CLOSE, "pause"));
+  assert(SM_ChangeStateTo("shop", NULL));
+  assert(SM_Dispatch(EVENT_CLOSE, NULL));
+  assert(SM_COMP_NAME(SM_GetCurrStateName(), "pause"));
+  TEST_PASS("Test_SM_Dispatch_UsesStaticStates");
+}
+
+void Test_SM_UpdateAll_UpdatesMachinesInStaticStates(void) {
+  StateMachine *first = SM_Create(NULL);
+  StateMachine *second = SM_Create(NULL);
+  assert(SM_MachineChangeStateTo(first, "shop", NULL));
+  assert(SM_MachineChangeStateTo(second, "pause", NULL));
+  assert(SM_COMP_NAME(SM_MachineGetCurrStateName(second), "pause"));
+
+  md.hasUpdated = false;
+  assert(SM_UpdateAll(mockDT));
+  assert(md.hasUpdated);
+
+  SM_Destroy(first);
+  SM_Destroy(second);
+  TEST_PASS("Test_SM_UpdateAll_UpdatesMachinesInStaticStates");
+}
+
+void Test_SM_Shutdown_LeavesStaticTableUntouched(void) {
+  assert(SM_Shutdown());
+  assert(!SM_IsInitialized() && SM_Test_GetStateCount() == 0);
+  assert(SM_COMP_NAME(testStateTable.states[0].name, "boot"));
+
+  // Either kind of initialization works again afterwards
+  assert(SM_Init());
+  assert(SM_RegisterState("testStatic", mockEnter, NULL, NULL, NULL));
+  assert(SM_Shutdown());
+  assert(SM_InitStatic(&testStateTable));
+  assert(SM_Shutdown());
+  TEST_PASS("Test_SM_Shutdown_LeavesStaticTableUntouched");
+}
+
 // --------------------------------------------------
 // Finger's crossed!
 // --------------------------------------------------
@@ -554,10 +2002,16 @@ int main() {
   Test_SM_IsInitialized_ReturnsFalseBeforeInitialization();
   Test_SM_RegisterState_ReturnsFalseBeforeInitialization();
   Test_SM_ChangeStateTo_ReturnsFalseBeforeInitialization();
+  Test_SM_PostStateChange_ReturnsFalseBeforeInitialization();
+  Test_SM_Dispatch_ReturnsFalseBeforeInitialization();
   Test_SM_Update_ReturnsFalseBeforeInitialization();
   Test_SM_Draw_ReturnsFalseBeforeInitialization();
   Test_SM_Shutdown_ReturnsFalseBeforeInitialization();
   Test_SM_GetCurrStateName_ReturnsNullBeforeInitialization();
+  Test_SM_Run_ReturnsFalseBeforeInitialization();
+  Test_SM_ChangeStateToWithArgs_ReturnsFalseBeforeInitialization();
+  Test_SM_FrameAlloc_ReturnsNullBeforeInitialization();
+  Test_SM_Create_ReturnsNullBeforeInitialization();
   puts("");
 
   puts("Testing Initialization");
@@ -579,11 +2033,15 @@ int main() {
   puts("Testing State Registration");
   Test_SM_RegisterState_ReturnsFalseIfNameIsNULL();
   Test_SM_RegisterState_ReturnsFalseIfNameIsEmpty();
+  Test_SM_RegisterState_ReturnsFalseIfNameIsWhitespaceOnly();
+  Test_SM_RegisterState_TrimsName();
   Test_SM_RegisterState_ReturnsTrueIfAllFunctionsPresent();
   Test_SM_RegisterState_ReturnsFalseIfNameAlreadyExists();
   Test_SM_RegisterState_ReturnsTrueIfEnterAndUpdateNULL();
   Test_SM_RegisterState_ReturnsTrueIfDrawAndExitNULL();
   Test_SM_RegisterState_ReturnsFalseIfAllFunctionsNULL();
+  Test_SM_RegisterState_StoresStatesNextToEachOther();
+  Test_SM_RegisterState_ReturnsFalseIfMallocFails();
   puts("");
 
   puts("Testing Post-Registration - Internal");
@@ -600,6 +2058,8 @@ int main() {
   Test_SM_ChangeStateTo_ReturnsTrueChangingFromNULLToValidState();
   Test_SM_ChangeStateTo_ReturnsFalseIfNameIsNULL();
   Test_SM_ChangeStateTo_ReturnsFalseIfStateIsUnregistered();
+  Test_SM_ChangeStateTo_ReturnsFalseIfNameIsWhitespaceOnly();
+  Test_SM_ChangeStateTo_IgnoresSurroundingWhitespace();
   Test_SM_ChangeStateTo_ReturnsTrueChangingFromOneValidStateToAnother();
   Test_SM_ChangeStateTo_CallsExitFunctionOfCurrentState();
   Test_SM_ChangeStateTo_CallsEnterFunctionOfNewState();
@@ -617,6 +2077,37 @@ int main() {
   Test_SM_IsStateRegistered_ReturnsFalseForInvalidStateName();
   puts("");
 
+  puts("Testing Handles");
+  Test_SM_GetStateHandle_ReturnsHandleOfRegisteredState();
+  Test_SM_GetStateHandle_ReturnsInvalidForUnregisteredName();
+  Test_SM_RegisterState_ReturnsUsableHandle();
+  Test_SM_ChangeStateToHandle_CallsExitAndEnter();
+  Test_SM_ChangeStateToHandle_ReturnsFalseForInvalidHandle();
+  puts("");
+
+  puts("Testing Machines");
+  Test_SM_Create_ReturnsMachineWithNoCurrentState();
+  Test_SM_Create_ReturnsNullIfMallocFails();
+  Test_SM_Create_MachineStaysSmall();
+  Test_SM_MachineChangeStateTo_TracksStateIndependently();
+  Test_SM_MachineUpdate_ExposesActiveMachine();
+  Test_SM_Destroy_CallsExitFunctionOfCurrentState();
+  puts("");
+
+  puts("Testing Batch Updates");
+  Test_SM_SetStateBatchUpdate_ReturnsFalseIfStateIsUnregistered();
+  Test_SM_UpdateAll_CallsBatchUpdateOncePerState();
+  Test_SM_UpdateAll_KeepsGroupsInSyncWithTransitions();
+  Test_SM_UpdateAll_DefersStateChangesUntilDone();
+  puts("");
+
+  puts("Testing Parallel Updates");
+  Test_SM_SetThreadCount_ReturnsThreadsUsed();
+  Test_SM_UpdateAllParallel_MatchesSerialOrder();
+  Test_SM_Destroy_DropsLaterChangesDuringUpdateAll();
+  Test_SM_Destroy_FreesOnceWhenDestroyedTwiceDuringUpdateAll();
+  puts("");
+
   puts("Testing Update and Draw");
   Test_SM_Update_CallsValidUpdateFunction();
   Test_SM_Draw_CallsValidDrawFunction();
@@ -624,9 +2115,91 @@ int main() {
   Test_SM_Draw_CallsValidDrawFunctionEvenIfNullDraw();
   puts("");
 
+  puts("Testing State Stack");
+  Test_SM_PushState_ReturnsFalseIfStateIsUnregistered();
+  Test_SM_PopState_ReturnsFalseWithNothingBelow();
+  Test_SM_SetStateStackOptions_ReturnsFalseIfStateIsUnregistered();
+  Test_SM_PushState_PausesInsteadOfExiting();
+  Test_SM_Update_OnlyRunsTopOfStackByDefault();
+  Test_SM_Update_RunsStatesBelowWithFlags();
+  Test_SM_Update_StopsAtStateWithoutFlags();
+  Test_SM_PopState_ResumesInsteadOfEntering();
+  Test_SM_ChangeStateTo_OnlyReplacesTopOfStack();
+  puts("");
+
+  puts("Testing Posted Changes");
+  Test_SM_PostStateChange_ReturnsFalseIfStateIsUnregistered();
+  Test_SM_PostStateChange_WaitsForNextUpdate();
+  Test_SM_PostStateChange_KeepsLastByDefault();
+  Test_SM_SetPostCoalescing_ChangesWhichPostsApply();
+  Test_SM_PostStateChange_FromUpdateAppliesNextFrame();
+  Test_SM_PostStateChange_ReturnsFalseIfQueueIsFull();
+  Test_SM_PostStateChange_WorksFromManyThreads();
+  puts("");
+
+  puts("Testing Events");
+  Test_SM_RegisterTransition_ReturnsFalseIfStateIsUnregistered();
+  Test_SM_RegisterTransition_ReturnsFalseIfAlreadyRegistered();
+  Test_SM_Dispatch_ChangesStateThroughTable();
+  Test_SM_Dispatch_IgnoresUnhandledEvents();
+  Test_SM_Dispatch_SkipsTransitionIfGuardRefuses();
+  Test_SM_RegisterTransition_KeepsTableWhenGrowing();
+  Test_SM_MachineDispatch_UsesMachineState();
+  puts("");
+
+  puts("Testing Nested States");
+  Test_SM_SetStateParent_ReturnsFalseIfStateIsUnregistered();
+  Test_SM_SetStateParent_ReturnsFalseIfStateWouldContainItself();
+  Test_SM_ChangeStateTo_EntersParentsOutermostFirst();
+  Test_SM_ChangeStateTo_KeepsSharedParentsEntered();
+  Test_SM_Update_RunsParentsFirst();
+  Test_SM_ChangeStateTo_MovesBetweenParentAndChild();
+  Test_SM_ChangeStateTo_ExitsParentsInnermostFirst();
+  Test_SM_Update_RunsParentsSharedByStackedStatesOnce();
+  Test_SM_MachineChangeStateTo_UsesParents();
+  puts("");
+
+  puts("Testing Preloading");
+  Test_SM_SetStatePreload_ReturnsFalseIfStateIsUnregistered();
+  Test_SM_PrefetchState_ReturnsTrueWithNothingToPreload();
+  Test_SM_ChangeStateToWhenReady_ShowsLoadingStateMeanwhile();
+  Test_SM_ChangeStateToWhenReady_ChangesAtOnceIfReady();
+  Test_SM_ChangeStateTo_CancelsWaitingForPreload();
+  Test_SM_PushState_CancelsWaitingForPreload();
+  puts("");
+
+  puts("Testing Main Loop");
+  Test_SM_Run_ReturnsFalseForNegativeRates();
+  Test_SM_Run_HeadlessRunsFixedStepsWithoutDrawing();
+  Test_SM_Run_DrawsWithInterpolationAlpha();
+  Test_SM_Run_StopsWhenStopRunIsCalled();
+  Test_SM_Run_ReturnsFalseIfAlreadyRunning();
+  puts("");
+
+  puts("Testing Stats");
+#ifdef SMILE_STATS
+  Test_SM_GetStats_CountsCallsOfEachFunction();
+  Test_SM_GetStats_ReturnsFalseIfStateIsUnregistered();
+  Test_SM_ResetStats_ClearsCounts();
+#else
+  Test_SM_GetStats_ReturnsFalseWithoutStats();
+#endif
+  puts("");
+
+  puts("Testing Frame Memory");
+  Test_SM_FrameAlloc_ReturnsAlignedMemory();
+  Test_SM_FrameAlloc_KeepsMemoryForOneMoreFrame();
+  Test_SM_ChangeStateToWithArgs_ReturnsFalseForNullArgs();
+  Test_SM_ChangeStateToWithArgs_PassesACopy();
+  Test_SM_ChangeStateToWithArgs_FreesCopyAfterExit();
+  Test_SM_ChangeStateToWithArgs_ReturnsFalseIfMallocFails();
+  Test_SM_ChangeStateToWithArgs_ReturnsFalseFromExitFunction();
+  puts("");
+
   puts("Testing Shutdown");
   Test_SM_Shutdown_CallsExitFunctionOfCurrentState();
   Test_SM_Shutdown_SkipsExitIfNull();
+  Test_SM_Shutdown_ExitsStatesUnderTheCurrentOne();
   Test_SM_Shutdown_SetsTrackerToNull();
   Test_SM_Shutdown_SetsStateCountToZero();
   puts("");
@@ -636,6 +2209,9 @@ int main() {
   Test_SM_GetCurrStateName_ReturnsNullAfterShutdown();
   Test_SM_RegisterState_ReturnsFalseAfterShutdown();
   Test_SM_ChangeStateTo_ReturnsFalseAfterShutdown();
+  Test_SM_ChangeStateToHandle_ReturnsFalseAfterShutdown();
+  Test_SM_UpdateAll_ReturnsFalseAfterShutdown();
+  Test_SM_UpdateAllParallel_ReturnsFalseAfterShutdown();
   Test_SM_Shutdown_ReturnsFalseIfCalledMultipleTimesAfterShutdown();
   puts("");
 
@@ -651,7 +2227,24 @@ int main() {
   puts("Testing Stress Tests");
   Test_SM_RegisteringMultipleStatesCausesNoSkips();
   Test_SM_ChangingStatesOftenCausesNoSkips();
+  Test_SM_ChangingStatesOftenByHandleCausesNoSkips();
   Test_SM_Shutdown_FreeingMultipleStatesCausesNoSkips();
+  Test_SM_InitWithCapacity_RegistersStatesWithoutAllocating();
+  puts("");
+
+  puts("Testing Static Tables");
+  Test_SM_InitStatic_ReturnsFalseIfTableIsNULL();
+  Test_SM_InitStatic_InitializesWithoutAllocating();
+  Test_SM_InitStatic_ReturnsFalseIfCalledTwice();
+  Test_SM_GetStateHandle_FindsEveryStaticState();
+  Test_SM_GetStateHandle_ReturnsInvalidForUnknownStaticName();
+  Test_SM_RegisterState_ReturnsInvalidWithStaticTable();
+  Test_SM_ChangeStateTo_UsesStaticStates();
+  Test_SM_PushState_UsesStaticStackOptions();
+  Test_SM_ChangeStateTo_UsesStaticParents();
+  Test_SM_Dispatch_UsesStaticStates();
+  Test_SM_UpdateAll_UpdatesMachinesInStaticStates();
+  Test_SM_Shutdown_LeavesStaticTableUntouched();
   puts("");
 
   puts("All tests completed successfully!");
@@ -0,0 +1,78 @@
+// Generated by tools/StateTableGen from tests/StateMachine/TestStateTable.txt.
+// Do not edit, regenerate it instead.
+
+#include "StateMachine.h"
+#include <stddef.h>
+
+void mockEnter(void *args);
+void mockUpdate(float dt);
+void mockDraw(void);
+void mockExit(void);
+void mockPause(void);
+void mockResume(void);
+
+static const State testStateTableStates[] = {
+    {.name = "boot", .handle = 1, .enter = mockEnter, .update = NULL, .draw = NULL, .exit = NULL},
+    {.name = "splash", .handle = 2, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "title", .handle = 3, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "menu", .handle = 4, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "options", .handle = 5, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "audio", .handle = 6, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "video", .handle = 7, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "controls", .handle = 8, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "credits", .handle = 9, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "lobby", .handle = 10, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "loading", .handle = 11, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "level1", .handle = 12, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "level2", .handle = 13, .parent = 10, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "level3", .handle = 14, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit, .pause = mockPause, .resume = mockResume},
+    {.name = "level4", .handle = 15, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "level5", .handle = 16, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "boss", .handle = 17, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "cutscene", .handle = 18, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "dialogue", .handle = 19, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "inventory", .handle = 20, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit, .flags = SM_UPDATE_BELOW | SM_DRAW_BELOW},
+    {.name = "map", .handle = 21, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "shop", .handle = 22, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "pause", .handle = 23, .enter = NULL, .update = mockUpdate, .draw = mockDraw, .exit = NULL, .flags = SM_DRAW_BELOW},
+    {.name = "gameOver", .handle = 24, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "victory", .handle = 25, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "highScores", .handle = 26, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "saveGame", .handle = 27, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "loadGame", .handle = 28, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "quitConfirm", .handle = 29, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "intro", .handle = 30, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "tutorial", .handle = 31, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "sandbox", .handle = 32, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "replay", .handle = 33, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "photoMode", .handle = 34, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "achievements", .handle = 35, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "statistics", .handle = 36, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "multiplayer", .handle = 37, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "matchmaking", .handle = 38, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "spectate", .handle = 39, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+    {.name = "epilogue", .handle = 40, .enter = mockEnter, .update = mockUpdate, .draw = mockDraw, .exit = mockExit},
+};
+
+static const unsigned short testStateTableDisplacements[] = {
+    0, 0, 2, 0, 5, 12, 20, 4, 0, 0, 0, 7,
+    0, 11, 2, 0, 0, 10, 10, 0, 1
+};
+
+static const unsigned short testStateTableSlots[] = {
+    10, 30, 38, 40, 22, 0, 0, 20, 4, 18, 37, 0,
+    13, 1, 0, 6, 16, 29, 34, 0, 21, 0, 28, 19,
+    11, 3, 26, 14, 27, 0, 32, 23, 9, 24, 15, 33,
+    31, 2, 36, 8, 0, 17, 12, 25, 5, 0, 0, 39,
+    35, 0, 7
+};
+
+const StateTable testStateTable = {
+    .states = testStateTableStates,
+    .stateCount = 40,
+    .displacements = testStateTableDisplacements,
+    .bucketCount = 21,
+    .slots = testStateTableSlots,
+    .slotCount = 51,
+    .seed = 0u,
+};
@@ -0,0 +1,543 @@
+/*
+ * Generates a static state table for SM_InitStatic.
+ *
+ * Usage: StateTableGen <states.txt> <output.c> <tableName>
+ *
+ * Each line of the input lists one state, then its enter, update, draw and
+ * exit functions, separated by whitespace. Use NULL for a missing function.
+ * States used with the state stack can add their pause and resume functions
+ * and their flags: 0, UPDATE_BELOW, DRAW_BELOW or UPDATE_BELOW|DRAW_BELOW.
+ * After those, nested states can name their parent state, or NULL. Blank
+ * lines and lines starting with '#' are skipped:
+ *
+ *   # name    enter      update      draw      exit
+ *   title     TitleEnter TitleUpdate TitleDraw NULL
+ *   inGame    GameEnter  GameUpdate  NULL      GameExit
+ *   level     LevelEnter LevelUpdate LevelDraw LevelExit LevelPause NULL 0
+ *   boss      BossEnter  BossUpdate  BossDraw  NULL NULL NULL 0 inGame
+ *   pauseMenu NULL       MenuUpdate  MenuDraw  NULL NULL NULL DRAW_BELOW
+ *
+ * The output is a C file defining `const StateTable <tableName>`, with a
+ * perfect hash of the state names built with the hash-and-displace method:
+ * names are split into buckets, and each bucket gets a displacement that moves
+ * all of its names into free slots. Biggest buckets are placed first, while
+ * most slots are still free.
+ * @author Vitor Betmann
+ */
+
+#include "../src/StateMachine/StateMachineHash.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --------------------------------------------------
+// Defines
+// --------------------------------------------------
+
+#define MAX_LINE 1024
+#define MAX_TOKEN 256
+#define MAX_STATES 65535
+#define MAX_DISPLACEMENT 65535
+#define MAX_SEEDS 1000
+
+// --------------------------------------------------
+// Data types
+// --------------------------------------------------
+
+// The first FN_LIFECYCLE functions are required columns, the rest optional
+enum {
+  FN_ENTER,
+  FN_UPDATE,
+  FN_DRAW,
+  FN_EXIT,
+  FN_PAUSE,
+  FN_RESUME,
+  FN_COUNT,
+  FN_LIFECYCLE = FN_PAUSE
+};
+
+typedef struct {
+  char *name;
+  char *fns[FN_COUNT];
+  char *flags;
+  char *parentName;
+  int parent;
+  uint32_t hash;
+} StateLine;
+
+typedef struct {
+  int bucket;
+  int size;
+} BucketSize;
+
+// --------------------------------------------------
+// Prototypes
+// --------------------------------------------------
+static bool ReadStates(const char *path);
+static bool IsIdentifier(const char *token);
+static char *ParseFlags(const char *token);
+static bool ResolveParents(const char *path);
+static bool BuildHash(void);
+static bool TrySeed(uint32_t seed);
+static int CompareBucketSizes(const void *a, const void *b);
+static bool WriteTable(const char *path, const char *inputPath,
+                       const char *tableName);
+static void WriteString(FILE *out, const char *str);
+static const char *Separator(int index);
+
+// --------------------------------------------------
+// Variables
+// --------------------------------------------------
+static const char *FN_TYPES[FN_COUNT] = {
+    "void %s(void *args);\n", "void %s(float dt);\n", "void %s(void);\n",
+    "void %s(void);\n",       "void %s(void);\n",     "void %s(void);\n",
+};
+static const char *FN_FIELDS[FN_COUNT] = {"enter", "update", "draw",
+                                          "exit",  "pause",  "resume"};
+
+static StateLine *states;
+static int stateCount;
+static int bucketCount;
+static int slotCount;
+static uint32_t tableSeed;
+static unsigned short *displacements;
+static unsigned short *slots;
+
+// --------------------------------------------------
+// Main
+// --------------------------------------------------
+
+int main(int argc, char **argv) {
+
+  if (argc != 4) {
+    fprintf(stderr, "Usage: %s <states.txt> <output.c> <tableName>\n",
+            argv[0]);
+    return 1;
+  }
+
+  if (!IsIdentifier(argv[3])) {
+    fprintf(stderr, "Table name '%s' is not a valid C identifier.\n", argv[3]);
+    return 1;
+  }
+
+  if (!ReadStates(argv[1]) || !ResolveParents(argv[1]) || !BuildHash() ||
+      !WriteTable(argv[2], argv[1], argv[3])) {
+    return 1;
+  }
+
+  return 0;
+}
+
+// --------------------------------------------------
+// Functions - Helpers
+// --------------------------------------------------
+
+static bool ReadStates(const char *path) {
+
+  FILE *in = fopen(path, "r");
+  if (!in) {
+    fprintf(stderr, "Failed to open '%s'.\n", path);
+    return false;
+  }
+
+  char line[MAX_LINE];
+  int capacity = 0;
+  for (int lineNumber = 1; fgets(line, sizeof(line), in); lineNumber++) {
+
+    // Name, functions, flags, parent
+    char tokens[FN_COUNT + 3][MAX_TOKEN];
+    char extra[2];
+    int count = sscanf(
+        line, "%255s %255s %255s %255s %255s %255s %255s %255s %255s %1s",
+        tokens[0], tokens[1], tokens[2], tokens[3], tokens[4], tokens[5],
+        tokens[6], tokens[7], tokens[8], extra);
+    if (count <= 0 || tokens[0][0] == '#') {
+      continue;
+    }
+
+    if (count == FN_LIFECYCLE + 1) {
+      strcpy(tokens[FN_PAUSE + 1], "NULL");
+      strcpy(tokens[FN_RESUME + 1], "NULL");
+      strcpy(tokens[FN_COUNT + 1], "0");
+    }
+    if (count == FN_LIFECYCLE + 1 || count == FN_COUNT + 2) {
+      strcpy(tokens[FN_COUNT + 2], "NULL");
+    } else if (count != FN_COUNT + 3) {
+      fprintf(stderr,
+              "%s:%d: expected a name and 4 functions, optionally followed "
+              "by 2 functions, flags and a parent.\n",
+              path, lineNumber);
+      fclose(in);
+      return false;
+    }
+
+    char *flags = ParseFlags(tokens[FN_COUNT + 1]);
+    if (!flags) {
+      fprintf(stderr, "%s:%d: '%s' are not valid flags.\n", path, lineNumber,
+              tokens[FN_COUNT + 1]);
+      fclose(in);
+      return false;
+    }
+
+    bool hasFunction = false;
+    for (int fn = 0; fn < FN_COUNT; fn++) {
+      const char *token = tokens[fn + 1];
+      if (fn < FN_LIFECYCLE && strcmp(token, "NULL") != 0) {
+        hasFunction = true;
+      }
+      if (!IsIdentifier(token)) {
+        fprintf(stderr, "%s:%d: '%s' is not a valid function name.\n", path,
+                lineNumber, token);
+        fclose(in);
+        return false;
+      }
+    }
+
+    // Same rule as SM_RegisterState
+    if (!hasFunction) {
+      fprintf(stderr, "%s:%d: state '%s' has no valid functions.\n", path,
+              lineNumber, tokens[0]);
+      fclose(in);
+      return false;
+    }
+
+    for (int i = 0; i < stateCount; i++) {
+      if (strcmp(states[i].name, tokens[0]) == 0) {
+        fprintf(stderr, "%s:%d: state '%s' is listed twice.\n", path,
+                lineNumber, tokens[0]);
+        fclose(in);
+        return false;
+      }
+    }
+
+    if (stateCount == MAX_STATES) {
+      fprintf(stderr, "%s:%d: more than %d states.\n", path, lineNumber,
+              MAX_STATES);
+      fclose(in);
+      return false;
+    }
+
+    if (stateCount == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      StateLine *grown = realloc(states, capacity * sizeof(StateLine));
+      if (!grown) {
+        fprintf(stderr, "Failed to allocate memory.\n");
+        fclose(in);
+        return false;
+      }
+      states = grown;
+    }
+
+    StateLine *state = &states[stateCount++];
+    state->name = strdup(tokens[0]);
+    for (int fn = 0; fn < FN_COUNT; fn++) {
+      state->fns[fn] = strdup(tokens[fn + 1]);
+    }
+    state->flags = flags;
+    state->parentName = strdup(tokens[FN_COUNT + 2]);
+    state->parent = 0;
+  }
+
+  fclose(in);
+
+  if (stateCount == 0) {
+    fprintf(stderr, "%s: no states listed.\n", path);
+    return false;
+  }
+
+  return true;
+}
+
+static bool IsIdentifier(const char *token) {
+
+  if (!(*token == '_' || (*token >= 'a' && *token <= 'z') ||
+        (*token >= 'A' && *token <= 'Z'))) {
+    return false;
+  }
+
+  for (token++; *token; token++) {
+    if (!(*token == '_' || (*token >= 'a' && *token <= 'z') ||
+          (*token >= 'A' && *token <= 'Z') ||
+          (*token >= '0' && *token <= '9'))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static char *ParseFlags(const char *token) {
+
+  if (strcmp(token, "0") == 0) {
+    return strdup("0");
+  }
+
+  // Each flag is written to the output under its SM_ name
+  char *flags = calloc(1, MAX_TOKEN * 2);
+  if (!flags) {
+    return NULL;
+  }
+
+  for (const char *flag = token; *flag;) {
+    size_t length = strcspn(flag, "|");
+    if (length == strlen("UPDATE_BELOW") &&
+        strncmp(flag, "UPDATE_BELOW", length) == 0) {
+      strcat(flags, *flags ? " | SM_UPDATE_BELOW" : "SM_UPDATE_BELOW");
+    } else if (length == strlen("DRAW_BELOW") &&
+               strncmp(flag, "DRAW_BELOW", length) == 0) {
+      strcat(flags, *flags ? " | SM_DRAW_BELOW" : "SM_DRAW_BELOW");
+    } else {
+      free(flags);
+      return NULL;
+    }
+    flag += length;
+    flag += *flag == '|';
+  }
+
+  return flags;
+}
+
+static bool ResolveParents(const char *path) {
+
+  // Parents may be listed after their children, so wait for every state
+  for (int i = 0; i < stateCount; i++) {
+    if (strcmp(states[i].parentName, "NULL") == 0) {
+      continue;
+    }
+
+    for (int j = 0; j < stateCount && !states[i].parent; j++) {
+      if (strcmp(states[j].name, states[i].parentName) == 0) {
+        states[i].parent = j + 1;
+      }
+    }
+
+    if (!states[i].parent) {
+      fprintf(stderr, "%s: parent '%s' of state '%s' is not listed.\n", path,
+              states[i].parentName, states[i].name);
+      return false;
+    }
+  }
+
+  // Same rule as SM_SetStateParent: no state may end up inside itself
+  for (int i = 0; i < stateCount; i++) {
+    int depth = 0;
+    for (int above = states[i].parent; above;
+         above = states[above - 1].parent) {
+      if (above == i + 1 || ++depth > stateCount) {
+        fprintf(stderr, "%s: state '%s' is nested inside itself.\n", path,
+                states[i].name);
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+static bool BuildHash(void) {
+
+  // About two names per bucket and a quarter of the slots left free keeps
+  // the search short while the table stays small
+  bucketCount = stateCount / 2 + 1;
+  slotCount = stateCount + stateCount / 4 + 1;
+  displacements = calloc(bucketCount, sizeof(unsigned short));
+  slots = calloc(slotCount, sizeof(unsigned short));
+  if (!displacements || !slots) {
+    fprintf(stderr, "Failed to allocate memory.\n");
+    return false;
+  }
+
+  for (uint32_t seed = 0; seed < MAX_SEEDS; seed++) {
+    if (TrySeed(seed)) {
+      tableSeed = seed;
+      return true;
+    }
+  }
+
+  fprintf(stderr, "Failed to find a perfect hash after %d seeds.\n",
+          MAX_SEEDS);
+  return false;
+}
+
+static bool TrySeed(uint32_t seed) {
+
+  memset(displacements, 0, bucketCount * sizeof(unsigned short));
+  memset(slots, 0, slotCount * sizeof(unsigned short));
+
+  for (int i = 0; i < stateCount; i++) {
+    states[i].hash = SM_Hash_Name(states[i].name, seed);
+  }
+
+  // Names with the same hash always share a slot, whatever the displacement
+  for (int i = 0; i < stateCount; i++) {
+    for (int j = i + 1; j < stateCount; j++) {
+      if (states[i].hash == states[j].hash) {
+        return false;
+      }
+    }
+  }
+
+  BucketSize *order = calloc(bucketCount, sizeof(BucketSize));
+  int *members = malloc(stateCount * sizeof(int));
+  uint32_t *taken = malloc(stateCount * sizeof(uint32_t));
+  if (!order || !members || !taken) {
+    free(order);
+    free(members);
+    free(taken);
+    return false;
+  }
+
+  for (int b = 0; b < bucketCount; b++) {
+    order[b].bucket = b;
+  }
+  for (int i = 0; i < stateCount; i++) {
+    order[states[i].hash % bucketCount].size++;
+  }
+  qsort(order, bucketCount, sizeof(BucketSize), CompareBucketSizes);
+
+  bool placedAll = true;
+  for (int b = 0; b < bucketCount && order[b].size > 0 && placedAll; b++) {
+
+    int memberCount = 0;
+    for (int i = 0; i < stateCount; i++) {
+      if ((int)(states[i].hash % bucketCount) == order[b].bucket) {
+        members[memberCount++] = i;
+      }
+    }
+
+    placedAll = false;
+    for (uint32_t d = 0; d <= MAX_DISPLACEMENT && !placedAll; d++) {
+
+      // Every member needs a free slot, and no two may pick the same one
+      placedAll = true;
+      for (int m = 0; m < memberCount && placedAll; m++) {
+        taken[m] = SM_Hash_Slot(states[members[m]].hash, d, slotCount);
+        placedAll = slots[taken[m]] == 0;
+        for (int k = 0; k < m && placedAll; k++) {
+          placedAll = taken[k] != taken[m];
+        }
+      }
+
+      if (placedAll) {
+        displacements[order[b].bucket] = (unsigned short)d;
+        for (int m = 0; m < memberCount; m++) {
+          slots[taken[m]] = (unsigned short)(members[m] + 1);
+        }
+      }
+    }
+  }
+
+  free(order);
+  free(members);
+  free(taken);
+  return placedAll;
+}
+
+static int CompareBucketSizes(const void *a, const void *b) {
+
+  const BucketSize *left = a, *right = b;
+  if (left->size != right->size) {
+    return right->size - left->size;
+  }
+  return left->bucket - right->bucket;
+}
+
+static bool WriteTable(const char *path, const char *inputPath,
+                       const char *tableName) {
+
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    fprintf(stderr, "Failed to open '%s'.\n", path);
+    return false;
+  }
+
+  fprintf(out, "// Generated by tools/StateTableGen from %s.\n", inputPath);
+  fprintf(out, "// Do not edit, regenerate it instead.\n\n");
+  fprintf(out, "#include \"StateMachine.h\"\n#include <stddef.h>\n\n");
+
+  // Each function is declared once, even when several states share it
+  for (int fn = 0; fn < FN_COUNT; fn++) {
+    for (int i = 0; i < stateCount; i++) {
+      const char *name = states[i].fns[fn];
+      bool declared = strcmp(name, "NULL") == 0;
+      for (int j = 0; j < i && !declared; j++) {
+        declared = strcmp(states[j].fns[fn], name) == 0;
+      }
+      if (!declared) {
+        fprintf(out, FN_TYPES[fn], name);
+      }
+    }
+  }
+
+  fprintf(out, "\nstatic const State %sStates[] = {\n", tableName);
+  for (int i = 0; i < stateCount; i++) {
+    fprintf(out, "    {.name = ");
+    WriteString(out, states[i].name);
+    fprintf(out, ", .handle = %d", i + 1);
+    if (states[i].parent) {
+      fprintf(out, ", .parent = %d", states[i].parent);
+    }
+    for (int fn = 0; fn < FN_COUNT; fn++) {
+      // Stack functions and flags are rarely set, so they're left out if not
+      if (fn < FN_LIFECYCLE || strcmp(states[i].fns[fn], "NULL") != 0) {
+        fprintf(out, ", .%s = %s", FN_FIELDS[fn], states[i].fns[fn]);
+      }
+    }
+    if (strcmp(states[i].flags, "0") != 0) {
+      fprintf(out, ", .flags = %s", states[i].flags);
+    }
+    fprintf(out, "},\n");
+  }
+  fprintf(out, "};\n");
+
+  fprintf(out, "\nstatic const unsigned short %sDisplacements[] = {",
+          tableName);
+  for (int b = 0; b < bucketCount; b++) {
+    fprintf(out, "%s%u", Separator(b), displacements[b]);
+  }
+  fprintf(out, "\n};\n");
+
+  fprintf(out, "\nstatic const unsigned short %sSlots[] = {", tableName);
+  for (int s = 0; s < slotCount; s++) {
+    fprintf(out, "%s%u", Separator(s), slots[s]);
+  }
+  fprintf(out, "\n};\n");
+
+  fprintf(out, "\nconst StateTable %s = {\n", tableName);
+  fprintf(out, "    .states = %sStates,\n", tableName);
+  fprintf(out, "    .stateCount = %d,\n", stateCount);
+  fprintf(out, "    .displacements = %sDisplacements,\n", tableName);
+  fprintf(out, "    .bucketCount = %d,\n", bucketCount);
+  fprintf(out, "    .slots = %sSlots,\n", tableName);
+  fprintf(out, "    .slotCount = %d,\n", slotCount);
+  fprintf(out, "    .seed = %uu,\n", tableSeed);
+  fprintf(out, "};\n");
+
+  bool written = !ferror(out);
+  if (fclose(out) != 0 || !written) {
+    fprintf(stderr, "Failed to write '%s'.\n", path);
+    return false;
+  }
+  return true;
+}
+
+static void WriteString(FILE *out, const char *str) {
+
+  fputc('"', out);
+  for (; *str; str++) {
+    if (*str == '"' || *str == '\\') {
+      fputc('\\', out);
+    }
+    fputc(*str, out);
+  }
+  fputc('"', out);
+}
+
+static const char *Separator(int index) {
+
+  // Twelve numbers per line
+  if (index == 0) {
+    return "\n    ";
+  }
+  return index % 12 ? ", " : ",\n    ";
+}